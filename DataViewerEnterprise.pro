@@ -1,4 +1,4 @@
-QT += core gui widgets sql
+QT += core gui widgets sql network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,14 +16,74 @@ INCLUDEPATH += $$PWD/external/QXlsx/header
 SOURCES += \
 	src/main.cpp \
 	src/MainWindow.cpp \
-	src/ExcelReader.cpp
+	src/ExcelReader.cpp \
+	src/Workbook.cpp \
+	src/CsvReader.cpp \
+	src/CompoundFile.cpp \
+	src/BiffWorkbook.cpp \
+	src/XlsxSheet.cpp \
+	src/SheetCellTokenizer.cpp \
+	src/SheetIngestPipeline.cpp \
+	src/ZipArchive.cpp \
+	src/SampleAggregator.cpp \
+	src/AggregationDialog.cpp \
+	src/SampleIndex.cpp \
+	src/MemoryAccounting.cpp \
+	src/StartupTimeline.cpp \
+	src/DerivedColumns.cpp \
+	src/SampleEditHistory.cpp \
+	src/ArrowIpc.cpp \
+	src/FeatherExporter.cpp \
+	src/LiveAcquisition.cpp \
+	src/SampleOverview.cpp \
+	src/RowIndex.cpp \
+	src/Metrics.cpp \
+	src/WorkbookDiff.cpp \
+	src/SheetPrefetcher.cpp \
+	src/DataServer.cpp \
+	src/DataServerClient.cpp \
+	src/RowQuery.cpp
 
 HEADERS += \
         src/MainWindow.h \
-	src/ExcelReader.h
+	src/ExcelReader.h \
+	src/Workbook.h \
+	src/CsvReader.h \
+	src/CompoundFile.h \
+	src/BiffWorkbook.h \
+	src/XlsxSheet.h \
+	src/SheetCellTokenizer.h \
+	src/SheetIngestPipeline.h \
+	src/BoundedQueue.h \
+	src/ZipArchive.h \
+	src/SampleAggregator.h \
+	src/AggregationDialog.h \
+	src/SampleIndex.h \
+	src/MemoryAccounting.h \
+	src/StartupTimeline.h \
+	src/DerivedColumns.h \
+	src/SampleEditHistory.h \
+	src/ArrowIpc.h \
+	src/FeatherExporter.h \
+	src/LiveAcquisition.h \
+	src/SampleOverview.h \
+	src/RowIndex.h \
+	src/Metrics.h \
+	src/WorkbookDiff.h \
+	src/SheetPrefetcher.h \
+	src/DataServer.h \
+	src/DataServerClient.h \
+	src/RowQuery.h
 
 INCLUDEPATH += src
 
+# zlib for inflating xlsx parts: system library on unix, Qt's bundled copy (exported by QtCore) on Windows
+unix: LIBS += -lz
+win32: INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
+
+# Process working set for the memory accounting panel
+win32: LIBS += -lpsapi
+
 DEFINES += QT_DEPRECATED_WARNINGS
 
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,192 @@
+#include "AggregationDialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFormLayout>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QHeaderView>
+#include <QApplication>
+#include <QDebug>
+#include <QtNumeric>
+
+AggregationDialog::AggregationDialog(QWidget* parent)
+	: QDialog(parent)
+{
+	setWindowTitle("Aggregate Across Workbooks");
+	resize(900, 600);
+
+	QVBoxLayout* mainLayout = new QVBoxLayout(this);
+
+	// Workbook selection
+	QHBoxLayout* loadLayout = new QHBoxLayout();
+	QPushButton* addButton = new QPushButton("Add Workbooks...", this);
+	connect(addButton, &QPushButton::clicked, this, &AggregationDialog::onAddWorkbooks);
+	loadedLabel = new QLabel("No workbooks loaded", this);
+	loadLayout->addWidget(addButton);
+	loadLayout->addWidget(loadedLabel, 1);
+	mainLayout->addLayout(loadLayout);
+
+	// Query
+	QFormLayout* queryLayout = new QFormLayout();
+
+	groupByList = new QListWidget(this);
+	groupByList->setMaximumHeight(110);
+	for (const QString& field : SampleAggregator::metadataFields())
+	{
+		QListWidgetItem* item = new QListWidgetItem(field, groupByList);
+		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		item->setCheckState(Qt::Unchecked);
+	}
+	queryLayout->addRow("Group by:", groupByList);
+
+	QHBoxLayout* measureLayout = new QHBoxLayout();
+	functionDropdown = new QComboBox(this);
+	functionDropdown->addItem("mean", SampleAggregator::Mean);
+	functionDropdown->addItem("sum", SampleAggregator::Sum);
+	functionDropdown->addItem("min", SampleAggregator::Min);
+	functionDropdown->addItem("max", SampleAggregator::Max);
+	functionDropdown->addItem("count", SampleAggregator::Count);
+	measureDropdown = new QComboBox(this);
+	measureDropdown->setEditable(true);
+	measureLayout->addWidget(functionDropdown);
+	measureLayout->addWidget(measureDropdown, 1);
+	queryLayout->addRow("Measure:", measureLayout);
+
+	filterEdit = new QLineEdit(this);
+	filterEdit->setPlaceholderText("e.g. date >= 2025-10-01; heatingTechnology ~ T51; voltage > 3");
+	queryLayout->addRow("Filters:", filterEdit);
+
+	mainLayout->addLayout(queryLayout);
+
+	runButton = new QPushButton("Run Query", this);
+	connect(runButton, &QPushButton::clicked, this, &AggregationDialog::onRunQuery);
+	connect(filterEdit, &QLineEdit::returnPressed, this, &AggregationDialog::onRunQuery);
+	mainLayout->addWidget(runButton);
+
+	// Results
+	resultTable = new QTableWidget(this);
+	resultTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	resultTable->horizontalHeader()->setStretchLastSection(true);
+	mainLayout->addWidget(resultTable, 1);
+
+	timingLabel = new QLabel(this);
+	mainLayout->addWidget(timingLabel);
+
+	updateMeasureDropdown();
+}
+
+void AggregationDialog::debugPrint(const QString& message)
+{
+	qDebug() << "DEBUG [AggregationDialog]:" << message;
+}
+
+void AggregationDialog::updateMeasureDropdown()
+{
+	QString current = measureDropdown->currentText();
+	measureDropdown->clear();
+
+	// Numeric metadata first, then the data columns found in the loaded workbooks
+	measureDropdown->addItems(QStringList() << "power" << "voltage" << "resistance" << "viscosity" << "initialOilMass");
+	measureDropdown->addItems(m_aggregator.columnNames());
+
+	if (!current.isEmpty())
+	{
+		measureDropdown->setCurrentText(current);
+	}
+}
+
+void AggregationDialog::onAddWorkbooks()
+{
+	QStringList filePaths = QFileDialog::getOpenFileNames(this, "Add Workbooks", "", "Data Files (*.xlsx *.xls *.csv *.tsv *.txt);;Excel Files (*.xlsx *.xls);;CSV/TSV Files (*.csv *.tsv *.txt);;All Files(*)");
+	if (filePaths.isEmpty())
+	{
+		return;
+	}
+
+	for (const QString& filePath : filePaths)
+	{
+		if (!m_filePaths.contains(filePath))
+		{
+			m_filePaths.append(filePath);
+		}
+	}
+
+	debugPrint("Loading " + QString::number(m_filePaths.size()) + " workbooks");
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	bool ok = m_aggregator.loadWorkbooks(m_filePaths);
+	QApplication::restoreOverrideCursor();
+
+	if (!ok)
+	{
+		QMessageBox::warning(this, "Aggregate Across Workbooks", "Some workbooks could not be loaded:\n" + m_aggregator.getLastError());
+	}
+
+	loadedLabel->setText(QString::number(m_aggregator.sampleCount()) + " samples from " +
+		QString::number(m_aggregator.workbookCount()) + " workbooks");
+	updateMeasureDropdown();
+}
+
+void AggregationDialog::onRunQuery()
+{
+	SampleAggregator::Query query;
+
+	for (int i = 0; i < groupByList->count(); i++)
+	{
+		if (groupByList->item(i)->checkState() == Qt::Checked)
+		{
+			query.groupBy.append(groupByList->item(i)->text());
+		}
+	}
+
+	SampleAggregator::Measure measure;
+	measure.function = SampleAggregator::Function(functionDropdown->currentData().toInt());
+	measure.field = measureDropdown->currentText().trimmed();
+	if (!measure.field.isEmpty())
+	{
+		query.measures.append(measure);
+	}
+
+	for (const QString& clause : filterEdit->text().split(';', QString::SkipEmptyParts))
+	{
+		SampleAggregator::Filter filter;
+		if (!SampleAggregator::parseFilter(clause, &filter))
+		{
+			QMessageBox::warning(this, "Aggregate Across Workbooks", "Cannot parse filter: " + clause.trimmed());
+			return;
+		}
+		query.filters.append(filter);
+	}
+
+	SampleAggregator::Result result = m_aggregator.run(query);
+
+	resultTable->clear();
+	resultTable->setColumnCount(result.columns.size());
+	resultTable->setRowCount(result.rows.size());
+	resultTable->setHorizontalHeaderLabels(result.columns);
+
+	for (int row = 0; row < result.rows.size(); row++)
+	{
+		const SampleAggregator::ResultRow& resultRow = result.rows.at(row);
+		int col = 0;
+
+		for (const QString& key : resultRow.keys)
+		{
+			resultTable->setItem(row, col++, new QTableWidgetItem(key));
+		}
+
+		QTableWidgetItem* countItem = new QTableWidgetItem(QString::number(resultRow.sampleCount));
+		countItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+		resultTable->setItem(row, col++, countItem);
+
+		for (double value : resultRow.values)
+		{
+			QTableWidgetItem* item = new QTableWidgetItem(qIsNaN(value) ? QString() : QString::number(value, 'f', 4));
+			item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+			resultTable->setItem(row, col++, item);
+		}
+	}
+
+	timingLabel->setText(QString::number(result.rows.size()) + " groups in " +
+		QString::number(result.elapsedNs / 1e6, 'f', 2) + " ms");
+}
@@ -0,0 +1,45 @@
+#ifndef AGGREGATIONDIALOG_H
+#define AGGREGATIONDIALOG_H
+
+#include <QDialog>
+#include <QListWidget>
+#include <QComboBox>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QLabel>
+#include "SampleAggregator.h"
+
+// Tools > Aggregate Across Workbooks: load a set of workbooks once, then run
+// group-by queries over their samples
+class AggregationDialog : public QDialog
+{
+	Q_OBJECT
+
+public:
+	explicit AggregationDialog(QWidget* parent = nullptr);
+
+	qint64 memoryBytes() const { return m_aggregator.memoryBytes(); }
+
+private slots:
+	void onAddWorkbooks();
+	void onRunQuery();
+
+private:
+	SampleAggregator m_aggregator;
+	QStringList m_filePaths;
+
+	QLabel* loadedLabel;
+	QListWidget* groupByList;
+	QComboBox* functionDropdown;
+	QComboBox* measureDropdown;
+	QLineEdit* filterEdit;
+	QPushButton* runButton;
+	QTableWidget* resultTable;
+	QLabel* timingLabel;
+
+	void debugPrint(const QString& message);
+	void updateMeasureDropdown();
+};
+
+#endif // AGGREGATIONDIALOG_H
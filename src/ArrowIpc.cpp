@@ -0,0 +1,912 @@
+#include "ArrowIpc.h"
+#include <QDebug>
+#include <QtEndian>
+#include <QtMath>
+#include <cstring>
+
+namespace
+{
+	// Arrow format constants (Schema.fbs, Message.fbs)
+	const qint16 METADATA_V5 = 4;
+	const quint8 HEADER_SCHEMA = 1;
+	const quint8 HEADER_RECORD_BATCH = 3;
+	const quint8 TYPE_INT = 2;
+	const quint8 TYPE_FLOATING_POINT = 3;
+	const quint8 TYPE_UTF8 = 5;
+	const quint8 TYPE_BOOL = 6;
+	const qint16 PRECISION_DOUBLE = 2;
+	const qint16 ENDIANNESS_LITTLE = 0;
+	const qint16 ENDIANNESS_BIG = 1;
+	const quint32 CONTINUATION = 0xFFFFFFFF;
+	const char MAGIC[] = "ARROW1";
+	const int MAGIC_SIZE = 6;
+
+	qint16 hostEndianness()
+	{
+		return Q_BYTE_ORDER == Q_BIG_ENDIAN ? ENDIANNESS_BIG : ENDIANNESS_LITTLE;
+	}
+
+	int padding8(int size)
+	{
+		return (8 - size % 8) % 8;
+	}
+
+	// Minimal flatbuffer builder. Like the reference implementation it builds
+	// back to front, so every offset points forward to data finished earlier;
+	// offsets are distances from the end of the buffer. Strings, vectors and
+	// child tables have to be finished before the table that refers to them.
+	class FlatBufferBuilder
+	{
+	public:
+		FlatBufferBuilder() : m_minAlign(1), m_tableEnd(0) {}
+
+		quint32 createString(const QString& text)
+		{
+			QByteArray utf8 = text.toUtf8();
+			preAlign(utf8.size() + 1, 4);
+			prepend(QByteArray(1, '\0'));
+			prepend(utf8);
+			prependScalar<quint32>(quint32(utf8.size()));
+			return size();
+		}
+
+		quint32 createOffsetVector(const QVector<quint32>& offsets)
+		{
+			preAlign(offsets.size() * 4, 4);
+			for (int i = offsets.size() - 1; i >= 0; i--)
+			{
+				prependOffset(offsets.at(i));
+			}
+			prependScalar<quint32>(quint32(offsets.size()));
+			return size();
+		}
+
+		// Structs as one little-endian block, elements in order
+		quint32 createStructVector(const QByteArray& structs, int count, int alignment)
+		{
+			preAlign(structs.size(), qMax(4, alignment));
+			prepend(structs);
+			prependScalar<quint32>(quint32(count));
+			return size();
+		}
+
+		void startTable()
+		{
+			m_fields.clear();
+			m_tableEnd = size();
+		}
+
+		template <typename T>
+		void addScalar(int slot, T value)
+		{
+			prependScalar<T>(value);
+			m_fields.append(qMakePair(slot, size()));
+		}
+
+		void addOffset(int slot, quint32 offset)
+		{
+			prependOffset(offset);
+			m_fields.append(qMakePair(slot, size()));
+		}
+
+		quint32 endTable()
+		{
+			// The table starts with the signed distance back to its vtable
+			prependScalar<qint32>(0);
+			quint32 table = size();
+
+			int slotCount = 0;
+			for (const QPair<int, quint32>& field : m_fields)
+			{
+				slotCount = qMax(slotCount, field.first + 1);
+			}
+
+			QVector<quint16> fieldOffsets(slotCount, 0);
+			for (const QPair<int, quint32>& field : m_fields)
+			{
+				fieldOffsets[field.first] = quint16(table - field.second);
+			}
+
+			for (int slot = slotCount - 1; slot >= 0; slot--)
+			{
+				prependScalar<quint16>(fieldOffsets.at(slot));
+			}
+			prependScalar<quint16>(quint16(table - m_tableEnd));
+			prependScalar<quint16>(quint16(4 + 2 * slotCount));
+
+			// The vtable sits right before the table
+			qToLittleEndian<qint32>(qint32(size() - table), m_data.data() + (m_data.size() - table));
+			return table;
+		}
+
+		QByteArray finish(quint32 root)
+		{
+			preAlign(4, m_minAlign);
+			prependOffset(root);
+			return m_data;
+		}
+
+	private:
+		QByteArray m_data; // Tail of the final buffer
+		int m_minAlign;
+		quint32 m_tableEnd;
+		QVector<QPair<int, quint32>> m_fields; // Slot, offset from the end
+
+		quint32 size() const { return quint32(m_data.size()); }
+
+		void prepend(const QByteArray& bytes)
+		{
+			m_data.prepend(bytes);
+		}
+
+		// Pads so that the buffer is aligned once size more bytes are prepended
+		void preAlign(int size, int alignment)
+		{
+			m_minAlign = qMax(m_minAlign, alignment);
+			int padding = (alignment - (m_data.size() + size) % alignment) % alignment;
+			if (padding > 0)
+			{
+				prepend(QByteArray(padding, '\0'));
+			}
+		}
+
+		template <typename T>
+		void prependScalar(T value)
+		{
+			preAlign(sizeof(T), sizeof(T));
+			QByteArray bytes(sizeof(T), '\0');
+			qToLittleEndian<T>(value, bytes.data());
+			prepend(bytes);
+		}
+
+		void prependOffset(quint32 offset)
+		{
+			preAlign(4, 4);
+			prependScalar<quint32>(size() + 4 - offset);
+		}
+	};
+
+	// Bounds-checked view of one flatbuffer table
+	class FlatTable
+	{
+	public:
+		FlatTable() : m_data(nullptr), m_size(0), m_pos(-1) {}
+
+		static FlatTable root(const uchar* data, int size)
+		{
+			FlatTable table(data, size, -1);
+			if (size >= 4)
+			{
+				table.m_pos = table.indirect(0);
+			}
+			return table;
+		}
+
+		bool isValid() const
+		{
+			return m_pos >= 0;
+		}
+
+		template <typename T>
+		T scalar(int slot, T defaultValue) const
+		{
+			int pos = fieldPos(slot, sizeof(T));
+			return pos < 0 ? defaultValue : qFromLittleEndian<T>(m_data + pos);
+		}
+
+		FlatTable table(int slot) const
+		{
+			int pos = fieldPos(slot, 4);
+			return FlatTable(m_data, m_size, pos < 0 ? -1 : indirect(pos));
+		}
+
+		QString string(int slot) const
+		{
+			int length = 0;
+			const uchar* bytes = vector(slot, 1, &length);
+			return bytes ? QString::fromUtf8(reinterpret_cast<const char*>(bytes), length) : QString();
+		}
+
+		// Start of the elements, nullptr when absent or out of bounds
+		const uchar* vector(int slot, int elementSize, int* count) const
+		{
+			*count = 0;
+			int pos = fieldPos(slot, 4);
+			int start = pos < 0 ? -1 : indirect(pos);
+			if (start < 0 || !inRange(start, 4))
+			{
+				return nullptr;
+			}
+
+			quint32 length = qFromLittleEndian<quint32>(m_data + start);
+			if (length > quint32(m_size) || !inRange(start + 4, int(length) * elementSize))
+			{
+				return nullptr;
+			}
+
+			*count = int(length);
+			return m_data + start + 4;
+		}
+
+		FlatTable tableAt(int slot, int index) const
+		{
+			int count = 0;
+			const uchar* elements = vector(slot, 4, &count);
+			if (!elements || index < 0 || index >= count)
+			{
+				return FlatTable();
+			}
+			return FlatTable(m_data, m_size, indirect(int(elements - m_data) + index * 4));
+		}
+
+	private:
+		const uchar* m_data;
+		int m_size;
+		int m_pos;
+
+		FlatTable(const uchar* data, int size, int pos) : m_data(data), m_size(size), m_pos(pos) {}
+
+		bool inRange(int pos, int bytes) const
+		{
+			return pos >= 0 && bytes >= 0 && qint64(pos) + bytes <= m_size;
+		}
+
+		int indirect(int pos) const
+		{
+			if (!inRange(pos, 4))
+			{
+				return -1;
+			}
+			qint64 target = qint64(pos) + qFromLittleEndian<quint32>(m_data + pos);
+			return target < m_size ? int(target) : -1;
+		}
+
+		int fieldPos(int slot, int bytes) const
+		{
+			if (m_pos < 0 || !inRange(m_pos, 4))
+			{
+				return -1;
+			}
+
+			qint64 vtable = qint64(m_pos) - qFromLittleEndian<qint32>(m_data + m_pos);
+			if (vtable < 0 || !inRange(int(vtable), 4))
+			{
+				return -1;
+			}
+
+			int vtableSize = qFromLittleEndian<quint16>(m_data + vtable);
+			int entry = 4 + 2 * slot;
+			if (entry + 2 > vtableSize || !inRange(int(vtable) + entry, 2))
+			{
+				return -1;
+			}
+
+			int offset = qFromLittleEndian<quint16>(m_data + vtable + entry);
+			if (offset == 0 || !inRange(m_pos + offset, bytes))
+			{
+				return -1;
+			}
+			return m_pos + offset;
+		}
+	};
+
+	quint32 buildSchema(FlatBufferBuilder* fbb, const QVector<ArrowField>& fields, const ArrowMetadata& metadata)
+	{
+		QVector<quint32> fieldTables;
+		for (const ArrowField& field : fields)
+		{
+			quint32 name = fbb->createString(field.name);
+
+			quint8 typeType = TYPE_UTF8;
+			fbb->startTable();
+			switch (field.type)
+			{
+			case ArrowField::Float64:
+				typeType = TYPE_FLOATING_POINT;
+				fbb->addScalar<qint16>(0, PRECISION_DOUBLE);
+				break;
+			case ArrowField::Bool:
+				typeType = TYPE_BOOL;
+				break;
+			case ArrowField::Int32:
+				typeType = TYPE_INT;
+				fbb->addScalar<qint32>(0, 32); // bitWidth
+				fbb->addScalar<quint8>(1, 1);  // is_signed
+				break;
+			case ArrowField::Utf8:
+				typeType = TYPE_UTF8;
+				break;
+			}
+			quint32 type = fbb->endTable();
+
+			// Readers expect the children vector even for primitive types
+			quint32 children = fbb->createOffsetVector(QVector<quint32>());
+
+			fbb->startTable();
+			fbb->addOffset(0, name);
+			fbb->addScalar<quint8>(1, 1); // nullable
+			fbb->addScalar<quint8>(2, typeType);
+			fbb->addOffset(3, type);
+			fbb->addOffset(5, children);
+			fieldTables.append(fbb->endTable());
+		}
+		quint32 fieldVector = fbb->createOffsetVector(fieldTables);
+
+		QVector<quint32> pairs;
+		for (const QPair<QString, QString>& pair : metadata)
+		{
+			quint32 key = fbb->createString(pair.first);
+			quint32 value = fbb->createString(pair.second);
+			fbb->startTable();
+			fbb->addOffset(0, key);
+			fbb->addOffset(1, value);
+			pairs.append(fbb->endTable());
+		}
+		quint32 metadataVector = fbb->createOffsetVector(pairs);
+
+		fbb->startTable();
+		fbb->addScalar<qint16>(0, hostEndianness());
+		fbb->addOffset(1, fieldVector);
+		fbb->addOffset(2, metadataVector);
+		return fbb->endTable();
+	}
+
+	void appendInt64(QByteArray* bytes, qint64 value)
+	{
+		char buffer[8];
+		qToLittleEndian<qint64>(value, buffer);
+		bytes->append(buffer, 8);
+	}
+
+	void setBit(QByteArray* bitmap, int index)
+	{
+		bitmap->data()[index >> 3] |= char(1 << (index & 7));
+	}
+
+	bool testBit(const uchar* bitmap, int index)
+	{
+		return (bitmap[index >> 3] >> (index & 7)) & 1;
+	}
+}
+
+ArrowIpcWriter::ArrowIpcWriter()
+	: m_bytesWritten(0)
+	, m_batchRows(0)
+{
+}
+
+ArrowIpcWriter::~ArrowIpcWriter()
+{
+	// Without close() the file has no footer and is not readable
+	if (m_file.isOpen())
+	{
+		m_file.close();
+	}
+}
+
+void ArrowIpcWriter::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [ArrowIpcWriter]:" << message;
+}
+
+bool ArrowIpcWriter::writeBytes(const QByteArray& bytes)
+{
+	if (m_file.write(bytes) != bytes.size())
+	{
+		m_lastError = "Failed to write " + m_file.fileName() + ": " + m_file.errorString();
+		return false;
+	}
+
+	m_bytesWritten += bytes.size();
+	return true;
+}
+
+bool ArrowIpcWriter::writeMessage(const QByteArray& metadata, const QByteArray& body, Block* block)
+{
+	// Continuation marker and metadata length, then the flatbuffer padded so the body stays 8-byte aligned
+	QByteArray padded = metadata;
+	padded.append(QByteArray(padding8(padded.size()), '\0'));
+
+	QByteArray prefix(8, '\0');
+	qToLittleEndian<quint32>(CONTINUATION, prefix.data());
+	qToLittleEndian<qint32>(qint32(padded.size()), prefix.data() + 4);
+
+	block->offset = m_bytesWritten;
+	block->metadataLength = qint32(prefix.size() + padded.size());
+	block->bodyLength = body.size();
+
+	return writeBytes(prefix) && writeBytes(padded) && writeBytes(body);
+}
+
+bool ArrowIpcWriter::open(const QString& filePath, const QVector<ArrowField>& fields, const ArrowMetadata& metadata)
+{
+	m_fields = fields;
+	m_metadata = metadata;
+	m_blocks.clear();
+	m_bytesWritten = 0;
+	m_lastError.clear();
+
+	m_file.setFileName(filePath);
+	if (!m_file.open(QIODevice::WriteOnly))
+	{
+		m_lastError = "Cannot create " + filePath + ": " + m_file.errorString();
+		return false;
+	}
+
+	FlatBufferBuilder fbb;
+	quint32 schema = buildSchema(&fbb, m_fields, m_metadata);
+	fbb.startTable();
+	fbb.addScalar<qint16>(0, METADATA_V5);
+	fbb.addScalar<quint8>(1, HEADER_SCHEMA);
+	fbb.addOffset(2, schema);
+	fbb.addScalar<qint64>(3, 0);
+	quint32 message = fbb.endTable();
+
+	// Magic padded to 8 bytes, then the stream: schema message first
+	Block block;
+	QByteArray magic(MAGIC, MAGIC_SIZE);
+	magic.append(QByteArray(2, '\0'));
+	if (!writeBytes(magic) || !writeMessage(fbb.finish(message), QByteArray(), &block))
+	{
+		m_file.close();
+		return false;
+	}
+
+	debugPrint("Opened " + filePath + " with " + QString::number(m_fields.size()) + " columns");
+	return true;
+}
+
+void ArrowIpcWriter::beginBatch(int rowCount)
+{
+	m_batchRows = rowCount;
+	m_batchTypes.clear();
+	m_body.clear();
+	m_nodes.clear();
+	m_buffers.clear();
+}
+
+void ArrowIpcWriter::appendBuffer(const char* data, int size)
+{
+	appendInt64(&m_buffers, m_body.size());
+	appendInt64(&m_buffers, size);
+	if (size > 0)
+	{
+		m_body.append(data, size);
+		m_body.append(QByteArray(padding8(size), '\0'));
+	}
+}
+
+void ArrowIpcWriter::addNode(int nullCount)
+{
+	appendInt64(&m_nodes, m_batchRows);
+	appendInt64(&m_nodes, nullCount);
+}
+
+void ArrowIpcWriter::addFloat64Column(const double* values)
+{
+	QByteArray validity((m_batchRows + 7) / 8, '\0');
+	int nullCount = 0;
+	for (int row = 0; row < m_batchRows; row++)
+	{
+		if (qIsNaN(values[row]))
+		{
+			nullCount++;
+		}
+		else
+		{
+			setBit(&validity, row);
+		}
+	}
+
+	// No validity buffer when nothing is null
+	appendBuffer(validity.constData(), nullCount > 0 ? validity.size() : 0);
+	appendBuffer(reinterpret_cast<const char*>(values), m_batchRows * int(sizeof(double)));
+	addNode(nullCount);
+	m_batchTypes.append(ArrowField::Float64);
+}
+
+void ArrowIpcWriter::addBoolColumn(const double* values)
+{
+	QByteArray validity((m_batchRows + 7) / 8, '\0');
+	QByteArray bits((m_batchRows + 7) / 8, '\0');
+	int nullCount = 0;
+	for (int row = 0; row < m_batchRows; row++)
+	{
+		if (qIsNaN(values[row]))
+		{
+			nullCount++;
+			continue;
+		}
+
+		setBit(&validity, row);
+		if (values[row] != 0.0)
+		{
+			setBit(&bits, row);
+		}
+	}
+
+	appendBuffer(validity.constData(), nullCount > 0 ? validity.size() : 0);
+	appendBuffer(bits.constData(), bits.size());
+	addNode(nullCount);
+	m_batchTypes.append(ArrowField::Bool);
+}
+
+void ArrowIpcWriter::addInt32Column(const QVector<qint32>& values)
+{
+	QVector<qint32> column = values;
+	column.resize(m_batchRows);
+
+	appendBuffer(nullptr, 0);
+	appendBuffer(reinterpret_cast<const char*>(column.constData()), m_batchRows * int(sizeof(qint32)));
+	addNode(0);
+	m_batchTypes.append(ArrowField::Int32);
+}
+
+void ArrowIpcWriter::addUtf8Column(const QStringList& values)
+{
+	QByteArray validity((m_batchRows + 7) / 8, '\0');
+	QVector<qint32> offsets(m_batchRows + 1, 0);
+	QByteArray data;
+	int nullCount = 0;
+
+	for (int row = 0; row < m_batchRows; row++)
+	{
+		offsets[row] = data.size();
+		if (row >= values.size() || values.at(row).isNull())
+		{
+			nullCount++;
+			continue;
+		}
+
+		setBit(&validity, row);
+		data.append(values.at(row).toUtf8());
+	}
+	offsets[m_batchRows] = data.size();
+
+	appendBuffer(validity.constData(), nullCount > 0 ? validity.size() : 0);
+	appendBuffer(reinterpret_cast<const char*>(offsets.constData()), offsets.size() * int(sizeof(qint32)));
+	appendBuffer(data.constData(), data.size());
+	addNode(nullCount);
+	m_batchTypes.append(ArrowField::Utf8);
+}
+
+bool ArrowIpcWriter::endBatch()
+{
+	if (!m_file.isOpen())
+	{
+		m_lastError = "File is not open";
+		return false;
+	}
+
+	if (m_batchTypes.size() != m_fields.size())
+	{
+		m_lastError = "Record batch has " + QString::number(m_batchTypes.size()) + " columns, the schema " +
+			QString::number(m_fields.size());
+		return false;
+	}
+
+	for (int i = 0; i < m_fields.size(); i++)
+	{
+		if (m_batchTypes.at(i) != m_fields.at(i).type)
+		{
+			m_lastError = "Column type differs from the schema: " + m_fields.at(i).name;
+			return false;
+		}
+	}
+
+	FlatBufferBuilder fbb;
+	quint32 nodes = fbb.createStructVector(m_nodes, m_nodes.size() / 16, 8);
+	quint32 buffers = fbb.createStructVector(m_buffers, m_buffers.size() / 16, 8);
+
+	fbb.startTable();
+	fbb.addScalar<qint64>(0, m_batchRows);
+	fbb.addOffset(1, nodes);
+	fbb.addOffset(2, buffers);
+	quint32 recordBatch = fbb.endTable();
+
+	fbb.startTable();
+	fbb.addScalar<qint16>(0, METADATA_V5);
+	fbb.addScalar<quint8>(1, HEADER_RECORD_BATCH);
+	fbb.addOffset(2, recordBatch);
+	fbb.addScalar<qint64>(3, m_body.size());
+	quint32 message = fbb.endTable();
+
+	Block block;
+	if (!writeMessage(fbb.finish(message), m_body, &block))
+	{
+		return false;
+	}
+
+	m_blocks.append(block);
+	m_body.clear();
+	return true;
+}
+
+bool ArrowIpcWriter::close()
+{
+	if (!m_file.isOpen())
+	{
+		m_lastError = "File is not open";
+		return false;
+	}
+
+	// End-of-stream marker
+	QByteArray endOfStream(8, '\0');
+	qToLittleEndian<quint32>(CONTINUATION, endOfStream.data());
+
+	// Footer: the schema again and where each record batch starts
+	QByteArray blocks;
+	for (const Block& block : m_blocks)
+	{
+		appendInt64(&blocks, block.offset);
+		char length[8] = {};
+		qToLittleEndian<qint32>(block.metadataLength, length);
+		blocks.append(length, 8); // Padded to the struct's 8-byte alignment
+		appendInt64(&blocks, block.bodyLength);
+	}
+
+	FlatBufferBuilder fbb;
+	quint32 schema = buildSchema(&fbb, m_fields, m_metadata);
+	quint32 dictionaries = fbb.createStructVector(QByteArray(), 0, 8);
+	quint32 recordBatches = fbb.createStructVector(blocks, m_blocks.size(), 8);
+	fbb.startTable();
+	fbb.addScalar<qint16>(0, METADATA_V5);
+	fbb.addOffset(1, schema);
+	fbb.addOffset(2, dictionaries);
+	fbb.addOffset(3, recordBatches);
+	QByteArray footer = fbb.finish(fbb.endTable());
+
+	QByteArray trailer(4, '\0');
+	qToLittleEndian<qint32>(qint32(footer.size()), trailer.data());
+	trailer.append(MAGIC, MAGIC_SIZE);
+
+	bool ok = writeBytes(endOfStream) && writeBytes(footer) && writeBytes(trailer);
+	m_file.close();
+
+	debugPrint("Wrote " + QString::number(m_blocks.size()) + " record batches, " + QString::number(m_bytesWritten) + " bytes");
+	return ok;
+}
+
+ArrowIpcReader::ArrowIpcReader()
+{
+}
+
+void ArrowIpcReader::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [ArrowIpcReader]:" << message;
+}
+
+bool ArrowIpcReader::open(const QString& filePath)
+{
+	m_fields.clear();
+	m_metadata.clear();
+	m_blocks.clear();
+
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		m_lastError = "Cannot open " + filePath + ": " + file.errorString();
+		return false;
+	}
+	m_data = file.readAll();
+	file.close();
+
+	// Magic, padding, stream, footer, footer length, magic
+	const int trailerSize = 4 + MAGIC_SIZE;
+	if (m_data.size() < 8 + trailerSize || !m_data.startsWith(QByteArray(MAGIC, MAGIC_SIZE)) ||
+		!m_data.endsWith(QByteArray(MAGIC, MAGIC_SIZE)))
+	{
+		m_lastError = "Not an Arrow IPC file: " + filePath;
+		return false;
+	}
+
+	const uchar* data = reinterpret_cast<const uchar*>(m_data.constData());
+	qint32 footerSize = qFromLittleEndian<qint32>(data + m_data.size() - trailerSize);
+	qint64 footerStart = qint64(m_data.size()) - trailerSize - footerSize;
+	if (footerSize <= 0 || footerStart < 8)
+	{
+		m_lastError = "Invalid footer length in " + filePath;
+		return false;
+	}
+
+	FlatTable footer = FlatTable::root(data + footerStart, footerSize);
+	FlatTable schema = footer.table(1);
+	if (!schema.isValid())
+	{
+		m_lastError = "Footer has no schema: " + filePath;
+		return false;
+	}
+
+	if (schema.scalar<qint16>(0, ENDIANNESS_LITTLE) != hostEndianness())
+	{
+		m_lastError = "File byte order differs from this machine: " + filePath;
+		return false;
+	}
+
+	int fieldCount = 0;
+	schema.vector(1, 4, &fieldCount);
+	for (int i = 0; i < fieldCount; i++)
+	{
+		FlatTable field = schema.tableAt(1, i);
+		FlatTable type = field.table(3);
+		quint8 typeType = field.scalar<quint8>(2, 0);
+
+		ArrowField arrowField;
+		arrowField.name = field.string(0);
+		if (typeType == TYPE_FLOATING_POINT && type.scalar<qint16>(0, 0) == PRECISION_DOUBLE)
+		{
+			arrowField.type = ArrowField::Float64;
+		}
+		else if (typeType == TYPE_BOOL)
+		{
+			arrowField.type = ArrowField::Bool;
+		}
+		else if (typeType == TYPE_INT && type.scalar<qint32>(0, 0) == 32)
+		{
+			arrowField.type = ArrowField::Int32;
+		}
+		else if (typeType == TYPE_UTF8)
+		{
+			arrowField.type = ArrowField::Utf8;
+		}
+		else
+		{
+			m_lastError = "Unsupported type of column " + arrowField.name;
+			return false;
+		}
+		m_fields.append(arrowField);
+	}
+
+	int pairCount = 0;
+	schema.vector(2, 4, &pairCount);
+	for (int i = 0; i < pairCount; i++)
+	{
+		FlatTable pair = schema.tableAt(2, i);
+		m_metadata.append(qMakePair(pair.string(0), pair.string(1)));
+	}
+
+	int blockCount = 0;
+	const uchar* blocks = footer.vector(3, 24, &blockCount);
+	for (int i = 0; i < blockCount; i++)
+	{
+		const uchar* entry = blocks + i * 24;
+		Block block;
+		block.offset = qFromLittleEndian<qint64>(entry);
+		block.metadataLength = qFromLittleEndian<qint32>(entry + 8);
+		block.bodyLength = qFromLittleEndian<qint64>(entry + 16);
+		m_blocks.append(block);
+	}
+
+	debugPrint("Opened " + filePath + ": " + QString::number(m_fields.size()) + " columns, " +
+		QString::number(m_blocks.size()) + " record batches");
+	return true;
+}
+
+bool ArrowIpcReader::readBatch(int index, Batch* batch)
+{
+	if (index < 0 || index >= m_blocks.size())
+	{
+		m_lastError = "No record batch " + QString::number(index);
+		return false;
+	}
+
+	const Block& block = m_blocks.at(index);
+	const uchar* data = reinterpret_cast<const uchar*>(m_data.constData());
+	qint64 bodyStart = block.offset + block.metadataLength;
+	if (block.offset < 0 || block.metadataLength < 8 || block.bodyLength < 0 || bodyStart + block.bodyLength > m_data.size())
+	{
+		m_lastError = "Record batch " + QString::number(index) + " lies outside the file";
+		return false;
+	}
+
+	// Message flatbuffer after the continuation marker and length
+	FlatTable message = FlatTable::root(data + block.offset + 8, block.metadataLength - 8);
+	FlatTable recordBatch = message.table(2);
+	if (message.scalar<quint8>(1, 0) != HEADER_RECORD_BATCH || !recordBatch.isValid())
+	{
+		m_lastError = "Block " + QString::number(index) + " is not a record batch";
+		return false;
+	}
+
+	int nodeCount = 0;
+	int bufferCount = 0;
+	const uchar* nodes = recordBatch.vector(1, 16, &nodeCount);
+	const uchar* buffers = recordBatch.vector(2, 16, &bufferCount);
+	if (nodeCount != m_fields.size())
+	{
+		m_lastError = "Record batch " + QString::number(index) + " does not match the schema";
+		return false;
+	}
+
+	batch->rowCount = int(recordBatch.scalar<qint64>(0, 0));
+	batch->columns.clear();
+
+	int nextBuffer = 0;
+	for (int col = 0; col < m_fields.size(); col++)
+	{
+		ArrowField::Type type = m_fields.at(col).type;
+		int rows = int(qFromLittleEndian<qint64>(nodes + col * 16));
+		int buffersNeeded = type == ArrowField::Utf8 ? 3 : 2;
+		if (rows != batch->rowCount || nextBuffer + buffersNeeded > bufferCount)
+		{
+			m_lastError = "Column " + m_fields.at(col).name + " has an invalid layout";
+			return false;
+		}
+
+		// Buffers of this column, checked against the body
+		const uchar* bufferData[3] = {};
+		qint64 bufferLength[3] = {};
+		for (int b = 0; b < buffersNeeded; b++)
+		{
+			const uchar* entry = buffers + (nextBuffer + b) * 16;
+			qint64 offset = qFromLittleEndian<qint64>(entry);
+			qint64 length = qFromLittleEndian<qint64>(entry + 8);
+			if (offset < 0 || length < 0 || offset + length > block.bodyLength)
+			{
+				m_lastError = "Buffer of column " + m_fields.at(col).name + " lies outside the body";
+				return false;
+			}
+			bufferData[b] = data + bodyStart + offset;
+			bufferLength[b] = length;
+		}
+		nextBuffer += buffersNeeded;
+
+		qint64 bitmapBytes = (rows + 7) / 8;
+		qint64 valueBytes = type == ArrowField::Float64 ? rows * 8 : type == ArrowField::Int32 ? rows * 4 :
+			type == ArrowField::Bool ? bitmapBytes : (rows + 1) * 4;
+		if ((bufferLength[0] > 0 && bufferLength[0] < bitmapBytes) || bufferLength[1] < valueBytes)
+		{
+			m_lastError = "Buffer of column " + m_fields.at(col).name + " is too short";
+			return false;
+		}
+
+		// Value buffers are in the schema's byte order, which open() checked is the host's
+		const uchar* validity = bufferLength[0] > 0 ? bufferData[0] : nullptr;
+		QVector<QVariant> values(rows);
+		for (int row = 0; row < rows; row++)
+		{
+			if (validity && !testBit(validity, row))
+			{
+				continue;
+			}
+
+			switch (type)
+			{
+			case ArrowField::Float64:
+			{
+				double number;
+				std::memcpy(&number, bufferData[1] + row * 8, sizeof(number));
+				values[row] = number;
+				break;
+			}
+			case ArrowField::Bool:
+				values[row] = testBit(bufferData[1], row);
+				break;
+			case ArrowField::Int32:
+			{
+				qint32 number;
+				std::memcpy(&number, bufferData[1] + row * 4, sizeof(number));
+				values[row] = number;
+				break;
+			}
+			case ArrowField::Utf8:
+			{
+				qint32 start;
+				qint32 end;
+				std::memcpy(&start, bufferData[1] + row * 4, sizeof(start));
+				std::memcpy(&end, bufferData[1] + (row + 1) * 4, sizeof(end));
+				if (start < 0 || end < start || end > bufferLength[2])
+				{
+					m_lastError = "String offsets of column " + m_fields.at(col).name + " are invalid";
+					return false;
+				}
+				values[row] = QString::fromUtf8(reinterpret_cast<const char*>(bufferData[2]) + start, end - start);
+				break;
+			}
+			}
+		}
+		batch->columns.append(values);
+	}
+
+	return true;
+}
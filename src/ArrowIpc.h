@@ -0,0 +1,127 @@
+#ifndef ARROWIPC_H
+#define ARROWIPC_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+#include <QPair>
+#include <QByteArray>
+#include <QFile>
+
+// Column of an Arrow schema; only the types the sample export needs
+struct ArrowField
+{
+	enum Type
+	{
+		Float64,
+		Bool,
+		Int32,
+		Utf8
+	};
+
+	QString name;
+	Type type;
+};
+
+typedef QVector<QPair<QString, QString>> ArrowMetadata; // Schema-level key/value pairs
+
+// Writes the Arrow IPC file format (Feather v2) without the Arrow libraries:
+// the schema, then one record batch at a time straight to the file, then the
+// footer that indexes the batches. The flatbuffer metadata is built by hand.
+// All columns are nullable; buffers are written in host byte order, which the
+// schema declares.
+class ArrowIpcWriter
+{
+public:
+	ArrowIpcWriter();
+	~ArrowIpcWriter();
+
+	bool open(const QString& filePath, const QVector<ArrowField>& fields, const ArrowMetadata& metadata);
+
+	// Columns are added in schema order between beginBatch() and endBatch()
+	void beginBatch(int rowCount);
+	void addFloat64Column(const double* values); // NaN is written as null
+	void addBoolColumn(const double* values);    // Non-zero is true, NaN is null
+	void addInt32Column(const QVector<qint32>& values);
+	void addUtf8Column(const QStringList& values); // Null strings are null
+	bool endBatch();
+
+	// Writes the footer; the file is not readable before this
+	bool close();
+
+	int batchCount() const { return m_blocks.size(); }
+	qint64 bytesWritten() const { return m_bytesWritten; }
+	QString getLastError() const { return m_lastError; }
+
+private:
+	struct Block
+	{
+		qint64 offset;
+		qint32 metadataLength;
+		qint64 bodyLength;
+	};
+
+	QFile m_file;
+	QVector<ArrowField> m_fields;
+	ArrowMetadata m_metadata;
+	QVector<Block> m_blocks;
+	qint64 m_bytesWritten;
+	QString m_lastError;
+
+	// Record batch being assembled
+	int m_batchRows;
+	QVector<ArrowField::Type> m_batchTypes;
+	QByteArray m_body;
+	QByteArray m_nodes;   // FieldNode structs
+	QByteArray m_buffers; // Buffer structs
+
+	void appendBuffer(const char* data, int size);
+	void appendValidity(const QVector<bool>& valid, int nullCount);
+	void addNode(int nullCount);
+	bool writeMessage(const QByteArray& metadata, const QByteArray& body, Block* block);
+	bool writeBytes(const QByteArray& bytes);
+	void debugPrint(const QString& message) const;
+};
+
+// Reads back what ArrowIpcWriter writes (the same types, no dictionaries or
+// compression), used to check exported files
+class ArrowIpcReader
+{
+public:
+	// One record batch, nulls as invalid variants
+	struct Batch
+	{
+		int rowCount;
+		QVector<QVector<QVariant>> columns;
+	};
+
+	ArrowIpcReader();
+
+	bool open(const QString& filePath);
+
+	QVector<ArrowField> fields() const { return m_fields; }
+	ArrowMetadata metadata() const { return m_metadata; }
+	int batchCount() const { return m_blocks.size(); }
+	bool readBatch(int index, Batch* batch);
+
+	QString getLastError() const { return m_lastError; }
+
+private:
+	struct Block
+	{
+		qint64 offset;
+		qint32 metadataLength;
+		qint64 bodyLength;
+	};
+
+	QByteArray m_data;
+	QVector<ArrowField> m_fields;
+	ArrowMetadata m_metadata;
+	QVector<Block> m_blocks;
+	QString m_lastError;
+
+	void debugPrint(const QString& message) const;
+};
+
+#endif // ARROWIPC_H
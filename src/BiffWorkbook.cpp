@@ -0,0 +1,576 @@
+#include "BiffWorkbook.h"
+#include "XlsxSheet.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QtEndian>
+#include <QHash>
+#include <cstring>
+
+namespace
+{
+	// Record types ([MS-XLS] 2.3)
+	const quint16 RECORD_FORMULA = 0x0006;
+	const quint16 RECORD_EOF = 0x000A;
+	const quint16 RECORD_DATEMODE = 0x0022;
+	const quint16 RECORD_FILEPASS = 0x002F;
+	const quint16 RECORD_CONTINUE = 0x003C;
+	const quint16 RECORD_BOUNDSHEET = 0x0085;
+	const quint16 RECORD_MULRK = 0x00BD;
+	const quint16 RECORD_RSTRING = 0x00D6;
+	const quint16 RECORD_XF = 0x00E0;
+	const quint16 RECORD_SST = 0x00FC;
+	const quint16 RECORD_LABELSST = 0x00FD;
+	const quint16 RECORD_NUMBER = 0x0203;
+	const quint16 RECORD_LABEL = 0x0204;
+	const quint16 RECORD_BOOLERR = 0x0205;
+	const quint16 RECORD_STRING = 0x0207;
+	const quint16 RECORD_RK = 0x027E;
+	const quint16 RECORD_FORMAT = 0x041E;
+	const quint16 RECORD_BOF = 0x0809;
+
+	const quint16 BIFF8_VERSION = 0x0600;
+	const quint16 BOF_GLOBALS = 0x0005;
+	const quint16 BOF_WORKSHEET = 0x0010;
+
+	quint16 read16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+	quint32 read32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+
+	double readDouble(const uchar* p)
+	{
+		quint64 bits = qFromLittleEndian<quint64>(p);
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// RK: a 30-bit integer or the high 30 bits of a double, optionally divided by 100
+	double decodeRk(quint32 rk)
+	{
+		double value;
+		if (rk & 0x02)
+		{
+			value = double(qint32(rk) >> 2);
+		}
+		else
+		{
+			quint64 bits = quint64(rk & 0xFFFFFFFC) << 32;
+			memcpy(&value, &bits, sizeof(value));
+		}
+		return (rk & 0x01) ? value / 100.0 : value;
+	}
+
+	QString errorText(quint8 code)
+	{
+		switch (code)
+		{
+		case 0x00: return "#NULL!";
+		case 0x07: return "#DIV/0!";
+		case 0x0F: return "#VALUE!";
+		case 0x17: return "#REF!";
+		case 0x1D: return "#NAME?";
+		case 0x24: return "#NUM!";
+		case 0x2A: return "#N/A";
+		}
+		return "#ERROR!";
+	}
+
+	// Characters of an XLUnicodeString: one byte each (Latin-1) or UTF-16LE
+	void appendChars(QString* text, const uchar* p, int count, bool wide)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			text->append(QChar(wide ? read16(p + i * 2) : ushort(p[i])));
+		}
+	}
+
+	// String that does not span a CONTINUE record; lengthBytes is 1 or 2 depending on the record
+	QString readString(const uchar* p, int available, int lengthBytes)
+	{
+		if (available < lengthBytes + 1)
+		{
+			return QString();
+		}
+
+		int count = lengthBytes == 1 ? p[0] : read16(p);
+		quint8 flags = p[lengthBytes];
+		int pos = lengthBytes + 1;
+		pos += (flags & 0x08) ? 2 : 0; // Rich text run count
+		pos += (flags & 0x04) ? 4 : 0; // Phonetic data size
+
+		bool wide = (flags & 0x01) != 0;
+		count = qBound(0, count, qMax(0, (available - pos) / (wide ? 2 : 1)));
+
+		QString text;
+		appendChars(&text, p + pos, count, wide);
+		return text;
+	}
+
+	// Reads the shared string table across the SST record and its CONTINUE records. A string's
+	// characters may be split by a CONTINUE, which then starts with a new option byte
+	class FragmentReader
+	{
+	public:
+		explicit FragmentReader(const QVector<QByteArray>& fragments)
+			: m_fragments(fragments), m_fragment(0), m_pos(0) {}
+
+		bool atEnd()
+		{
+			while (m_fragment < m_fragments.size() && m_pos >= m_fragments.at(m_fragment).size())
+			{
+				m_fragment++;
+				m_pos = 0;
+			}
+			return m_fragment >= m_fragments.size();
+		}
+
+		bool readBytes(uchar* out, int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				if (atEnd())
+				{
+					return false;
+				}
+				out[i] = uchar(m_fragments.at(m_fragment).at(m_pos++));
+			}
+			return true;
+		}
+
+		bool skip(qint64 count)
+		{
+			while (count > 0)
+			{
+				if (atEnd())
+				{
+					return false;
+				}
+				int step = int(qMin<qint64>(count, m_fragments.at(m_fragment).size() - m_pos));
+				m_pos += step;
+				count -= step;
+			}
+			return true;
+		}
+
+		bool readString(QString* text)
+		{
+			uchar header[3];
+			if (!readBytes(header, 3))
+			{
+				return false;
+			}
+
+			int count = read16(header);
+			quint8 flags = header[2];
+			uchar extra[4];
+			int runs = 0;
+			quint32 phoneticSize = 0;
+			if (flags & 0x08)
+			{
+				if (!readBytes(extra, 2))
+				{
+					return false;
+				}
+				runs = read16(extra);
+			}
+			if (flags & 0x04)
+			{
+				if (!readBytes(extra, 4))
+				{
+					return false;
+				}
+				phoneticSize = read32(extra);
+			}
+
+			text->clear();
+			text->reserve(count);
+			bool wide = (flags & 0x01) != 0;
+			while (count > 0)
+			{
+				if (m_fragment < m_fragments.size() && m_pos >= m_fragments.at(m_fragment).size())
+				{
+					// Continued characters: the next fragment repeats the option byte
+					m_fragment++;
+					m_pos = 0;
+					uchar option;
+					if (!readBytes(&option, 1))
+					{
+						return false;
+					}
+					wide = (option & 0x01) != 0;
+				}
+				if (m_fragment >= m_fragments.size())
+				{
+					return false;
+				}
+
+				const QByteArray& fragment = m_fragments.at(m_fragment);
+				int chars = qMin(count, (fragment.size() - m_pos) / (wide ? 2 : 1));
+				if (chars == 0)
+				{
+					return false;
+				}
+				appendChars(text, reinterpret_cast<const uchar*>(fragment.constData()) + m_pos, chars, wide);
+				m_pos += chars * (wide ? 2 : 1);
+				count -= chars;
+			}
+
+			return skip(qint64(runs) * 4 + phoneticSize);
+		}
+
+	private:
+		const QVector<QByteArray>& m_fragments;
+		int m_fragment;
+		int m_pos;
+	};
+}
+
+BiffWorkbook::BiffWorkbook()
+	: m_date1904(false)
+{
+}
+
+void BiffWorkbook::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [BiffWorkbook]:" << message;
+}
+
+bool BiffWorkbook::open(const QString& filePath)
+{
+	if (!m_file.open(filePath))
+	{
+		m_lastError = m_file.getLastError();
+		return false;
+	}
+
+	QString error;
+	m_stream = m_file.streamData("Workbook", &error);
+	if (m_stream.isEmpty())
+	{
+		// Excel 5/95 files keep a BIFF5 "Book" stream
+		m_lastError = m_file.findStream("Book") ? QString("Excel 5.0/95 (BIFF5) workbooks are not supported") : error;
+		m_file.close();
+		return false;
+	}
+
+	// Keep our own copy and let go of the file, so it can be rewritten while it is viewed
+	if (m_file.isView(m_stream))
+	{
+		m_stream = QByteArray(m_stream.constData(), m_stream.size());
+	}
+	m_file.close();
+
+	if (!readGlobals())
+	{
+		return false;
+	}
+
+	debugPrint("Opened " + filePath + ": " + QString::number(m_stream.size()) + " byte workbook stream, " +
+		QString::number(m_sharedStrings.size()) + " shared strings, sheets: " + m_sheetNames.join(","));
+	return true;
+}
+
+bool BiffWorkbook::readGlobals()
+{
+	const uchar* data = reinterpret_cast<const uchar*>(m_stream.constData());
+	const int size = m_stream.size();
+
+	if (size < 8 || read16(data) != RECORD_BOF || read16(data + 4) != BIFF8_VERSION || read16(data + 6) != BOF_GLOBALS)
+	{
+		m_lastError = "Not an Excel 97-2003 (BIFF8) workbook";
+		return false;
+	}
+
+	QHash<int, bool> customFormats; // Format id -> shows a date
+	QVector<int> xfFormats;         // Format id of each XF, in XF order
+	QVector<QByteArray> sstFragments;
+
+	int pos = 0;
+	while (pos + 4 <= size)
+	{
+		quint16 type = read16(data + pos);
+		int length = read16(data + pos + 2);
+		const uchar* body = data + pos + 4;
+		if (pos + 4 + length > size)
+		{
+			m_lastError = "Truncated record in the workbook globals";
+			return false;
+		}
+		pos += 4 + length;
+
+		switch (type)
+		{
+		case RECORD_FILEPASS:
+			m_lastError = "The workbook is password protected";
+			return false;
+
+		case RECORD_DATEMODE:
+			m_date1904 = length >= 2 && read16(body) != 0;
+			break;
+
+		case RECORD_FORMAT:
+			if (length >= 5)
+			{
+				customFormats.insert(read16(body), XlsxSheet::isDateFormatCode(readString(body + 2, length - 2, 2)));
+			}
+			break;
+
+		case RECORD_XF:
+			if (length >= 4)
+			{
+				xfFormats.append(read16(body + 2));
+			}
+			break;
+
+		case RECORD_BOUNDSHEET:
+			// Only worksheets (type 0) hold cells; the sheet's BOF offset is absolute within the stream
+			if (length >= 8 && body[5] == 0)
+			{
+				m_sheetOffsets.append(read32(body));
+				m_sheetNames.append(readString(body + 6, length - 6, 1));
+			}
+			break;
+
+		case RECORD_SST:
+			// The table continues in the CONTINUE records right after it
+			sstFragments.append(QByteArray::fromRawData(reinterpret_cast<const char*>(body) + qMin(8, length), qMax(0, length - 8)));
+			while (pos + 4 <= size && read16(data + pos) == RECORD_CONTINUE)
+			{
+				int continueLength = read16(data + pos + 2);
+				if (pos + 4 + continueLength > size)
+				{
+					break;
+				}
+				sstFragments.append(QByteArray::fromRawData(reinterpret_cast<const char*>(data) + pos + 4, continueLength));
+				pos += 4 + continueLength;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if (type == RECORD_EOF)
+		{
+			break;
+		}
+	}
+
+	for (int i = 0; i < xfFormats.size(); i++)
+	{
+		int format = xfFormats.at(i);
+		if (customFormats.contains(format) ? customFormats.value(format) : XlsxSheet::isBuiltInDateFormat(format))
+		{
+			m_dateStyles.insert(i);
+		}
+	}
+
+	return readSharedStrings(sstFragments);
+}
+
+bool BiffWorkbook::readSharedStrings(const QVector<QByteArray>& fragments)
+{
+	FragmentReader reader(fragments);
+	QString text;
+	while (!reader.atEnd())
+	{
+		if (!reader.readString(&text))
+		{
+			m_lastError = "Shared string table is cut off after " + QString::number(m_sharedStrings.size()) + " strings";
+			return false;
+		}
+		m_sharedStrings.append(text);
+	}
+	return true;
+}
+
+bool BiffWorkbook::readSheet(const QString& name, int rowLimit, XlsxSheet* sheet, ReadStats* stats, QString* error) const
+{
+	int index = m_sheetNames.indexOf(name);
+	if (index < 0)
+	{
+		*error = "Sheet not found: " + name;
+		return false;
+	}
+
+	const uchar* data = reinterpret_cast<const uchar*>(m_stream.constData());
+	const int size = m_stream.size();
+	int pos = int(m_sheetOffsets.at(index));
+	if (pos < 0 || pos + 8 > size || read16(data + pos) != RECORD_BOF || read16(data + pos + 6) != BOF_WORKSHEET)
+	{
+		*error = "No worksheet substream at offset " + QString::number(pos);
+		return false;
+	}
+
+	stats->records = 0;
+	stats->cells = 0;
+	stats->bytes = 0;
+
+	// Cells arrive in row blocks, so the grid is filled roughly in row order
+	QVector<QVector<QVariant>> rows;
+	auto setCell = [&](int row, int col, const QVariant& value) {
+		if (row >= rows.size())
+		{
+			rows.resize(row + 1);
+		}
+		QVector<QVariant>& cells = rows[row];
+		if (col >= cells.size())
+		{
+			cells.resize(col + 1);
+		}
+		cells[col] = value;
+		stats->cells++;
+	};
+	auto numberValue = [&](double number, int xf) {
+		return m_dateStyles.contains(xf) ? XlsxSheet::excelDateToVariant(number, m_date1904) : QVariant(number);
+	};
+
+	const int start = pos;
+	int depth = 0;
+	int stringRow = -1; // Cell of a formula whose text result follows in a STRING record
+	int stringCol = -1;
+	bool limitReached = false;
+
+	while (pos + 4 <= size && !limitReached)
+	{
+		quint16 type = read16(data + pos);
+		int length = read16(data + pos + 2);
+		const uchar* body = data + pos + 4;
+		if (pos + 4 + length > size)
+		{
+			*error = "Truncated record in sheet " + name;
+			return false;
+		}
+		pos += 4 + length;
+		stats->records++;
+
+		// Embedded chart substreams have their own BOF/EOF pair
+		if (type == RECORD_BOF)
+		{
+			depth++;
+			continue;
+		}
+		if (type == RECORD_EOF)
+		{
+			if (--depth == 0)
+			{
+				break;
+			}
+			continue;
+		}
+		if (depth > 1)
+		{
+			continue;
+		}
+
+		// STRING has no cell address, it belongs to the formula before it
+		if (type == RECORD_STRING)
+		{
+			if (stringRow >= 0)
+			{
+				setCell(stringRow, stringCol, readString(body, length, 2));
+				stringRow = -1;
+			}
+			continue;
+		}
+		if (length < 6)
+		{
+			continue;
+		}
+
+		int row = read16(body);
+		int col = read16(body + 2);
+		int xf = read16(body + 4);
+		bool isCell = (type == RECORD_NUMBER || type == RECORD_RK || type == RECORD_MULRK || type == RECORD_LABELSST ||
+			type == RECORD_LABEL || type == RECORD_RSTRING || type == RECORD_BOOLERR || type == RECORD_FORMULA);
+		if (isCell && rowLimit > 0 && row >= rowLimit)
+		{
+			limitReached = true;
+			break;
+		}
+
+		switch (type)
+		{
+		case RECORD_NUMBER:
+			if (length >= 14)
+			{
+				setCell(row, col, numberValue(readDouble(body + 6), xf));
+			}
+			break;
+
+		case RECORD_RK:
+			if (length >= 10)
+			{
+				setCell(row, col, numberValue(decodeRk(read32(body + 6)), xf));
+			}
+			break;
+
+		case RECORD_MULRK:
+			// Consecutive cells of one row: (xf, rk) pairs, then the last column
+			for (int offset = 4; offset + 6 <= length - 2; offset += 6, col++)
+			{
+				setCell(row, col, numberValue(decodeRk(read32(body + offset + 2)), read16(body + offset)));
+			}
+			break;
+
+		case RECORD_LABELSST:
+			if (length >= 10)
+			{
+				quint32 sst = read32(body + 6);
+				if (sst < quint32(m_sharedStrings.size()))
+				{
+					setCell(row, col, m_sharedStrings.at(int(sst)));
+				}
+			}
+			break;
+
+		case RECORD_LABEL:
+		case RECORD_RSTRING:
+			setCell(row, col, readString(body + 6, length - 6, 2));
+			break;
+
+		case RECORD_BOOLERR:
+			if (length >= 8)
+			{
+				setCell(row, col, body[7] ? QVariant(errorText(body[6])) : QVariant(body[6] != 0));
+			}
+			break;
+
+		case RECORD_FORMULA:
+			// Cached result: a double, or a typed value marked by 0xFFFF in the top bytes
+			if (length >= 14)
+			{
+				if (read16(body + 12) != 0xFFFF)
+				{
+					setCell(row, col, numberValue(readDouble(body + 6), xf));
+				}
+				else if (body[6] == 0)
+				{
+					stringRow = row;
+					stringCol = col;
+				}
+				else if (body[6] == 1)
+				{
+					setCell(row, col, body[8] != 0);
+				}
+				else if (body[6] == 2)
+				{
+					setCell(row, col, errorText(body[8]));
+				}
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	sheet->clear();
+	sheet->appendRows(rows);
+	stats->bytes = pos - start;
+	return true;
+}
+
+qint64 BiffWorkbook::memoryBytes() const
+{
+	return MemoryAccounting::stringListBytes(m_sharedStrings) + qint64(m_dateStyles.size()) * 16 + m_stream.size();
+}
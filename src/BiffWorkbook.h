@@ -0,0 +1,59 @@
+#ifndef BIFFWORKBOOK_H
+#define BIFFWORKBOOK_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QSet>
+#include "CompoundFile.h"
+
+class XlsxSheet;
+
+// Legacy .xls workbook (BIFF8, Excel 97-2003) read straight from its OLE2
+// container. open() walks the globals substream once for the sheet list,
+// the shared string table (SST + CONTINUE), the date formats and the date
+// mode; a worksheet's records are only walked when the sheet is read, from
+// its BOF to its EOF, into the same cell grid an xlsx worksheet fills. After
+// open() the object is not modified, so sheets may be read from several threads.
+class BiffWorkbook
+{
+public:
+	struct ReadStats
+	{
+		int records;
+		int cells;
+		qint64 bytes;
+	};
+
+	BiffWorkbook();
+
+	bool open(const QString& filePath);
+
+	QStringList sheetNames() const { return m_sheetNames; } // Worksheets only, chart and macro sheets are skipped
+	const QStringList& sharedStrings() const { return m_sharedStrings; }
+	const QSet<int>& dateStyles() const { return m_dateStyles; } // XF indices with a date or time format
+	bool date1904() const { return m_date1904; }
+
+	// rowLimit > 0 stops at the first cell below the limit
+	bool readSheet(const QString& name, int rowLimit, XlsxSheet* sheet, ReadStats* stats, QString* error) const;
+
+	qint64 memoryBytes() const; // Shared strings and the workbook stream
+	QString getLastError() const { return m_lastError; }
+
+private:
+	CompoundFile m_file;
+	QByteArray m_stream;          // "Workbook" stream, copied out of the file at open()
+	QStringList m_sheetNames;
+	QVector<quint32> m_sheetOffsets; // Stream offset of each sheet's BOF record
+	QStringList m_sharedStrings;
+	QSet<int> m_dateStyles;
+	bool m_date1904;
+	QString m_lastError;
+
+	void debugPrint(const QString& message) const;
+	bool readGlobals();
+	bool readSharedStrings(const QVector<QByteArray>& fragments);
+};
+
+#endif // BIFFWORKBOOK_H
@@ -0,0 +1,116 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QElapsedTimer>
+
+// Fixed-capacity queue between two pipeline threads. push() blocks while the
+// queue is full (backpressure), pop() blocks while it is empty. Time spent
+// blocked on either side is accumulated so stage utilization can be derived.
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(int capacity)
+		: m_capacity(capacity)
+		, m_closed(false)
+		, m_aborted(false)
+		, m_pushWaitNs(0)
+		, m_popWaitNs(0)
+		, m_highWater(0)
+	{
+	}
+
+	// Returns false if the queue was aborted
+	bool push(const T& item)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if (m_items.size() >= m_capacity && !m_aborted)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			while (m_items.size() >= m_capacity && !m_aborted)
+			{
+				m_notFull.wait(&m_mutex);
+			}
+			m_pushWaitNs += timer.nsecsElapsed();
+		}
+
+		if (m_aborted)
+		{
+			return false;
+		}
+
+		m_items.enqueue(item);
+		m_highWater = qMax(m_highWater, m_items.size());
+		m_notEmpty.wakeOne();
+		return true;
+	}
+
+	// Returns false once the queue is closed and drained, or aborted
+	bool pop(T* item)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if (m_items.isEmpty() && !m_closed && !m_aborted)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			while (m_items.isEmpty() && !m_closed && !m_aborted)
+			{
+				m_notEmpty.wait(&m_mutex);
+			}
+			m_popWaitNs += timer.nsecsElapsed();
+		}
+
+		if (m_aborted || m_items.isEmpty())
+		{
+			return false;
+		}
+
+		*item = m_items.dequeue();
+		m_notFull.wakeOne();
+		return true;
+	}
+
+	// Producer is done; the consumer still drains what is queued
+	void close()
+	{
+		QMutexLocker locker(&m_mutex);
+		m_closed = true;
+		m_notEmpty.wakeAll();
+	}
+
+	// Either side gave up; queued items are dropped and both sides are released
+	void abort()
+	{
+		QMutexLocker locker(&m_mutex);
+		m_aborted = true;
+		m_items.clear();
+		m_notEmpty.wakeAll();
+		m_notFull.wakeAll();
+	}
+
+	qint64 pushWaitNs() const { QMutexLocker locker(&m_mutex); return m_pushWaitNs; }
+	qint64 popWaitNs() const { QMutexLocker locker(&m_mutex); return m_popWaitNs; }
+	int highWater() const { QMutexLocker locker(&m_mutex); return m_highWater; }
+	int capacity() const { return m_capacity; }
+
+private:
+	mutable QMutex m_mutex;
+	QWaitCondition m_notEmpty;
+	QWaitCondition m_notFull;
+	QQueue<T> m_items;
+	int m_capacity;
+	bool m_closed;
+	bool m_aborted;
+	qint64 m_pushWaitNs;
+	qint64 m_popWaitNs;
+	int m_highWater;
+};
+
+#endif // BOUNDEDQUEUE_H
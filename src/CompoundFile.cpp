@@ -0,0 +1,389 @@
+#include "CompoundFile.h"
+#include <QDebug>
+#include <QtEndian>
+#include <cstring>
+
+namespace
+{
+	const quint32 FREE_SECTOR = 0xFFFFFFFF;
+	const quint32 END_OF_CHAIN = 0xFFFFFFFE;
+	const int HEADER_SIZE = 512;
+	const int DIRECTORY_ENTRY_SIZE = 128;
+	const int HEADER_DIFAT_ENTRIES = 109;
+
+	quint16 read16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+	quint32 read32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+	quint64 read64(const uchar* p) { return qFromLittleEndian<quint64>(p); }
+}
+
+CompoundFile::CompoundFile()
+	: m_map(nullptr)
+	, m_size(0)
+	, m_sectorShift(9)
+	, m_miniSectorShift(6)
+	, m_miniStreamCutoff(4096)
+{
+}
+
+CompoundFile::~CompoundFile()
+{
+	close();
+}
+
+void CompoundFile::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [CompoundFile]:" << message;
+}
+
+bool CompoundFile::open(const QString& filePath)
+{
+	close();
+
+	m_file.setFileName(filePath);
+	if (!m_file.open(QIODevice::ReadOnly))
+	{
+		m_lastError = "Cannot open file: " + m_file.errorString();
+		return false;
+	}
+
+	m_size = m_file.size();
+	if (m_size < HEADER_SIZE)
+	{
+		m_lastError = "File is too small to be a compound file";
+		close();
+		return false;
+	}
+
+	m_map = m_file.map(0, m_size);
+	if (!m_map)
+	{
+		m_lastError = "Cannot memory-map file: " + m_file.errorString();
+		close();
+		return false;
+	}
+
+	if (!readHeaderAndTables())
+	{
+		close();
+		return false;
+	}
+
+	debugPrint("Mapped " + QString::number(m_size) + " bytes, " + QString::number(m_fat.size()) +
+		" FAT entries, streams: " + streamNames().join(","));
+	return true;
+}
+
+void CompoundFile::close()
+{
+	// The mini stream may be a view into the map
+	m_miniStream.clear();
+
+	if (m_map)
+	{
+		m_file.unmap(m_map);
+		m_map = nullptr;
+	}
+
+	if (m_file.isOpen())
+	{
+		m_file.close();
+	}
+
+	m_size = 0;
+	m_fat.clear();
+	m_miniFat.clear();
+	m_entries.clear();
+}
+
+const uchar* CompoundFile::sector(quint32 index) const
+{
+	// Sector 0 follows the header, which takes one sector
+	qint64 offset = (qint64(index) + 1) << m_sectorShift;
+	return offset < m_size ? m_map + offset : nullptr;
+}
+
+bool CompoundFile::readChain(const QVector<quint32>& table, quint32 start, QVector<quint32>* chain, QString* error) const
+{
+	chain->clear();
+	for (quint32 index = start; index != END_OF_CHAIN; index = table.at(int(index)))
+	{
+		// A chain can not be longer than the table, anything else is a loop
+		if (index >= quint32(table.size()) || chain->size() >= table.size())
+		{
+			*error = "Broken sector chain at sector " + QString::number(index);
+			return false;
+		}
+		chain->append(index);
+	}
+	return true;
+}
+
+QByteArray CompoundFile::readStream(quint32 start, qint64 size, QString* error) const
+{
+	if (size == 0)
+	{
+		return QByteArray();
+	}
+
+	bool mini = quint64(size) < m_miniStreamCutoff && !m_miniStream.isNull();
+	QVector<quint32> chain;
+	if (!readChain(mini ? m_miniFat : m_fat, start, &chain, error))
+	{
+		return QByteArray();
+	}
+
+	int sectorSize = 1 << (mini ? m_miniSectorShift : m_sectorShift);
+	if (qint64(chain.size()) * sectorSize < size)
+	{
+		*error = "Stream is longer than its sector chain";
+		return QByteArray();
+	}
+
+	if (mini)
+	{
+		QByteArray data(int(size), Qt::Uninitialized);
+		for (int i = 0; i < chain.size() && qint64(i) * sectorSize < size; i++)
+		{
+			qint64 offset = qint64(chain.at(i)) << m_miniSectorShift;
+			int length = int(qMin<qint64>(sectorSize, size - qint64(i) * sectorSize));
+			if (offset + length > m_miniStream.size())
+			{
+				*error = "Mini sector outside the mini stream";
+				return QByteArray();
+			}
+			memcpy(data.data() + qint64(i) * sectorSize, m_miniStream.constData() + offset, size_t(length));
+		}
+		return data;
+	}
+
+	// Writers usually allocate a stream in one run, which needs no copy
+	bool contiguous = true;
+	for (int i = 1; i < chain.size() && contiguous; i++)
+	{
+		contiguous = (chain.at(i) == chain.at(0) + quint32(i));
+	}
+	qint64 firstOffset = (qint64(chain.at(0)) + 1) << m_sectorShift;
+	if (contiguous && firstOffset + size <= m_size)
+	{
+		return QByteArray::fromRawData(reinterpret_cast<const char*>(m_map + firstOffset), int(size));
+	}
+
+	QByteArray data(int(size), Qt::Uninitialized);
+	for (int i = 0; i < chain.size() && qint64(i) * sectorSize < size; i++)
+	{
+		const uchar* source = sector(chain.at(i));
+		qint64 length = qMin<qint64>(sectorSize, size - qint64(i) * sectorSize);
+
+		// The last sector of a file may be cut short
+		qint64 available = source ? qMin<qint64>(length, m_size - (source - m_map)) : 0;
+		if (available < length && i != chain.size() - 1)
+		{
+			*error = "Sector " + QString::number(chain.at(i)) + " is outside the file";
+			return QByteArray();
+		}
+		memcpy(data.data() + qint64(i) * sectorSize, source, size_t(available));
+		memset(data.data() + qint64(i) * sectorSize + available, 0, size_t(length - available));
+	}
+	return data;
+}
+
+bool CompoundFile::readHeaderAndTables()
+{
+	static const uchar signature[8] = { 0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1 };
+	if (memcmp(m_map, signature, sizeof(signature)) != 0)
+	{
+		m_lastError = "Not an OLE2 compound file";
+		return false;
+	}
+
+	m_sectorShift = read16(m_map + 0x1E);
+	m_miniSectorShift = read16(m_map + 0x20);
+	if ((m_sectorShift != 9 && m_sectorShift != 12) || m_miniSectorShift != 6)
+	{
+		m_lastError = "Unsupported sector size 2^" + QString::number(m_sectorShift);
+		return false;
+	}
+
+	quint32 fatSectorCount = read32(m_map + 0x2C);
+	quint32 firstDirectorySector = read32(m_map + 0x30);
+	m_miniStreamCutoff = read32(m_map + 0x38);
+	quint32 firstMiniFatSector = read32(m_map + 0x3C);
+	quint32 firstDifatSector = read32(m_map + 0x44);
+	quint32 difatSectorCount = read32(m_map + 0x48);
+
+	// FAT sector numbers: 109 in the header, the rest in a chain of DIFAT sectors
+	int sectorSize = 1 << m_sectorShift;
+	int entriesPerSector = sectorSize / 4;
+	QVector<quint32> fatSectors;
+	for (int i = 0; i < HEADER_DIFAT_ENTRIES && quint32(fatSectors.size()) < fatSectorCount; i++)
+	{
+		fatSectors.append(read32(m_map + 0x4C + i * 4));
+	}
+
+	quint32 difat = firstDifatSector;
+	for (quint32 n = 0; n < difatSectorCount && quint32(fatSectors.size()) < fatSectorCount; n++)
+	{
+		const uchar* data = sector(difat);
+		if (!data || (data - m_map) + sectorSize > m_size)
+		{
+			m_lastError = "DIFAT sector " + QString::number(difat) + " is outside the file";
+			return false;
+		}
+		for (int i = 0; i < entriesPerSector - 1 && quint32(fatSectors.size()) < fatSectorCount; i++)
+		{
+			fatSectors.append(read32(data + i * 4));
+		}
+		difat = read32(data + (entriesPerSector - 1) * 4);
+	}
+
+	m_fat.reserve(fatSectors.size() * entriesPerSector);
+	for (quint32 fatSector : fatSectors)
+	{
+		const uchar* data = sector(fatSector);
+		if (fatSector == FREE_SECTOR || !data || (data - m_map) + sectorSize > m_size)
+		{
+			m_lastError = "FAT sector " + QString::number(fatSector) + " is outside the file";
+			return false;
+		}
+		for (int i = 0; i < entriesPerSector; i++)
+		{
+			m_fat.append(read32(data + i * 4));
+		}
+	}
+
+	// Directory: a flat list is enough, workbook streams live directly under the root
+	QString error;
+	QVector<quint32> chain;
+	if (!readChain(m_fat, firstDirectorySector, &chain, &error))
+	{
+		m_lastError = "Cannot read directory: " + error;
+		return false;
+	}
+
+	for (quint32 directorySector : chain)
+	{
+		const uchar* data = sector(directorySector);
+		if (!data || (data - m_map) + sectorSize > m_size)
+		{
+			m_lastError = "Directory sector " + QString::number(directorySector) + " is outside the file";
+			return false;
+		}
+
+		for (int offset = 0; offset + DIRECTORY_ENTRY_SIZE <= sectorSize; offset += DIRECTORY_ENTRY_SIZE)
+		{
+			const uchar* raw = data + offset;
+			quint8 type = raw[0x42];
+			if (type != 1 && type != 2 && type != 5)
+			{
+				continue;
+			}
+
+			// UTF-16 name, the length includes the terminator
+			int nameLength = qBound(0, int(read16(raw + 0x40)) / 2 - 1, 31);
+			QString name;
+			for (int i = 0; i < nameLength; i++)
+			{
+				name.append(QChar(read16(raw + i * 2)));
+			}
+
+			Entry entry;
+			entry.name = name;
+			entry.type = type;
+			entry.startSector = read32(raw + 0x74);
+
+			// Version 3 files only define the low 32 bits of the size
+			entry.size = qint64(m_sectorShift == 9 ? read32(raw + 0x78) : read64(raw + 0x78));
+			m_entries.append(entry);
+		}
+	}
+
+	if (m_entries.isEmpty() || m_entries.first().type != 5)
+	{
+		m_lastError = "Compound file has no root entry";
+		return false;
+	}
+
+	// Small streams live in the root entry's stream, addressed through the mini FAT
+	if (firstMiniFatSector != END_OF_CHAIN && firstMiniFatSector != FREE_SECTOR)
+	{
+		if (!readChain(m_fat, firstMiniFatSector, &chain, &error))
+		{
+			m_lastError = "Cannot read mini FAT: " + error;
+			return false;
+		}
+		for (quint32 miniFatSector : chain)
+		{
+			const uchar* data = sector(miniFatSector);
+			if (!data || (data - m_map) + sectorSize > m_size)
+			{
+				m_lastError = "Mini FAT sector " + QString::number(miniFatSector) + " is outside the file";
+				return false;
+			}
+			for (int i = 0; i < entriesPerSector; i++)
+			{
+				m_miniFat.append(read32(data + i * 4));
+			}
+		}
+	}
+
+	const Entry& root = m_entries.first();
+	if (root.size > 0)
+	{
+		m_miniStream = readStream(root.startSector, root.size, &error);
+		if (m_miniStream.isNull())
+		{
+			m_lastError = "Cannot read mini stream: " + error;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+QStringList CompoundFile::streamNames() const
+{
+	QStringList names;
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.type == 2)
+		{
+			names.append(entry.name);
+		}
+	}
+	return names;
+}
+
+const CompoundFile::Entry* CompoundFile::findStream(const QString& name) const
+{
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.type == 2 && entry.name.compare(name, Qt::CaseInsensitive) == 0)
+		{
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+QByteArray CompoundFile::streamData(const QString& name, QString* error) const
+{
+	const Entry* entry = findStream(name);
+	if (!entry)
+	{
+		*error = "Stream not found: " + name;
+		return QByteArray();
+	}
+
+	QByteArray data = readStream(entry->startSector, entry->size, error);
+	if (data.isEmpty() && entry->size > 0)
+	{
+		*error = name + ": " + *error;
+	}
+	return data;
+}
+
+bool CompoundFile::isView(const QByteArray& data) const
+{
+	const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+	return m_map && bytes >= m_map && bytes < m_map + m_size;
+}
@@ -0,0 +1,64 @@
+#ifndef COMPOUNDFILE_H
+#define COMPOUNDFILE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+
+// Read-only OLE2 compound file (CFB, [MS-CFB]) over a memory-mapped file,
+// the container of legacy .xls workbooks. open() reads the sector allocation
+// tables and the directory; streams are assembled from their sector chains
+// on request, a stream whose sectors are contiguous is returned as a view
+// into the map. Returned data stays valid until close(). After open() the
+// object is not modified, so streams may be read from several threads.
+class CompoundFile
+{
+public:
+	struct Entry
+	{
+		QString name;
+		quint8 type;      // 1 = storage, 2 = stream, 5 = root
+		quint32 startSector;
+		qint64 size;
+	};
+
+	CompoundFile();
+	~CompoundFile();
+
+	bool open(const QString& filePath);
+	void close();
+	bool isOpen() const { return m_map != nullptr; }
+	qint64 mappedSize() const { return m_size; }
+
+	QStringList streamNames() const;
+	const Entry* findStream(const QString& name) const; // Case-insensitive, as in the format
+
+	// Whole stream; empty with *error set when it is missing or its chain is broken
+	QByteArray streamData(const QString& name, QString* error) const;
+	bool isView(const QByteArray& data) const; // Points into the map rather than owning a copy
+
+	QString getLastError() const { return m_lastError; }
+
+private:
+	QFile m_file;
+	uchar* m_map;
+	qint64 m_size;
+	int m_sectorShift;
+	int m_miniSectorShift;
+	quint32 m_miniStreamCutoff;
+	QVector<quint32> m_fat;
+	QVector<quint32> m_miniFat;
+	QVector<Entry> m_entries;
+	QByteArray m_miniStream; // Root entry stream that holds the small streams
+	QString m_lastError;
+
+	void debugPrint(const QString& message) const;
+	const uchar* sector(quint32 index) const;
+	bool readChain(const QVector<quint32>& table, quint32 start, QVector<quint32>* chain, QString* error) const;
+	QByteArray readStream(quint32 start, qint64 size, QString* error) const;
+	bool readHeaderAndTables();
+};
+
+#endif // COMPOUNDFILE_H
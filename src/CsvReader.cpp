@@ -0,0 +1,418 @@
+#include "CsvReader.h"
+#include "XlsxSheet.h"
+#include "SheetCellTokenizer.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <cstring>
+
+namespace
+{
+	// Runs worker on threadCount threads (inline for one) and waits for all of them
+	template <typename Worker>
+	void runWorkers(int threadCount, Worker worker)
+	{
+		if (threadCount <= 1)
+		{
+			worker();
+			return;
+		}
+
+		QVector<QThread*> threads;
+		for (int i = 0; i < threadCount; i++)
+		{
+			threads.append(QThread::create(worker));
+			threads.last()->start();
+		}
+		for (QThread* thread : threads)
+		{
+			thread->wait();
+			delete thread;
+		}
+	}
+
+	inline bool isBlankByte(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+}
+
+CsvReader::CsvReader()
+	: m_threadCount(0)
+	, m_minChunkSize(1024 * 1024)
+	, m_rowLimit(0)
+	, m_delimiter(0)
+	, m_usedDelimiter(',')
+	, m_fileSize(0)
+	, m_splitNs(0)
+	, m_assembleNs(0)
+	, m_wallNs(0)
+{
+}
+
+void CsvReader::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [CsvReader]:" << message;
+}
+
+QVariant CsvReader::fieldValue(const char* text, int length)
+{
+	const char* begin = text;
+	const char* end = text + length;
+	while (begin < end && isBlankByte(*begin))
+	{
+		begin++;
+	}
+	while (end > begin && isBlankByte(end[-1]))
+	{
+		end--;
+	}
+
+	if (begin == end)
+	{
+		return QVariant();
+	}
+
+	// Only digits make a number; from_chars would also take "nan" and "inf"
+	const char* digits = (*begin == '-' || *begin == '+') ? begin + 1 : begin;
+	double number = 0.0;
+	if (digits < end && ((*digits >= '0' && *digits <= '9') || *digits == '.') &&
+		SheetCellTokenizer::parseNumber(begin, int(end - begin), &number))
+	{
+		return number;
+	}
+
+	// Excel writes boolean cells as TRUE/FALSE
+	int size = int(end - begin);
+	if (size == 4 && qstrnicmp(begin, "TRUE", 4) == 0)
+	{
+		return true;
+	}
+	if (size == 5 && qstrnicmp(begin, "FALSE", 5) == 0)
+	{
+		return false;
+	}
+
+	return QString::fromUtf8(text, length);
+}
+
+char CsvReader::detectDelimiter(const QString& filePath, const char* data, qint64 size)
+{
+	QString suffix = QFileInfo(filePath).suffix().toLower();
+	if (suffix == "tsv" || suffix == "tab")
+	{
+		return '\t';
+	}
+
+	// Otherwise the most frequent candidate in the first line, outside quotes
+	int commas = 0;
+	int semicolons = 0;
+	int tabs = 0;
+	bool quoted = false;
+	for (qint64 i = 0; i < size && i < 1024 * 1024; i++)
+	{
+		char c = data[i];
+		if (c == '"')
+		{
+			quoted = !quoted;
+		}
+		else if (quoted)
+		{
+			continue;
+		}
+		else if (c == '\n')
+		{
+			break;
+		}
+		else if (c == ',')
+		{
+			commas++;
+		}
+		else if (c == ';')
+		{
+			semicolons++;
+		}
+		else if (c == '\t')
+		{
+			tabs++;
+		}
+	}
+
+	if (tabs > commas && tabs >= semicolons)
+	{
+		return '\t';
+	}
+	if (semicolons > commas)
+	{
+		return ';';
+	}
+	return ',';
+}
+
+QVector<qint64> CsvReader::splitChunks(const char* data, qint64 size, int chunkCount, int threadCount)
+{
+	// Evenly spaced cut points, later moved forward to the next record boundary
+	QVector<qint64> nominal(chunkCount + 1);
+	for (int i = 0; i <= chunkCount; i++)
+	{
+		nominal[i] = size * i / chunkCount;
+	}
+
+	// Quotes in front of each cut, counted in parallel: an odd count means the cut is inside a quoted field
+	QVector<qint64> quotes(chunkCount, 0);
+	QAtomicInt next(0);
+	runWorkers(qMin(threadCount, chunkCount), [&]() {
+		for (int i = next.fetchAndAddRelaxed(1); i < chunkCount; i = next.fetchAndAddRelaxed(1))
+		{
+			qint64 count = 0;
+			for (const char* p = data + nominal.at(i), *end = data + nominal.at(i + 1); p < end; p++)
+			{
+				count += (*p == '"');
+			}
+			quotes[i] = count;
+		}
+	});
+
+	QVector<qint64> bounds(chunkCount + 1);
+	bounds[0] = 0;
+	bounds[chunkCount] = size;
+	qint64 quotesBefore = 0;
+	for (int i = 1; i < chunkCount; i++)
+	{
+		quotesBefore += quotes.at(i - 1);
+
+		// The first newline after the cut that is outside quotes ends a record
+		bool quoted = (quotesBefore % 2) != 0;
+		qint64 pos = nominal.at(i);
+		while (pos < size && (quoted || data[pos] != '\n'))
+		{
+			if (data[pos] == '"')
+			{
+				quoted = !quoted;
+			}
+			pos++;
+		}
+
+		// A record longer than a chunk leaves the chunks it spans empty
+		bounds[i] = qMax(bounds.at(i - 1), qMin(pos + 1, size));
+	}
+
+	return bounds;
+}
+
+qint64 CsvReader::parseChunk(const char* begin, const char* end, char delimiter, int rowLimit,
+	QVector<QVector<QVariant>>* rows)
+{
+	const char* p = begin;
+	while (p < end && (rowLimit <= 0 || rows->size() < rowLimit))
+	{
+		QVector<QVariant> row;
+		int usedColumns = 0;
+
+		for (int col = 0; ; col++)
+		{
+			QVariant value;
+			if (p < end && *p == '"')
+			{
+				// Quoted field: "" is a quote, separators and newlines are part of the value
+				QByteArray text;
+				p++;
+				while (p < end)
+				{
+					const char* quote = static_cast<const char*>(memchr(p, '"', size_t(end - p)));
+					if (!quote)
+					{
+						text.append(p, int(end - p));
+						p = end;
+						break;
+					}
+
+					text.append(p, int(quote - p));
+					p = quote + 1;
+					if (p < end && *p == '"')
+					{
+						text.append('"');
+						p++;
+						continue;
+					}
+					break;
+				}
+
+				// Text after the closing quote is kept, as Excel does
+				const char* rest = p;
+				while (p < end && *p != delimiter && *p != '\n')
+				{
+					p++;
+				}
+				const char* restEnd = (p > rest && p[-1] == '\r') ? p - 1 : p;
+				text.append(rest, int(restEnd - rest));
+
+				// Quoted fields stay text; XlsxSheet::number() still reads numbers in them
+				if (!text.trimmed().isEmpty())
+				{
+					value = QString::fromUtf8(text);
+				}
+			}
+			else
+			{
+				const char* field = p;
+				while (p < end && *p != delimiter && *p != '\n')
+				{
+					p++;
+				}
+				const char* fieldEnd = (p > field && p[-1] == '\r') ? p - 1 : p;
+				value = fieldValue(field, int(fieldEnd - field));
+			}
+
+			if (!value.isNull())
+			{
+				row.resize(col + 1);
+				row[col] = value;
+				usedColumns = col + 1;
+			}
+
+			if (p < end && *p == delimiter)
+			{
+				p++;
+				continue;
+			}
+
+			// End of the record
+			if (p < end)
+			{
+				p++;
+			}
+			break;
+		}
+
+		// Blank rows are kept, they end a sample's data like an empty worksheet row
+		row.resize(usedColumns);
+		rows->append(row);
+	}
+
+	return p - begin;
+}
+
+bool CsvReader::read(const QString& filePath, XlsxSheet* sheet)
+{
+	m_lastError.clear();
+	m_chunkStats.clear();
+	m_splitNs = 0;
+	m_assembleNs = 0;
+	m_wallNs = 0;
+
+	QElapsedTimer wallTimer;
+	wallTimer.start();
+
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		m_lastError = "Cannot open " + filePath + ": " + file.errorString();
+		return false;
+	}
+
+	m_fileSize = file.size();
+	sheet->clear();
+	if (m_fileSize == 0)
+	{
+		m_usedDelimiter = m_delimiter ? m_delimiter : ',';
+		return true;
+	}
+
+	// Cells copy what they keep, so the mapping is only needed during the read
+	QByteArray fallback;
+	const char* data = reinterpret_cast<const char*>(file.map(0, m_fileSize));
+	if (!data)
+	{
+		debugPrint("Cannot map " + filePath + ", reading it instead: " + file.errorString());
+		fallback = file.readAll();
+		data = fallback.constData();
+		m_fileSize = fallback.size();
+	}
+
+	// UTF-8 byte order mark
+	qint64 size = m_fileSize;
+	if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+	{
+		data += 3;
+		size -= 3;
+	}
+
+	m_usedDelimiter = m_delimiter ? m_delimiter : detectDelimiter(filePath, data, size);
+
+	// A few chunks per thread, so one slow chunk does not hold up the others
+	int threadCount = m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+	int chunkCount = 1;
+	if (m_rowLimit <= 0)
+	{
+		chunkCount = int(qBound(qint64(1), size / qMax(1, m_minChunkSize), qint64(threadCount) * 4));
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QVector<qint64> bounds = splitChunks(data, size, chunkCount, threadCount);
+	m_splitNs = timer.nsecsElapsed();
+
+	QVector<QVector<QVector<QVariant>>> chunkRows(chunkCount);
+	m_chunkStats.fill(ChunkStats(), chunkCount);
+	const char delimiter = m_usedDelimiter;
+	const int rowLimit = m_rowLimit;
+	QAtomicInt next(0);
+
+	runWorkers(qMin(threadCount, chunkCount), [&]() {
+		for (int i = next.fetchAndAddRelaxed(1); i < chunkCount; i = next.fetchAndAddRelaxed(1))
+		{
+			QElapsedTimer chunkTimer;
+			chunkTimer.start();
+
+			ChunkStats& stats = m_chunkStats[i];
+			stats.bytes = parseChunk(data + bounds.at(i), data + bounds.at(i + 1), delimiter, rowLimit, &chunkRows[i]);
+			stats.rows = chunkRows.at(i).size();
+			stats.parseNs = chunkTimer.nsecsElapsed();
+		}
+	});
+
+	// Rows go into the sheet in file order
+	timer.restart();
+	for (QVector<QVector<QVariant>>& rows : chunkRows)
+	{
+		sheet->appendRows(rows);
+		rows.clear();
+	}
+	m_assembleNs = timer.nsecsElapsed();
+	m_wallNs = wallTimer.nsecsElapsed();
+
+	file.close();
+
+	debugPrint("Read " + QString::number(sheet->rowCount()) + " rows, " + QString::number(sheet->columnCount()) +
+		" columns from " + QFileInfo(filePath).fileName() + " in " + QString::number(m_wallNs / 1e6, 'f', 2) + " ms");
+	return true;
+}
+
+QString CsvReader::statsReport() const
+{
+	QString delimiterName = m_usedDelimiter == '\t' ? QString("tab") : QString("'") + QChar(m_usedDelimiter) + "'";
+	QString report = "CSV ingest wall time: " + QString::number(m_wallNs / 1e6, 'f', 2) + " ms (" +
+		MemoryAccounting::formatBytes(m_fileSize) + ", delimiter " + delimiterName + ")";
+
+	qint64 parseNs = 0;
+	qint64 slowestNs = 0;
+	int rows = 0;
+	for (const ChunkStats& stats : m_chunkStats)
+	{
+		parseNs += stats.parseNs;
+		slowestNs = qMax(slowestNs, stats.parseNs);
+		rows += stats.rows;
+	}
+
+	report += "\nSplit: " + QString::number(m_splitNs / 1e6, 'f', 2) + " ms into " +
+		QString::number(m_chunkStats.size()) + " chunks";
+	report += "\nParse: " + QString::number(parseNs / 1e6, 'f', 2) + " ms work, slowest chunk " +
+		QString::number(slowestNs / 1e6, 'f', 2) + " ms, " + QString::number(rows) + " rows";
+	report += "\nAssemble: " + QString::number(m_assembleNs / 1e6, 'f', 2) + " ms";
+	return report;
+}
@@ -0,0 +1,70 @@
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include <QString>
+#include <QVector>
+#include <QVariant>
+
+class XlsxSheet;
+
+// Reads a CSV/TSV export into the same cell grid an xlsx worksheet fills, so
+// the sample layout (metadata rows 1-3, headers in row 4, 12 columns per
+// sample) is extracted the same way. The file is memory-mapped and cut into
+// chunks at record boundaries; a newline inside a quoted field is not a
+// boundary, which the quote count before each cut decides. Chunks are parsed
+// in parallel and appended to the sheet in file order.
+class CsvReader
+{
+public:
+	CsvReader();
+
+	// Tuning; 0 threads uses QThread::idealThreadCount()
+	void setThreadCount(int threads) { m_threadCount = threads; }
+	void setMinChunkSize(int bytes) { m_minChunkSize = bytes; }
+
+	// Stop after the first rows (0 = whole file); the file is then read by one thread
+	void setRowLimit(int rows) { m_rowLimit = rows; }
+
+	// Field separator; 0 detects it from the extension (.tsv) or the first line
+	void setDelimiter(char delimiter) { m_delimiter = delimiter; }
+
+	bool read(const QString& filePath, XlsxSheet* sheet);
+
+	// Statistics of the last read
+	char delimiter() const { return m_usedDelimiter; }
+	int chunkCount() const { return m_chunkStats.size(); }
+	QString statsReport() const;
+
+	QString getLastError() const { return m_lastError; }
+
+	// Cell value of one unquoted field: null when blank, then number, TRUE/FALSE, text
+	static QVariant fieldValue(const char* text, int length);
+
+private:
+	struct ChunkStats
+	{
+		qint64 bytes;
+		int rows;
+		qint64 parseNs;
+	};
+
+	int m_threadCount;
+	int m_minChunkSize;
+	int m_rowLimit;
+	char m_delimiter;
+	char m_usedDelimiter;
+	qint64 m_fileSize;
+	qint64 m_splitNs;
+	qint64 m_assembleNs;
+	qint64 m_wallNs;
+	QVector<ChunkStats> m_chunkStats;
+	QString m_lastError;
+
+	static char detectDelimiter(const QString& filePath, const char* data, qint64 size);
+	static QVector<qint64> splitChunks(const char* data, qint64 size, int chunkCount, int threadCount);
+	static qint64 parseChunk(const char* begin, const char* end, char delimiter, int rowLimit,
+		QVector<QVector<QVariant>>* rows);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // CSVREADER_H
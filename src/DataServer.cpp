@@ -0,0 +1,556 @@
+#include "DataServer.h"
+#include "MemoryAccounting.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <cstring>
+
+namespace
+{
+	const quint32 SHEET_IMAGE_MAGIC = 0x44535644; // "DVSD"
+	const quint32 SHEET_IMAGE_VERSION = 1;
+	const int SHEET_IMAGE_HEADER = 16;           // Magic, version, layout size
+
+	void writeMetadata(QDataStream& stream, const SampleMetadata& metadata)
+	{
+		stream << metadata.testName << metadata.date << metadata.sampleID << metadata.media
+			<< metadata.resistance << metadata.voltage << metadata.power << metadata.viscosity
+			<< metadata.tester << metadata.puffingRegime << metadata.initialOilMass << metadata.heatingTechnology;
+	}
+
+	void readMetadata(QDataStream& stream, SampleMetadata* metadata)
+	{
+		stream >> metadata->testName >> metadata->date >> metadata->sampleID >> metadata->media
+			>> metadata->resistance >> metadata->voltage >> metadata->power >> metadata->viscosity
+			>> metadata->tester >> metadata->puffingRegime >> metadata->initialOilMass >> metadata->heatingTechnology;
+	}
+}
+
+DataServer::DataServer(QObject* parent)
+	: QObject(parent)
+	, m_server(nullptr)
+	, m_idleExitMs(10 * 60 * 1000)
+	, m_nextId(0)
+	, m_sheetsServed(0)
+{
+	m_idleTimer = new QTimer(this);
+	m_idleTimer->setSingleShot(true);
+	connect(m_idleTimer, &QTimer::timeout, this, &DataServer::onIdleTimeout);
+}
+
+DataServer::~DataServer()
+{
+	if (m_server)
+	{
+		m_server->close();
+	}
+	for (QThread* thread : m_threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+
+	// Viewers that still map an image keep its pages until they let go
+	if (!m_imageFolder.isEmpty())
+	{
+		QDir(m_imageFolder).removeRecursively();
+	}
+}
+
+void DataServer::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [DataServer]:" << message;
+}
+
+bool DataServer::listen(const QString& serverName, QString* error)
+{
+	// Another server may have been started at the same moment by another viewer
+	QLocalSocket probe;
+	probe.connectToServer(serverName);
+	if (probe.waitForConnected(500))
+	{
+		*error = "A data server is already listening on " + serverName;
+		return false;
+	}
+
+	// A server left behind by a crashed instance would make listen() fail
+	m_server = new QLocalServer(this);
+	QLocalServer::removeServer(serverName);
+	if (!m_server->listen(serverName))
+	{
+		*error = "Cannot listen on " + serverName + ": " + m_server->errorString();
+		delete m_server;
+		m_server = nullptr;
+		return false;
+	}
+	connect(m_server, &QLocalServer::newConnection, this, &DataServer::onNewConnection);
+
+	// Images live in memory where the system has a tmpfs for it. /dev/shm is shared by all
+	// users, the folder is named after the server, which carries the user id (see defaultServerName)
+	QString base = QDir("/dev/shm").exists() ? QString("/dev/shm") : QStandardPaths::writableLocation(QStandardPaths::TempLocation);
+	m_imageFolder = base + "/" + serverName + "-images";
+	QDir(m_imageFolder).removeRecursively();
+	if (!QDir().mkpath(m_imageFolder))
+	{
+		*error = "Cannot create the image folder " + m_imageFolder;
+		m_server->close();
+		return false;
+	}
+
+	if (m_idleExitMs > 0)
+	{
+		m_idleTimer->start(m_idleExitMs);
+	}
+
+	debugPrint("Listening on " + m_server->fullServerName() + ", images in " + m_imageFolder);
+	return true;
+}
+
+void DataServer::onNewConnection()
+{
+	while (QLocalSocket* socket = m_server->nextPendingConnection())
+	{
+		m_sockets.insert(socket, QByteArray());
+		connect(socket, &QLocalSocket::readyRead, this, &DataServer::onReadyRead);
+		connect(socket, &QLocalSocket::disconnected, this, &DataServer::onDisconnected);
+	}
+}
+
+void DataServer::onReadyRead()
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+	if (!socket || !m_sockets.contains(socket))
+	{
+		return;
+	}
+
+	QByteArray& pending = m_sockets[socket];
+	pending += socket->readAll();
+
+	// One JSON request per line
+	int end;
+	while ((end = pending.indexOf('\n')) >= 0)
+	{
+		QByteArray line = pending.left(end);
+		pending.remove(0, end + 1);
+
+		QJsonObject request = QJsonDocument::fromJson(line).object();
+		QJsonObject reply = handleRequest(request, socket);
+		if (!reply.isEmpty())
+		{
+			sendReply(socket, reply);
+		}
+		if (!m_sockets.contains(socket))
+		{
+			return;
+		}
+	}
+}
+
+void DataServer::onDisconnected()
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+	if (!socket)
+	{
+		return;
+	}
+
+	m_sockets.remove(socket);
+	socket->deleteLater();
+
+	// A viewer's session ends when it exits or crashes; its leases go with it
+	QString clientId = m_sessions.take(socket);
+	if (!clientId.isEmpty())
+	{
+		debugPrint("Client " + clientId + " disconnected");
+		QList<QString> ids = m_workbooks.keys();
+		for (const QString& id : ids)
+		{
+			release(id, clientId, true);
+		}
+
+		if (m_sessions.isEmpty() && m_idleExitMs > 0)
+		{
+			m_idleTimer->start(m_idleExitMs);
+		}
+	}
+}
+
+void DataServer::onIdleTimeout()
+{
+	if (m_sessions.isEmpty())
+	{
+		debugPrint("No viewer for " + QString::number(m_idleExitMs / 1000) + " s, exiting");
+		QCoreApplication::quit();
+	}
+}
+
+void DataServer::sendReply(QLocalSocket* socket, const QJsonObject& reply)
+{
+	socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+}
+
+QJsonObject DataServer::handleRequest(const QJsonObject& request, QLocalSocket* socket)
+{
+	QString op = request.value("op").toString();
+	QString clientId = request.value("client").toString();
+	QJsonObject reply;
+
+	if (op == "hello")
+	{
+		QString id = QString::number(qint64(request.value("pid").toDouble())) + "." + QString::number(++m_nextId);
+		m_sessions.insert(socket, id);
+		m_idleTimer->stop();
+		reply.insert("client", id);
+		debugPrint("Client " + id + " connected, " + QString::number(m_sessions.size()) + " connected");
+		return reply;
+	}
+
+	// Every other request comes from a known session
+	if (!m_sessions.values().contains(clientId))
+	{
+		reply.insert("error", "Unknown client, connect again");
+		return reply;
+	}
+
+	if (op == "open")
+	{
+		return openWorkbook(request.value("path").toString(), clientId);
+	}
+	if (op == "sheet")
+	{
+		QSharedPointer<ServedWorkbook> served = m_workbooks.value(request.value("workbook").toString());
+		if (!served || !served->leases.contains(clientId))
+		{
+			reply.insert("error", "Workbook is not open");
+			return reply;
+		}
+
+		// Answered from the request thread once the image is written
+		serveSheet(served, request.value("name").toString(), socket);
+		return QJsonObject();
+	}
+	if (op == "release")
+	{
+		release(request.value("workbook").toString(), clientId, false);
+		reply.insert("released", true);
+		return reply;
+	}
+	if (op == "status")
+	{
+		reply.insert("report", report());
+		return reply;
+	}
+
+	reply.insert("error", "Unknown request: " + op);
+	return reply;
+}
+
+QJsonObject DataServer::openWorkbook(const QString& filePath, const QString& clientId)
+{
+	QJsonObject reply;
+	QFileInfo fileInfo(filePath);
+	QString canonicalPath = fileInfo.canonicalFilePath();
+	if (canonicalPath.isEmpty())
+	{
+		reply.insert("error", "File not found: " + filePath);
+		return reply;
+	}
+
+	// A file that changed since it was opened is served as a new version
+	QSharedPointer<ServedWorkbook> served = m_workbooks.value(m_currentVersion.value(canonicalPath));
+	if (served && (served->fileSize != fileInfo.size() || served->fileModified != fileInfo.lastModified()))
+	{
+		debugPrint(fileInfo.fileName() + " changed, opening a new version");
+		served.clear();
+	}
+
+	if (!served)
+	{
+		QString error;
+		QSharedPointer<Workbook> workbook = Workbook::open(canonicalPath, 0, &error);
+		if (!workbook)
+		{
+			reply.insert("error", error);
+			return reply;
+		}
+
+		served.reset(new ServedWorkbook());
+		served->id = "w" + QString::number(++m_nextId);
+		served->filePath = canonicalPath;
+		served->fileSize = fileInfo.size();
+		served->fileModified = fileInfo.lastModified();
+		served->workbook = workbook;
+		served->parseNs = 0;
+		m_workbooks.insert(served->id, served);
+		m_currentVersion.insert(canonicalPath, served->id);
+	}
+
+	served->leases[clientId]++;
+
+	reply.insert("workbook", served->id);
+	reply.insert("sheets", QJsonArray::fromStringList(served->workbook->sheetNames()));
+	reply.insert("newTemplate", served->workbook->isNewTemplate());
+	return reply;
+}
+
+void DataServer::serveSheet(const QSharedPointer<ServedWorkbook>& served, const QString& sheetName, QLocalSocket* socket)
+{
+	deleteFinishedThreads();
+
+	QPointer<QLocalSocket> replyTo(socket);
+	QString imageFolder = m_imageFolder;
+	QThread* thread = QThread::create([this, served, sheetName, replyTo, imageFolder]() {
+		QJsonObject reply;
+		bool written = false;
+		{
+			// One sheet of a workbook at a time, so each is parsed and written once
+			QMutexLocker locker(&served->mutex);
+			if (!served->workbook)
+			{
+				reply.insert("error", "Workbook was evicted");
+			}
+			else if (!served->sheets.contains(sheetName))
+			{
+				QElapsedTimer timer;
+				timer.start();
+				QString error;
+				QSharedPointer<const SheetData> sheet = served->workbook->sheet(sheetName, &error);
+				if (sheet)
+				{
+					QByteArray image = sheetImage(*sheet);
+					QString imagePath = imageFolder + "/" + served->id + "-" +
+						QString::number(served->workbook->sheetNames().indexOf(sheetName)) + ".sheet";
+					QFile file(imagePath);
+					if (file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(image) == image.size())
+					{
+						// Viewers read the image from now on, the parsed cells are not needed here
+						file.close();
+						sheet.clear();
+						served->workbook->releaseSheet(sheetName);
+						ServedSheet servedSheet = { imagePath, image.size() };
+						served->sheets.insert(sheetName, servedSheet);
+						served->parseNs += timer.nsecsElapsed();
+						written = true;
+					}
+					else
+					{
+						error = "Cannot write " + imagePath + ": " + file.errorString();
+						file.remove();
+					}
+				}
+				if (!error.isEmpty())
+				{
+					reply.insert("error", error);
+				}
+			}
+
+			if (!reply.contains("error"))
+			{
+				reply.insert("image", served->sheets.value(sheetName).imagePath);
+				reply.insert("bytes", double(served->sheets.value(sheetName).bytes));
+			}
+		}
+
+		QMetaObject::invokeMethod(this, [this, replyTo, reply, written]() {
+			if (written)
+			{
+				m_sheetsServed++;
+			}
+			if (replyTo)
+			{
+				sendReply(replyTo, reply);
+			}
+		}, Qt::QueuedConnection);
+	});
+	m_threads.append(thread);
+	thread->start();
+}
+
+void DataServer::release(const QString& workbookId, const QString& clientId, bool allLeases)
+{
+	QSharedPointer<ServedWorkbook> served = m_workbooks.value(workbookId);
+	if (!served || !served->leases.contains(clientId))
+	{
+		return;
+	}
+
+	int& count = served->leases[clientId];
+	if (allLeases || --count <= 0)
+	{
+		served->leases.remove(clientId);
+	}
+
+	if (served->leases.isEmpty())
+	{
+		evict(served);
+	}
+}
+
+void DataServer::evict(const QSharedPointer<ServedWorkbook>& served)
+{
+	debugPrint("Evicting " + QFileInfo(served->filePath).fileName() + " (" + served->id + "), no viewer holds it");
+
+	m_workbooks.remove(served->id);
+	if (m_currentVersion.value(served->filePath) == served->id)
+	{
+		m_currentVersion.remove(served->filePath);
+	}
+
+	// After any sheet still being written, without holding up the other viewers meanwhile
+	deleteFinishedThreads();
+	QThread* thread = QThread::create([served]() {
+		QMutexLocker locker(&served->mutex);
+		for (const ServedSheet& sheet : served->sheets)
+		{
+			QFile::remove(sheet.imagePath);
+		}
+		served->sheets.clear();
+		served->workbook.clear();
+	});
+	m_threads.append(thread);
+	thread->start();
+}
+
+void DataServer::deleteFinishedThreads()
+{
+	for (int i = m_threads.size() - 1; i >= 0; i--)
+	{
+		if (m_threads[i]->isFinished())
+		{
+			delete m_threads[i];
+			m_threads.remove(i);
+		}
+	}
+}
+
+QString DataServer::report() const
+{
+	QString report = QString::number(m_sessions.size()) + " viewers connected, " + QString::number(m_workbooks.size()) +
+		" workbooks served, " + QString::number(m_sheetsServed) + " sheet images written\n";
+
+	for (const QSharedPointer<ServedWorkbook>& served : m_workbooks)
+	{
+		int leases = 0;
+		for (int count : served->leases)
+		{
+			leases += count;
+		}
+
+		// A sheet being parsed holds the lock, its workbook is listed without the images then
+		QString images = "images pending";
+		if (served->mutex.tryLock())
+		{
+			qint64 bytes = 0;
+			for (const ServedSheet& sheet : served->sheets)
+			{
+				bytes += sheet.bytes;
+			}
+			images = QString::number(served->sheets.size()) + " sheet images, " + MemoryAccounting::formatBytes(bytes) +
+				", parsed in " + QString::number(served->parseNs / 1e6, 'f', 0) + " ms";
+			served->mutex.unlock();
+		}
+
+		report += "  " + QFileInfo(served->filePath).fileName() + " (" + served->id + "): " + QString::number(served->leases.size()) +
+			" viewers, " + QString::number(leases) + " leases, " + images + "\n";
+	}
+	return report;
+}
+
+QByteArray DataServer::sheetImage(const SheetData& sheet)
+{
+	QByteArray layout;
+	{
+		QDataStream stream(&layout, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_6);
+		stream << sheet.name << qint32(sheet.metadata.size());
+		for (const SampleMetadata& metadata : sheet.metadata)
+		{
+			writeMetadata(stream, metadata);
+		}
+		stream << sheet.rowCounts << sheet.ingestReport;
+	}
+
+	// The cell grid's number columns are read in place, so it starts at an 8-byte boundary
+	qint64 cellsOffset = (SHEET_IMAGE_HEADER + layout.size() + 7) / 8 * 8;
+	QByteArray cells = sheet.cells.toImage();
+
+	QByteArray image(int(cellsOffset + cells.size()), '\0');
+	char* data = image.data();
+	qint64 layoutSize = layout.size();
+	memcpy(data, &SHEET_IMAGE_MAGIC, 4);
+	memcpy(data + 4, &SHEET_IMAGE_VERSION, 4);
+	memcpy(data + 8, &layoutSize, 8);
+	memcpy(data + SHEET_IMAGE_HEADER, layout.constData(), size_t(layout.size()));
+	memcpy(data + cellsOffset, cells.constData(), size_t(cells.size()));
+	return image;
+}
+
+QSharedPointer<const SheetData> DataServer::mapSheetImage(const QString& filePath, QString* error)
+{
+	QSharedPointer<QFile> file(new QFile(filePath));
+	if (!file->open(QIODevice::ReadOnly))
+	{
+		*error = "Cannot open sheet image " + filePath + ": " + file->errorString();
+		return QSharedPointer<const SheetData>();
+	}
+
+	qint64 size = file->size();
+	const uchar* image = size > SHEET_IMAGE_HEADER ? file->map(0, size) : nullptr;
+	quint32 magic = 0;
+	quint32 version = 0;
+	qint64 layoutSize = -1;
+	if (image)
+	{
+		memcpy(&magic, image, 4);
+		memcpy(&version, image + 4, 4);
+		memcpy(&layoutSize, image + 8, 8);
+	}
+	if (!image || magic != SHEET_IMAGE_MAGIC || version != SHEET_IMAGE_VERSION || layoutSize < 0 ||
+		SHEET_IMAGE_HEADER + layoutSize > size)
+	{
+		*error = "Not a sheet image, or one of another version: " + filePath;
+		return QSharedPointer<const SheetData>();
+	}
+
+	// The layout is copied, the cell grid keeps the file mapped for its number columns
+	QSharedPointer<SheetData> data(new SheetData());
+	QByteArray layout = QByteArray::fromRawData(reinterpret_cast<const char*>(image) + SHEET_IMAGE_HEADER, int(layoutSize));
+	QDataStream stream(layout);
+	stream.setVersion(QDataStream::Qt_5_6);
+	qint32 sampleCount = 0;
+	stream >> data->name >> sampleCount;
+	for (int i = 0; i < sampleCount && stream.status() == QDataStream::Ok; i++)
+	{
+		SampleMetadata metadata;
+		readMetadata(stream, &metadata);
+		data->metadata.append(metadata);
+	}
+	stream >> data->rowCounts >> data->ingestReport;
+	if (stream.status() != QDataStream::Ok)
+	{
+		*error = "Sheet image is corrupt: " + filePath;
+		return QSharedPointer<const SheetData>();
+	}
+
+	qint64 cellsOffset = (SHEET_IMAGE_HEADER + layoutSize + 7) / 8 * 8;
+	if (!data->cells.attachImage(image + cellsOffset, size - cellsOffset, file))
+	{
+		*error = data->cells.getLastError() + ": " + filePath;
+		return QSharedPointer<const SheetData>();
+	}
+	return data;
+}
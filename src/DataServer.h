@@ -0,0 +1,100 @@
+#ifndef DATASERVER_H
+#define DATASERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QDateTime>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QJsonObject>
+#include "Workbook.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QThread;
+class QTimer;
+
+// Shared data server: one headless process per machine (DataViewerEnterprise
+// --data-server) that opens and parses workbooks on behalf of every viewer.
+// Viewers ask over a local socket for a file's sheet list and then for sheets;
+// a parsed sheet is written once as an image file in a shared-memory folder
+// (/dev/shm where there is one) and each viewer maps that file, reading the
+// number columns in place (see XlsxSheet::toImage()). The server keeps only
+// the images, not the parsed sheets.
+//
+// Every open is a lease of the viewer's session. A workbook is evicted, its
+// images deleted, when the last lease is released or the last session holding
+// one disconnects; viewers that still map an image keep its pages until they
+// let go. A changed file is opened as a new version, the old one stays served
+// to the viewers that hold it.
+class DataServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit DataServer(QObject* parent = nullptr);
+	~DataServer();
+
+	// Removes a server left behind by a crashed instance and its images
+	bool listen(const QString& serverName, QString* error);
+	void setIdleExitMs(int idleExitMs) { m_idleExitMs = idleExitMs; } // Quits with no session for this long, 0 = never
+
+	QString report() const;
+
+	// Image file of a parsed sheet: the sheet layout, then the cell grid's image at an 8-byte boundary
+	static QByteArray sheetImage(const SheetData& sheet);
+	static QSharedPointer<const SheetData> mapSheetImage(const QString& filePath, QString* error);
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDisconnected();
+	void onIdleTimeout();
+
+private:
+	struct ServedSheet
+	{
+		QString imagePath;
+		qint64 bytes;
+	};
+
+	struct ServedWorkbook
+	{
+		QString id;
+		QString filePath;
+		qint64 fileSize;
+		QDateTime fileModified;
+		QSharedPointer<Workbook> workbook;
+		QHash<QString, int> leases; // Client id -> open count, GUI thread only
+
+		// Written by the request threads; held while a sheet is parsed and written
+		QMutex mutex;
+		QHash<QString, ServedSheet> sheets;
+		qint64 parseNs;
+	};
+
+	QLocalServer* m_server;
+	QString m_imageFolder;
+	QHash<QLocalSocket*, QByteArray> m_sockets;  // Partial request line of each connection
+	QHash<QLocalSocket*, QString> m_sessions;    // Session connection -> client id
+	QHash<QString, QSharedPointer<ServedWorkbook>> m_workbooks; // By id
+	QHash<QString, QString> m_currentVersion;    // Canonical file path -> id of its newest version
+	QVector<QThread*> m_threads;
+	QTimer* m_idleTimer;
+	int m_idleExitMs;
+	quint64 m_nextId;
+	int m_sheetsServed;
+
+	QJsonObject handleRequest(const QJsonObject& request, QLocalSocket* socket);
+	QJsonObject openWorkbook(const QString& filePath, const QString& clientId);
+	void serveSheet(const QSharedPointer<ServedWorkbook>& served, const QString& sheetName, QLocalSocket* socket);
+	void release(const QString& workbookId, const QString& clientId, bool allLeases);
+	void evict(const QSharedPointer<ServedWorkbook>& served);
+	void sendReply(QLocalSocket* socket, const QJsonObject& reply);
+	void deleteFinishedThreads();
+	void debugPrint(const QString& message) const;
+};
+
+#endif // DATASERVER_H
@@ -0,0 +1,244 @@
+#include "DataServerClient.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QThread>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+namespace
+{
+	struct ClientState
+	{
+		QMutex mutex;
+		QString serverName;
+		QString clientId;       // Empty while not connected
+		QLocalSocket* session = nullptr; // GUI thread only
+	};
+
+	ClientState& state()
+	{
+		static ClientState client;
+		return client;
+	}
+
+	void debugPrint(const QString& message)
+	{
+		qDebug() << "DEBUG [DataServerClient]:" << message;
+	}
+
+	// One JSON line out, one back
+	QJsonObject exchange(QLocalSocket* socket, const QJsonObject& request, QString* error, int timeoutMs)
+	{
+		socket->write(QJsonDocument(request).toJson(QJsonDocument::Compact) + '\n');
+		if (!socket->waitForBytesWritten(timeoutMs))
+		{
+			*error = "Data server did not take the request: " + socket->errorString();
+			return QJsonObject();
+		}
+
+		QByteArray line;
+		while (!line.endsWith('\n'))
+		{
+			if (!socket->bytesAvailable() && !socket->waitForReadyRead(timeoutMs))
+			{
+				*error = "Data server did not answer: " + socket->errorString();
+				return QJsonObject();
+			}
+			line += socket->readLine();
+		}
+
+		QJsonObject reply = QJsonDocument::fromJson(line).object();
+		if (reply.isEmpty())
+		{
+			*error = "Data server sent an unreadable reply";
+		}
+		else if (reply.contains("error"))
+		{
+			*error = reply.value("error").toString();
+		}
+		return reply;
+	}
+}
+
+QString DataServerClient::userScopedName(const QString& name)
+{
+#if defined(Q_OS_UNIX)
+	return name + "-" + QString::number(uint(getuid()));
+#else
+	QString user = QString::fromLocal8Bit(qgetenv("USERNAME"));
+	return user.isEmpty() ? name : name + "-" + user;
+#endif
+}
+
+bool DataServerClient::connectToServer(const QString& serverName, bool startServer, QString* error)
+{
+	disconnectFromServer();
+
+	QLocalSocket* session = new QLocalSocket();
+	session->connectToServer(serverName);
+	bool connected = session->waitForConnected(1000);
+
+	// The server runs as this executable in --data-server mode and outlives the viewer that started it
+	if (!connected && startServer)
+	{
+		debugPrint("Starting data server " + serverName);
+		if (!QProcess::startDetached(QCoreApplication::applicationFilePath(), QStringList() << "--data-server" << serverName))
+		{
+			*error = "Cannot start the data server";
+			delete session;
+			return false;
+		}
+		for (int attempt = 0; attempt < 30 && !connected; attempt++)
+		{
+			QThread::msleep(100);
+			session->connectToServer(serverName);
+			connected = session->waitForConnected(500);
+		}
+	}
+
+	if (!connected)
+	{
+		*error = "Cannot connect to data server " + serverName + ": " + session->errorString();
+		delete session;
+		return false;
+	}
+
+	QJsonObject hello;
+	hello.insert("op", "hello");
+	hello.insert("pid", double(QCoreApplication::applicationPid()));
+	QJsonObject reply = exchange(session, hello, error, 5000);
+	if (reply.value("client").toString().isEmpty())
+	{
+		delete session;
+		return false;
+	}
+
+	// A server that goes away ends the session; workbooks are read locally from then on
+	QObject::connect(session, &QLocalSocket::disconnected, []() {
+		ClientState& client = state();
+		QMutexLocker locker(&client.mutex);
+		client.clientId.clear();
+		debugPrint("Data server disconnected");
+	});
+
+	ClientState& client = state();
+	QMutexLocker locker(&client.mutex);
+	client.serverName = serverName;
+	client.clientId = reply.value("client").toString();
+	client.session = session;
+
+	debugPrint("Connected to " + serverName + " as client " + client.clientId);
+	return true;
+}
+
+void DataServerClient::disconnectFromServer()
+{
+	ClientState& client = state();
+	QLocalSocket* session = nullptr;
+	{
+		QMutexLocker locker(&client.mutex);
+		session = client.session;
+		client.session = nullptr;
+		client.clientId.clear();
+	}
+
+	// Closing the session releases every lease this viewer still holds
+	if (session)
+	{
+		session->disconnect();
+		session->abort();
+		delete session;
+		debugPrint("Disconnected from " + client.serverName);
+	}
+}
+
+bool DataServerClient::isConnected()
+{
+	ClientState& client = state();
+	QMutexLocker locker(&client.mutex);
+	return !client.clientId.isEmpty();
+}
+
+QString DataServerClient::serverName()
+{
+	ClientState& client = state();
+	QMutexLocker locker(&client.mutex);
+	return client.serverName;
+}
+
+QJsonObject DataServerClient::request(QJsonObject request, QString* error, int timeoutMs)
+{
+	QString serverName;
+	{
+		ClientState& client = state();
+		QMutexLocker locker(&client.mutex);
+		if (client.clientId.isEmpty())
+		{
+			*error = "Not connected to a data server";
+			return QJsonObject();
+		}
+		serverName = client.serverName;
+		request.insert("client", client.clientId);
+	}
+
+	QLocalSocket socket;
+	socket.connectToServer(serverName);
+	if (!socket.waitForConnected(1000))
+	{
+		*error = "Cannot connect to data server " + serverName + ": " + socket.errorString();
+		return QJsonObject();
+	}
+	return exchange(&socket, request, error, timeoutMs);
+}
+
+void DataServerClient::post(QJsonObject request)
+{
+	QString serverName;
+	{
+		ClientState& client = state();
+		QMutexLocker locker(&client.mutex);
+		if (client.clientId.isEmpty())
+		{
+			return;
+		}
+		serverName = client.serverName;
+		request.insert("client", client.clientId);
+	}
+
+	// A local connection and one short line complete at once unless the server is gone
+	QLocalSocket socket;
+	socket.connectToServer(serverName);
+	if (!socket.waitForConnected(100))
+	{
+		debugPrint("WARNING: Dropped " + request.value("op").toString() + " request - " + socket.errorString());
+		return;
+	}
+	socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + '\n');
+	socket.waitForBytesWritten(100);
+	socket.disconnectFromServer();
+}
+
+QString DataServerClient::serverReport()
+{
+	if (!isConnected())
+	{
+		return "Data server: not connected";
+	}
+
+	QString error;
+	QJsonObject status;
+	status.insert("op", "status");
+	QJsonObject reply = request(status, &error, 5000);
+	if (!error.isEmpty())
+	{
+		return "Data server: " + error;
+	}
+	return "Data server " + serverName() + ":\n" + reply.value("report").toString();
+}
@@ -0,0 +1,35 @@
+#ifndef DATASERVERCLIENT_H
+#define DATASERVERCLIENT_H
+
+#include <QString>
+#include <QJsonObject>
+
+// Viewer side of the shared data server (see DataServer). One session
+// connection per process, made from the GUI thread, identifies the viewer; the
+// server drops the viewer's workbooks when it closes, including on a crash.
+// Requests are blocking and may come from any thread: each one opens its own
+// short connection, sends one JSON line and reads one back.
+class DataServerClient
+{
+public:
+	// Local socket names are machine-wide; the user id keeps users on one machine apart
+	static QString userScopedName(const QString& name);
+	static QString defaultServerName() { return userScopedName("DataViewerEnterprise-data"); }
+
+	// Starts the server in the background when none is listening and startServer is set
+	static bool connectToServer(const QString& serverName, bool startServer, QString* error);
+	static void disconnectFromServer();
+	static bool isConnected(); // Thread-safe
+	static QString serverName();
+
+	// Adds the session's client id; a reply carrying "error" is returned as such
+	static QJsonObject request(QJsonObject request, QString* error, int timeoutMs = 300000);
+
+	// Sends a request without waiting for the reply, for notices from destructors
+	static void post(QJsonObject request);
+
+	// Served workbooks, their leases and images, as reported by the server
+	static QString serverReport();
+};
+
+#endif // DATASERVERCLIENT_H
@@ -0,0 +1,275 @@
+#include "DerivedColumns.h"
+#include <QDebug>
+#include <QtMath>
+#include <cstring>
+
+DerivedColumns::DerivedColumns()
+	: m_evaluations(0)
+{
+}
+
+void DerivedColumns::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [DerivedColumns]:" << message;
+}
+
+bool DerivedColumns::addInput(const QString& name)
+{
+	if (m_index.contains(name))
+	{
+		m_lastError = "Column already declared: " + name;
+		return false;
+	}
+
+	Node node;
+	node.name = name;
+	node.isInput = true;
+	node.valid = true;
+	m_index.insert(name, m_nodes.size());
+	m_nodes.append(node);
+	return true;
+}
+
+bool DerivedColumns::addColumn(const QString& name, const QStringList& dependencies, const Formula& formula)
+{
+	if (m_index.contains(name))
+	{
+		m_lastError = "Column already declared: " + name;
+		return false;
+	}
+
+	// Dependencies must already exist, which keeps the graph free of cycles
+	Node node;
+	node.name = name;
+	node.isInput = false;
+	node.formula = formula;
+	node.valid = false;
+	for (const QString& dependency : dependencies)
+	{
+		if (!m_index.contains(dependency))
+		{
+			m_lastError = "Column " + name + " depends on undeclared column " + dependency;
+			return false;
+		}
+		node.dependencies.append(m_index.value(dependency));
+	}
+
+	int id = m_nodes.size();
+	for (int dependency : node.dependencies)
+	{
+		m_nodes[dependency].dependents.append(id);
+	}
+	m_index.insert(name, id);
+	m_nodes.append(node);
+	return true;
+}
+
+int DerivedColumns::setInput(const QString& name, const QVector<double>& values)
+{
+	int id = m_index.value(name, -1);
+	if (id < 0 || !m_nodes.at(id).isInput)
+	{
+		m_lastError = "Not an input column: " + name;
+		return 0;
+	}
+
+	// Bitwise comparison, so unchanged NaN blanks count as equal
+	Node& node = m_nodes[id];
+	if (node.values.size() == values.size() &&
+		std::memcmp(node.values.constData(), values.constData(), size_t(values.size()) * sizeof(double)) == 0)
+	{
+		return 0;
+	}
+
+	node.values = values;
+	return invalidateDependents(id);
+}
+
+int DerivedColumns::invalidateDependents(int node)
+{
+	int invalidated = 0;
+	for (int dependent : m_nodes.at(node).dependents)
+	{
+		// An invalid column's dependents are invalid already
+		if (m_nodes.at(dependent).valid)
+		{
+			m_nodes[dependent].valid = false;
+			invalidated += 1 + invalidateDependents(dependent);
+		}
+	}
+	return invalidated;
+}
+
+void DerivedColumns::evaluate(int node)
+{
+	Arguments args;
+	for (int dependency : m_nodes.at(node).dependencies)
+	{
+		if (!m_nodes.at(dependency).valid)
+		{
+			evaluate(dependency);
+		}
+		args.append(&m_nodes.at(dependency).values);
+	}
+
+	Node& target = m_nodes[node];
+	target.formula(args, target.values);
+	target.valid = true;
+	m_evaluations++;
+}
+
+const QVector<double>& DerivedColumns::column(const QString& name)
+{
+	static const QVector<double> empty;
+
+	int id = m_index.value(name, -1);
+	if (id < 0)
+	{
+		m_lastError = "Unknown column: " + name;
+		return empty;
+	}
+
+	if (!m_nodes.at(id).valid)
+	{
+		evaluate(id);
+	}
+	return m_nodes.at(id).values;
+}
+
+double DerivedColumns::scalar(const QString& name)
+{
+	const QVector<double>& values = column(name);
+	return values.isEmpty() ? qQNaN() : values.first();
+}
+
+bool DerivedColumns::isCached(const QString& name) const
+{
+	int id = m_index.value(name, -1);
+	return id >= 0 && m_nodes.at(id).valid;
+}
+
+QStringList DerivedColumns::columnNames() const
+{
+	QStringList names;
+	for (const Node& node : m_nodes)
+	{
+		names.append(node.name);
+	}
+	return names;
+}
+
+// Element count shared by all column arguments
+static int rowCount(const DerivedColumns::Arguments& args)
+{
+	int rows = args.isEmpty() ? 0 : args.first()->size();
+	for (const QVector<double>* column : args)
+	{
+		rows = qMin(rows, column->size());
+	}
+	return rows;
+}
+
+void DerivedColumns::defineTemplateColumns()
+{
+	addInput("puffs");
+	addInput("beforeWeight");
+	addInput("afterWeight");
+	addInput("power");
+
+	// Puffs is cumulative; each row's weights cover the puffs since the previous row
+	addColumn("puffsInInterval", QStringList() << "puffs", [](const Arguments& args, QVector<double>& result)
+	{
+		const QVector<double>& puffs = *args.at(0);
+		result.resize(puffs.size());
+		double previous = 0.0;
+		for (int i = 0; i < puffs.size(); i++)
+		{
+			result[i] = puffs[i] - previous;
+			if (!qIsNaN(puffs[i]))
+			{
+				previous = puffs[i];
+			}
+		}
+	});
+
+	addColumn("weightLoss", QStringList() << "beforeWeight" << "afterWeight", [](const Arguments& args, QVector<double>& result)
+	{
+		const double* before = args.at(0)->constData();
+		const double* after = args.at(1)->constData();
+		int rows = rowCount(args);
+		result.resize(rows);
+		for (int i = 0; i < rows; i++)
+		{
+			result[i] = before[i] - after[i];
+		}
+	});
+
+	addColumn("tpm", QStringList() << "weightLoss" << "puffsInInterval", [](const Arguments& args, QVector<double>& result)
+	{
+		const double* loss = args.at(0)->constData();
+		const double* puffs = args.at(1)->constData();
+		int rows = rowCount(args);
+		result.resize(rows);
+		for (int i = 0; i < rows; i++)
+		{
+			result[i] = puffs[i] > 0.0 ? loss[i] * 1000.0 / puffs[i] : qQNaN(); // g -> mg
+		}
+	});
+
+	addColumn("tpmMean", QStringList() << "tpm", [](const Arguments& args, QVector<double>& result)
+	{
+		double sum = 0.0;
+		int count = 0;
+		for (double value : *args.at(0))
+		{
+			if (!qIsNaN(value))
+			{
+				sum += value;
+				count++;
+			}
+		}
+		result = QVector<double>(1, count > 0 ? sum / count : qQNaN());
+	});
+
+	addColumn("tpmPowerDensity", QStringList() << "tpm" << "power", [](const Arguments& args, QVector<double>& result)
+	{
+		const QVector<double>& tpm = *args.at(0);
+		double power = args.at(1)->isEmpty() ? qQNaN() : args.at(1)->first();
+		result.resize(tpm.size());
+		for (int i = 0; i < tpm.size(); i++)
+		{
+			result[i] = power > 0.0 ? tpm[i] / power : qQNaN();
+		}
+	});
+
+	addColumn("tpmVariation", QStringList() << "tpm" << "tpmMean", [](const Arguments& args, QVector<double>& result)
+	{
+		const QVector<double>& tpm = *args.at(0);
+		double mean = args.at(1)->first();
+		result.resize(tpm.size());
+		for (int i = 0; i < tpm.size(); i++)
+		{
+			result[i] = mean != 0.0 ? (tpm[i] - mean) / mean * 100.0 : qQNaN();
+		}
+	});
+
+	// Blank rows stay blank but do not break the running total
+	addColumn("oilConsumed", QStringList() << "weightLoss", [](const Arguments& args, QVector<double>& result)
+	{
+		const QVector<double>& loss = *args.at(0);
+		result.resize(loss.size());
+		double total = 0.0;
+		for (int i = 0; i < loss.size(); i++)
+		{
+			if (qIsNaN(loss[i]))
+			{
+				result[i] = qQNaN();
+				continue;
+			}
+			total += loss[i];
+			result[i] = total;
+		}
+	});
+
+	debugPrint("Declared " + QString::number(m_nodes.size()) + " template columns");
+}
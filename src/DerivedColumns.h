@@ -0,0 +1,70 @@
+#ifndef DERIVEDCOLUMNS_H
+#define DERIVEDCOLUMNS_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <functional>
+
+// Columns computed from other columns, declared once as a dependency graph.
+// Inputs (and scalar parameters, stored as one-value columns) are set from
+// sample data; a derived column is evaluated over the whole column on first
+// request and cached until an input it depends on, directly or through other
+// derived columns, changes. A column may only depend on columns declared
+// before it, so the graph is acyclic by construction.
+class DerivedColumns
+{
+public:
+	// One pointer per declared dependency, in order; result comes back sized by the formula
+	typedef QVector<const QVector<double>*> Arguments;
+	typedef std::function<void(const Arguments& args, QVector<double>& result)> Formula;
+
+	DerivedColumns();
+
+	bool addInput(const QString& name);
+	bool addColumn(const QString& name, const QStringList& dependencies, const Formula& formula);
+
+	// Returns how many cached columns were invalidated; identical values invalidate nothing
+	int setInput(const QString& name, const QVector<double>& values);
+	int setParameter(const QString& name, double value) { return setInput(name, QVector<double>(1, value)); }
+
+	// Evaluates on demand; empty for unknown names
+	const QVector<double>& column(const QString& name);
+	double scalar(const QString& name); // First value of a column, NaN when empty
+
+	bool contains(const QString& name) const { return m_index.contains(name); }
+	bool isCached(const QString& name) const;
+	QStringList columnNames() const;
+	int evaluationCount() const { return m_evaluations; }
+	QString getLastError() const { return m_lastError; }
+
+	// Computed columns of the 12-column template, from the inputs "puffs",
+	// "beforeWeight", "afterWeight" (g) and the parameter "power" (W):
+	// tpm (mg/puff), tpmPowerDensity (mg/puff/W), tpmVariation (% from the
+	// sample mean, tpmMean) and oilConsumed (g, running total)
+	void defineTemplateColumns();
+
+private:
+	struct Node
+	{
+		QString name;
+		bool isInput;
+		QVector<int> dependencies;
+		QVector<int> dependents; // Direct only
+		Formula formula;
+		QVector<double> values;
+		bool valid;
+	};
+
+	QVector<Node> m_nodes; // Declaration order is a topological order
+	QHash<QString, int> m_index;
+	int m_evaluations;
+	QString m_lastError;
+
+	void evaluate(int node);
+	int invalidateDependents(int node);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // DERIVEDCOLUMNS_H
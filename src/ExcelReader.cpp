@@ -1,12 +1,20 @@
 #include "ExcelReader.h"
-#include "xlsxdocument.h"
-#include "xlsxworksheet.h"
+#include "XlsxSheet.h"
+#include "SheetCellTokenizer.h"
+#include "SheetIngestPipeline.h"
+#include "MemoryAccounting.h"
 #include <QDebug>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QAtomicInt>
+#include <QRandomGenerator>
+#include <QtMath>
 
 ExcelReader::ExcelReader()
-	: m_document(nullptr)
-	, m_worksheet(nullptr)
+	: m_worksheet(nullptr)
+	, m_rowLimit(0)
+	, m_storageGeneration(0)
 {
 	debugPrint("ExcelReader constructor");
 }
@@ -45,60 +53,148 @@ bool ExcelReader::loadFile(const QString& filePath)
 		return false;
 	}
 
-	// Create QXlsx Document
-	QXlsx::Document* doc = new QXlsx::Document(filePath);
-	if (!doc)
+	// Map the package and read the sheet list, sheets are only parsed once they are selected
+	m_workbook = Workbook::open(filePath, m_rowLimit, &m_lastError);
+	if (!m_workbook)
 	{
-		m_lastError = "Failed to create Excel document object";
 		debugPrint("Error: " + m_lastError);
 		return false;
 	}
 
-	m_document = doc;
 	m_filePath = filePath;
 
 	debugPrint("File loaded successfully");
 	debugPrint("Available sheets: " + getSheetNames().join(","));
 
-	// Auto-select first sheet
-	QStringList sheets = getSheetNames();
-	if (!sheets.isEmpty())
+	return true;
+}
+
+void ExcelReader::closeFile()
+{
+    debugPrint("Closing file");
+
+	// Handles opened on the workbook keep it alive on their own
+	m_sheet.clear();
+	m_workbook.clear();
+	m_worksheet = nullptr;
+	m_sheetUse.clear();
+	m_storageGeneration++;
+
+    m_filePath.clear();
+	m_currentSheet.clear();
+}
+
+bool ExcelReader::reloadChangedParts(ReloadResult* result)
+{
+	result->structureChanged = false;
+	result->changedSheets.clear();
+	result->changedSamples.clear();
+	result->partialError.clear();
+
+	if (!m_workbook)
+	{
+		m_lastError = "No document loaded";
+		return false;
+	}
+
+	Workbook::ReopenResult reopened = m_workbook->reopen();
+	if (reopened.unchanged)
+	{
+		debugPrint("File changed on disk but no parts differ");
+		return true;
+	}
+	if (reopened.structureChanged)
+	{
+		result->structureChanged = true;
+		debugPrint("Workbook structure changed, full reload required");
+		return true;
+	}
+	if (!reopened.workbook)
+	{
+		m_lastError = "Failed to reopen Excel package: " + reopened.error;
+		debugPrint("ERROR: " + m_lastError);
+		return false;
+	}
+
+	// Unchanged sheets were carried over, so only re-parsed ones invalidate views
+	QSharedPointer<const SheetData> previous = m_sheet;
+	m_workbook = reopened.workbook;
+	result->changedSheets = reopened.changedSheets;
+
+	if (!m_currentSheet.isEmpty())
+	{
+		m_sheet = m_workbook->parsedSheet(m_currentSheet);
+		m_worksheet = m_sheet ? &m_sheet->cells : nullptr;
+
+		if (previous && m_sheet && m_sheet != previous)
+		{
+			result->changedSamples = changedSampleBlocks(&previous->cells, m_worksheet);
+		}
+	}
+
+	// Views of the current sheet point into its cells, other sheets have no views here
+	if (m_sheet != previous)
 	{
-		selectSheet(sheets.first());
+		m_storageGeneration++;
 	}
 
+	debugPrint("Re-ingested " + QString::number(result->changedSheets.size()) + " sheets, " +
+		QString::number(result->changedSamples.size()) + " samples changed in the current sheet");
+
+	// The workbook was replaced all the same: the old cells of that sheet were kept
+	// and its part is retried on the next reload
+	if (!reopened.error.isEmpty())
+	{
+		result->partialError = reopened.error;
+		m_lastError = reopened.error;
+		debugPrint("ERROR: " + m_lastError);
+	}
 	return true;
 }
 
-void ExcelReader::closeFile()
+QVector<int> ExcelReader::changedSampleBlocks(const XlsxSheet* before, const XlsxSheet* after)
 {
-    debugPrint("Closing file");
+	const int COLUMNS_PER_SAMPLE = 12;
 
-	if (m_document)
+	QVector<int> changed;
+	int sampleCount = qMax(before->columnCount(), after->columnCount()) / COLUMNS_PER_SAMPLE;
+	int rowCount = qMax(before->rowCount(), after->rowCount());
+
+	for (int sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++)
 	{
-        QXlsx::Document* doc = static_cast<QXlsx::Document*>(m_document);
-		delete doc;
-		m_document = nullptr;
+		int firstCol = sampleIndex * COLUMNS_PER_SAMPLE;
+		bool differs = false;
+
+		for (int row = 0; row < rowCount && !differs; row++)
+		{
+			for (int col = firstCol; col < firstCol + COLUMNS_PER_SAMPLE; col++)
+			{
+				if (before->value(row, col) != after->value(row, col))
+				{
+					differs = true;
+					break;
+				}
+			}
+		}
+
+		if (differs)
+		{
+			changed.append(sampleIndex);
+		}
 	}
 
-	m_worksheet = nullptr;
-    m_filePath.clear();
-	m_currentSheet.clear();
+	return changed;
 }
 
 QStringList ExcelReader::getSheetNames() const
 {
-	QStringList sheetNames;
-
-	if (!m_document)
+	if (!m_workbook)
 	{
 		debugPrint("WARNING: No document loaded, cannot get sheet names");
-		return sheetNames;
+		return QStringList();
 	}
 
-	QXlsx::Document* doc = static_cast<QXlsx::Document*>(m_document);
-	sheetNames = doc->sheetNames();
-
+	QStringList sheetNames = m_workbook->sheetNames();
 	debugPrint("Found " + QString::number(sheetNames.size()) + " sheets");
 	return sheetNames;
 }
@@ -107,33 +203,40 @@ bool ExcelReader::selectSheet(const QString& sheetName)
 {
 	debugPrint("Selecting sheet: " + sheetName);
 
-	if (!m_document)
+	if (!m_workbook)
 	{
 		m_lastError = "No document loaded";
 		debugPrint("ERROR: " + m_lastError);
 		return false;
 	}
 
-	QXlsx::Document* doc = static_cast<QXlsx::Document*>(m_document);
-
 	// Verify sheet exists
-	if (!doc->sheetNames().contains(sheetName))
+	if (!m_workbook->hasSheet(sheetName))
 	{
 		m_lastError = "Sheet not found: " + sheetName;
 		debugPrint("ERROR: " + m_lastError);
 		return false;
 	}
 
-	// Select the sheet
-	if (!doc->selectSheet(sheetName))
+	// Parsed the first time it is selected, or taken from the workbook's cache
+	QSharedPointer<const SheetData> sheet = m_workbook->sheet(sheetName, &m_lastError);
+	if (!sheet)
 	{
-		m_lastError = "Failed to select sheet: " + sheetName;
 		debugPrint("ERROR: " + m_lastError);
 		return false;
 	}
 
+	// Views of the previous sheet no longer keep its cells alive, a release could free them
+	if (sheet != m_sheet)
+	{
+		m_storageGeneration++;
+	}
+
 	m_currentSheet = sheetName;
-	m_worksheet = doc->currentWorksheet();
+	m_sheet = sheet;
+	m_worksheet = &sheet->cells;
+	m_sheetUse.removeAll(sheetName);
+	m_sheetUse.append(sheetName);
 
 	debugPrint("Sheet selected successfully");
 	debugPrint("Sample count: " + QString::number(getSampleCount()));
@@ -141,6 +244,16 @@ bool ExcelReader::selectSheet(const QString& sheetName)
 	return true;
 }
 
+SheetHandle ExcelReader::openSheet(const QString& sheetName) const
+{
+	return SheetHandle(m_workbook, sheetName);
+}
+
+QString ExcelReader::getLastIngestReport() const
+{
+	return m_sheet ? m_sheet->ingestReport : QString();
+}
+
 QVariant ExcelReader::getCellValue(int row, int col) const
 {
 	if (!m_worksheet)
@@ -148,12 +261,7 @@ QVariant ExcelReader::getCellValue(int row, int col) const
 		return QVariant();
 	}
 
-	QXlsx::Worksheet* ws = static_cast<QXlsx::Worksheet*>(m_worksheet);
-
-	// Note: QXlsx uses 1-based idnexing, so add 1 to row and col
-	QVariant value = ws->read(row + 1, col + 1);
-
-	return value;
+	return m_worksheet->value(row, col);
 }
 
 QString ExcelReader::getCellString(int row, int col) const
@@ -170,17 +278,13 @@ QString ExcelReader::getCellString(int row, int col) const
 
 double ExcelReader::getCellDouble(int row, int col) const
 {
-	QVariant value = getCellValue(row, col);
-
-	if (value.isNull())
+	if (!m_worksheet)
 	{
 		return 0.0;
 	}
 
-	bool ok = false;
-	double result = value.toDouble(&ok);
-
-	return ok ? result : 0.0;
+	double result = m_worksheet->number(row, col);
+	return qIsNaN(result) ? 0.0 : result;
 }
 
 bool ExcelReader::isDeprecatedUserTestSimulation() const
@@ -242,22 +346,11 @@ QString ExcelReader::detectTemplateVersion() const
         return "unknown";
 	}
 
-	// Check for new template indicators in sheet names
-    QStringList sheets = getSheetNames();
-	QStringList newTemplateIndicators = {
-		"Long Puff lifetime Test",
-		"Rapid Puff Lifetime Test",
-		"Temperature Cycling Test #1",
-		"Temperature Cycling Teset #2"
-	};
-
-	for (const QString& indicator : newTemplateIndicators)
+	// The workbook tells the templates apart by their sheet names
+	if (m_workbook->isNewTemplate())
 	{
-		if (sheets.contains(indicator, Qt::CaseInsensitive))
-		{
-			debugPrint("Detected new template (December 2025");
-			return "new";
-		}
+		debugPrint("Detected new template (December 2025");
+		return "new";
 	}
 
 	// if we get here, it's likely the old template (Jan 2025)
@@ -276,11 +369,8 @@ int ExcelReader::countSamples() const
 	// Always use 12 columns per sample
 	const int COLUMNS_PER_SAMPLE = 12;
 
-	QXlsx::Worksheet* ws = static_cast<QXlsx::Worksheet*>(m_worksheet);
-
 	// Get the used range to determine the column count
-	QXlsx::CellRange range = ws->dimension();
-	int totalColumns = range.columnCount();
+	int totalColumns = m_worksheet->columnCount();
 
 	// calculate number of samples
 	int sampleCount = totalColumns / COLUMNS_PER_SAMPLE;
@@ -297,240 +387,534 @@ int ExcelReader::getSampleCount() const
 	return countSamples();
 }
 
-ExcelReader::SampleMetadata ExcelReader::extractMetadata(int sampleIndex) const
+QStringList ExcelReader::getColumnHeaders() const
 {
-	SampleMetadata metadata;
+	QStringList headers;
 
 	if (!m_worksheet)
 	{
-		return metadata;
+		return headers;
 	}
 
-	// Always use 12 columns per sample
+	// Always 12 col per sample
 	const int COLUMNS_PER_SAMPLE = 12;
-	int colOffset = sampleIndex * COLUMNS_PER_SAMPLE;
 
-	debugPrint("Extracting metadata for sample " + QString::number(sampleIndex + 1) +
-		" at column offset " + QString::number(colOffset));
+	// row 4 contains column headers
+	for (int col = 0; col < COLUMNS_PER_SAMPLE; col++)
+	{
+		QString header = getCellString(3, col);
+		headers.append(header);
+	}
+
+	debugPrint("Extracted " + QString::number(headers.size()) + " column headers: " + headers.join(", "));
 
-	// Detect template version
-	QString templateVersion = detectTemplateVersion();
-	debugPrint("Using template version: " + templateVersion);
+    return headers;
+}
 
-	if (templateVersion == "new")
+ExcelReader::SampleMetadata ExcelReader::getSampleMetadata(int sampleIndex) const
+{
+	if (sampleIndex < 0 || sampleIndex >= getSampleCount())
 	{
-		// NEW TEMPLATE (December 2025) structure
-		// Row 1 (index 0): Test name (col A), Date (col C), Sample ID (col E), Heating Technology (col F)
-		metadata.testName = getCellString(0, colOffset + 0);  // Column A + offset
-		metadata.date = getCellString(0, colOffset + 2);      // Column C + offset
-		metadata.sampleID = getCellString(0, colOffset + 4);  // Column E + offset
-		metadata.heatingTechnology = getCellString(0, colOffset + 5); // Column F + offset
+		debugPrint("ERROR: Invalid sample index: " + QString::number(sampleIndex));
+		return SampleMetadata();
+	}
 
-		// Row 2 (index 1): Media (col A), Resistance (col C), Power (col E)
-		metadata.media = getCellString(1, colOffset + 0);      // Column A + offset
-		metadata.resistance = getCellDouble(1, colOffset + 2); // Column C + offset
-		// Power will be calculated below or read from E2
+	// Extracted once per sheet when it was parsed
+	return m_sheet->metadata.at(sampleIndex);
+}
 
-		// Row 3 (index 2): Viscosity (col A), Tester (col C), Voltage (col E), Puffing Regime (col G), Initial Oil Mass (col H)
-		metadata.viscosity = getCellDouble(2, colOffset + 0);         // Column A + offset
-		metadata.tester = getCellString(2, colOffset + 2);            // Column C + offset
-		metadata.voltage = getCellDouble(2, colOffset + 4);           // Column E + offset
-		metadata.puffingRegime = getCellString(2, colOffset + 6);     // Column G + offset
-		metadata.initialOilMass = getCellDouble(2, colOffset + 7);    // Column H + offset
-	}
-	else
-	{
-		// OLD TEMPLATE (January 2025) structure
-		// Row 1 (index 0): Test name (col A), Date (col D), Sample ID (col G)
-		metadata.testName = getCellString(0, colOffset + 0);   // Column A + offset
-		metadata.date = getCellString(0, colOffset + 3);       // Column D + offset (Date value)
-		metadata.sampleID = getCellString(0, colOffset + 6);   // Column G + offset (Sample ID value)
+ExcelReader::SampleView::SampleView()
+	: m_reader(nullptr)
+	, m_sheet(nullptr)
+	, m_metadata(nullptr)
+	, m_generation(0)
+	, m_sampleIndex(-1)
+	, m_startColumn(0)
+	, m_rowCount(0)
+{
+}
 
-		// No heating technology in old template
-		metadata.heatingTechnology = "";
+bool ExcelReader::SampleView::isValid() const
+{
+	// Views from a handle have no reader, their handle keeps the storage alive
+	return m_sheet && (!m_reader || m_generation == m_reader->m_storageGeneration);
+}
 
-		// Row 2 (index 1): Media value (col B), Resistance value (col D), Puffing Regime value (col I)
-		metadata.media = getCellString(1, colOffset + 1);        // Column B + offset (Media value)
-		metadata.resistance = getCellDouble(1, colOffset + 3);   // Column D + offset (Resistance value)
-		metadata.puffingRegime = getCellString(1, colOffset + 8);// Column I + offset (Puffing Regime value)
+const ExcelReader::SampleMetadata& ExcelReader::SampleView::metadata() const
+{
+	static const SampleMetadata empty = SampleMetadata();
+	return m_metadata ? *m_metadata : empty;
+}
 
-		// Row 3 (index 2): Viscosity value (col B), Tester value (col D), Voltage value (col G), Initial Oil Mass (col M or nearby)
-		metadata.viscosity = getCellDouble(2, colOffset + 1);    // Column B + offset (Viscosity value)
-		metadata.tester = getCellString(2, colOffset + 3);       // Column D + offset (Tester value)
-		metadata.voltage = getCellDouble(2, colOffset + 6);      // Column G + offset (Voltage value)
-		metadata.initialOilMass = getCellDouble(2, colOffset + 12); // Column M + offset (Initial Oil Mass value - approximate position)
+ExcelReader::ColumnSpan ExcelReader::SampleView::column(int col) const
+{
+	ColumnSpan span = { XlsxSheet::EmptyColumn, nullptr, m_rowCount, false };
+
+	const XlsxSheet::Column* column = (m_sheet && col >= 0 && col < columnCount()) ? m_sheet->column(m_startColumn + col) : nullptr;
+	if (!column)
+	{
+		return span;
 	}
 
-	// Calculate power: P = V^2 / (R + Roffset)
-	// For old template, Roffset is always 0 (no heating technology field)
-	double rOffset = 0.0;
+	// Sample rows start at the sheet's first data row, so the column buffer lines up with them
+	span.type = column->type;
+	span.hasStrays = !column->strays.isEmpty();
+	if (column->type == XlsxSheet::NumericColumn || column->type == XlsxSheet::FlagColumn)
+	{
+		span.numbers = column->data();
+	}
+	return span;
+}
+
+XlsxSheet::ColumnType ExcelReader::SampleView::columnType(int col) const
+{
+	return column(col).type;
+}
 
-	if (!metadata.heatingTechnology.isEmpty())
+double ExcelReader::SampleView::number(int row, int col) const
+{
+	if (!m_sheet || row < 0 || row >= m_rowCount || col < 0 || col >= columnCount())
 	{
-		QString tech = metadata.heatingTechnology.trimmed().toLower();
-		if (tech.contains("t51"))
-		{
-			rOffset = 0.25;
-			debugPrint("Heating technology T51 detected, using Roffset = 0.25");
-		}
-		else if (tech.contains("t58g") || tech.contains("ccell3.0") || tech.contains("ccell 3.0"))
-		{
-			rOffset = 0.78;
-			debugPrint("Heating technology T58G/CCELL3.0 detected, using Roffset = 0.78");
-		}
+		return qQNaN();
 	}
-	else
+
+	// Data starts at row 5 (index 4)
+	return m_sheet->number(4 + row, m_startColumn + col);
+}
+
+QVariant ExcelReader::SampleView::value(int row, int col) const
+{
+	if (!m_sheet || row < 0 || row >= m_rowCount || col < 0 || col >= columnCount())
 	{
-		debugPrint("No heating technology (old template), using Roffset = 0.0");
+		return QVariant();
 	}
 
-	// Calculate power only if we have valid voltage and resistance
-	if (metadata.voltage > 0 && metadata.resistance > 0)
+	return m_sheet->value(4 + row, m_startColumn + col);
+}
+
+ExcelReader::SampleData ExcelReader::SampleView::toOwned() const
+{
+	SampleData sample;
+	sample.startColumn = m_startColumn;
+	sample.metadata = metadata();
+	sample.dataRows.reserve(m_rowCount);
+
+	for (int row = 0; row < m_rowCount; row++)
 	{
-		double denominator = metadata.resistance + rOffset;
-		if (denominator > 0)
-		{
-			metadata.power = (metadata.voltage * metadata.voltage) / denominator;
-			debugPrint("Calculated power: " + QString::number(metadata.power, 'f', 4) +
-				" W (V=" + QString::number(metadata.voltage) +
-				", R=" + QString::number(metadata.resistance) +
-				", Roffset=" + QString::number(rOffset) + ")");
-		}
-		else
+		QVector<QVariant> rowData(columnCount());
+		for (int col = 0; col < columnCount(); col++)
 		{
-			metadata.power = 0.0;
-			debugPrint("Cannot calculate power: denominator is zero");
+			rowData[col] = value(row, col);
 		}
+		sample.dataRows.append(rowData);
 	}
-	else
+
+	return sample;
+}
+
+ExcelReader::SampleView ExcelReader::makeView(const SheetData* sheet, int sampleIndex, const ExcelReader* reader, quint64 generation)
+{
+	SampleView view;
+	view.m_reader = reader;
+	view.m_sheet = &sheet->cells;
+	view.m_metadata = &sheet->metadata.at(sampleIndex);
+	view.m_generation = generation;
+	view.m_sampleIndex = sampleIndex;
+	view.m_startColumn = sampleIndex * view.columnCount();
+	view.m_rowCount = sheet->rowCounts.at(sampleIndex);
+	return view;
+}
+
+QVector<ExcelReader::SampleView> ExcelReader::sampleViews()
+{
+	QVector<SampleView> views;
+
+	if (!m_sheet)
 	{
-		metadata.power = 0.0;
-		debugPrint("Cannot calculate power: voltage or resistance is zero");
+		debugPrint("ERROR: No worksheet loaded");
+		return views;
 	}
 
-	debugPrint("Metadata extracted - Sample ID: " + metadata.sampleID +
-		", Tester: " + metadata.tester +
-		", Voltage: " + QString::number(metadata.voltage) +
-		", Power: " + QString::number(metadata.power));
+	views.reserve(m_sheet->metadata.size());
+	for (int i = 0; i < m_sheet->metadata.size(); i++)
+	{
+		views.append(makeView(m_sheet.data(), i, this, m_storageGeneration));
+	}
 
-	return metadata;
+	return views;
 }
 
-QVector<QVariant> ExcelReader::extractRow(int rowIndex, int startCol, int numCols) const
+ExcelReader::SampleView ExcelReader::sampleView(int sampleIndex)
 {
-    QVector<QVariant> rowData;
-
-	if (!m_worksheet)
+	if (!m_sheet)
 	{
-        return rowData;
+		debugPrint("ERROR: No worksheet loaded");
+		return SampleView();
 	}
 
-	// Extract specified number of columns
-	for (int col = 0; col < numCols; col++)
+	if (sampleIndex < 0 || sampleIndex >= m_sheet->metadata.size())
 	{
-		QVariant value = getCellValue(rowIndex, startCol + col);
-		rowData.append(value);
+		debugPrint("ERROR: Invalid sample index: " + QString::number(sampleIndex));
+		return SampleView();
 	}
 
-	return rowData;
+	return makeView(m_sheet.data(), sampleIndex, this, m_storageGeneration);
 }
 
-QStringList ExcelReader::getColumnHeaders() const
+ExcelReader::SampleData ExcelReader::getSample(int sampleIndex)
 {
-	QStringList headers;
+	debugPrint("Extracting sample" + QString::number(sampleIndex + 1));
+	return sampleView(sampleIndex).toOwned();
+}
 
-	if (!m_worksheet)
+void ExcelReader::accountMemory(MemoryAccounting* accounting) const
+{
+	if (m_workbook)
 	{
-		return headers;
+		m_workbook->accountMemory(accounting);
 	}
+}
 
-	// Always 12 col per sample
-	const int COLUMNS_PER_SAMPLE = 12;
+QStringList ExcelReader::parsedSheetsByAge() const
+{
+	if (!m_workbook)
+	{
+		return QStringList();
+	}
 
-	// row 4 contains column headers
-	for (int col = 0; col < COLUMNS_PER_SAMPLE; col++)
+	// Parsed in the background but never looked at, in workbook order
+	QStringList parsed = m_workbook->parsedSheetNames();
+	QStringList sheets;
+	for (const QString& sheetName : m_workbook->sheetNames())
 	{
-		QString header = getCellString(3, col);
-		headers.append(header);
+		if (parsed.contains(sheetName) && !m_sheetUse.contains(sheetName))
+		{
+			sheets.append(sheetName);
+		}
 	}
+	sheets.append(m_sheetUse);
+	return sheets;
+}
 
-	debugPrint("Extracted " + QString::number(headers.size()) + " column headers: " + headers.join(", "));
+qint64 ExcelReader::releaseSheet(const QString& sheetName)
+{
+	if (!m_workbook || sheetName == m_currentSheet)
+	{
+		return 0;
+	}
 
-    return headers;
+	qint64 bytes = m_workbook->releaseSheet(sheetName);
+	m_sheetUse.removeAll(sheetName);
+
+	debugPrint("Released sheet " + sheetName + " (" + MemoryAccounting::formatBytes(bytes) + ")");
+	return bytes;
 }
 
-ExcelReader::SampleData ExcelReader::getSample(int sampleIndex)
+QString ExcelReader::benchmarkSheetParse(const QString& sheetName)
 {
-	SampleData sample;
+	debugPrint("Benchmarking sheet parse: " + sheetName);
 
-	if (!m_worksheet)
+	if (!m_workbook || !m_workbook->hasSheet(sheetName))
 	{
-		debugPrint("ERROR: No worksheet loaded");
-		return sample;
+		m_lastError = "Sheet not found: " + sheetName;
+		return QString();
 	}
 
-	if (sampleIndex < 0 || sampleIndex >= getSampleCount())
+	if (!m_workbook->package())
 	{
-		debugPrint("ERROR: Invalid sample index: " + QString::number(sampleIndex));
-		return sample;
+		m_lastError = "The parser benchmark compares xlsx worksheet parsers, " + QFileInfo(m_filePath).fileName() + " is not an xlsx package";
+		return QString();
 	}
 
-	debugPrint("Extracting sample" + QString::number(sampleIndex + 1));
+	QString partPath = m_workbook->partPath(sheetName);
+	const QStringList& sharedStrings = m_workbook->sharedStrings();
+	const QSet<int>& dateStyles = m_workbook->dateStyles();
+	bool date1904 = m_workbook->date1904();
+	QByteArray xml = m_workbook->readPart(partPath);
+	if (xml.isEmpty())
+	{
+		m_lastError = "Worksheet part not found: " + partPath;
+		return QString();
+	}
 
-	const int COLUMNS_PER_SAMPLE = 12;
-	int colOffset = sampleIndex * COLUMNS_PER_SAMPLE;
+	// Best of several runs for each path
+	const int RUNS = 3;
+	qint64 tokenizerNs = -1;
+	qint64 xmlReaderNs = -1;
+	qint64 pipelineNs = -1;
+	XlsxSheet tokenized;
+	XlsxSheet reference;
+	XlsxSheet pipelined;
+	SheetIngestPipeline pipeline;
+	QElapsedTimer timer;
 
-	sample.startColumn = colOffset;
-	sample.metadata = extractMetadata(sampleIndex);
+	for (int run = 0; run < RUNS; run++)
+	{
+		timer.start();
+		tokenized.parse(xml, sharedStrings, dateStyles, date1904);
+		qint64 elapsed = timer.nsecsElapsed();
+		tokenizerNs = (tokenizerNs < 0) ? elapsed : qMin(tokenizerNs, elapsed);
 
-	// Extract data rows from row 5 after the header row, continue until rows are empty
-	QXlsx::Worksheet* ws = static_cast<QXlsx::Worksheet*>(m_worksheet);
-	QXlsx::CellRange range = ws->dimension();
-	int maxRows = range.rowCount();
+		timer.start();
+		reference.parseWithXmlReader(xml, sharedStrings, dateStyles, date1904);
+		elapsed = timer.nsecsElapsed();
+		xmlReaderNs = (xmlReaderNs < 0) ? elapsed : qMin(xmlReaderNs, elapsed);
 
-	int dataRowCount = 0;
-	for (int row = 4; row < maxRows; row++)
-	{
-		QVector<QVariant> rowData = extractRow(row, colOffset, COLUMNS_PER_SAMPLE);
+		// The pipeline inflates as it goes, so its time includes decompression
+		timer.start();
+		pipeline.run(m_workbook->package(), partPath, &pipelined, sharedStrings, dateStyles, date1904);
+		elapsed = timer.nsecsElapsed();
+		pipelineNs = (pipelineNs < 0) ? elapsed : qMin(pipelineNs, elapsed);
+	}
 
-		// check if row is empty (all values are null or empty)
-		bool isEmpty = true;
-		for (const QVariant& val : rowData)
+	// Both paths must produce the same grid
+	int mismatches = 0;
+	int rows = qMax(qMax(tokenized.rowCount(), reference.rowCount()), pipelined.rowCount());
+	int cols = qMax(qMax(tokenized.columnCount(), reference.columnCount()), pipelined.columnCount());
+	for (int row = 0; row < rows; row++)
+	{
+		for (int col = 0; col < cols; col++)
 		{
-            if (!val.isNull() && !val.toString().trimmed().isEmpty())
+			if (tokenized.value(row, col) != reference.value(row, col) ||
+				pipelined.value(row, col) != reference.value(row, col))
 			{
-				isEmpty = false;
-				break;
-            }
+				mismatches++;
+			}
+		}
+	}
+
+	// Typed column build on top of the pipeline output, as parseSheet() does it
+	timer.start();
+	pipelined.buildColumns(4);
+	qint64 columnsNs = timer.nsecsElapsed();
+
+	QMap<QString, int> columnTypes;
+	int strayCells = 0;
+	for (int col = 0; col < pipelined.columnCount(); col++)
+	{
+		const XlsxSheet::Column* column = pipelined.column(col);
+		columnTypes[XlsxSheet::columnTypeName(column->type)]++;
+		strayCells += column->strays.size();
+	}
+
+	QStringList schema;
+	for (QMap<QString, int>::const_iterator it = columnTypes.constBegin(); it != columnTypes.constEnd(); ++it)
+	{
+		schema.append(QString::number(it.value()) + " " + it.key());
+	}
+
+	// Sample extraction on the selected sheet: owning copies (the old getAllSamples path) against views
+	QString sampleReport;
+	if (sheetName == m_currentSheet && m_worksheet)
+	{
+		timer.start();
+		QVector<SampleView> views = sampleViews();
+		qint64 viewNs = timer.nsecsElapsed();
+
+		// One buffer per copied row plus the row list of each sample
+		qint64 copiedBuffers = 0;
+		timer.start();
+		for (const SampleView& view : views)
+		{
+			SampleData owned = view.toOwned();
+			copiedBuffers += owned.dataRows.size() + 1;
 		}
+		qint64 copyNs = timer.nsecsElapsed();
+
+		sampleReport = "Samples: " + QString::number(views.size()) + "\n" +
+			"  Owning copies: " + QString::number(copyNs / 1e6, 'f', 2) + " ms, " + QString::number(copiedBuffers) + " row buffers allocated\n" +
+			"  Views: " + QString::number(viewNs / 1e6, 'f', 3) + " ms, 1 buffer (the view list)\n\n";
+	}
+
+	double megabytes = xml.size() / (1024.0 * 1024.0);
+	double tokenizerRate = megabytes / qMax(tokenizerNs, qint64(1)) * 1e9;
+	double xmlReaderRate = megabytes / qMax(xmlReaderNs, qint64(1)) * 1e9;
+
+	QString report = "Sheet: " + sheetName + "\n" +
+		"XML size: " + QString::number(megabytes, 'f', 2) + " MB\n" +
+		"Tokenizer (" + QString(SheetCellTokenizer::simdLevel()) + "): " +
+		QString::number(tokenizerNs / 1e6, 'f', 2) + " ms, " + QString::number(tokenizerRate, 'f', 1) + " MB/s\n" +
+		"XML reader: " + QString::number(xmlReaderNs / 1e6, 'f', 2) + " ms, " + QString::number(xmlReaderRate, 'f', 1) + " MB/s\n" +
+		"Speedup: " + QString::number(double(xmlReaderNs) / qMax(tokenizerNs, qint64(1)), 'f', 1) + "x\n" +
+		"Pipeline (inflate + tokenize + convert): " + QString::number(pipelineNs / 1e6, 'f', 2) + " ms\n" +
+		"Mismatched cells: " + QString::number(mismatches) + "\n" +
+		"Typed columns: " + QString::number(columnsNs / 1e6, 'f', 2) + " ms (" + schema.join(", ") + ", " +
+		QString::number(strayCells) + " stray cells)\n\n" +
+		sampleReport +
+		pipeline.statsReport();
+
+	debugPrint(report);
+	return report;
+}
 
-		if (isEmpty)
+// Order-independent fingerprint of everything a reader sees of one sample
+static double sampleChecksum(const ExcelReader::SampleView& sample)
+{
+	double sum = sample.rowCount() + sample.metadata().sampleID.size() + sample.metadata().power;
+	for (int col = 0; col < sample.columnCount(); col++)
+	{
+		ExcelReader::ColumnSpan span = sample.column(col);
+		for (int row = 0; row < span.size; row++)
 		{
-			// stop at first empty row
-			break;
+			double value = span.numbers ? span.numbers[row] : qQNaN();
+			sum += qIsNaN(value) ? sample.value(row, col).toString().size() : value;
 		}
+	}
+	return sum;
+}
 
-		sample.dataRows.append(rowData);
-		dataRowCount++;
+QString ExcelReader::stressTestConcurrentReads(int threadCount, int readsPerThread)
+{
+	debugPrint("Concurrent read stress test: " + QString::number(threadCount) + " threads");
+
+	if (!m_workbook)
+	{
+		m_lastError = "No document loaded";
+		return QString();
 	}
 
-	debugPrint("Extracted " + QString::number(dataRowCount) + " data rows for sample " + QString::number(sampleIndex + 1));
+	// Expected fingerprints per sheet and sample, read single-threaded through this reader's workbook
+	QStringList sheets = m_workbook->sheetNames();
+	QVector<QVector<double>> expected(sheets.size());
+	for (int s = 0; s < sheets.size(); s++)
+	{
+		SheetHandle handle(m_workbook, sheets.at(s));
+		for (const SampleView& sample : handle.sampleViews())
+		{
+			expected[s].append(sampleChecksum(sample));
+		}
+	}
 
-	return sample;
+	// A freshly opened copy, so the threads also race to parse each sheet first
+	QSharedPointer<const Workbook> workbook = Workbook::open(m_filePath, m_rowLimit, &m_lastError);
+	if (!workbook)
+	{
+		return QString();
+	}
+
+	QAtomicInt reads(0);
+	QAtomicInt mismatches(0);
+	QAtomicInt failures(0);
+	QVector<QThread*> threads;
+
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.append(QThread::create([&, t]()
+		{
+			QRandomGenerator random(quint32(t + 1));
+			QHash<QString, SheetHandle> handles; // This thread's own handles
+			for (int i = 0; i < readsPerThread; i++)
+			{
+				int s = int(random.bounded(sheets.size()));
+				if (expected.at(s).isEmpty())
+				{
+					continue;
+				}
+
+				// Replace a handle now and then so that opening races with reading too
+				const QString& name = sheets.at(s);
+				if (!handles.contains(name) || random.bounded(16) == 0)
+				{
+					handles.insert(name, SheetHandle(workbook, name));
+				}
+
+				const SheetHandle& handle = handles[name];
+				if (!handle.isValid())
+				{
+					failures.fetchAndAddRelaxed(1);
+					continue;
+				}
+
+				int sample = int(random.bounded(expected.at(s).size()));
+				if (sampleChecksum(handle.sampleView(sample)) != expected.at(s).at(sample))
+				{
+					mismatches.fetchAndAddRelaxed(1);
+				}
+				reads.fetchAndAddRelaxed(1);
+			}
+		}));
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	for (QThread* thread : threads)
+	{
+		thread->start();
+	}
+	for (QThread* thread : threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+	qint64 elapsedNs = timer.nsecsElapsed();
+
+	QString report = "Workbook: " + QFileInfo(m_filePath).fileName() + "\n" +
+		"Threads: " + QString::number(threadCount) + ", sheets parsed concurrently: " +
+		QString::number(workbook->parsedSheetNames().size()) + "\n" +
+		"Sample reads: " + QString::number(reads.loadAcquire()) + " in " + QString::number(elapsedNs / 1e6, 'f', 1) + " ms (" +
+		QString::number(reads.loadAcquire() / qMax(elapsedNs / 1e9, 1e-9), 'f', 0) + " reads/s)\n" +
+		"Mismatched reads: " + QString::number(mismatches.loadAcquire()) + "\n" +
+		"Failed handles: " + QString::number(failures.loadAcquire());
+
+	debugPrint(report);
+	return report;
+}
+
+SheetHandle::SheetHandle()
+{
+}
+
+SheetHandle::SheetHandle(const QSharedPointer<const Workbook>& workbook, const QString& sheetName)
+	: m_workbook(workbook)
+	, m_sheetName(sheetName)
+{
+	if (!workbook)
+	{
+		m_lastError = "No document loaded";
+		return;
+	}
+
+	m_sheet = workbook->sheet(sheetName, &m_lastError);
 }
 
-QVector<ExcelReader::SampleData> ExcelReader::getAllSamples()
+int SheetHandle::sampleCount() const
 {
-	QVector<SampleData> samples;
+	return m_sheet ? m_sheet->metadata.size() : 0;
+}
 
-	int sampleCount = getSampleCount();
-	debugPrint("Extracting all " + QString::number(sampleCount) + " samples");
+ExcelReader::SampleView SheetHandle::sampleView(int sampleIndex) const
+{
+	if (!m_sheet || sampleIndex < 0 || sampleIndex >= m_sheet->metadata.size())
+	{
+		return ExcelReader::SampleView();
+	}
 
-	for (int i = 0; i < sampleCount; i++)
+	return ExcelReader::makeView(m_sheet.data(), sampleIndex, nullptr, 0);
+}
+
+QVector<ExcelReader::SampleView> SheetHandle::sampleViews() const
+{
+	QVector<ExcelReader::SampleView> views;
+	for (int i = 0; i < sampleCount(); i++)
 	{
-		SampleData sample = getSample(i);
-		samples.append(sample);
+		views.append(ExcelReader::makeView(m_sheet.data(), i, nullptr, 0));
 	}
+	return views;
+}
 
-	return samples;
+QStringList SheetHandle::columnHeaders() const
+{
+	QStringList headers;
+	if (!m_sheet)
+	{
+		return headers;
+	}
+
+	// row 4 contains column headers
+	for (int col = 0; col < 12; col++)
+	{
+		QVariant header = m_sheet->cells.value(3, col);
+		headers.append(header.isNull() ? QString() : header.toString().trimmed());
+	}
+	return headers;
 }
@@ -6,33 +6,91 @@
 #include <QVector>
 #include <QVariant>
 #include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QSharedPointer>
+#include "XlsxSheet.h"
+#include "Workbook.h"
 
+class MemoryAccounting;
+class SheetHandle;
+
+// Single-threaded front end over a shared Workbook: it keeps the "current"
+// sheet for the UI and handles reloads. Other threads read through their own
+// SheetHandle (openSheet()) instead of sharing a reader.
 class ExcelReader
 {
 public:
-	struct SampleMetadata
-	{
-		QString testName;
-		QString date;
-		QString sampleID;
-		QString media;
-		double resistance;
-		double voltage;
-		double power;
-		double viscosity;
-		QString tester;
-		QString puffingRegime;
-		double initialOilMass;
-		QString heatingTechnology;
-	};
+	typedef ::SampleMetadata SampleMetadata;
 
+	// Owning copy of one sample, for data that has to outlive the sheet. Move-only so
+	// ownership is handed over instead of the rows being copied on every assignment
 	struct SampleData
 	{
 		SampleMetadata metadata;
 		QVector<QVector<QVariant>> dataRows; // Row x Column Data
 		int startColumn; // Starting column index for this sample (0-based)
+
+		SampleData() : startColumn(0) {}
+		SampleData(SampleData&&) = default;
+		SampleData& operator=(SampleData&&) = default;
+		SampleData(const SampleData&) = delete;
+		SampleData& operator=(const SampleData&) = delete;
+	};
+
+	// One data column of a sample, pointing into the sheet's typed column storage
+	struct ColumnSpan
+	{
+		XlsxSheet::ColumnType type;
+		const double* numbers; // Numeric and flag columns, NaN where blank; nullptr for other types
+		int size;              // Data rows of the sample
+		bool hasStrays;        // Some cells do not fit the type, read those through SampleView::value()
 	};
 
+	// Non-owning view of one sample block: metadata and data rows are read from the
+	// parsed sheet. Views are cheap to copy. Views from the reader stay valid until
+	// its storage changes (another sheet selected, sheet re-ingested, file closed), which
+	// isValid() reports, and must not outlive the reader; views from a SheetHandle
+	// stay valid for as long as the handle lives
+	class SampleView
+	{
+	public:
+		SampleView();
+
+		bool isValid() const;
+		int sampleIndex() const { return m_sampleIndex; }
+		int startColumn() const { return m_startColumn; }
+		const SampleMetadata& metadata() const;
+
+		int rowCount() const { return m_rowCount; } // Data rows from row 5 up to the first empty row
+		int columnCount() const { return 12; }
+		ColumnSpan column(int col) const;
+		XlsxSheet::ColumnType columnType(int col) const;
+		double number(int row, int col) const; // NaN when blank or not a number
+		QVariant value(int row, int col) const; // Null outside the block
+
+		SampleData toOwned() const; // Deep copy
+
+	private:
+		friend class ExcelReader;
+		const ExcelReader* m_reader;
+		const XlsxSheet* m_sheet;
+		const SampleMetadata* m_metadata;
+		quint64 m_generation;
+		int m_sampleIndex;
+		int m_startColumn;
+		int m_rowCount;
+	};
+
+
+	// Outcome of re-reading a file that changed on disk
+	struct ReloadResult
+	{
+		bool structureChanged;       // Sheet list changed, the file has to be loaded again
+		QStringList changedSheets;   // Parsed sheets that were re-ingested
+		QVector<int> changedSamples; // Samples of the current sheet whose cells differ
+		QString partialError;        // Sheets that could not be re-read kept their old cells
+	};
 
 	ExcelReader();
 	~ExcelReader();
@@ -42,15 +100,29 @@ public:
 	void closeFile();
 	QString getFilePath() const { return m_filePath; }
 
+	// Only ingest the first rows of each sheet (0 = all), e.g. 3 for metadata-only scans
+	void setRowLimit(int rowLimit) { m_rowLimit = rowLimit; }
+
+	// Re-ingests only the worksheet parts whose zip CRC changed since they were loaded.
+	// False when nothing was replaced; true once the new workbook is in place, with
+	// partialError set when some sheets could not be re-read
+	bool reloadChangedParts(ReloadResult* result);
+
 	// Sheet operations
 	QStringList getSheetNames() const;
 	bool selectSheet(const QString& sheetName);
 	QString getCurrentSheet() const { return m_currentSheet; }
 
+	// Shared workbook behind the reader and independent, thread-safe handles onto its sheets
+	QSharedPointer<const Workbook> workbook() const { return m_workbook; }
+	SheetHandle openSheet(const QString& sheetName) const;
+
 	// Data extraction
 	int getSampleCount() const;
-	QVector<SampleData> getAllSamples();
-	SampleData getSample(int sampleIndex);
+	QVector<SampleView> sampleViews();     // All samples of the current sheet, no cell copies
+	SampleView sampleView(int sampleIndex);
+	SampleData getSample(int sampleIndex); // Owning copy
+	SampleMetadata getSampleMetadata(int sampleIndex) const; // Rows 1-3 only
 
 	// Column headers (row 4)
 	QStringList getColumnHeaders() const;
@@ -62,22 +134,77 @@ public:
 	// Error Handling
 	QString getLastError() const { return m_lastError; }
 
+	// Times the tokenizer cell ingest against the generic XML reader on one sheet
+	QString benchmarkSheetParse(const QString& sheetName);
+
+	// Per-stage utilization of the current sheet's ingest
+	QString getLastIngestReport() const;
+
+	// Memory accounting: the package index, the shared parts and every parsed sheet
+	void accountMemory(MemoryAccounting* accounting) const;
+
+	// Parsed sheets, those never selected (prefetched) first, then least recently selected first.
+	// A released sheet is parsed again when it is next selected; returns the estimated bytes
+	// freed (0 for the current sheet)
+	QStringList parsedSheetsByAge() const;
+	qint64 releaseSheet(const QString& sheetName);
+
+	// Reads random samples of every sheet from many threads through SheetHandles, each on a
+	// freshly opened copy of the workbook, and checks every read against the current reader
+	QString stressTestConcurrentReads(int threadCount = 8, int readsPerThread = 2000);
+
 private:
+	friend class SheetHandle;
+
 	QString m_filePath;
 	QString m_currentSheet;
 	QString m_lastError;
-	void* m_document; // Opaque pointer to QXlsx::Document
-	void* m_worksheet; // Opaque pointer to QXlsx::Worksheet
+	QSharedPointer<Workbook> m_workbook;
+	QSharedPointer<const SheetData> m_sheet; // Currently selected sheet
+	const XlsxSheet* m_worksheet;            // Cells of m_sheet
+	QStringList m_sheetUse;                  // Parsed sheet names, most recently selected last
+	int m_rowLimit;
+
+	// Changes only when the storage behind the current sheet's views is replaced or freed
+	quint64 m_storageGeneration;
 
 	// Helper functions
 	void debugPrint(const QString& message) const;
+	static QVector<int> changedSampleBlocks(const XlsxSheet* before, const XlsxSheet* after);
 	QVariant getCellValue(int row, int col) const;
 	QString getCellString(int row, int col) const;
 	double getCellDouble(int row, int col) const;
 
-	SampleMetadata extractMetadata(int sampleIndex) const;
-	QVector<QVariant> extractRow(int rowIndex, int startCol, int numCols) const;
+	static SampleView makeView(const SheetData* sheet, int sampleIndex, const ExcelReader* reader, quint64 generation);
 	int countSamples() const;
 };
 
+// Read-only access to one sheet of a shared Workbook. Handles are cheap to copy
+// and keep the workbook and the parsed sheet alive; nothing on the read path
+// takes a lock, so each thread can work through its own handle concurrently.
+class SheetHandle
+{
+public:
+	SheetHandle();
+	// Parses the sheet if no one has yet; check isValid() and getLastError()
+	SheetHandle(const QSharedPointer<const Workbook>& workbook, const QString& sheetName);
+
+	bool isValid() const { return !m_sheet.isNull(); }
+	QString sheetName() const { return m_sheetName; }
+	QString getLastError() const { return m_lastError; }
+	QSharedPointer<const Workbook> workbook() const { return m_workbook; }
+
+	int sampleCount() const;
+	ExcelReader::SampleView sampleView(int sampleIndex) const; // Valid while this handle lives
+	QVector<ExcelReader::SampleView> sampleViews() const;
+	const XlsxSheet* cells() const { return m_sheet ? &m_sheet->cells : nullptr; }
+	QStringList columnHeaders() const; // Row 4 of the first sample block
+
+private:
+	QSharedPointer<const Workbook> m_workbook;
+	QSharedPointer<const SheetData> m_sheet;
+	QString m_sheetName;
+	QString m_lastError;
+};
+
 #endif // EXCELREADER_H
\ No newline at end of file
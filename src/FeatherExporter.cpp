@@ -0,0 +1,369 @@
+#include "FeatherExporter.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QtMath>
+
+FeatherExporter::FeatherExporter()
+{
+}
+
+void FeatherExporter::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [FeatherExporter]:" << message;
+}
+
+QString FeatherExporter::fileNameFor(const QString& workbookPath, const QString& sheetName)
+{
+	// Sheet names may contain characters that are not allowed in file names
+	QString safeName;
+	for (int i = 0; i < sheetName.size(); i++)
+	{
+		QChar c = sheetName.at(i);
+		safeName.append(QString("\\/:*?\"<>|").contains(c) ? QChar('_') : c);
+	}
+	return QFileInfo(workbookPath).completeBaseName() + " - " + safeName + ".feather";
+}
+
+QVector<ArrowField> FeatherExporter::sheetFields(const SheetHandle& sheet)
+{
+	static const char* templateNames[] = {
+		"Puffs", "Before Weight", "After Weight", "Draw Pressure", "Resistance", "Smell",
+		"Clog", "Notes", "TPM (mg/puff)", "TPM Power Density", "Variation in TPM (%)", "Oil Consumed"
+	};
+
+	QVector<ArrowField> fields;
+	ArrowField sampleField;
+	sampleField.name = "Sample";
+	sampleField.type = ArrowField::Int32;
+	fields.append(sampleField);
+
+	QSet<QString> usedNames;
+	usedNames.insert(sampleField.name);
+	QStringList headers = sheet.columnHeaders();
+
+	for (int col = 0; col < 12; col++)
+	{
+		// Header from row 4, made unique
+		QString baseName = headers.value(col).trimmed();
+		if (baseName.isEmpty())
+		{
+			baseName = templateNames[col];
+		}
+		QString name = baseName;
+		for (int n = 2; usedNames.contains(name); n++)
+		{
+			name = baseName + " (" + QString::number(n) + ")";
+		}
+		usedNames.insert(name);
+
+		// One type for the column across all samples: any text makes it a string column,
+		// flags mixed with numbers are numbers
+		bool anyText = false;
+		bool anyNumber = false;
+		bool anyFlag = false;
+		for (int s = 0; s < sheet.sampleCount(); s++)
+		{
+			switch (sheet.sampleView(s).columnType(col))
+			{
+			case XlsxSheet::TextColumn:
+			case XlsxSheet::VariantColumn:
+				anyText = true;
+				break;
+			case XlsxSheet::NumericColumn:
+				anyNumber = true;
+				break;
+			case XlsxSheet::FlagColumn:
+				anyFlag = true;
+				break;
+			case XlsxSheet::EmptyColumn:
+				break;
+			}
+		}
+
+		ArrowField field;
+		field.name = name;
+		field.type = anyText ? ArrowField::Utf8 : (anyFlag && !anyNumber) ? ArrowField::Bool : ArrowField::Float64;
+		fields.append(field);
+	}
+
+	return fields;
+}
+
+ArrowMetadata FeatherExporter::sheetMetadata(const SheetHandle& sheet)
+{
+	ArrowMetadata metadata;
+	metadata.append(qMakePair(QString("source"), QFileInfo(sheet.workbook()->filePath()).fileName()));
+	metadata.append(qMakePair(QString("sheet"), sheet.sheetName()));
+	metadata.append(qMakePair(QString("template"), QString(sheet.workbook()->isNewTemplate() ? "new" : "old")));
+	metadata.append(qMakePair(QString("samples"), QString::number(sheet.sampleCount())));
+
+	// Rows 1-3 of each sample block, as the reader extracted them
+	for (int s = 0; s < sheet.sampleCount(); s++)
+	{
+		const SampleMetadata& sample = sheet.sampleView(s).metadata();
+		QString prefix = "sample." + QString::number(s + 1) + ".";
+
+		metadata.append(qMakePair(prefix + "testName", sample.testName));
+		metadata.append(qMakePair(prefix + "date", sample.date));
+		metadata.append(qMakePair(prefix + "sampleID", sample.sampleID));
+		metadata.append(qMakePair(prefix + "heatingTechnology", sample.heatingTechnology));
+		metadata.append(qMakePair(prefix + "media", sample.media));
+		metadata.append(qMakePair(prefix + "resistance", QString::number(sample.resistance, 'g', 15)));
+		metadata.append(qMakePair(prefix + "voltage", QString::number(sample.voltage, 'g', 15)));
+		metadata.append(qMakePair(prefix + "power", QString::number(sample.power, 'g', 15)));
+		metadata.append(qMakePair(prefix + "viscosity", QString::number(sample.viscosity, 'g', 15)));
+		metadata.append(qMakePair(prefix + "tester", sample.tester));
+		metadata.append(qMakePair(prefix + "puffingRegime", sample.puffingRegime));
+		metadata.append(qMakePair(prefix + "initialOilMass", QString::number(sample.initialOilMass, 'g', 15)));
+	}
+
+	return metadata;
+}
+
+QVector<QVariant> FeatherExporter::expectedColumn(const ExcelReader::SampleView& sample, int col, ArrowField::Type type)
+{
+	QVector<QVariant> values(sample.rowCount());
+	for (int row = 0; row < sample.rowCount(); row++)
+	{
+		if (type == ArrowField::Utf8)
+		{
+			// Blank text is null, like an empty cell
+			QVariant value = sample.value(row, col);
+			QString text = value.toString();
+			if (!value.isNull() && !text.trimmed().isEmpty())
+			{
+				values[row] = text;
+			}
+			continue;
+		}
+
+		double number = sample.number(row, col);
+		if (!qIsNaN(number))
+		{
+			values[row] = type == ArrowField::Bool ? QVariant(number != 0.0) : QVariant(number);
+		}
+	}
+	return values;
+}
+
+bool FeatherExporter::exportSheet(const SheetHandle& sheet, const QString& filePath, int* strayCells)
+{
+	QVector<ArrowField> fields = sheetFields(sheet);
+
+	ArrowIpcWriter writer;
+	if (!writer.open(filePath, fields, sheetMetadata(sheet)))
+	{
+		m_lastError = writer.getLastError();
+		return false;
+	}
+
+	for (int s = 0; s < sheet.sampleCount(); s++)
+	{
+		ExcelReader::SampleView sample = sheet.sampleView(s);
+		int rows = sample.rowCount();
+
+		writer.beginBatch(rows);
+		writer.addInt32Column(QVector<qint32>(rows, s + 1));
+
+		for (int col = 0; col < 12; col++)
+		{
+			ArrowField::Type type = fields.at(col + 1).type;
+
+			if (type == ArrowField::Utf8)
+			{
+				QStringList texts;
+				for (const QVariant& value : expectedColumn(sample, col, type))
+				{
+					texts.append(value.isNull() ? QString() : value.toString());
+				}
+				writer.addUtf8Column(texts);
+				continue;
+			}
+
+			// Numbers are written straight from the sheet's column storage
+			ExcelReader::ColumnSpan span = sample.column(col);
+			QVector<double> blank;
+			const double* numbers = span.numbers;
+			if (!numbers)
+			{
+				blank.fill(qQNaN(), rows);
+				numbers = blank.constData();
+			}
+
+			// Cells that are not numbers have no place in a number column
+			if (span.hasStrays)
+			{
+				for (int row = 0; row < rows; row++)
+				{
+					if (qIsNaN(numbers[row]) && !sample.value(row, col).toString().trimmed().isEmpty())
+					{
+						(*strayCells)++;
+					}
+				}
+			}
+
+			if (type == ArrowField::Bool)
+			{
+				writer.addBoolColumn(numbers);
+			}
+			else
+			{
+				writer.addFloat64Column(numbers);
+			}
+		}
+
+		if (!writer.endBatch())
+		{
+			m_lastError = writer.getLastError();
+			return false;
+		}
+	}
+
+	if (!writer.close())
+	{
+		m_lastError = writer.getLastError();
+		return false;
+	}
+
+	return true;
+}
+
+bool FeatherExporter::verifyFile(const SheetHandle& sheet, const QString& filePath, const QVector<ArrowField>& fields)
+{
+	ArrowIpcReader reader;
+	if (!reader.open(filePath))
+	{
+		m_lastError = "Verification failed: " + reader.getLastError();
+		return false;
+	}
+
+	QString mismatch;
+	if (reader.fields().size() != fields.size() || reader.batchCount() != sheet.sampleCount())
+	{
+		mismatch = "column or record batch count";
+	}
+	else if (reader.metadata() != sheetMetadata(sheet))
+	{
+		mismatch = "schema metadata";
+	}
+
+	for (int i = 0; i < fields.size() && mismatch.isEmpty(); i++)
+	{
+		if (reader.fields().at(i).name != fields.at(i).name || reader.fields().at(i).type != fields.at(i).type)
+		{
+			mismatch = "schema of column " + fields.at(i).name;
+		}
+	}
+
+	for (int s = 0; s < sheet.sampleCount() && mismatch.isEmpty(); s++)
+	{
+		ArrowIpcReader::Batch batch;
+		if (!reader.readBatch(s, &batch))
+		{
+			m_lastError = "Verification failed: " + reader.getLastError();
+			return false;
+		}
+
+		ExcelReader::SampleView sample = sheet.sampleView(s);
+		if (batch.rowCount != sample.rowCount() || batch.columns.at(0) != QVector<QVariant>(sample.rowCount(), s + 1))
+		{
+			mismatch = "rows of sample " + QString::number(s + 1);
+			break;
+		}
+
+		for (int col = 0; col < 12; col++)
+		{
+			if (batch.columns.at(col + 1) != expectedColumn(sample, col, fields.at(col + 1).type))
+			{
+				mismatch = "sample " + QString::number(s + 1) + ", column " + fields.at(col + 1).name;
+				break;
+			}
+		}
+	}
+
+	if (!mismatch.isEmpty())
+	{
+		m_lastError = "Verification failed for " + QFileInfo(filePath).fileName() + ": " + mismatch + " differs";
+		return false;
+	}
+
+	return true;
+}
+
+bool FeatherExporter::exportWorkbook(const QSharedPointer<const Workbook>& workbook, const QString& directory)
+{
+	m_writtenFiles.clear();
+	m_report.clear();
+	m_lastError.clear();
+
+	if (!workbook)
+	{
+		m_lastError = "No document loaded";
+		return false;
+	}
+
+	QDir dir(directory);
+	if (!dir.exists())
+	{
+		m_lastError = "Folder does not exist: " + directory;
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QStringList parsedBefore = workbook->parsedSheetNames();
+
+	for (const QString& sheetName : workbook->sheetNames())
+	{
+		bool exported = false;
+		{
+			SheetHandle sheet(workbook, sheetName);
+			if (!sheet.isValid())
+			{
+				m_lastError = "Cannot read sheet " + sheetName + ": " + sheet.getLastError();
+				return false;
+			}
+
+			if (sheet.sampleCount() > 0)
+			{
+				QString filePath = dir.filePath(fileNameFor(workbook->filePath(), sheetName));
+				int strayCells = 0;
+				if (!exportSheet(sheet, filePath, &strayCells) || !verifyFile(sheet, filePath, sheetFields(sheet)))
+				{
+					return false;
+				}
+
+				int rows = 0;
+				for (int s = 0; s < sheet.sampleCount(); s++)
+				{
+					rows += sheet.sampleView(s).rowCount();
+				}
+
+				m_writtenFiles.append(filePath);
+				m_report += QFileInfo(filePath).fileName() + ": " + QString::number(sheet.sampleCount()) + " samples, " +
+					QString::number(rows) + " rows, " + MemoryAccounting::formatBytes(QFileInfo(filePath).size()) + ", verified";
+				if (strayCells > 0)
+				{
+					m_report += ", " + QString::number(strayCells) + " non-numeric cells in number columns written as null";
+				}
+				m_report += "\n";
+				exported = true;
+			}
+		}
+
+		// Sheets parsed only for the export are freed again once their handle is gone
+		if (!parsedBefore.contains(sheetName))
+		{
+			workbook->releaseSheet(sheetName);
+		}
+
+		debugPrint(sheetName + (exported ? ": exported" : ": no samples, skipped"));
+	}
+
+	m_report += "\n" + QString::number(m_writtenFiles.size()) + " file(s) written in " + QString::number(timer.elapsed()) + " ms";
+	return true;
+}
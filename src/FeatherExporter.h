@@ -0,0 +1,43 @@
+#ifndef FEATHEREXPORTER_H
+#define FEATHEREXPORTER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include "ArrowIpc.h"
+#include "ExcelReader.h"
+
+// Exports the samples of a workbook as Feather v2 (Arrow IPC) files, one per
+// sheet with samples, for reading with pyarrow or pandas instead of parsing
+// the xlsx again. Each sample is one record batch with a "Sample" column and
+// the 12 template columns; the metadata rows of every sample go into the
+// schema's key/value pairs ("sample.<n>.<field>"). Sheets are parsed, written
+// and released one at a time, and every file is read back and compared.
+class FeatherExporter
+{
+public:
+	FeatherExporter();
+
+	bool exportWorkbook(const QSharedPointer<const Workbook>& workbook, const QString& directory);
+
+	QStringList writtenFiles() const { return m_writtenFiles; }
+	QString report() const { return m_report; } // Per-file summary of the last export
+	QString getLastError() const { return m_lastError; }
+
+private:
+	QStringList m_writtenFiles;
+	QString m_report;
+	QString m_lastError;
+
+	bool exportSheet(const SheetHandle& sheet, const QString& filePath, int* strayCells);
+	bool verifyFile(const SheetHandle& sheet, const QString& filePath, const QVector<ArrowField>& fields);
+
+	static QVector<ArrowField> sheetFields(const SheetHandle& sheet);
+	static ArrowMetadata sheetMetadata(const SheetHandle& sheet);
+	static QVector<QVariant> expectedColumn(const ExcelReader::SampleView& sample, int col, ArrowField::Type type);
+	static QString fileNameFor(const QString& workbookPath, const QString& sheetName);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // FEATHEREXPORTER_H
@@ -0,0 +1,537 @@
+#include "LiveAcquisition.h"
+#include "CsvReader.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThread>
+#include <QRandomGenerator>
+#include <cstring>
+#include <limits>
+
+LiveAcquisition::LiveAcquisition(QObject* parent)
+	: QObject(parent)
+	, m_server(nullptr)
+	, m_sampleIndex(-1)
+	, m_bytesReceived(0)
+	, m_rejectedLines(0)
+	, m_rateWindowRows(0)
+	, m_lastRate(0.0)
+	, m_traceColumn(2)
+	, m_rowsPerBucket(1)
+	, m_lastBucketRows(0)
+	, m_feeder(nullptr)
+	, m_feederStop(0)
+{
+	clearRows();
+}
+
+LiveAcquisition::~LiveAcquisition()
+{
+	stop();
+}
+
+void LiveAcquisition::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [LiveAcquisition]:" << message;
+}
+
+bool LiveAcquisition::start(const SheetHandle& sheet, int sampleIndex, const QString& serverName)
+{
+	stop();
+	m_lastError.clear();
+
+	if (!sheet.isValid() || sampleIndex < 0 || sampleIndex >= sheet.sampleCount())
+	{
+		m_lastError = "No sample to append to";
+		return false;
+	}
+
+	m_sheet = sheet;
+	m_sampleIndex = sampleIndex;
+	m_sample = sheet.sampleView(sampleIndex);
+	clearRows();
+	rebuildTrace();
+
+	m_server = new QLocalServer(this);
+	bool listening = m_server->listen(serverName);
+	if (!listening)
+	{
+		// A socket left behind by a crashed instance makes listen() fail; it is only
+		// removed when nothing answers on it, a running instance keeps its own
+		QLocalSocket probe;
+		probe.connectToServer(serverName);
+		if (probe.waitForConnected(500))
+		{
+			m_lastError = "Another instance is already listening on " + serverName;
+		}
+		else
+		{
+			QLocalServer::removeServer(serverName);
+			listening = m_server->listen(serverName);
+		}
+	}
+	if (!listening)
+	{
+		if (m_lastError.isEmpty())
+		{
+			m_lastError = "Cannot listen on " + serverName + ": " + m_server->errorString();
+		}
+		delete m_server;
+		m_server = nullptr;
+		return false;
+	}
+
+	m_serverName = serverName;
+	connect(m_server, &QLocalServer::newConnection, this, &LiveAcquisition::onNewConnection);
+	m_rateTimer.start();
+
+	debugPrint("Listening on " + m_server->fullServerName() + " for sample " + QString::number(sampleIndex + 1) +
+		" of " + sheet.sheetName());
+	return true;
+}
+
+void LiveAcquisition::stop()
+{
+	stopFeeder();
+
+	for (auto it = m_sockets.begin(); it != m_sockets.end(); ++it)
+	{
+		// The sockets are children of the server and go with it
+		it.key()->disconnect(this);
+		it.key()->abort();
+	}
+	m_sockets.clear();
+
+	if (m_server)
+	{
+		m_server->close();
+		delete m_server;
+		m_server = nullptr;
+		debugPrint("Stopped after " + QString::number(rowCount()) + " rows");
+	}
+}
+
+void LiveAcquisition::clear()
+{
+	stop();
+	clearRows();
+	m_trace.clear();
+	m_sample = ExcelReader::SampleView();
+	m_sheet = SheetHandle();
+	m_sampleIndex = -1;
+}
+
+bool LiveAcquisition::isListening() const
+{
+	return m_server && m_server->isListening();
+}
+
+void LiveAcquisition::clearRows()
+{
+	for (int col = 0; col < COLUMNS; col++)
+	{
+		m_columns[col].clear();
+		m_stats[col].count = 0;
+		m_stats[col].sum = 0.0;
+		m_stats[col].min = qQNaN();
+		m_stats[col].max = qQNaN();
+	}
+	m_textCells.clear();
+	m_bytesReceived = 0;
+	m_rejectedLines = 0;
+	m_rateWindowRows = 0;
+	m_lastRate = 0.0;
+}
+
+void LiveAcquisition::onNewConnection()
+{
+	while (QLocalSocket* socket = m_server->nextPendingConnection())
+	{
+		// Qt stops reading from the writer while this much is waiting
+		socket->setReadBufferSize(MAX_LINE_BYTES);
+		m_sockets.insert(socket, QByteArray());
+		connect(socket, &QLocalSocket::readyRead, this, &LiveAcquisition::onReadyRead);
+		connect(socket, &QLocalSocket::disconnected, this, &LiveAcquisition::onDisconnected);
+		debugPrint("Writer connected, " + QString::number(m_sockets.size()) + " connected");
+	}
+	emit connectionsChanged(m_sockets.size());
+}
+
+void LiveAcquisition::onDisconnected()
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+	if (!socket || !m_sockets.contains(socket))
+	{
+		return;
+	}
+
+	// Whatever arrived with the disconnect, and a last line without a newline
+	onReadyRead();
+	QByteArray rest = m_sockets.take(socket);
+	if (!rest.trimmed().isEmpty() && appendLine(rest.constData(), rest.constData() + rest.size()))
+	{
+		emit rowsReceived(rowCount());
+	}
+
+	socket->deleteLater();
+	debugPrint("Writer disconnected, " + QString::number(m_sockets.size()) + " connected");
+	emit connectionsChanged(m_sockets.size());
+}
+
+void LiveAcquisition::onReadyRead()
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+	if (!socket || !m_sockets.contains(socket))
+	{
+		return;
+	}
+
+	QByteArray& pending = m_sockets[socket];
+	QByteArray data = socket->readAll();
+	if (data.isEmpty())
+	{
+		return;
+	}
+	m_bytesReceived += data.size();
+
+	// Only complete lines are rows, the remainder waits for the next read
+	pending.append(data);
+	const char* begin = pending.constData();
+	const char* end = begin + pending.size();
+	const char* line = begin;
+	int before = rowCount();
+	while (const char* newline = static_cast<const char*>(memchr(line, '\n', size_t(end - line))))
+	{
+		appendLine(line, newline);
+		line = newline + 1;
+	}
+	pending.remove(0, int(line - begin));
+	bool overlong = pending.size() > MAX_LINE_BYTES;
+
+	if (rowCount() > before)
+	{
+		emit rowsReceived(rowCount());
+	}
+
+	// Not a row writer, or a broken one: its partial line would grow without bound
+	if (overlong)
+	{
+		debugPrint("WARNING: Dropping writer after " + QString::number(MAX_LINE_BYTES) + " bytes without a line end");
+		m_rejectedLines++;
+		m_sockets.remove(socket);
+		socket->disconnect(this);
+		socket->abort();
+		socket->deleteLater();
+		emit connectionsChanged(m_sockets.size());
+	}
+}
+
+bool LiveAcquisition::appendLine(const char* begin, const char* end)
+{
+	if (end > begin && end[-1] == '\r')
+	{
+		end--;
+	}
+	if (begin == end)
+	{
+		return false;
+	}
+
+	// Tabs win, then semicolons when there is no comma, as in CSV exports
+	int length = int(end - begin);
+	char delimiter = ',';
+	if (memchr(begin, '\t', size_t(length)))
+	{
+		delimiter = '\t';
+	}
+	else if (memchr(begin, ';', size_t(length)) && !memchr(begin, ',', size_t(length)))
+	{
+		delimiter = ';';
+	}
+
+	QVariant values[COLUMNS];
+	const char* field = begin;
+	for (int col = 0; col < COLUMNS && field <= end; col++)
+	{
+		const char* fieldEnd = static_cast<const char*>(memchr(field, delimiter, size_t(end - field)));
+		if (!fieldEnd)
+		{
+			fieldEnd = end;
+		}
+		values[col] = CsvReader::fieldValue(field, int(fieldEnd - field));
+		field = fieldEnd + 1;
+	}
+
+	// Every puff row starts with the puff count; header lines and noise are counted and dropped
+	if (values[0].type() != QVariant::Double)
+	{
+		m_rejectedLines++;
+		return false;
+	}
+
+	int row = rowCount();
+	for (int col = 0; col < COLUMNS; col++)
+	{
+		const QVariant& value = values[col];
+		double number = qQNaN();
+		if (value.type() == QVariant::Double || value.type() == QVariant::Bool)
+		{
+			number = value.toDouble();
+		}
+		else if (!value.isNull())
+		{
+			m_textCells.insert(qMakePair(row, col), value);
+		}
+		m_columns[col].append(number);
+
+		if (!qIsNaN(number))
+		{
+			ColumnStats& stats = m_stats[col];
+			stats.min = stats.count > 0 ? qMin(stats.min, number) : number;
+			stats.max = stats.count > 0 ? qMax(stats.max, number) : number;
+			stats.sum += number;
+			stats.count++;
+		}
+	}
+
+	appendTrace(m_columns[m_traceColumn].last());
+
+	m_rateWindowRows++;
+	qint64 elapsed = m_rateTimer.elapsed();
+	if (elapsed >= 1000)
+	{
+		m_lastRate = m_rateWindowRows * 1000.0 / elapsed;
+		m_rateWindowRows = 0;
+		m_rateTimer.restart();
+	}
+	return true;
+}
+
+double LiveAcquisition::rowsPerSecond() const
+{
+	// A window that has run long without a row means the writers went quiet
+	if (!m_rateTimer.isValid() || m_rateTimer.elapsed() >= 2000)
+	{
+		return 0.0;
+	}
+	return m_lastRate;
+}
+
+double LiveAcquisition::number(int row, int col) const
+{
+	if (row < 0 || row >= rowCount() || col < 0 || col >= COLUMNS)
+	{
+		return qQNaN();
+	}
+	return m_columns[col].at(row);
+}
+
+QVariant LiveAcquisition::value(int row, int col) const
+{
+	double value = number(row, col);
+	if (!qIsNaN(value))
+	{
+		return value;
+	}
+	return m_textCells.value(qMakePair(row, col));
+}
+
+void LiveAcquisition::setTraceColumn(int col)
+{
+	if (col < 0 || col >= COLUMNS || col == m_traceColumn)
+	{
+		return;
+	}
+	m_traceColumn = col;
+	rebuildTrace();
+}
+
+void LiveAcquisition::appendTrace(double value)
+{
+	if (m_trace.isEmpty() || m_lastBucketRows >= m_rowsPerBucket)
+	{
+		// Out of buckets: every pair becomes one, twice as wide
+		if (m_trace.size() >= TRACE_BUCKETS)
+		{
+			int merged = m_trace.size() / 2;
+			for (int i = 0; i < merged; i++)
+			{
+				m_trace[i].min = qMin(m_trace.at(2 * i).min, m_trace.at(2 * i + 1).min);
+				m_trace[i].max = qMax(m_trace.at(2 * i).max, m_trace.at(2 * i + 1).max);
+			}
+			m_trace.resize(merged);
+			m_rowsPerBucket *= 2;
+		}
+
+		// An empty bucket has min above max, rows without a number leave it that way
+		TraceBucket bucket;
+		bucket.min = std::numeric_limits<double>::infinity();
+		bucket.max = -std::numeric_limits<double>::infinity();
+		m_trace.append(bucket);
+		m_lastBucketRows = 0;
+	}
+
+	if (!qIsNaN(value))
+	{
+		TraceBucket& bucket = m_trace.last();
+		bucket.min = qMin(bucket.min, value);
+		bucket.max = qMax(bucket.max, value);
+	}
+	m_lastBucketRows++;
+}
+
+void LiveAcquisition::rebuildTrace()
+{
+	m_trace.clear();
+	m_rowsPerBucket = 1;
+	m_lastBucketRows = 0;
+
+	if (m_sample.isValid())
+	{
+		for (int row = 0; row < m_sample.rowCount(); row++)
+		{
+			appendTrace(m_sample.number(row, m_traceColumn));
+		}
+	}
+	for (double value : m_columns[m_traceColumn])
+	{
+		appendTrace(value);
+	}
+}
+
+qint64 LiveAcquisition::memoryBytes() const
+{
+	qint64 bytes = qint64(m_trace.capacity()) * qint64(sizeof(TraceBucket));
+	for (int col = 0; col < COLUMNS; col++)
+	{
+		bytes += qint64(m_columns[col].capacity()) * qint64(sizeof(double));
+	}
+	for (auto it = m_textCells.constBegin(); it != m_textCells.constEnd(); ++it)
+	{
+		bytes += 32 + MemoryAccounting::variantBytes(it.value());
+	}
+	for (const QByteArray& pending : m_sockets)
+	{
+		bytes += pending.capacity();
+	}
+	return bytes;
+}
+
+bool LiveAcquisition::startFeeder(int rowsPerSecond)
+{
+	if (!isListening())
+	{
+		m_lastError = "Live acquisition is not running";
+		return false;
+	}
+	stopFeeder();
+
+	// Carry on from the last row with a puff count and weight, the sample's or a received one
+	double puffs = 0.0;
+	double weight = 20.0;
+	bool puffsFound = false;
+	bool weightFound = false;
+	for (int row = rowCount() - 1; row >= 0 && !(puffsFound && weightFound); row--)
+	{
+		if (!puffsFound && !qIsNaN(number(row, 0)))
+		{
+			puffs = number(row, 0);
+			puffsFound = true;
+		}
+		if (!weightFound && !qIsNaN(number(row, 2)))
+		{
+			weight = number(row, 2);
+			weightFound = true;
+		}
+	}
+	for (int row = m_sample.rowCount() - 1; row >= 0 && !(puffsFound && weightFound); row--)
+	{
+		if (!puffsFound && !qIsNaN(m_sample.number(row, 0)))
+		{
+			puffs = m_sample.number(row, 0);
+			puffsFound = true;
+		}
+		if (!weightFound && !qIsNaN(m_sample.number(row, 2)))
+		{
+			weight = m_sample.number(row, 2);
+			weightFound = true;
+		}
+	}
+
+	const QString serverName = m_serverName;
+	const int rate = qMax(1, rowsPerSecond);
+	const double resistance = m_sample.metadata().resistance;
+	m_feederStop.storeRelease(0);
+
+	m_feeder = QThread::create([this, serverName, rate, resistance, puffs, weight]() {
+		QLocalSocket socket;
+		socket.connectToServer(serverName);
+		if (!socket.waitForConnected(2000))
+		{
+			qDebug() << "DEBUG [LiveAcquisition]:" << "Feeder cannot connect:" << socket.errorString();
+			return;
+		}
+
+		// Rows are written as they fall due, in small batches like a rig's serial buffer
+		QRandomGenerator random(rate);
+		double puffCount = puffs;
+		double afterWeight = weight;
+		qint64 sent = 0;
+		QElapsedTimer clock;
+		clock.start();
+		while (!m_feederStop.loadAcquire() && socket.state() == QLocalSocket::ConnectedState)
+		{
+			qint64 due = clock.elapsed() * rate / 1000;
+			QByteArray batch;
+			for (; sent < due; sent++)
+			{
+				double beforeWeight = afterWeight;
+				puffCount += 10.0;
+				afterWeight = beforeWeight - 0.004 - random.generateDouble() * 0.002;
+
+				batch += QByteArray::number(puffCount, 'f', 0) + ',' +
+					QByteArray::number(beforeWeight, 'f', 4) + ',' +
+					QByteArray::number(afterWeight, 'f', 4) + ',' +
+					QByteArray::number(1.5 + random.generateDouble() * 0.5, 'f', 3) + ',' +
+					QByteArray::number(resistance > 0.0 ? resistance : 1.2, 'f', 3) + ",,,\n";
+			}
+
+			if (!batch.isEmpty())
+			{
+				socket.write(batch);
+				socket.waitForBytesWritten(1000);
+			}
+			QThread::msleep(5);
+		}
+
+		socket.disconnectFromServer();
+		if (socket.state() != QLocalSocket::UnconnectedState)
+		{
+			socket.waitForDisconnected(1000);
+		}
+	});
+	m_feeder->start();
+
+	debugPrint("Feeder writing " + QString::number(rate) + " rows/s from puff " + QString::number(puffs));
+	return true;
+}
+
+void LiveAcquisition::stopFeeder()
+{
+	if (!m_feeder)
+	{
+		return;
+	}
+
+	m_feederStop.storeRelease(1);
+	m_feeder->wait();
+	delete m_feeder;
+	m_feeder = nullptr;
+	debugPrint("Feeder stopped");
+}
+
+bool LiveAcquisition::isFeeding() const
+{
+	return m_feeder && m_feeder->isRunning();
+}
@@ -0,0 +1,147 @@
+#ifndef LIVEACQUISITION_H
+#define LIVEACQUISITION_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QVariant>
+#include <QHash>
+#include <QPair>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QtNumeric>
+#include "ExcelReader.h"
+#include "DataServerClient.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QThread;
+
+// Puff rows streamed from a test rig into one sample while it is displayed.
+// A local server (a Unix domain socket, a named pipe on Windows) accepts any
+// number of writers; each line is one row in template column order, fields
+// separated by commas, semicolons or tabs. Received rows are kept after the
+// sample's own rows in typed columns, like the sheet's storage, with running
+// statistics and a downsampled trace updated per row, so nothing has to be
+// recomputed over the whole sample when more rows arrive. rowsReceived() is
+// emitted once per socket read, however many rows it held; the viewer decides
+// how often to show them.
+class LiveAcquisition : public QObject
+{
+	Q_OBJECT
+
+public:
+	static const int COLUMNS = 12;
+	static const int TRACE_BUCKETS = 512;
+	static const int MAX_LINE_BYTES = 1024 * 1024; // A writer that sends a longer line is dropped
+
+	struct ColumnStats
+	{
+		int count; // Numeric cells
+		double sum;
+		double min;
+		double max;
+
+		double mean() const { return count > 0 ? sum / count : qQNaN(); }
+	};
+
+	// Minimum and maximum of a run of rows of the trace column
+	struct TraceBucket
+	{
+		double min;
+		double max;
+	};
+
+	explicit LiveAcquisition(QObject* parent = nullptr);
+	~LiveAcquisition();
+
+	static QString defaultServerName() { return DataServerClient::userScopedName("DataViewerEnterprise-live"); }
+
+	// Rows are appended to this sample; the handle keeps its rows readable across reloads
+	bool start(const SheetHandle& sheet, int sampleIndex, const QString& serverName = defaultServerName());
+	void stop(); // Closes the server and its connections, received rows are kept until the next start()
+	void clear(); // Stops and lets go of the sample and its received rows
+	bool isListening() const;
+
+	QString serverName() const { return m_serverName; }
+	QString sheetName() const { return m_sheet.sheetName(); }
+	int sampleIndex() const { return m_sampleIndex; }
+	const ExcelReader::SampleView& sample() const { return m_sample; }
+
+	// Received rows, numbered from 0 after the sample's last row
+	int rowCount() const { return m_columns[0].size(); }
+	const QVector<double>& column(int col) const { return m_columns[col]; } // NaN where blank or text
+	double number(int row, int col) const;
+	QVariant value(int row, int col) const;
+
+	const ColumnStats& columnStats(int col) const { return m_stats[col]; } // Received rows only
+	double rowsPerSecond() const; // Over the last second or so
+	int connectionCount() const { return m_sockets.size(); }
+	qint64 bytesReceived() const { return m_bytesReceived; }
+	int rejectedLines() const { return m_rejectedLines; }
+
+	// Trace of one column over the sample's rows and the received ones, at most
+	// TRACE_BUCKETS buckets of rowsPerBucket() rows each; buckets are merged in
+	// pairs when they run out, so appending a row costs the same however long the test
+	void setTraceColumn(int col);
+	int traceColumn() const { return m_traceColumn; }
+	const QVector<TraceBucket>& trace() const { return m_trace; }
+	int rowsPerBucket() const { return m_rowsPerBucket; }
+
+	qint64 memoryBytes() const;
+
+	// Test feeder: writes synthetic puff rows to the server from a worker thread,
+	// continuing from the sample's last puff count and weight
+	bool startFeeder(int rowsPerSecond);
+	void stopFeeder();
+	bool isFeeding() const;
+
+	QString getLastError() const { return m_lastError; }
+
+signals:
+	void rowsReceived(int rowCount);
+	void connectionsChanged(int connectionCount);
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDisconnected();
+
+private:
+	QLocalServer* m_server;
+	QString m_serverName;
+	QHash<QLocalSocket*, QByteArray> m_sockets; // Partial last line of each connection
+
+	SheetHandle m_sheet;
+	ExcelReader::SampleView m_sample;
+	int m_sampleIndex;
+
+	QVector<double> m_columns[COLUMNS];
+	QHash<QPair<int, int>, QVariant> m_textCells; // (row, column) of cells that are not numbers
+	ColumnStats m_stats[COLUMNS];
+	qint64 m_bytesReceived;
+	int m_rejectedLines;
+
+	// Rate over a window that restarts every second
+	QElapsedTimer m_rateTimer;
+	int m_rateWindowRows;
+	double m_lastRate;
+
+	int m_traceColumn;
+	QVector<TraceBucket> m_trace;
+	int m_rowsPerBucket;
+	int m_lastBucketRows;
+
+	QThread* m_feeder;
+	QAtomicInt m_feederStop;
+
+	QString m_lastError;
+
+	void clearRows();
+	bool appendLine(const char* begin, const char* end);
+	void appendTrace(double value);
+	void rebuildTrace();
+	void debugPrint(const QString& message) const;
+};
+
+#endif // LIVEACQUISITION_H
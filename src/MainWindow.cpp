@@ -1,28 +1,196 @@
 ﻿#include "MainWindow.h"
+#include "AggregationDialog.h"
 #include <QApplication>
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QHeaderView>
 #include <QFileInfo>
+#include <QScrollBar>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QInputDialog>
+#include <QCheckBox>
+#include <QPaintEvent>
+#include <QTextStream>
+#include <QtMath>
+#include <QPainter>
+#include <QPixmap>
+#include <QPainterPath>
+#include <algorithm>
+#include "StartupTimeline.h"
+#include "FeatherExporter.h"
+#include "Metrics.h"
+#include "DataServerClient.h"
 
 MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
+	, sampleOverview(nullptr)
+	, aggregationDialog(nullptr)
+	, searchResults(nullptr)
+	, m_excelReader(nullptr)
+	, m_querySheetNs(0)
+	, m_startupComplete(false)
+	, m_firstPaintSeen(false)
+	, m_interactiveMarked(false)
+	, m_sampleIndexChecked(false)
 {
 	debugPrint("MainWindow constructor starting...");
 
 	setWindowTitle("DataViewer Enterprise v1.0");
 	resize(1200, 800);
 
+	// Only the shell (menus, top frame, empty frames) is built here; the reader and the
+	// remaining widgets follow in completeStartup() once the first frame is on screen
 	setupUI();
-
-	// Initialize Excel Reader
-	m_excelReader = new ExcelReader();
 	m_currentSampleIndex = -1;
-    debugPrint("Excel reader initilaized");
+	m_derivedColumns.defineTemplateColumns();
+
+	// Watch the loaded file so rigs appending to it show up without reloading
+	fileWatcher = new QFileSystemWatcher(this);
+	connect(fileWatcher, &QFileSystemWatcher::fileChanged, this, &MainWindow::onWatchedFileChanged);
+
+	reloadTimer = new QTimer(this);
+	reloadTimer->setSingleShot(true);
+	reloadTimer->setInterval(1000);
+	connect(reloadTimer, &QTimer::timeout, this, &MainWindow::onReloadChangedFile);
+	reloadRetries = 0;
+
+	// Memory accounting runs after every load, and periodically for the caches while a budget is set
+	m_memoryBudget = 0;
+	m_tableItems = 0;
+	memoryTimer = new QTimer(this);
+	memoryTimer->setInterval(5000);
+	connect(memoryTimer, &QTimer::timeout, this, &MainWindow::enforceMemoryBudget);
+
+	// Live acquisition: a burst of reads schedules one flush, not one per read
+	m_live = new LiveAcquisition(this);
+	connect(m_live, &LiveAcquisition::rowsReceived, this, &MainWindow::onLiveRowsReceived);
+	connect(m_live, &LiveAcquisition::connectionsChanged, this, &MainWindow::onLiveRowsReceived);
+	liveFlushTimer = new QTimer(this);
+	liveFlushTimer->setSingleShot(true);
+	liveFlushTimer->setInterval(50);
+	connect(liveFlushTimer, &QTimer::timeout, this, &MainWindow::flushLiveRows);
+	m_liveRowsShown = 0;
 
 	debugPrint("MainWindow constructor comple");
 }
 
+void MainWindow::paintEvent(QPaintEvent* event)
+{
+	QMainWindow::paintEvent(event);
+
+	if (!m_firstPaintSeen)
+	{
+		m_firstPaintSeen = true;
+		StartupTimeline::mark("first paint");
+		QTimer::singleShot(0, this, &MainWindow::completeStartup);
+	}
+	else if (m_startupComplete && !m_interactiveMarked)
+	{
+		m_interactiveMarked = true;
+		StartupTimeline::mark("interactive");
+		reportStartup();
+	}
+}
+
+bool MainWindow::eventFilter(QObject* watched, QEvent* event)
+{
+	switch (event->type())
+	{
+	case QEvent::MouseButtonPress:
+	case QEvent::KeyPress:
+	case QEvent::Wheel:
+	case QEvent::TouchBegin:
+		m_prefetcher.noteInteraction();
+		break;
+	default:
+		break;
+	}
+	return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::completeStartup()
+{
+	// Also called from actions that need the reader or the deferred widgets
+	if (m_startupComplete)
+	{
+		return;
+	}
+	m_startupComplete = true;
+
+	m_excelReader = new ExcelReader();
+	debugPrint("Excel reader initilaized");
+
+	buildCenterPanels();
+	buildImagePanel();
+
+	// Search hits float over the center frame, below the search box
+	searchResults = new QListWidget(centralWidget());
+	searchResults->setFocusPolicy(Qt::NoFocus);
+	searchResults->hide();
+	connect(searchResults, &QListWidget::itemActivated, this, &MainWindow::onSearchResultActivated);
+	connect(searchResults, &QListWidget::itemClicked, this, &MainWindow::onSearchResultActivated);
+	StartupTimeline::mark("deferred UI built");
+
+	QSettings settings;
+	m_memoryBudget = settings.value("memory/budgetMB", 0).toLongLong() * 1024 * 1024;
+	if (m_memoryBudget > 0)
+	{
+		memoryTimer->start();
+	}
+	enforceMemoryBudget();
+
+	// Every input event of the application holds back the next prefetched sheet
+	qApp->installEventFilter(this);
+
+	// Files opened from now on are parsed once by the shared data server
+	if (settings.value("dataServer/enabled", false).toBool())
+	{
+		QString error;
+		if (!DataServerClient::connectToServer(DataServerClient::defaultServerName(), true, &error))
+		{
+			debugPrint("WARNING: Data server not used - " + error);
+		}
+	}
+
+	// Repaint so the next paint event marks the window interactive
+	update();
+}
+
+void MainWindow::reportStartup()
+{
+	QSettings settings;
+	double targetMs = settings.value("startup/targetMs", 500).toDouble();
+	QString report = StartupTimeline::report(targetMs);
+	debugPrint("Startup timeline:\n" + report);
+
+	// Scripted launches: print the timeline and exit non-zero when the target was missed
+	if (QCoreApplication::arguments().contains("--startup-profile"))
+	{
+		QTextStream out(stdout);
+		out << report << "\n";
+		out.flush();
+		QApplication::exit(StartupTimeline::elapsedMs() <= targetMs ? 0 : 1);
+	}
+}
+
+void MainWindow::ensureSampleIndex()
+{
+	// The persisted index of the last indexed folder is only read once search is used
+	if (m_sampleIndexChecked)
+	{
+		return;
+	}
+	m_sampleIndexChecked = true;
+
+	QSettings settings;
+	QString indexDirectory = settings.value("sampleIndex/directory").toString();
+	if (!indexDirectory.isEmpty() && m_sampleIndex.open(indexDirectory))
+	{
+		debugPrint("Sample index opened: " + QString::number(m_sampleIndex.documentCount()) + " samples");
+	}
+}
+
 MainWindow::~MainWindow()
 {
 	// Clean up excel reader
@@ -32,6 +200,9 @@ MainWindow::~MainWindow()
 		m_excelReader = nullptr;
 	}
 
+	// Releases the workbooks this viewer still holds on the data server
+	DataServerClient::disconnectFromServer();
+
 	debugPrint("MainWindow destructor called");
 }
 
@@ -64,6 +235,8 @@ void MainWindow::setupUI()
 
 	// Status bar
 	statusBar()->showMessage("Ready");
+	memoryLabel = new QLabel(this);
+	statusBar()->addPermanentWidget(memoryLabel);
 
 	debugPrint("UI setup complete");
 }
@@ -92,6 +265,10 @@ void MainWindow::createMenuBar()
 	connect(saveAction, &QAction::triggered, this, &MainWindow::onSaveFile);
 	fileMenu->addAction(saveAction);
 
+	exportFeatherAction = new QAction("Export Samples to &Feather...", this);
+	connect(exportFeatherAction, &QAction::triggered, this, &MainWindow::onExportFeather);
+	fileMenu->addAction(exportFeatherAction);
+
 	fileMenu->addSeparator();
 
 	exitAction = new QAction("&Exit", this);
@@ -99,6 +276,45 @@ void MainWindow::createMenuBar()
 	connect(exitAction, &QAction::triggered, this, &MainWindow::onExit);
 	fileMenu->addAction(exitAction);
 
+	// Edit Menu, undo/redo of table edits on the displayed sample
+	QMenu* editMenu = menuBar->addMenu("&Edit");
+
+	undoAction = new QAction("&Undo", this);
+	undoAction->setShortcut(QKeySequence::Undo);
+	undoAction->setEnabled(false);
+	connect(undoAction, &QAction::triggered, this, &MainWindow::onUndo);
+	editMenu->addAction(undoAction);
+
+	redoAction = new QAction("&Redo", this);
+	redoAction->setShortcut(QKeySequence::Redo);
+	redoAction->setEnabled(false);
+	connect(redoAction, &QAction::triggered, this, &MainWindow::onRedo);
+	editMenu->addAction(redoAction);
+
+	editMenu->addSeparator();
+
+	findRowsAction = new QAction("&Find Rows...", this);
+	findRowsAction->setShortcut(QKeySequence::Find);
+	connect(findRowsAction, &QAction::triggered, this, &MainWindow::onFindRows);
+	editMenu->addAction(findRowsAction);
+
+	nextMatchAction = new QAction("Find &Next Match", this);
+	nextMatchAction->setShortcut(QKeySequence::FindNext);
+	nextMatchAction->setEnabled(false);
+	connect(nextMatchAction, &QAction::triggered, this, &MainWindow::onNextMatch);
+	editMenu->addAction(nextMatchAction);
+
+	previousMatchAction = new QAction("Find &Previous Match", this);
+	previousMatchAction->setShortcut(QKeySequence::FindPrevious);
+	previousMatchAction->setEnabled(false);
+	connect(previousMatchAction, &QAction::triggered, this, &MainWindow::onPreviousMatch);
+	editMenu->addAction(previousMatchAction);
+
+	clearQueryAction = new QAction("&Clear Row Query", this);
+	clearQueryAction->setEnabled(false);
+	connect(clearQueryAction, &QAction::triggered, this, &MainWindow::onClearQuery);
+	editMenu->addAction(clearQueryAction);
+
 	// Reports Menu
     QMenu* reportsMenu = menuBar->addMenu("&Reports");
 
@@ -110,6 +326,87 @@ void MainWindow::createMenuBar()
 	connect(generateFullReportAction, &QAction::triggered, this, &MainWindow::onGenerateFullReport);
     reportsMenu->addAction(generateFullReportAction);
 
+	// Tools Menu
+	QMenu* toolsMenu = menuBar->addMenu("&Tools");
+
+	benchmarkParserAction = new QAction("&Benchmark Sheet Parser", this);
+	connect(benchmarkParserAction, &QAction::triggered, this, &MainWindow::onBenchmarkParser);
+	toolsMenu->addAction(benchmarkParserAction);
+
+	ingestStatsAction = new QAction("&Ingest Pipeline Statistics", this);
+	connect(ingestStatsAction, &QAction::triggered, this, &MainWindow::onShowIngestStats);
+	toolsMenu->addAction(ingestStatsAction);
+
+	stressTestAction = new QAction("&Concurrent Read Stress Test", this);
+	connect(stressTestAction, &QAction::triggered, this, &MainWindow::onStressTestReads);
+	toolsMenu->addAction(stressTestAction);
+
+	toolsMenu->addSeparator();
+
+	aggregateAction = new QAction("&Aggregate Across Workbooks...", this);
+	connect(aggregateAction, &QAction::triggered, this, &MainWindow::onAggregateWorkbooks);
+	toolsMenu->addAction(aggregateAction);
+
+	indexFolderAction = new QAction("&Index Workbook Folder...", this);
+	connect(indexFolderAction, &QAction::triggered, this, &MainWindow::onIndexFolder);
+	toolsMenu->addAction(indexFolderAction);
+
+	compareWorkbookAction = new QAction("&Compare With Earlier Version...", this);
+	connect(compareWorkbookAction, &QAction::triggered, this, &MainWindow::onCompareWorkbook);
+	toolsMenu->addAction(compareWorkbookAction);
+
+	compareSampleAction = new QAction("Compare Sample &With...", this);
+	connect(compareSampleAction, &QAction::triggered, this, &MainWindow::onCompareSample);
+	toolsMenu->addAction(compareSampleAction);
+
+	clearComparisonAction = new QAction("Clear Compa&rison", this);
+	clearComparisonAction->setEnabled(false);
+	connect(clearComparisonAction, &QAction::triggered, this, &MainWindow::onClearComparison);
+	toolsMenu->addAction(clearComparisonAction);
+
+	toolsMenu->addSeparator();
+
+	liveModeAction = new QAction("&Live Acquisition", this);
+	liveModeAction->setCheckable(true);
+	connect(liveModeAction, &QAction::triggered, this, &MainWindow::onToggleLiveMode);
+	toolsMenu->addAction(liveModeAction);
+
+	liveFeederAction = new QAction("Live Test &Feeder...", this);
+	liveFeederAction->setCheckable(true);
+	liveFeederAction->setEnabled(false);
+	connect(liveFeederAction, &QAction::triggered, this, &MainWindow::onToggleLiveFeeder);
+	toolsMenu->addAction(liveFeederAction);
+
+	toolsMenu->addSeparator();
+
+	memoryUsageAction = new QAction("&Memory Usage", this);
+	connect(memoryUsageAction, &QAction::triggered, this, &MainWindow::onShowMemoryUsage);
+	toolsMenu->addAction(memoryUsageAction);
+
+	memoryBudgetAction = new QAction("Memory &Budget...", this);
+	connect(memoryBudgetAction, &QAction::triggered, this, &MainWindow::onSetMemoryBudget);
+	toolsMenu->addAction(memoryBudgetAction);
+
+	prefetchAction = new QAction("&Prefetch Sheets", this);
+	prefetchAction->setCheckable(true);
+	prefetchAction->setChecked(QSettings().value("prefetch/enabled", true).toBool());
+	connect(prefetchAction, &QAction::triggered, this, &MainWindow::onTogglePrefetch);
+	toolsMenu->addAction(prefetchAction);
+
+	dataServerAction = new QAction("Shared &Data Server", this);
+	dataServerAction->setCheckable(true);
+	dataServerAction->setChecked(QSettings().value("dataServer/enabled", false).toBool());
+	connect(dataServerAction, &QAction::triggered, this, &MainWindow::onToggleDataServer);
+	toolsMenu->addAction(dataServerAction);
+
+	startupTimelineAction = new QAction("&Startup Timeline", this);
+	connect(startupTimelineAction, &QAction::triggered, this, &MainWindow::onShowStartupTimeline);
+	toolsMenu->addAction(startupTimelineAction);
+
+	metricsAction = new QAction("&Latency Metrics", this);
+	connect(metricsAction, &QAction::triggered, this, &MainWindow::onShowMetrics);
+	toolsMenu->addAction(metricsAction);
+
 	// Help Menu
 	QMenu* helpMenu = menuBar->addMenu("&Help");
 
@@ -122,7 +419,7 @@ void MainWindow::createMenuBar()
     connect(aboutAction, &QAction::triggered, this, &MainWindow::onAbout);
 	helpMenu->addAction(aboutAction);
 
-	debugPrint("Menu bar created with File, Reports, and Help menus");
+	debugPrint("Menu bar created with File, Reports, Tools, and Help menus");
 }
 
 void MainWindow::createTopFrame()
@@ -155,6 +452,15 @@ void MainWindow::createTopFrame()
 
 	layout->addStretch();
 
+	// Sample search
+	searchEdit = new QLineEdit(topFrame);
+	searchEdit->setMinimumWidth(260);
+	searchEdit->setPlaceholderText("Search samples (ID, tester, media, from:2025-10-01)");
+	searchEdit->setClearButtonEnabled(true);
+	connect(searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
+	connect(searchEdit, &QLineEdit::returnPressed, this, &MainWindow::onSearchReturnPressed);
+	layout->addWidget(searchEdit);
+
 	// Load Button
 	loadButton = new QPushButton("Load File", topFrame);
 	connect(loadButton, &QPushButton::clicked, this, &MainWindow::onLoadFile);
@@ -180,6 +486,43 @@ void MainWindow::createCenterFrame()
 	mainLayout->setContentsMargins(0, 0, 0, 0);
 	mainLayout->setSpacing(10);
 
+	// The table, statistics and plot panels are built by buildCenterPanels() after the first paint
+	centerFrame->setLayout(mainLayout);
+}
+
+// Template column headers, until a sheet provides its own
+static QStringList templateHeaders()
+{
+	QStringList headers;
+	headers << "Puffs" << "Before Weight" << "After Weight" << "Draw Pressure" << "Resistance"
+		<< "Smell" << "Clog" << "Notes" << "TPM (mg/puff)" << "TPM Power Density"
+		<< "Variation in TPM (%)" << "Oil Consumed";
+	return headers;
+}
+
+// Computed columns are recomputed from the weights rather than read from the sheet's formulas
+static const struct { int column; const char* name; } derivedTableColumns[] = {
+	{ 8, "tpm" }, { 9, "tpmPowerDensity" }, { 10, "tpmVariation" }, { 11, "oilConsumed" }
+};
+
+static const char* derivedColumnName(int column)
+{
+	for (const auto& entry : derivedTableColumns)
+	{
+		if (entry.column == column)
+		{
+			return entry.name;
+		}
+	}
+	return nullptr;
+}
+
+void MainWindow::buildCenterPanels()
+{
+	debugPrint("Building center panels...");
+
+	QHBoxLayout* mainLayout = qobject_cast<QHBoxLayout*>(centerFrame->layout());
+
 	// LEFT PANEL: Table and Statistics (50% width)
 	leftPanel = new QWidget(centerFrame);
 	QVBoxLayout* leftLayout = new QVBoxLayout(leftPanel);
@@ -206,6 +549,12 @@ void MainWindow::createCenterFrame()
 	connect(nextSampleButton, &QPushButton::clicked, this, &MainWindow::onNextSample);
 	navLayout->addWidget(nextSampleButton);
 
+	overviewButton = new QPushButton("Overview", sampleNavFrame);
+	overviewButton->setCheckable(true);
+	overviewButton->setToolTip("Show every sample of the sheet as a TPM sparkline");
+	connect(overviewButton, &QPushButton::toggled, this, &MainWindow::onToggleOverview);
+	navLayout->addWidget(overviewButton);
+
 	leftLayout->addWidget(sampleNavFrame);
 
 	// Data table
@@ -214,20 +563,29 @@ void MainWindow::createCenterFrame()
 	dataTable->setRowCount(50); // Default to 50 rows, will expand as needed
 
 	// Set headers
-	QStringList headers;
-	headers << "Puffs" << "Before Weight" << "After Weight" << "Draw Pressure" << "Resistance"
-		<< "Smell" << "Clog" << "Notes" << "TPM (mg/puff)" << "TPM Power Density"
-		<< "Variation in TPM (%)" << "Oil Consumed";
-	dataTable->setHorizontalHeaderLabels(headers);
+	dataTable->setHorizontalHeaderLabels(templateHeaders());
 
 	// Table settings
 	dataTable->horizontalHeader()->setStretchLastSection(true);
 	dataTable->setAlternatingRowColors(true);
 	dataTable->setSelectionBehavior(QAbstractItemView::SelectRows);
 	dataTable->setEditTriggers(QAbstractItemView::DoubleClicked);
+	connect(dataTable, &QTableWidget::itemChanged, this, &MainWindow::onTableItemChanged);
+
+	// Sorting and filtering reorder an index over the sample's columns, never the items
+	dataTable->horizontalHeader()->setSectionsClickable(true);
+	dataTable->horizontalHeader()->setContextMenuPolicy(Qt::CustomContextMenu);
+	connect(dataTable->horizontalHeader(), &QHeaderView::sectionClicked, this, &MainWindow::onTableHeaderClicked);
+	connect(dataTable->horizontalHeader(), &QHeaderView::customContextMenuRequested, this, &MainWindow::onTableHeaderMenu);
 
 	leftLayout->addWidget(dataTable, 3);  // Table gets more space (3x weight)
 
+	// Overview grid, takes the table's place while shown
+	sampleOverview = new SampleOverview(leftPanel);
+	sampleOverview->setVisible(false);
+	connect(sampleOverview, &SampleOverview::sampleActivated, this, &MainWindow::onOverviewSampleActivated);
+	leftLayout->addWidget(sampleOverview, 3);
+
 	// Sample statistics frame
 	statsFrame = new QWidget(leftPanel);
 	QVBoxLayout* statsLayout = new QVBoxLayout(statsFrame);
@@ -272,8 +630,6 @@ void MainWindow::createCenterFrame()
 	rightPanel->setLayout(rightLayout);
 	mainLayout->addWidget(rightPanel, 1);  // 50% width
 
-	centerFrame->setLayout(mainLayout);
-
 	debugPrint("Center frame created with table (left) and plot (right) panels");
 }
 
@@ -285,6 +641,17 @@ void MainWindow::createBottomFrame()
 	QHBoxLayout* layout = new QHBoxLayout(bottomFrame);
 	layout->setContentsMargins(0, 0, 0, 0);
 
+	// Fixed height up front so the deferred image panel does not shift the layout
+	bottomFrame->setLayout(layout);
+	bottomFrame->setFixedHeight(150);
+}
+
+void MainWindow::buildImagePanel()
+{
+	debugPrint("Building image panel...");
+
+	QHBoxLayout* layout = qobject_cast<QHBoxLayout*>(bottomFrame->layout());
+
 	// Load Images Button
 	loadImagesButton = new QPushButton("Load Images", bottomFrame);
 	layout->addWidget(loadImagesButton);
@@ -297,9 +664,6 @@ void MainWindow::createBottomFrame()
 	imageLabel->setMinimumSize(400, 150);
 	layout->addWidget(imageLabel, 1);
 
-	bottomFrame->setLayout(layout);
-	bottomFrame->setFixedHeight(150);
-
 	debugPrint("Bottom frame created with image display area");
 }
 
@@ -317,7 +681,7 @@ void MainWindow::onLoadFile()
 		this,
 		"Load Excel File",
 		"",
-		"Excel Files (*.xlsx *.xls);;All Files(*)"
+		"Data Files (*.xlsx *.xls *.csv *.tsv *.txt);;Excel Files (*.xlsx *.xls);;CSV/TSV Files (*.csv *.tsv *.txt);;All Files(*)"
 	);
 
 	if (filePath.isEmpty()) {
@@ -326,27 +690,38 @@ void MainWindow::onLoadFile()
 	}
 
 	debugPrint("Selected file: " + filePath);
-	
+	openFile(filePath);
+}
+
+bool MainWindow::openFile(const QString& filePath)
+{
+	completeStartup();
+	Metrics::ScopedTimer metric("file.open");
+	m_prefetcher.stop();
+
 	// Load the excel file
 	if (!m_excelReader->loadFile(filePath))
 	{
 		QString error = m_excelReader->getLastError();
 		debugPrint("ERROR: Failed to load file - " + error);
 		QMessageBox::critical(this, "Load Error", "Failed to load Excel file:\n" + error);
-		return;
+		return false;
 	}
 
 	currentFile = filePath;
+	m_sampleEdits.clear();
+	m_comparison.clear();
+	stopLiveAcquisition();
 	debugPrint("File loaded successfully");
+	watchCurrentFile();
 
-	// Update UI
+	// Update UI, populating the sheet dropdown selects (and parses) the first sheet
 	updateFileDropdown();
 	updateSheetDropdown();
-
-	// Load data from first sheet
-	loadExcelData();
+	startPrefetch();
 
 	statusBar()->showMessage("Loaded: " + QFileInfo(filePath).fileName());
+	return true;
 }
 
 void MainWindow::onSaveFile()
@@ -366,6 +741,38 @@ void MainWindow::onSaveFile()
 	QMessageBox::information(this, "Save File", "Excel saving will be implemented");
 }
 
+void MainWindow::onExportFeather()
+{
+	debugPrint("Export Samples to Feather action triggered");
+	completeStartup();
+
+	if (currentFile.isEmpty())
+	{
+		QMessageBox::warning(this, "Export Samples to Feather", "No file is currently loaded");
+		return;
+	}
+
+	QString directory = QFileDialog::getExistingDirectory(this, "Export Samples to Feather", QFileInfo(currentFile).absolutePath());
+	if (directory.isEmpty())
+	{
+		return;
+	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	FeatherExporter exporter;
+	bool exported = exporter.exportWorkbook(m_excelReader->workbook(), directory);
+	QApplication::restoreOverrideCursor();
+
+	if (!exported)
+	{
+		QMessageBox::warning(this, "Export Samples to Feather", "Export failed:\n" + exporter.getLastError());
+		return;
+	}
+
+	statusBar()->showMessage("Exported " + QString::number(exporter.writtenFiles().size()) + " Feather file(s) to " + directory);
+	QMessageBox::information(this, "Export Samples to Feather", exporter.report());
+}
+
 void MainWindow::onExit()
 {
 	debugPrint("Exit action triggered");
@@ -387,9 +794,14 @@ void MainWindow::onSheetSelected(int index)
 		return;
 	}
 
+	Metrics::ScopedTimer metric("sheet.select");
 	QString sheetName = sheetDropdown->itemText(index);
 	debugPrint("Sheet name: " + sheetName);
 
+	// Hit rate of the background prefetch
+	QSharedPointer<const Workbook> workbook = m_excelReader->workbook();
+	Metrics::increment(workbook && workbook->parsedSheet(sheetName) ? "sheet.select.parsed" : "sheet.select.unparsed");
+
 	if (!m_excelReader->selectSheet(sheetName))
 	{
 		QString error = m_excelReader->getLastError();
@@ -414,6 +826,8 @@ void MainWindow::onSheetSelected(int index)
 
 		// Clear the table
 		dataTable->clearContents();
+		m_tableItems = 0;
+		sampleOverview->clear();
 		statusBar()->showMessage("Sheet Skipped - deprecated format");
 		return;
 	}
@@ -422,310 +836,2598 @@ void MainWindow::onSheetSelected(int index)
 	loadExcelData();
 }
 
-void MainWindow::onGenerateTestReport()
+void MainWindow::watchCurrentFile()
 {
-	debugPrint("Generate Test Report action triggered");
-	QMessageBox::information(this, "Generate Test Report", "Test report generation will be implemented here.");
-}
+	if (!fileWatcher->files().isEmpty())
+	{
+		fileWatcher->removePaths(fileWatcher->files());
+	}
 
-void MainWindow::onGenerateFullReport()
-{
-    debugPrint("Generate Full Report action triggered");
-    QMessageBox::information(this, "Generate Full Report", "Full report generation will be implemented here.");
-}
+	reloadTimer->stop();
+	reloadRetries = 0;
 
-void MainWindow::onAbout()
-{
-    debugPrint("About action triggered");
-    QString aboutText = "DataViewer Enterprise v1.0\n"
-                        "Developed by Charlie Becquet\n"
-                        "C++ Qt Implementation";
-    QMessageBox::information(this, "About", aboutText);
+	if (!currentFile.isEmpty())
+	{
+		fileWatcher->addPath(currentFile);
+		debugPrint("Watching file: " + currentFile);
+	}
 }
 
-void MainWindow::onHelp()
+void MainWindow::onWatchedFileChanged(const QString& path)
 {
-	debugPrint("Help action triggered");
-	QString helpText = "DataViewer Enterprise \n\n"
-		"This program is designed to be used with TPM data according to a standardized testing template.\n\n"
-		"Use File -> Load to open data files in the window \n"
-		"Use Reports menu to generate powerpoint reports";
-    QMessageBox::information(this, "Help", helpText);
+	debugPrint("Watched file changed: " + path);
+
+	// Saving by replace (write temp + rename) drops the path from the watcher
+	if (!fileWatcher->files().contains(path) && QFileInfo::exists(path))
+	{
+		fileWatcher->addPath(path);
+	}
+
+	// No background sheet reads against a file that is still being written; the reload restarts them
+	m_prefetcher.stop();
+
+	reloadRetries = 0;
+	reloadTimer->start();
 }
 
-void MainWindow::updateFileDropdown()
+void MainWindow::onReloadChangedFile()
 {
-	debugPrint("Updating file dropdown...");
-	fileDropdown->clear();
+	if (currentFile.isEmpty())
+	{
+		return;
+	}
 
-	if (!currentFile.isEmpty())
+	debugPrint("Reloading changed parts of " + currentFile);
+	Metrics::increment("file.reloads");
+
+	// Rows of the comparison may have moved
+	m_comparison.clear();
+
+	// The reload replaces the workbook, the prefetch restarts on the new one
+	m_prefetcher.stop();
+
+	ExcelReader::ReloadResult result;
+	bool reloaded = m_excelReader->reloadChangedParts(&result);
+	if (reloaded && !result.structureChanged)
 	{
-		QFileInfo fileInfo(currentFile);
-		fileDropdown->addItem(fileInfo.fileName());
-		debugPrint("Added file to dropdown: " + fileInfo.fileName());
+		startPrefetch();
 	}
 
-	debugPrint("File dropdown updated");
-}
+	if (!reloaded)
+	{
+		// Nothing was replaced. The writer may not be done yet, try again a few times before giving up
+		QString error = m_excelReader->getLastError();
+		debugPrint("WARNING: Reload failed - " + error);
 
-void MainWindow::updateSheetDropdown()
-{
-	debugPrint("Updating sheet dropdown...");
-	sheetDropdown->clear();
+		if (reloadRetries < 3)
+		{
+			reloadRetries++;
+			reloadTimer->start();
+		}
 
-	if (currentFile.isEmpty()) {
-		debugPrint("No current file selected");
+		statusBar()->showMessage("File changed but could not be re-read: " + error);
+		startPrefetch();
 		return;
 	}
 
-	// Get sheets from Excel reader
-	QStringList sheets = m_excelReader->getSheetNames();
-	debugPrint("Found " + QString::number(sheets.size()) + " sheets");
-
-	for (const QString& sheet : sheets)
+	if (result.structureChanged)
 	{
-		sheetDropdown->addItem(sheet);
-		debugPrint("Added sheet: " + sheet);
+		reloadWholeFile();
+		return;
 	}
 
-	debugPrint("Sheet dropdown updated");
-}
+	// Edits of samples that changed on disk are dropped, the file wins. Only the
+	// current sheet reports which samples changed, other sheets lose all their edits
+	for (const QString& sheetName : result.changedSheets)
+	{
+		if (sheetName != currentSheet)
+		{
+			discardEdits(sheetName, QVector<int>());
+		}
+		else if (!result.changedSamples.isEmpty())
+		{
+			discardEdits(sheetName, result.changedSamples);
+		}
+	}
 
-void MainWindow::loadExcelData()
-{
-	debugPrint("Loading Excel data from current sheet");
+	// The new workbook is in place even though some sheets kept their old cells
+	if (!result.partialError.isEmpty())
+	{
+		debugPrint("WARNING: Reload incomplete - " + result.partialError);
+		if (reloadRetries < 3)
+		{
+			reloadRetries++;
+			reloadTimer->start();
+		}
+		statusBar()->showMessage("File changed but some sheets could not be re-read: " + result.partialError);
+	}
 
-	if (currentFile.isEmpty() || currentSheet.isEmpty())
+	if (!result.changedSheets.contains(currentSheet))
 	{
-		debugPrint("No file or sheet selected");
+		debugPrint("Current sheet unaffected by file change");
 		return;
 	}
 
-	// Log template info
-	QString templateVersion = m_excelReader->detectTemplateVersion();
-	debugPrint("Template version: " + templateVersion);
-	debugPrint("Processing with 12-column standard format");
+	refreshChangedSamples(result.changedSamples);
+}
 
-	// get all samples from current sheet
-	m_currentSamples = m_excelReader->getAllSamples();
-	debugPrint("Loaded " + QString::number(m_currentSamples.size()) + " samples");
+void MainWindow::refreshChangedSamples(const QVector<int>& changedSamples)
+{
+	debugPrint("Refreshing " + QString::number(changedSamples.size()) + " changed samples");
 
-	// Display first sample if available
-	if (!m_currentSamples.isEmpty())
+	// The re-ingested sheet invalidated the old views
+	m_currentSamples = m_excelReader->sampleViews();
+	int sampleCount = m_currentSamples.size();
+
+	if (overviewButton->isChecked())
 	{
-		displaySample(0);
+		sampleOverview->refreshSamples(m_excelReader->openSheet(currentSheet), changedSamples);
 	}
 	else
 	{
-		dataTable->clearContents();
-		debugPrint("No samples found in sheet");
-		QMessageBox::information(
-			this,
-			"No Data",
-			"No sample data found in this sheet.\n"
-			"The sheet may be empty or have an unexpected format."
-		);
+		sampleOverview->clear();
 	}
-}
 
-void MainWindow::displaySample(int sampleIndex)
-{
-	debugPrint("Displaying sample " + QString::number(sampleIndex + 1));
+	if (m_currentSamples.isEmpty())
+	{
+		m_currentSampleIndex = -1;
+		dataTable->clearContents();
+		m_tableItems = 0;
+		updateSampleNavigation();
+		return;
+	}
 
-	if (sampleIndex < 0 || sampleIndex >= m_currentSamples.size())
+	// The sample being viewed may have been removed
+	if (m_currentSampleIndex < 0 || m_currentSampleIndex >= sampleCount)
 	{
-		debugPrint("ERROR: Invalid sample index: " + QString::number(sampleIndex));
+		displaySample(qBound(0, m_currentSampleIndex, sampleCount - 1));
+		querySheet();
 		return;
 	}
 
-	m_currentSampleIndex = sampleIndex;
-	const ExcelReader::SampleData& sample = m_currentSamples[sampleIndex];
+	if (changedSamples.contains(m_currentSampleIndex))
+	{
+		// Redraw in place, keeping the selection and scroll position
+		int verticalScroll = dataTable->verticalScrollBar()->value();
+		int horizontalScroll = dataTable->horizontalScrollBar()->value();
+		int selectedRow = dataTable->currentRow() >= 0 ? sampleRowOf(dataTable->currentRow()) : -1;
+		int selectedColumn = dataTable->currentColumn();
 
-	// Log sample metadata
-	debugPrint("Sample metadata");
-	debugPrint("  Test Name: " + sample.metadata.testName);
-	debugPrint("  Sample ID: " + sample.metadata.sampleID);
-	debugPrint("  Date: " + sample.metadata.date);
-	debugPrint("  Tester: " + sample.metadata.tester);
-	debugPrint("  Voltage: " + QString::number(sample.metadata.voltage));
-	debugPrint("  Viscosity: " + QString::number(sample.metadata.viscosity));
-	debugPrint("  Resistance: " + QString::number(sample.metadata.resistance));
-	debugPrint("  Puffing Regime: " + sample.metadata.puffingRegime);
-	debugPrint("  Initial Oil Mass: " + QString::number(sample.metadata.initialOilMass));
-	debugPrint("  Data rows: " + QString::number(sample.dataRows.size()));
+		const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+		populateTableWithSample(sample);
+		updateSampleStatistics(sample);
 
-	// Populate table
-	populateTableWithSample(sample);
+		if (selectedRow >= 0 && selectedColumn >= 0 && displayRowOf(selectedRow) >= 0)
+		{
+			dataTable->setCurrentCell(displayRowOf(selectedRow), selectedColumn);
+		}
+		dataTable->verticalScrollBar()->setValue(verticalScroll);
+		dataTable->horizontalScrollBar()->setValue(horizontalScroll);
+	}
+
+	querySheet();
+	updateSampleNavigation();
+
+	statusBar()->showMessage("File updated: " + QString::number(changedSamples.size()) + " sample(s) refreshed");
+}
+
+void MainWindow::reloadWholeFile()
+{
+	debugPrint("Reloading whole file after a structure change");
+
+	QString previousSheet = currentSheet;
+	int previousSample = m_currentSampleIndex;
+	m_prefetcher.stop();
+
+	if (!m_excelReader->loadFile(currentFile))
+	{
+		QString error = m_excelReader->getLastError();
+		debugPrint("ERROR: Failed to reload file - " + error);
+		statusBar()->showMessage("File changed but could not be reloaded: " + error);
+		startPrefetch();
+		return;
+	}
+
+	// Sample blocks may have moved, edits and received rows no longer apply
+	m_sampleEdits.clear();
+	stopLiveAcquisition();
+
+	// Repopulate without selecting the first sheet, then return to the previous one
+	sheetDropdown->blockSignals(true);
+	updateSheetDropdown();
+	int sheetIndex = qMax(0, sheetDropdown->findText(previousSheet));
+	sheetDropdown->setCurrentIndex(sheetIndex);
+	sheetDropdown->blockSignals(false);
+
+	onSheetSelected(sheetDropdown->currentIndex());
+
+	if (sheetDropdown->currentText() == previousSheet && previousSample > 0 && previousSample < m_currentSamples.size())
+	{
+		displaySample(previousSample);
+	}
+	startPrefetch();
+
+	statusBar()->showMessage("File reloaded: " + QFileInfo(currentFile).fileName());
+}
+
+void MainWindow::onGenerateTestReport()
+{
+	debugPrint("Generate Test Report action triggered");
+	QMessageBox::information(this, "Generate Test Report", "Test report generation will be implemented here.");
+}
+
+void MainWindow::onGenerateFullReport()
+{
+    debugPrint("Generate Full Report action triggered");
+    QMessageBox::information(this, "Generate Full Report", "Full report generation will be implemented here.");
+}
+
+void MainWindow::onBenchmarkParser()
+{
+	debugPrint("Benchmark Sheet Parser action triggered");
+
+	if (currentSheet.isEmpty())
+	{
+		QMessageBox::warning(this, "Benchmark Sheet Parser", "Load a file and select a sheet first");
+		return;
+	}
+
+	QString report = m_excelReader->benchmarkSheetParse(currentSheet);
+	if (report.isEmpty())
+	{
+		QMessageBox::warning(this, "Benchmark Sheet Parser", "Benchmark failed:\n" + m_excelReader->getLastError());
+		return;
+	}
+
+	QMessageBox::information(this, "Benchmark Sheet Parser", report);
+}
+
+void MainWindow::onShowIngestStats()
+{
+	debugPrint("Ingest Pipeline Statistics action triggered");
+	completeStartup();
+
+	QString report = m_excelReader->getLastIngestReport();
+	if (report.isEmpty())
+	{
+		QMessageBox::information(this, "Ingest Pipeline Statistics", "No sheet has been parsed yet");
+		return;
+	}
+
+	QMessageBox::information(this, "Ingest Pipeline Statistics", report);
+}
+
+void MainWindow::onStressTestReads()
+{
+	debugPrint("Concurrent Read Stress Test action triggered");
+	completeStartup();
+
+	if (currentFile.isEmpty())
+	{
+		QMessageBox::warning(this, "Concurrent Read Stress Test", "Load a file first");
+		return;
+	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	QString report = m_excelReader->stressTestConcurrentReads();
+	QApplication::restoreOverrideCursor();
+
+	if (report.isEmpty())
+	{
+		QMessageBox::warning(this, "Concurrent Read Stress Test", "Stress test failed:\n" + m_excelReader->getLastError());
+		return;
+	}
+
+	QMessageBox::information(this, "Concurrent Read Stress Test", report);
+}
+
+void MainWindow::onAggregateWorkbooks()
+{
+	debugPrint("Aggregate Across Workbooks action triggered");
+
+	if (!aggregationDialog)
+	{
+		aggregationDialog = new AggregationDialog(this);
+	}
+
+	aggregationDialog->show();
+	aggregationDialog->raise();
+	aggregationDialog->activateWindow();
+}
+
+void MainWindow::onIndexFolder()
+{
+	debugPrint("Index Workbook Folder action triggered");
+	completeStartup();
+	ensureSampleIndex();
+
+	QString directory = QFileDialog::getExistingDirectory(this, "Index Workbook Folder", m_sampleIndex.directory());
+	if (directory.isEmpty())
+	{
+		return;
+	}
+
+	if (directory != m_sampleIndex.directory())
+	{
+		m_sampleIndex.open(directory);
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	bool ok = m_sampleIndex.update();
+	QApplication::restoreOverrideCursor();
+
+	if (!ok)
+	{
+		QMessageBox::warning(this, "Index Workbook Folder", "Some workbooks could not be indexed:\n" + m_sampleIndex.getLastError());
+	}
+
+	QSettings settings;
+	settings.setValue("sampleIndex/directory", directory);
+
+	statusBar()->showMessage("Indexed " + QString::number(m_sampleIndex.documentCount()) + " samples in " +
+		QString::number(m_sampleIndex.fileCount()) + " workbooks (" + QString::number(timer.elapsed()) + " ms)");
+
+	onSearchTextChanged(searchEdit->text());
+}
+
+void MainWindow::onSearchTextChanged(const QString& text)
+{
+	completeStartup();
+	ensureSampleIndex();
+
+	searchResults->clear();
+	m_searchHits.clear();
+
+	if (text.trimmed().isEmpty() || !m_sampleIndex.isOpen())
+	{
+		searchResults->hide();
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	m_searchHits = m_sampleIndex.search(text);
+
+	for (const SampleIndex::Document& hit : m_searchHits)
+	{
+		QStringList description;
+		description << hit.sampleID << hit.tester << hit.media << hit.date;
+		description.removeAll(QString());
+		searchResults->addItem(description.join("  |  ") + "    " +
+			QFileInfo(hit.filePath).fileName() + " / " + hit.sheetName + " / sample " + QString::number(hit.sampleIndex + 1));
+	}
+
+	if (m_searchHits.isEmpty())
+	{
+		searchResults->addItem("No matching samples");
+	}
+
+	statusBar()->showMessage(QString::number(m_searchHits.size()) + " hits in " +
+		QString::number(timer.nsecsElapsed() / 1e6, 'f', 2) + " ms");
+
+	// Drop the list below the search box, right aligned with it
+	QPoint below = searchEdit->mapTo(centralWidget(), QPoint(0, searchEdit->height()));
+	int width = qMax(searchEdit->width() * 2, 500);
+	int rows = qMin(searchResults->count(), 12);
+	int left = qMax(0, below.x() + searchEdit->width() - width);
+	searchResults->setGeometry(left, below.y(), width, rows * searchResults->sizeHintForRow(0) + 2 * searchResults->frameWidth());
+	searchResults->show();
+	searchResults->raise();
+}
+
+void MainWindow::onSearchReturnPressed()
+{
+	if (!m_searchHits.isEmpty())
+	{
+		int row = qMax(0, searchResults->currentRow());
+		openSearchHit(m_searchHits.at(row));
+	}
+}
+
+void MainWindow::onSearchResultActivated(QListWidgetItem* item)
+{
+	int row = searchResults->row(item);
+	if (row >= 0 && row < m_searchHits.size())
+	{
+		openSearchHit(m_searchHits.at(row));
+	}
+}
+
+void MainWindow::openSearchHit(const SampleIndex::Document& hit)
+{
+	debugPrint("Opening search hit: " + hit.filePath + " / " + hit.sheetName + " / " + QString::number(hit.sampleIndex));
+	searchResults->hide();
+
+	if (hit.filePath != currentFile && !openFile(hit.filePath))
+	{
+		return;
+	}
+
+	int sheetIndex = sheetDropdown->findText(hit.sheetName);
+	if (sheetIndex < 0)
+	{
+		QMessageBox::warning(this, "Sample Search", "Sheet \"" + hit.sheetName + "\" no longer exists, re-index the folder");
+		return;
+	}
+
+	// Selecting the sheet parses it and shows its first sample
+	if (sheetIndex != sheetDropdown->currentIndex())
+	{
+		sheetDropdown->setCurrentIndex(sheetIndex);
+	}
+
+	if (hit.sampleIndex < m_currentSamples.size())
+	{
+		displaySample(hit.sampleIndex);
+	}
+}
+
+QTableWidgetItem* MainWindow::tableItem(int row, int col)
+{
+	QTableWidgetItem* item = dataTable->item(row, col);
+	if (!item)
+	{
+		item = new QTableWidgetItem();
+		dataTable->setItem(row, col, item);
+		m_tableItems++;
+	}
+	return item;
+}
+
+MemoryAccounting MainWindow::collectMemoryUsage() const
+{
+	MemoryAccounting accounting;
+
+	// Includes the sample metadata; the sample views themselves share the sheet cells
+	m_excelReader->accountMemory(&accounting);
+
+	// One item per filled cell, each with a small role/value vector and a short text
+	qint64 tableBytes = qint64(m_tableItems) * (sizeof(QTableWidgetItem) + 64 + 64);
+	accounting.add(MemoryAccounting::Table, "Sample table", tableBytes);
+
+	if (m_live->rowCount() > 0)
+	{
+		accounting.add(MemoryAccounting::Cache, "Live acquisition rows", m_live->memoryBytes());
+	}
+	if (sampleOverview)
+	{
+		accounting.add(MemoryAccounting::Cache, "Sample overview tiles", sampleOverview->memoryBytes());
+	}
+
+	for (auto it = m_sampleEdits.constBegin(); it != m_sampleEdits.constEnd(); ++it)
+	{
+		accounting.add(MemoryAccounting::Cache, "Edit history: " + it.key().first + " sample " + QString::number(it.key().second + 1),
+			it.value()->memoryBytes());
+	}
+
+	if (m_sampleIndex.isOpen())
+	{
+		accounting.add(MemoryAccounting::Cache, "Sample search index", m_sampleIndex.memoryBytes());
+	}
+	if (aggregationDialog)
+	{
+		accounting.add(MemoryAccounting::Cache, "Aggregation records", aggregationDialog->memoryBytes());
+	}
+
+	return accounting;
+}
+
+void MainWindow::enforceMemoryBudget()
+{
+	completeStartup();
+
+	MemoryAccounting accounting = collectMemoryUsage();
+	qint64 used = accounting.heapTotal();
+
+	if (m_memoryBudget > 0 && used > m_memoryBudget)
+	{
+		// Release down to 80% of the budget so the next load does not trigger again straight away
+		qint64 target = m_memoryBudget * 8 / 10;
+		debugPrint("Memory budget exceeded: " + MemoryAccounting::formatBytes(used) + " of " +
+			MemoryAccounting::formatBytes(m_memoryBudget));
+
+		// Parsed sheets other than the current one, least recently selected first
+		for (const QString& sheetName : m_excelReader->parsedSheetsByAge())
+		{
+			if (used <= target)
+			{
+				break;
+			}
+			used -= m_excelReader->releaseSheet(sheetName);
+		}
+
+		// Samples are views into the current sheet and hold no cells of their own
+		debugPrint("Now " + MemoryAccounting::formatBytes(used));
+	}
+
+	QString text = "Data: " + MemoryAccounting::formatBytes(used);
+	if (m_memoryBudget > 0)
+	{
+		text += " / " + MemoryAccounting::formatBytes(m_memoryBudget);
+	}
+	qint64 resident = MemoryAccounting::processResidentBytes();
+	if (resident > 0)
+	{
+		text += "  Process: " + MemoryAccounting::formatBytes(resident);
+	}
+	memoryLabel->setText(text);
+}
+
+void MainWindow::onCompareWorkbook()
+{
+	debugPrint("Compare With Earlier Version action triggered");
+	completeStartup();
+
+	if (currentFile.isEmpty())
+	{
+		QMessageBox::warning(this, "Compare With Earlier Version", "Load a file first");
+		return;
+	}
+
+	QString filePath = QFileDialog::getOpenFileName(
+		this,
+		"Compare " + QFileInfo(currentFile).fileName() + " With",
+		QFileInfo(currentFile).absolutePath(),
+		"Data Files (*.xlsx *.xls *.csv *.tsv *.txt);;Excel Files (*.xlsx *.xls);;CSV/TSV Files (*.csv *.tsv *.txt);;All Files(*)"
+	);
+	if (filePath.isEmpty())
+	{
+		return;
+	}
+
+	// The earlier version is only open for the comparison
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	QString error;
+	QSharedPointer<Workbook> before = Workbook::open(filePath, 0, &error);
+	m_comparison.setLabels(QFileInfo(filePath).fileName(), QFileInfo(currentFile).fileName());
+	bool compared = before && m_comparison.compareWorkbooks(before, m_excelReader->workbook());
+	QApplication::restoreOverrideCursor();
+
+	if (!compared)
+	{
+		QMessageBox::warning(this, "Compare With Earlier Version", "Comparison failed:\n" +
+			(error.isEmpty() ? m_comparison.getLastError() : error));
+		m_comparison.clear();
+		return;
+	}
+
+	showComparisonResult("Compare With Earlier Version");
+}
+
+void MainWindow::onCompareSample()
+{
+	debugPrint("Compare Sample With action triggered");
+
+	if (m_currentSampleIndex < 0 || m_currentSampleIndex >= m_currentSamples.size())
+	{
+		QMessageBox::warning(this, "Compare Sample", "Load a file and select a sample first");
+		return;
+	}
+
+	bool ok = false;
+	int other = QInputDialog::getInt(this, "Compare Sample", "Compare sample " + QString::number(m_currentSampleIndex + 1) +
+		" with sample:", m_currentSampleIndex > 0 ? m_currentSampleIndex : qMin(2, m_currentSamples.size()), 1,
+		m_currentSamples.size(), 1, &ok);
+	if (!ok)
+	{
+		return;
+	}
+
+	if (!m_currentSamples[m_currentSampleIndex].isValid())
+	{
+		m_currentSamples = m_excelReader->sampleViews();
+	}
+	if (m_currentSampleIndex >= m_currentSamples.size() || other > m_currentSamples.size())
+	{
+		return;
+	}
+
+	m_comparison.setLabels("sample " + QString::number(other), "sample " + QString::number(m_currentSampleIndex + 1));
+	m_comparison.compareSamples(m_currentSamples[other - 1], m_currentSamples[m_currentSampleIndex], currentSheet, tableHeaders(false));
+	showComparisonResult("Compare Sample");
+}
+
+void MainWindow::onClearComparison()
+{
+	debugPrint("Clear Comparison action triggered");
+
+	m_comparison.clear();
+	clearComparisonAction->setEnabled(false);
+	if (m_currentSampleIndex >= 0 && m_currentSampleIndex < m_currentSamples.size())
+	{
+		displaySample(m_currentSampleIndex);
+	}
+}
+
+void MainWindow::showComparisonResult(const QString& title)
+{
+	clearComparisonAction->setEnabled(true);
+	if (m_currentSampleIndex >= 0 && m_currentSampleIndex < m_currentSamples.size())
+	{
+		displaySample(m_currentSampleIndex);
+	}
+
+	statusBar()->showMessage("Compared " + m_comparison.beforeLabel() + " with " + m_comparison.afterLabel() + " in " +
+		QString::number(m_comparison.elapsedNs() / 1e6, 'f', 0) + " ms");
+
+	QMessageBox box(QMessageBox::Information, title, m_comparison.beforeLabel() + " -> " + m_comparison.afterLabel() + "\n\n" +
+		m_comparison.summary(), QMessageBox::Ok, this);
+	box.setDetailedText(m_comparison.report(50));
+	box.exec();
+}
+
+void MainWindow::onShowMemoryUsage()
+{
+	debugPrint("Memory Usage action triggered");
+
+	enforceMemoryBudget();
+	MemoryAccounting accounting = collectMemoryUsage();
+
+	QString report = accounting.report();
+	report += "\nProcess resident: " + MemoryAccounting::formatBytes(MemoryAccounting::processResidentBytes());
+	report += "\nBudget: " + (m_memoryBudget > 0 ? MemoryAccounting::formatBytes(m_memoryBudget) : QString("none"));
+	report += "\n" + m_prefetcher.report();
+	report += "\n" + DataServerClient::serverReport();
+
+	QMessageBox box(QMessageBox::Information, "Memory Usage", report, QMessageBox::Ok, this);
+	box.setStyleSheet("QLabel { font-family: monospace; }");
+	box.exec();
+}
+
+void MainWindow::onSetMemoryBudget()
+{
+	debugPrint("Memory Budget action triggered");
+
+	bool ok = false;
+	int megabytes = QInputDialog::getInt(this, "Memory Budget",
+		"Budget for loaded data in MB (0 = no budget):", int(m_memoryBudget / (1024 * 1024)), 0, 1024 * 1024, 64, &ok);
+	if (!ok)
+	{
+		return;
+	}
+
+	m_memoryBudget = qint64(megabytes) * 1024 * 1024;
+
+	QSettings settings;
+	settings.setValue("memory/budgetMB", megabytes);
+
+	if (m_memoryBudget > 0)
+	{
+		memoryTimer->start();
+	}
+	else
+	{
+		memoryTimer->stop();
+	}
+	enforceMemoryBudget();
+
+	// The prefetch limit follows the budget
+	if (m_prefetcher.isRunning())
+	{
+		startPrefetch();
+	}
+}
+
+void MainWindow::onTogglePrefetch(bool enabled)
+{
+	debugPrint(QString("Prefetch Sheets ") + (enabled ? "enabled" : "disabled"));
+
+	QSettings settings;
+	settings.setValue("prefetch/enabled", enabled);
+
+	if (enabled)
+	{
+		startPrefetch();
+	}
+	else
+	{
+		m_prefetcher.stop();
+	}
+}
+
+void MainWindow::onToggleDataServer(bool enabled)
+{
+	debugPrint(QString("Shared Data Server ") + (enabled ? "enabled" : "disabled"));
+
+	QSettings settings;
+	settings.setValue("dataServer/enabled", enabled);
+
+	if (!enabled)
+	{
+		// The open workbook keeps its mapped sheets, the server drops it once nothing holds it
+		DataServerClient::disconnectFromServer();
+		statusBar()->showMessage("Files opened from now on are read by this window", 5000);
+		return;
+	}
+
+	QString error;
+	if (!DataServerClient::connectToServer(DataServerClient::defaultServerName(), true, &error))
+	{
+		dataServerAction->setChecked(false);
+		settings.setValue("dataServer/enabled", false);
+		QMessageBox::warning(this, "Shared Data Server", "Cannot use the data server:\n" + error);
+		return;
+	}
+	statusBar()->showMessage("Files opened from now on are shared through " + DataServerClient::serverName(), 5000);
+}
+
+void MainWindow::startPrefetch()
+{
+	QSettings settings;
+	if (!settings.value("prefetch/enabled", true).toBool() || currentFile.isEmpty() || !m_excelReader->workbook())
+	{
+		return;
+	}
+
+	// Sheets in dropdown order, without the one on screen
+	QStringList sheetNames = m_excelReader->getSheetNames();
+	sheetNames.removeAll(currentSheet);
+
+	// Kept below the level the budget releases down to, so prefetching never evicts a viewed sheet
+	qint64 limit = m_memoryBudget > 0 ? m_memoryBudget * 7 / 10 : settings.value("prefetch/limitMB", 1024).toLongLong() * 1024 * 1024;
+	m_prefetcher.setMemoryLimit(limit);
+	m_prefetcher.setIdleMs(settings.value("prefetch/idleMs", 500).toInt());
+	m_prefetcher.start(m_excelReader->workbook(), sheetNames);
+}
+
+void MainWindow::onShowStartupTimeline()
+{
+	debugPrint("Startup Timeline action triggered");
+
+	QSettings settings;
+	QString report = StartupTimeline::report(settings.value("startup/targetMs", 500).toDouble());
+
+	QMessageBox box(QMessageBox::Information, "Startup Timeline", report, QMessageBox::Ok, this);
+	box.setStyleSheet("QLabel { font-family: monospace; }");
+	box.exec();
+}
+
+void MainWindow::onShowMetrics()
+{
+	debugPrint("Latency Metrics action triggered");
+
+	QSettings settings;
+	QMessageBox box(QMessageBox::Information, "Latency Metrics", Metrics::report(), QMessageBox::Ok, this);
+	box.setStyleSheet("QLabel { font-family: monospace; }");
+	QPushButton* saveButton = box.addButton("Save...", QMessageBox::ActionRole);
+	QPushButton* resetButton = box.addButton("Reset", QMessageBox::ResetRole);
+
+	// Collected from installations that turn this on; only the newest files are kept
+	QCheckBox* writeOnExit = new QCheckBox("Write metrics file on exit");
+	writeOnExit->setChecked(settings.value("metrics/writeOnExit", false).toBool());
+	box.setCheckBox(writeOnExit);
+
+	box.exec();
+	settings.setValue("metrics/writeOnExit", writeOnExit->isChecked());
+
+	if (box.clickedButton() == saveButton)
+	{
+		QString filePath = QFileDialog::getSaveFileName(this, "Save Metrics", Metrics::defaultFilePath(), "JSON Files (*.json)");
+		QString error;
+		if (!filePath.isEmpty() && !Metrics::writeFile(filePath, &error))
+		{
+			QMessageBox::warning(this, "Save Metrics", error);
+		}
+	}
+	else if (box.clickedButton() == resetButton)
+	{
+		Metrics::reset();
+		statusBar()->showMessage("Latency metrics reset");
+	}
+}
+
+void MainWindow::onAbout()
+{
+    debugPrint("About action triggered");
+    QString aboutText = "DataViewer Enterprise v1.0\n"
+                        "Developed by Charlie Becquet\n"
+                        "C++ Qt Implementation";
+    QMessageBox::information(this, "About", aboutText);
+}
+
+void MainWindow::onHelp()
+{
+	debugPrint("Help action triggered");
+	QString helpText = "DataViewer Enterprise \n\n"
+		"This program is designed to be used with TPM data according to a standardized testing template.\n\n"
+		"Use File -> Load to open data files in the window \n"
+		"Use Tools -> Live Acquisition to stream puff rows from a rig into the displayed sample\n"
+		"Click a column header to sort the table (Ctrl+click adds a key), right-click it to filter\n"
+		"Use Edit -> Find Rows to highlight rows such as \"Clog\" or \"TPM outside 10% of mean\", F3 for the next match\n"
+		"Use Tools -> Compare With Earlier Version to highlight what a re-issued workbook changed\n"
+		"The other sheets of a file are parsed in the background while idle (Tools -> Prefetch Sheets)\n"
+		"Use Tools -> Shared Data Server to parse each file once for all open viewers\n"
+		"Use Reports menu to generate powerpoint reports";
+    QMessageBox::information(this, "Help", helpText);
+}
+
+void MainWindow::updateFileDropdown()
+{
+	debugPrint("Updating file dropdown...");
+	fileDropdown->clear();
+
+	if (!currentFile.isEmpty())
+	{
+		QFileInfo fileInfo(currentFile);
+		fileDropdown->addItem(fileInfo.fileName());
+		debugPrint("Added file to dropdown: " + fileInfo.fileName());
+	}
+
+	debugPrint("File dropdown updated");
+}
+
+void MainWindow::updateSheetDropdown()
+{
+	debugPrint("Updating sheet dropdown...");
+	sheetDropdown->clear();
+
+	if (currentFile.isEmpty()) {
+		debugPrint("No current file selected");
+		return;
+	}
+
+	// Get sheets from Excel reader
+	QStringList sheets = m_excelReader->getSheetNames();
+	debugPrint("Found " + QString::number(sheets.size()) + " sheets");
+
+	for (const QString& sheet : sheets)
+	{
+		sheetDropdown->addItem(sheet);
+		debugPrint("Added sheet: " + sheet);
+	}
+
+	debugPrint("Sheet dropdown updated");
+}
+
+void MainWindow::loadExcelData()
+{
+	debugPrint("Loading Excel data from current sheet");
+
+	if (currentFile.isEmpty() || currentSheet.isEmpty())
+	{
+		debugPrint("No file or sheet selected");
+		return;
+	}
+
+	Metrics::ScopedTimer metric("sheet.load");
+
+	// Log template info
+	QString templateVersion = m_excelReader->detectTemplateVersion();
+	debugPrint("Template version: " + templateVersion);
+	debugPrint("Processing with 12-column standard format");
+
+	// Views of all samples in the current sheet, the cells stay in the reader
+	m_currentSamples = m_excelReader->sampleViews();
+	debugPrint("Loaded " + QString::number(m_currentSamples.size()) + " samples");
+	updateOverview();
+
+	// Display first sample if available
+	if (!m_currentSamples.isEmpty())
+	{
+		displaySample(0);
+		querySheet();
+	}
+	else
+	{
+		dataTable->clearContents();
+		m_tableItems = 0;
+		debugPrint("No samples found in sheet");
+		QMessageBox::information(
+			this,
+			"No Data",
+			"No sample data found in this sheet.\n"
+			"The sheet may be empty or have an unexpected format."
+		);
+	}
+
+	enforceMemoryBudget();
+}
+
+void MainWindow::displaySample(int sampleIndex)
+{
+	debugPrint("Displaying sample " + QString::number(sampleIndex + 1));
+
+	if (sampleIndex < 0 || sampleIndex >= m_currentSamples.size())
+	{
+		debugPrint("ERROR: Invalid sample index: " + QString::number(sampleIndex));
+		return;
+	}
+
+	Metrics::ScopedTimer metric("sample.display");
+	m_currentSampleIndex = sampleIndex;
+
+	// Views go stale when the reader replaces or frees sheet storage
+	if (!m_currentSamples[sampleIndex].isValid())
+	{
+		m_currentSamples = m_excelReader->sampleViews();
+		if (sampleIndex >= m_currentSamples.size())
+		{
+			debugPrint("ERROR: Sample no longer exists: " + QString::number(sampleIndex));
+			return;
+		}
+	}
+
+	const ExcelReader::SampleView& sample = m_currentSamples[sampleIndex];
+
+	// Log sample metadata
+	debugPrint("Sample metadata");
+	debugPrint("  Test Name: " + sample.metadata().testName);
+	debugPrint("  Sample ID: " + sample.metadata().sampleID);
+	debugPrint("  Date: " + sample.metadata().date);
+	debugPrint("  Tester: " + sample.metadata().tester);
+	debugPrint("  Voltage: " + QString::number(sample.metadata().voltage));
+	debugPrint("  Viscosity: " + QString::number(sample.metadata().viscosity));
+	debugPrint("  Resistance: " + QString::number(sample.metadata().resistance));
+	debugPrint("  Puffing Regime: " + sample.metadata().puffingRegime);
+	debugPrint("  Initial Oil Mass: " + QString::number(sample.metadata().initialOilMass));
+	debugPrint("  Data rows: " + QString::number(sample.rowCount()));
+
+	// Populate table
+	populateTableWithSample(sample);
+
+	// Update naviagation controls
+	updateSampleNavigation();
+	sampleOverview->setCurrentSample(sampleIndex);
+
+	// Update Sample Statistics
+	updateSampleStatistics(sample);
+	updatePlot();
+
+	statusBar()->showMessage("Displaying sample " + QString::number(sampleIndex + 1) +
+		" of " + QString::number(m_currentSamples.size()) + " - " + sample.metadata().sampleID);
+}
+
+void MainWindow::onPrevSample()
+{
+	debugPrint("Previous sample button clicked");
+
+	if (m_currentSampleIndex > 0)
+	{
+		Metrics::increment("sample.previous");
+		displaySample(m_currentSampleIndex - 1);
+	}
+	else
+	{
+		debugPrint("Already at first sample");
+	}
+}
+
+void MainWindow::onNextSample()
+{
+	debugPrint("Next sample button clicked");
+
+	if (m_currentSampleIndex < m_currentSamples.size() - 1)
+	{
+		Metrics::increment("sample.next");
+		displaySample(m_currentSampleIndex + 1);
+	}
+	else
+	{
+		debugPrint("Already at last sample");
+	}
+}
+
+void MainWindow::onToggleOverview(bool checked)
+{
+	debugPrint(QString("Overview ") + (checked ? "shown" : "hidden"));
+
+	dataTable->setVisible(!checked);
+	sampleOverview->setVisible(checked);
+
+	if (!checked)
+	{
+		statusBar()->showMessage(sampleOverview->renderReport());
+		return;
+	}
+
+	// Tiles cached while hidden are kept as long as the sheet is the same
+	if (sampleOverview->sheetName() != currentSheet || sampleOverview->sampleCount() != m_currentSamples.size())
+	{
+		updateOverview();
+	}
+	statusBar()->showMessage(QString::number(m_currentSamples.size()) + " samples - click one to open it");
+}
+
+void MainWindow::onOverviewSampleActivated(int sampleIndex)
+{
+	overviewButton->setChecked(false);
+	displaySample(sampleIndex);
+}
+
+void MainWindow::updateOverview()
+{
+	// A hidden overview lets go of its tiles, they are rendered again when it is shown
+	if (overviewButton->isChecked() && !currentSheet.isEmpty())
+	{
+		sampleOverview->setSheet(m_excelReader->openSheet(currentSheet));
+	}
+	else
+	{
+		sampleOverview->clear();
+	}
+	sampleOverview->setCurrentSample(m_currentSampleIndex);
+}
+
+void MainWindow::updateSampleNavigation()
+{
+	debugPrint("Updating sample navigation controls");
+
+	updateEditActions();
+
+	if (m_currentSamples.isEmpty())
+	{
+		prevSampleButton->setEnabled(false);
+		nextSampleButton->setEnabled(false);
+		sampleCountLabel->setText("No samples");
+		return;
+	}
+
+	// Update label
+	sampleCountLabel->setText("Sample " + QString::number(m_currentSampleIndex + 1) +
+		" of " + QString::number(m_currentSamples.size()));
+
+	// Enable/disable buttons
+	prevSampleButton->setEnabled(m_currentSampleIndex > 0);
+	nextSampleButton->setEnabled(m_currentSampleIndex < m_currentSamples.size() - 1);
+
+	debugPrint("Navigation updated: " + QString::number(m_currentSampleIndex + 1) +
+		"/" + QString::number(m_currentSamples.size()));
+}
+
+void MainWindow::updateSampleStatistics(const ExcelReader::SampleView& sample)
+{
+	debugPrint("Updating sample statistics display");
+	Metrics::ScopedTimer metric("stats.update");
+
+	// Build statistics HTML
+	QString statsHtml = "<table style='width:100%; font-size:10pt;'>";
+
+	// Sample identification
+	statsHtml += "<tr><td style='font-weight:bold; width:40%;'>Sample ID:</td><td>" +
+		sample.metadata().sampleID + "</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Date:</td><td>" +
+		sample.metadata().date + "</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Tester:</td><td>" +
+		sample.metadata().tester + "</td></tr>";
+
+	// Device parameters
+	statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Device Parameters</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Media:</td><td>" +
+		sample.metadata().media + "</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Viscosity:</td><td>" +
+		QString::number(sample.metadata().viscosity, 'f', 0) + " cP</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Resistance:</td><td>" +
+		QString::number(sample.metadata().resistance, 'f', 2) + " Ω</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Voltage:</td><td>" +
+		QString::number(sample.metadata().voltage, 'f', 1) + " V</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Power:</td><td>" +
+		QString::number(sample.metadata().power, 'f', 2) + " W</td></tr>";
+
+	if (!sample.metadata().heatingTechnology.isEmpty())
+	{
+		statsHtml += "<tr><td style='font-weight:bold;'>Heating Tech:</td><td>" +
+			sample.metadata().heatingTechnology + "</td></tr>";
+	}
+
+	// Test parameters
+	statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Test Parameters</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Puffing Regime:</td><td>" +
+		sample.metadata().puffingRegime + "</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Initial Oil Mass:</td><td>" +
+		QString::number(sample.metadata().initialOilMass, 'f', 2) + " g</td></tr>";
+	statsHtml += "<tr><td style='font-weight:bold;'>Total Puffs:</td><td>" +
+		QString::number(sample.rowCount() + liveRowCount()) + "</td></tr>";
+
+	// Results from the derived columns loaded with this sample
+	double averageTpm = m_derivedColumns.scalar("tpmMean");
+	const QVector<double>& oilConsumed = m_derivedColumns.column("oilConsumed");
+	double totalOil = qQNaN();
+	for (int row = oilConsumed.size() - 1; row >= 0 && qIsNaN(totalOil); row--)
+	{
+		totalOil = oilConsumed[row];
+	}
+
+	if (!qIsNaN(averageTpm))
+	{
+		statsHtml += "<tr><td style='font-weight:bold;'>Average TPM:</td><td>" +
+			QString::number(averageTpm, 'f', 2) + " mg/puff</td></tr>";
+	}
+	if (!qIsNaN(totalOil))
+	{
+		statsHtml += "<tr><td style='font-weight:bold;'>Oil Consumed:</td><td>" +
+			QString::number(totalOil, 'f', 3) + " g</td></tr>";
+	}
+
+	// Running statistics of the received rows, kept up to date as they arrive
+	if (liveSampleDisplayed())
+	{
+		const LiveAcquisition::ColumnStats& puffs = m_live->columnStats(0);
+		const LiveAcquisition::ColumnStats& afterWeight = m_live->columnStats(2);
+
+		statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Live Acquisition</td></tr>";
+		statsHtml += "<tr><td style='font-weight:bold;'>Status:</td><td>" +
+			(m_live->isListening() ? "Listening, " + QString::number(m_live->connectionCount()) + " writer(s)" : QString("Stopped")) + "</td></tr>";
+		statsHtml += "<tr><td style='font-weight:bold;'>Rows Received:</td><td>" + QString::number(m_live->rowCount()) +
+			(m_live->rejectedLines() > 0 ? " (" + QString::number(m_live->rejectedLines()) + " lines rejected)" : QString()) + "</td></tr>";
+		statsHtml += "<tr><td style='font-weight:bold;'>Rate:</td><td>" +
+			QString::number(m_live->rowsPerSecond(), 'f', 0) + " rows/s</td></tr>";
+		if (puffs.count > 0)
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>Last Puff Count:</td><td>" +
+				QString::number(puffs.max, 'f', 0) + "</td></tr>";
+		}
+		if (afterWeight.count > 0)
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>After Weight:</td><td>" + QString::number(afterWeight.max, 'f', 4) +
+				" to " + QString::number(afterWeight.min, 'f', 4) + " g</td></tr>";
+		}
+	}
+
+	// Against the version or sample it was compared with
+	const WorkbookDiff::SampleDiff* diff = m_comparison.sampleDiff(currentSheet, sample.sampleIndex());
+	if (diff)
+	{
+		statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Changes Since " +
+			m_comparison.beforeLabel().toHtmlEscaped() + "</td></tr>";
+		if (diff->status == WorkbookDiff::Added)
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>Sample:</td><td>Added</td></tr>";
+		}
+		else
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>Rows:</td><td>" + QString::number(diff->addedRows) + " added, " +
+				QString::number(diff->removedRows) + " removed, " + QString::number(diff->modifiedRows) + " modified</td></tr>";
+		}
+		for (const WorkbookDiff::FieldDiff& field : diff->metadata)
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>" + field.field + ":</td><td>" + field.before.toHtmlEscaped() +
+				" &rarr; " + field.after.toHtmlEscaped() + "</td></tr>";
+		}
+
+		// Removed rows have no place in the table
+		QStringList removedPuffs;
+		for (const WorkbookDiff::RowDiff& row : diff->rows)
+		{
+			if (row.change == WorkbookDiff::RowRemoved && removedPuffs.size() < 10)
+			{
+				removedPuffs << (qIsNaN(row.puff) ? "row " + QString::number(row.beforeRow + 1) : QString::number(row.puff, 'g', 12));
+			}
+		}
+		if (!removedPuffs.isEmpty())
+		{
+			statsHtml += "<tr><td style='font-weight:bold;'>Removed Puffs:</td><td>" + removedPuffs.join(", ") +
+				(diff->removedRows > removedPuffs.size() ? ", ..." : QString()) + "</td></tr>";
+		}
+	}
+
+	statsHtml += "</table>";
+
+	statsLabel->setText(statsHtml);
+	debugPrint("Statistics updated");
+}
+
+void MainWindow::populateTableWithSample(const ExcelReader::SampleView& sample)
+{
+	debugPrint("Populating table with sample data");
+	Metrics::ScopedTimer metric("table.populate");
+
+	loadDerivedInputs(sample);
+
+	// Filling the table is not an edit
+	dataTable->blockSignals(true);
+
+	// Clear existing data
+	dataTable->clearContents();
+	m_tableItems = 0;
+
+	// set row count based on data, received live rows follow the sample's own
+	int rowCount = sample.rowCount();
+	int liveRows = liveRowCount();
+	computeRowOrder(sample);
+	evaluateQuery(sample);
+	if (rowOrderActive())
+	{
+		// Exactly the rows that pass the filters
+		dataTable->setRowCount(m_rowOrder.size());
+	}
+	else if (rowCount + liveRows > dataTable->rowCount())
+	{
+		dataTable->setRowCount(rowCount + liveRows);
+		debugPrint("Expanded Table to " + QString::number(rowCount + liveRows) + " rows");
+	}
+
+	// get column headers
+	QStringList headers = tableHeaders();
+	if (!headers.isEmpty())
+	{
+		dataTable->setHorizontalHeaderLabels(headers);
+		debugPrint("Set column headers: " + headers.join(", "));
+	}
+
+	// populate column by column, the formatting follows the column type; table row
+	// displayRow shows sample row sampleRowOf(displayRow), live rows are filled below
+	int displayRows = rowOrderActive() ? m_rowOrder.size() : rowCount;
+	for (int col = 0; col < sample.columnCount() && col < dataTable->columnCount(); col++)
+	{
+		ExcelReader::ColumnSpan column = sample.column(col);
+
+		for (int displayRow = 0; displayRow < displayRows; displayRow++)
+		{
+			int row = sampleRowOf(displayRow);
+			if (row >= rowCount)
+			{
+				continue;
+			}
+
+			QTableWidgetItem* item = new QTableWidgetItem();
+			double numValue = column.numbers ? column.numbers[row] : qQNaN();
+
+			if (column.type == XlsxSheet::NumericColumn && !qIsNaN(numValue))
+			{
+				// format numeric values
+				item->setText(QString::number(numValue, 'f', 4));
+				item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+			}
+			else if (column.type == XlsxSheet::FlagColumn && !qIsNaN(numValue))
+			{
+				item->setText(numValue != 0.0 ? "true" : "false");
+			}
+			else if (column.type == XlsxSheet::TextColumn || column.type == XlsxSheet::VariantColumn || column.hasStrays)
+			{
+				item->setText(sample.value(row, col).toString());
+			}
+
+			dataTable->setItem(displayRow, col, item);
+			m_tableItems++;
+		}
+	}
+
+	// Edited cells of this sample on top of the sheet values
+	SampleEditHistory* edits = currentEdits();
+	if (edits)
+	{
+		for (const QPair<int, int>& cell : edits->editedCells())
+		{
+			if (cell.second < dataTable->columnCount())
+			{
+				showCellValue(cell.first, cell.second, edits->value(cell.first, cell.second), sample.columnType(cell.second));
+			}
+		}
+	}
+
+	showLiveRows(0, liveRows);
+	m_liveRowsShown = liveRows;
+
+	showDerivedColumns(0, rowCount + liveRows);
+	showQueryMatches();
+	showComparison(sample);
+
+	// Auto resize columns to content
+	dataTable->resizeColumnsToContents();
+
+	dataTable->blockSignals(false);
+
+	debugPrint("Table populated with " + QString::number(rowCount) + " rows");
+}
+
+// Text of a cell as the table shows it, numbers follow the column type
+static QString cellText(const QVariant& value, XlsxSheet::ColumnType type)
+{
+	bool isNumber = value.type() == QVariant::Double || value.type() == QVariant::Int ||
+		value.type() == QVariant::LongLong || value.type() == QVariant::Bool;
+
+	if (isNumber && type == XlsxSheet::NumericColumn)
+	{
+		return QString::number(value.toDouble(), 'f', 4);
+	}
+	if (isNumber && type == XlsxSheet::FlagColumn)
+	{
+		return value.toDouble() != 0.0 ? "true" : "false";
+	}
+	return value.toString();
+}
+
+void MainWindow::showCellValue(int row, int col, const QVariant& value, XlsxSheet::ColumnType type)
+{
+	int displayRow = displayRowOf(row);
+	if (displayRow < 0)
+	{
+		return;
+	}
+
+	QTableWidgetItem* item = tableItem(displayRow, col);
+
+	item->setText(cellText(value, type));
+	bool alignRight = type == XlsxSheet::NumericColumn && value.type() != QVariant::String;
+	item->setTextAlignment(alignRight ? Qt::AlignRight | Qt::AlignVCenter : Qt::AlignLeft | Qt::AlignVCenter);
+
+	SampleEditHistory* edits = currentEdits();
+	item->setToolTip(edits && edits->isEdited(row, col) ? "Edited" : QString());
+}
+
+void MainWindow::showDerivedColumns(int firstRow, int lastRow)
+{
+	for (const auto& entry : derivedTableColumns)
+	{
+		if (entry.column >= dataTable->columnCount())
+		{
+			continue;
+		}
+
+		const QVector<double>& values = m_derivedColumns.column(entry.name);
+		for (int row = firstRow; row < lastRow && row < values.size(); row++)
+		{
+			int displayRow = displayRowOf(row);
+			if (qIsNaN(values[row]) || displayRow < 0)
+			{
+				continue;
+			}
+
+			// Edit the inputs instead
+			QTableWidgetItem* item = dataTable->item(displayRow, entry.column);
+			item->setText(QString::number(values[row], 'f', 4));
+			item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+			item->setToolTip("Computed from the weights and sample power");
+			item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+		}
+	}
+}
+
+void MainWindow::showComparison(const ExcelReader::SampleView& sample)
+{
+	const WorkbookDiff::SampleDiff* diff = m_comparison.sampleDiff(currentSheet, sample.sampleIndex());
+	if (!diff)
+	{
+		return;
+	}
+
+	// Added rows in green, changed cells in amber with the earlier value in the tooltip
+	for (const WorkbookDiff::RowDiff& row : diff->rows)
+	{
+		int displayRow = row.afterRow >= 0 ? displayRowOf(row.afterRow) : -1;
+		if (displayRow < 0)
+		{
+			continue;
+		}
+
+		for (int col = 0; col < dataTable->columnCount() && col < 12; col++)
+		{
+			if (row.change == WorkbookDiff::RowModified && !(row.changedColumns & (1 << col)))
+			{
+				continue;
+			}
+
+			QTableWidgetItem* item = tableItem(displayRow, col);
+
+			if (row.change == WorkbookDiff::RowAdded)
+			{
+				item->setBackground(QColor(200, 235, 200));
+				item->setToolTip("Added since " + m_comparison.beforeLabel());
+			}
+			else
+			{
+				QString before = cellText(row.before.value(col), sample.columnType(col));
+				item->setBackground(QColor(255, 225, 150));
+				item->setToolTip("Was: " + (before.isEmpty() ? QString("(blank)") : before) + " in " + m_comparison.beforeLabel());
+			}
+		}
+	}
+}
+
+// Puffs, before and after weight are the first three template columns
+static const char* derivedInputs[] = { "puffs", "beforeWeight", "afterWeight" };
+
+// Inputs of the computed columns as they are in the sheet
+static void readDerivedInputs(const ExcelReader::SampleView& sample, QVector<double>* values)
+{
+	for (int col = 0; col < 3; col++)
+	{
+		ExcelReader::ColumnSpan span = sample.column(col);
+		values[col] = QVector<double>(span.size, qQNaN());
+		if (span.numbers)
+		{
+			std::copy(span.numbers, span.numbers + span.size, values[col].begin());
+		}
+	}
+}
+
+void MainWindow::loadDerivedInputs(const ExcelReader::SampleView& sample)
+{
+	QVector<double> values[3];
+	readDerivedInputs(sample, values);
+
+	// Received live rows continue the columns
+	if (liveRowCount() > 0)
+	{
+		for (int col = 0; col < 3; col++)
+		{
+			values[col] += m_live->column(col);
+		}
+	}
+
+	// Table edits replace the sheet values
+	SampleEditHistory* edits = currentEdits();
+	if (edits)
+	{
+		for (const QPair<int, int>& cell : edits->editedCells())
+		{
+			if (cell.second < 3 && cell.first < values[cell.second].size())
+			{
+				values[cell.second][cell.first] = edits->number(cell.first, cell.second);
+			}
+		}
+	}
+
+	int invalidated = 0;
+	for (int col = 0; col < 3; col++)
+	{
+		invalidated += m_derivedColumns.setInput(derivedInputs[col], values[col]);
+	}
+	invalidated += m_derivedColumns.setParameter("power", sample.metadata().power);
+
+	debugPrint("Derived columns: " + QString::number(invalidated) + " invalidated");
+}
+
+SampleEditHistory* MainWindow::currentEdits() const
+{
+	return m_sampleEdits.value(qMakePair(currentSheet, m_currentSampleIndex)).data();
+}
+
+void MainWindow::onTableItemChanged(QTableWidgetItem* item)
+{
+	if (!item || m_currentSampleIndex < 0 || m_currentSampleIndex >= m_currentSamples.size())
+	{
+		return;
+	}
+
+	int row = sampleRowOf(item->row());
+	int col = item->column();
+	const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+	XlsxSheet::ColumnType type = sample.columnType(col);
+	SampleEditHistory* edits = currentEdits();
+
+	// Committing the editor without a change still reports the item
+	QVariant current = edits ? edits->value(row, col) : sample.value(row, col);
+	QString text = item->text();
+	if (text == cellText(current, type))
+	{
+		return;
+	}
+
+	// Typed the way the column is: numbers stay numbers, anything else is kept as text
+	QVariant value = text;
+	bool ok = false;
+	double number = text.trimmed().toDouble(&ok);
+	if (type == XlsxSheet::FlagColumn && (text.trimmed() == "true" || text.trimmed() == "false"))
+	{
+		value = (text.trimmed() == "true");
+	}
+	else if (ok && type != XlsxSheet::TextColumn)
+	{
+		value = number;
+	}
+
+	if (!edits)
+	{
+		SheetHandle sheet = m_excelReader->openSheet(currentSheet);
+		if (!sheet.isValid())
+		{
+			statusBar()->showMessage("Cannot edit: " + sheet.getLastError());
+			refreshEditedCell(qMakePair(row, col));
+			return;
+		}
+
+		QSharedPointer<SampleEditHistory> history(new SampleEditHistory(sheet, m_currentSampleIndex));
+		m_sampleEdits.insert(qMakePair(currentSheet, m_currentSampleIndex), history);
+		edits = history.data();
+	}
+
+	if (edits->setValue(row, col, value))
+	{
+		Metrics::increment("table.edits");
+		statusBar()->showMessage("Edited row " + QString::number(row + 1) + ", column " + QString::number(col + 1));
+	}
+
+	// Normalise the text and update what depends on the cell
+	refreshEditedCell(qMakePair(row, col));
+	updateEditActions();
+}
+
+void MainWindow::refreshEditedCell(const QPair<int, int>& cell)
+{
+	if (m_currentSampleIndex < 0 || m_currentSampleIndex >= m_currentSamples.size() || cell.second >= dataTable->columnCount())
+	{
+		return;
+	}
+
+	const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+	SampleEditHistory* edits = currentEdits();
+
+	dataTable->blockSignals(true);
+	showCellValue(cell.first, cell.second, edits ? edits->value(cell.first, cell.second) : sample.value(cell.first, cell.second),
+		sample.columnType(cell.second));
+
+	// Puffs and weights feed the computed columns and the statistics
+	if (cell.second < 3)
+	{
+		loadDerivedInputs(sample);
+		showDerivedColumns(0, sample.rowCount() + liveRowCount());
+		updateSampleStatistics(sample);
+	}
+	dataTable->blockSignals(false);
+}
+
+void MainWindow::onUndo()
+{
+	debugPrint("Undo action triggered");
+
+	SampleEditHistory* edits = currentEdits();
+	if (!edits || !edits->canUndo())
+	{
+		return;
+	}
+
+	QPair<int, int> cell = edits->undoCell();
+	edits->undo();
+	refreshEditedCell(cell);
+	if (displayRowOf(cell.first) >= 0)
+	{
+		dataTable->setCurrentCell(displayRowOf(cell.first), cell.second);
+	}
+	updateEditActions();
+
+	statusBar()->showMessage("Undid edit of row " + QString::number(cell.first + 1) + ", column " + QString::number(cell.second + 1));
+}
+
+void MainWindow::onRedo()
+{
+	debugPrint("Redo action triggered");
+
+	SampleEditHistory* edits = currentEdits();
+	if (!edits || !edits->canRedo())
+	{
+		return;
+	}
+
+	QPair<int, int> cell = edits->redoCell();
+	edits->redo();
+	refreshEditedCell(cell);
+	if (displayRowOf(cell.first) >= 0)
+	{
+		dataTable->setCurrentCell(displayRowOf(cell.first), cell.second);
+	}
+	updateEditActions();
+
+	statusBar()->showMessage("Redid edit of row " + QString::number(cell.first + 1) + ", column " + QString::number(cell.second + 1));
+}
+
+void MainWindow::onTableHeaderClicked(int column)
+{
+	debugPrint("Header clicked: column " + QString::number(column + 1));
+
+	// Click sorts by the column, again for descending, a third time back to sheet order.
+	// Ctrl+click adds the column as a further key, or flips it when it already is one
+	int existing = -1;
+	for (int i = 0; i < m_sortColumns.size(); i++)
+	{
+		if (m_sortColumns[i].first == column)
+		{
+			existing = i;
+		}
+	}
+
+	if (QApplication::keyboardModifiers() & Qt::ControlModifier)
+	{
+		if (existing >= 0)
+		{
+			m_sortColumns[existing].second = !m_sortColumns[existing].second;
+		}
+		else
+		{
+			m_sortColumns.append(qMakePair(column, false));
+		}
+	}
+	else if (m_sortColumns.size() == 1 && existing == 0)
+	{
+		if (!m_sortColumns[0].second)
+		{
+			m_sortColumns[0].second = true;
+		}
+		else
+		{
+			m_sortColumns.clear();
+		}
+	}
+	else
+	{
+		m_sortColumns = { qMakePair(column, false) };
+	}
+
+	applyRowOrder();
+}
+
+void MainWindow::onTableHeaderMenu(const QPoint& position)
+{
+	int column = dataTable->horizontalHeader()->logicalIndexAt(position);
+	if (column < 0)
+	{
+		return;
+	}
+
+	QString title = tableHeaders(false).value(column);
+	bool isKey = false;
+	bool isFiltered = false;
+	for (const QPair<int, bool>& key : m_sortColumns)
+	{
+		isKey = isKey || key.first == column;
+	}
+	for (const ColumnFilter& filter : m_columnFilters)
+	{
+		isFiltered = isFiltered || filter.column == column;
+	}
+
+	QMenu menu(this);
+	QAction* ascendingAction = menu.addAction("Sort Ascending");
+	QAction* descendingAction = menu.addAction("Sort Descending");
+	QAction* thenByAction = menu.addAction("Then Sort By \"" + title + "\"");
+	thenByAction->setEnabled(!m_sortColumns.isEmpty() && !isKey);
+	menu.addSeparator();
+	QAction* filterAction = menu.addAction("Filter \"" + title + "\"...");
+	QAction* clearFilterAction = menu.addAction("Clear Column Filter");
+	clearFilterAction->setEnabled(isFiltered);
+	menu.addSeparator();
+	QAction* resetAction = menu.addAction("Show All Rows in Sheet Order");
+	resetAction->setEnabled(rowOrderActive());
+
+	QAction* chosen = menu.exec(dataTable->horizontalHeader()->mapToGlobal(position));
+	if (!chosen)
+	{
+		return;
+	}
+
+	if (chosen == ascendingAction || chosen == descendingAction)
+	{
+		m_sortColumns = { qMakePair(column, chosen == descendingAction) };
+	}
+	else if (chosen == thenByAction)
+	{
+		m_sortColumns.append(qMakePair(column, false));
+	}
+	else if (chosen == filterAction)
+	{
+		if (!askColumnFilter(column))
+		{
+			return;
+		}
+	}
+	else if (chosen == clearFilterAction)
+	{
+		for (int i = m_columnFilters.size() - 1; i >= 0; i--)
+		{
+			if (m_columnFilters[i].column == column)
+			{
+				m_columnFilters.remove(i);
+			}
+		}
+	}
+	else if (chosen == resetAction)
+	{
+		m_sortColumns.clear();
+		m_columnFilters.clear();
+	}
+
+	applyRowOrder();
+}
+
+bool MainWindow::askColumnFilter(int column)
+{
+	QString title = tableHeaders(false).value(column);
+	XlsxSheet::ColumnType type = XlsxSheet::NumericColumn;
+	if (m_currentSampleIndex >= 0 && m_currentSampleIndex < m_currentSamples.size() && !derivedColumnName(column))
+	{
+		type = m_currentSamples[m_currentSampleIndex].columnType(column);
+	}
+
+	// Text columns compare whole values only
+	QList<RowIndex::Comparison> comparisons;
+	if (type == XlsxSheet::TextColumn)
+	{
+		comparisons << RowIndex::Equal << RowIndex::NotEqual << RowIndex::Blank << RowIndex::NotBlank;
+	}
+	else
+	{
+		comparisons << RowIndex::Less << RowIndex::LessOrEqual << RowIndex::Greater << RowIndex::GreaterOrEqual
+			<< RowIndex::Equal << RowIndex::NotEqual << RowIndex::Blank << RowIndex::NotBlank;
+	}
+	QStringList names;
+	for (RowIndex::Comparison comparison : comparisons)
+	{
+		names << RowIndex::comparisonName(comparison);
+	}
+
+	bool ok = false;
+	QString name = QInputDialog::getItem(this, "Filter " + title, "Show rows where " + title, names, 0, false, &ok);
+	if (!ok)
+	{
+		return false;
+	}
+
+	ColumnFilter filter;
+	filter.column = column;
+	filter.comparison = comparisons[names.indexOf(name)];
+	filter.operand = 0.0;
+
+	if (filter.comparison != RowIndex::Blank && filter.comparison != RowIndex::NotBlank)
+	{
+		filter.text = QInputDialog::getText(this, "Filter " + title, title + " " + name, QLineEdit::Normal, QString(), &ok).trimmed();
+		if (!ok)
+		{
+			return false;
+		}
+
+		bool isNumber = false;
+		if (type == XlsxSheet::FlagColumn && (filter.text == "true" || filter.text == "false"))
+		{
+			filter.operand = filter.text == "true" ? 1.0 : 0.0;
+			isNumber = true;
+		}
+		else
+		{
+			filter.operand = filter.text.toDouble(&isNumber);
+		}
+
+		if (type != XlsxSheet::TextColumn && !isNumber)
+		{
+			QMessageBox::warning(this, "Filter " + title, "\"" + filter.text + "\" is not a number.");
+			return false;
+		}
+	}
+
+	// One filter per column, the new one replaces it
+	for (int i = m_columnFilters.size() - 1; i >= 0; i--)
+	{
+		if (m_columnFilters[i].column == column)
+		{
+			m_columnFilters.remove(i);
+		}
+	}
+	m_columnFilters.append(filter);
+	return true;
+}
+
+void MainWindow::applyRowOrder()
+{
+	if (m_currentSampleIndex < 0 || m_currentSampleIndex >= m_currentSamples.size())
+	{
+		dataTable->setHorizontalHeaderLabels(tableHeaders());
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	if (m_currentSamples[m_currentSampleIndex].isValid())
+	{
+		populateTableWithSample(m_currentSamples[m_currentSampleIndex]);
+	}
+	else
+	{
+		displaySample(m_currentSampleIndex);
+	}
+	dataTable->scrollToTop();
+
+	// Index time (sort and filter passes) apart from filling the table items
+	QStringList titles = tableHeaders(false);
+	QStringList parts;
+	QStringList keys;
+	for (const QPair<int, bool>& key : m_sortColumns)
+	{
+		keys << titles.value(key.first) + (key.second ? " descending" : " ascending");
+	}
+	if (!keys.isEmpty())
+	{
+		parts << "Sorted by " + keys.join(", then ");
+	}
+	QStringList filters;
+	for (const ColumnFilter& filter : m_columnFilters)
+	{
+		filters << (titles.value(filter.column) + " " + RowIndex::comparisonName(filter.comparison) + " " + filter.text).trimmed();
+	}
+	if (!filters.isEmpty())
+	{
+		parts << "rows where " + filters.join(" and ");
+	}
+
+	int totalRows = m_currentSamples[m_currentSampleIndex].rowCount() + liveRowCount();
+	if (parts.isEmpty())
+	{
+		statusBar()->showMessage("Showing all " + QString::number(totalRows) + " rows in sheet order");
+		return;
+	}
+
+	statusBar()->showMessage(parts.join(", ") + ": " + QString::number(m_rowOrder.size()) + " of " +
+		QString::number(totalRows) + " rows (index " +
+		QString::number((m_rowIndex.lastSortNs() + m_rowIndex.lastFilterNs()) / 1e6, 'f', 1) + " ms, table " +
+		QString::number(timer.elapsed()) + " ms)");
+}
+
+QStringList MainWindow::tableHeaders(bool marked) const
+{
+	QStringList headers = m_excelReader ? m_excelReader->getColumnHeaders() : QStringList();
+	QStringList defaults = templateHeaders();
+	for (int col = 0; col < defaults.size(); col++)
+	{
+		if (col >= headers.size())
+		{
+			headers.append(defaults[col]);
+		}
+		else if (headers[col].trimmed().isEmpty())
+		{
+			headers[col] = defaults[col];
+		}
+	}
+
+	if (!marked)
+	{
+		return headers;
+	}
+
+	// Sort direction, and the key's position when there are several
+	for (int i = 0; i < m_sortColumns.size(); i++)
+	{
+		int col = m_sortColumns[i].first;
+		if (col < headers.size())
+		{
+			headers[col] += QString(" ") + QChar(m_sortColumns[i].second ? 0x25BC : 0x25B2) +
+				(m_sortColumns.size() > 1 ? QString::number(i + 1) : QString());
+		}
+	}
+	for (const ColumnFilter& filter : m_columnFilters)
+	{
+		if (filter.column < headers.size() && !headers[filter.column].endsWith(" (filtered)"))
+		{
+			headers[filter.column] += " (filtered)";
+		}
+	}
+	return headers;
+}
+
+void MainWindow::computeRowOrder(const ExcelReader::SampleView& sample)
+{
+	m_rowOrder.clear();
+	m_displayRows.clear();
+	if (!rowOrderActive())
+	{
+		return;
+	}
+
+	int totalRows = sample.rowCount() + liveRowCount();
+
+	// Key columns are read in place where they can be; copies live until the order is built
+	QVector<QVector<double>> storage(m_sortColumns.size() + m_columnFilters.size());
+	QVector<RowIndex::SortKey> keys;
+	for (int i = 0; i < m_sortColumns.size(); i++)
+	{
+		RowIndex::SortKey key;
+		key.values = rowKeyColumn(sample, m_sortColumns[i].first, &storage[i]);
+		key.descending = m_sortColumns[i].second;
+		keys.append(key);
+	}
+
+	QVector<RowIndex::Predicate> predicates;
+	for (int i = 0; i < m_columnFilters.size(); i++)
+	{
+		const ColumnFilter& filter = m_columnFilters[i];
+		RowIndex::Predicate predicate;
+		predicate.comparison = filter.comparison;
+		predicate.operand = filter.operand;
+		predicate.values = rowKeyColumn(sample, filter.column, &storage[m_sortColumns.size() + i], filter.text, &predicate.operand);
+		predicates.append(predicate);
+	}
+
+	m_rowOrder = m_rowIndex.filter(predicates, m_rowIndex.sort(keys, totalRows), totalRows);
+	Metrics::recordNs("table.rowOrder", m_rowIndex.lastSortNs() + m_rowIndex.lastFilterNs());
+	m_displayRows = QVector<int>(totalRows, -1);
+	for (int displayRow = 0; displayRow < m_rowOrder.size(); displayRow++)
+	{
+		m_displayRows[m_rowOrder[displayRow]] = displayRow;
+	}
+
+	debugPrint("Row order: " + QString::number(m_rowOrder.size()) + " of " + QString::number(totalRows) + " rows, sort " +
+		QString::number(m_rowIndex.lastSortNs() / 1e6, 'f', 2) + " ms, filter " + QString::number(m_rowIndex.lastFilterNs() / 1e6, 'f', 2) + " ms");
+}
+
+const double* MainWindow::rowKeyColumn(const ExcelReader::SampleView& sample, int col, QVector<double>* storage,
+	const QString& text, double* textOperand)
+{
+	int rowCount = sample.rowCount();
+	int liveRows = liveRowCount();
+	int totalRows = rowCount + liveRows;
+
+	// Computed columns already hold every row, edits and received rows included
+	if (const char* name = derivedColumnName(col))
+	{
+		const QVector<double>& values = m_derivedColumns.column(name);
+		if (values.size() == totalRows)
+		{
+			return values.constData();
+		}
+		*storage = QVector<double>(totalRows, qQNaN());
+		std::copy(values.constBegin(), values.constBegin() + qMin(values.size(), totalRows), storage->begin());
+		return storage->constData();
+	}
+
+	SampleEditHistory* edits = currentEdits();
+	QVector<int> editedRows;
+	if (edits)
+	{
+		for (const QPair<int, int>& cell : edits->editedCells())
+		{
+			if (cell.second == col && cell.first < totalRows)
+			{
+				editedRows.append(cell.first);
+			}
+		}
+	}
+
+	// Text is compared by its rank among the column's values
+	if (sample.columnType(col) == XlsxSheet::TextColumn)
+	{
+		QStringList texts;
+		texts.reserve(totalRows);
+		for (int row = 0; row < rowCount; row++)
+		{
+			texts.append(sample.value(row, col).toString());
+		}
+		for (int row = 0; row < liveRows; row++)
+		{
+			texts.append(m_live->value(row, col).toString());
+		}
+		for (int row : editedRows)
+		{
+			texts[row] = edits->value(row, col).toString();
+		}
+		*storage = RowIndex::textRanks(texts, text, textOperand);
+		return storage->constData();
+	}
+
+	// Number columns are read in place unless edits or received rows change them
+	ExcelReader::ColumnSpan span = sample.column(col);
+	if (span.numbers && span.size == rowCount && liveRows == 0 && editedRows.isEmpty())
+	{
+		return span.numbers;
+	}
+
+	*storage = QVector<double>(totalRows, qQNaN());
+	if (span.numbers)
+	{
+		std::copy(span.numbers, span.numbers + qMin(span.size, rowCount), storage->begin());
+	}
+	if (liveRows > 0 && col < LiveAcquisition::COLUMNS)
+	{
+		const QVector<double>& live = m_live->column(col);
+		std::copy(live.constBegin(), live.constBegin() + qMin(live.size(), liveRows), storage->begin() + rowCount);
+	}
+	for (int row : editedRows)
+	{
+		(*storage)[row] = edits->number(row, col);
+	}
+	return storage->constData();
+}
+
+void MainWindow::onFindRows()
+{
+	debugPrint("Find Rows action triggered");
+
+	QSettings settings;
+	QString text = m_rowQuery.isEmpty() ? settings.value("query/last").toString() : m_rowQuery.text();
+	bool ok = false;
+	text = QInputDialog::getText(this, "Find Rows", RowQuery::syntaxHelp() + "\n\nFind rows where:", QLineEdit::Normal, text, &ok).trimmed();
+	if (!ok)
+	{
+		return;
+	}
+	if (text.isEmpty())
+	{
+		onClearQuery();
+		return;
+	}
 
-	// Update naviagation controls
-	updateSampleNavigation();
+	RowQuery query;
+	if (!query.compile(text, tableHeaders(false)))
+	{
+		QMessageBox::warning(this, "Find Rows", query.getLastError());
+		return;
+	}
+	settings.setValue("query/last", text);
+	m_rowQuery = query;
 
-	// Update Sample Statistics
-	updateSampleStatistics(sample);
+	nextMatchAction->setEnabled(true);
+	previousMatchAction->setEnabled(true);
+	clearQueryAction->setEnabled(true);
 
-	statusBar()->showMessage("Displaying sample " + QString::number(sampleIndex + 1) +
-		" of " + QString::number(m_currentSamples.size()) + " - " + sample.metadata.sampleID);
+	// Highlighted in the displayed sample, counted in the others
+	if (m_currentSampleIndex >= 0 && m_currentSampleIndex < m_currentSamples.size())
+	{
+		displaySample(m_currentSampleIndex);
+	}
+	querySheet();
+
+	dataTable->setCurrentItem(nullptr);
+	goToMatch(true);
+	showQueryStatus();
 }
 
-void MainWindow::onPrevSample()
+void MainWindow::onNextMatch()
 {
-	debugPrint("Previous sample button clicked");
+	goToMatch(true);
+}
 
-	if (m_currentSampleIndex > 0)
+void MainWindow::onPreviousMatch()
+{
+	goToMatch(false);
+}
+
+void MainWindow::onClearQuery()
+{
+	debugPrint("Clear Row Query action triggered");
+
+	m_rowQuery.clear();
+	m_queryMask.clear();
+	m_queryCounts.clear();
+
+	nextMatchAction->setEnabled(false);
+	previousMatchAction->setEnabled(false);
+	clearQueryAction->setEnabled(false);
+
+	if (m_currentSampleIndex >= 0 && m_currentSampleIndex < m_currentSamples.size())
 	{
-		displaySample(m_currentSampleIndex - 1);
+		displaySample(m_currentSampleIndex);
 	}
-	else
+	statusBar()->showMessage("Row query cleared");
+}
+
+void MainWindow::evaluateQuery(const ExcelReader::SampleView& sample)
+{
+	m_queryMask.clear();
+	if (m_rowQuery.isEmpty())
 	{
-		debugPrint("Already at first sample");
+		return;
 	}
+
+	// The columns the sort and filter read: computed columns, edits and received rows included
+	int totalRows = sample.rowCount() + liveRowCount();
+	m_queryMask = m_rowQuery.evaluate(totalRows, [this, &sample](int col, QVector<double>* storage, const QString& text, double* textOperand) {
+		return rowKeyColumn(sample, col, storage, text, textOperand);
+	});
+	Metrics::recordNs("table.query", m_rowQuery.lastEvaluateNs());
+	debugPrint("Query: " + QString::number(RowQuery::matchCount(m_queryMask)) + " of " + QString::number(totalRows) + " rows in " +
+		QString::number(m_rowQuery.lastEvaluateNs() / 1e6, 'f', 2) + " ms");
 }
 
-void MainWindow::onNextSample()
+void MainWindow::querySheet()
 {
-	debugPrint("Next sample button clicked");
+	m_queryCounts.clear();
+	m_querySheetNs = 0;
+	if (m_rowQuery.isEmpty() || m_currentSamples.isEmpty())
+	{
+		return;
+	}
 
-	if (m_currentSampleIndex < m_currentSamples.size() - 1)
+	QElapsedTimer timer;
+	timer.start();
+
+	// Views go stale when the reader replaces or frees sheet storage
+	for (const ExcelReader::SampleView& sample : m_currentSamples)
 	{
-		displaySample(m_currentSampleIndex + 1);
+		if (!sample.isValid())
+		{
+			m_currentSamples = m_excelReader->sampleViews();
+			break;
+		}
 	}
-	else
+
+	// The other samples as they are in the sheet, their computed columns from a scratch graph
+	bool readsDerived = false;
+	for (int col : m_rowQuery.columns())
 	{
-		debugPrint("Already at last sample");
+		readsDerived = readsDerived || derivedColumnName(col);
+	}
+	DerivedColumns derived;
+	derived.defineTemplateColumns();
+
+	for (int index = 0; index < m_currentSamples.size(); index++)
+	{
+		if (index == m_currentSampleIndex && !m_queryMask.isEmpty())
+		{
+			m_queryCounts.append(RowQuery::matchCount(m_queryMask));
+			continue;
+		}
+
+		const ExcelReader::SampleView& sample = m_currentSamples[index];
+		int rowCount = sample.rowCount();
+		if (readsDerived)
+		{
+			QVector<double> values[3];
+			readDerivedInputs(sample, values);
+			for (int col = 0; col < 3; col++)
+			{
+				derived.setInput(derivedInputs[col], values[col]);
+			}
+			derived.setParameter("power", sample.metadata().power);
+		}
+
+		QVector<quint8> mask = m_rowQuery.evaluate(rowCount,
+			[&sample, &derived, rowCount](int col, QVector<double>* storage, const QString& text, double* textOperand) -> const double* {
+				if (const char* name = derivedColumnName(col))
+				{
+					const QVector<double>& values = derived.column(name);
+					if (values.size() >= rowCount)
+					{
+						return values.constData();
+					}
+					*storage = QVector<double>(rowCount, qQNaN());
+					std::copy(values.constBegin(), values.constEnd(), storage->begin());
+					return storage->constData();
+				}
+
+				if (sample.columnType(col) == XlsxSheet::TextColumn)
+				{
+					QStringList texts;
+					texts.reserve(rowCount);
+					for (int row = 0; row < rowCount; row++)
+					{
+						texts.append(sample.value(row, col).toString());
+					}
+					*storage = RowIndex::textRanks(texts, text, textOperand);
+					return storage->constData();
+				}
+
+				ExcelReader::ColumnSpan span = sample.column(col);
+				if (span.numbers && span.size >= rowCount)
+				{
+					return span.numbers;
+				}
+				*storage = QVector<double>(rowCount, qQNaN());
+				if (span.numbers)
+				{
+					std::copy(span.numbers, span.numbers + span.size, storage->begin());
+				}
+				return storage->constData();
+			});
+		m_queryCounts.append(RowQuery::matchCount(mask));
 	}
+
+	m_querySheetNs = timer.nsecsElapsed();
+	Metrics::recordNs("sheet.query", m_querySheetNs);
 }
 
-void MainWindow::updateSampleNavigation()
+void MainWindow::showQueryMatches()
 {
-	debugPrint("Updating sample navigation controls");
+	// Matching rows in light blue; comparison colours are drawn afterwards and win on their cells
+	for (int row = 0; row < m_queryMask.size(); row++)
+	{
+		int displayRow = m_queryMask[row] ? displayRowOf(row) : -1;
+		if (displayRow < 0 || displayRow >= dataTable->rowCount())
+		{
+			continue;
+		}
 
-	if (m_currentSamples.isEmpty())
+		for (int col = 0; col < dataTable->columnCount(); col++)
+		{
+			QTableWidgetItem* item = tableItem(displayRow, col);
+			item->setBackground(QColor(205, 225, 255));
+		}
+	}
+}
+
+void MainWindow::showQueryStatus()
+{
+	int sheetMatches = 0;
+	int samplesWithMatches = 0;
+	for (int count : m_queryCounts)
+	{
+		sheetMatches += count;
+		samplesWithMatches += count > 0 ? 1 : 0;
+	}
+
+	statusBar()->showMessage("Rows where " + m_rowQuery.text() + ": " + QString::number(RowQuery::matchCount(m_queryMask)) +
+		" in this sample, " + QString::number(sheetMatches) + " in " + QString::number(samplesWithMatches) + " of " +
+		QString::number(m_queryCounts.size()) + " samples of the sheet (" + QString::number(m_querySheetNs / 1e6, 'f', 1) + " ms)");
+}
+
+void MainWindow::goToMatch(bool forward)
+{
+	if (m_rowQuery.isEmpty())
 	{
-		prevSampleButton->setEnabled(false);
-		nextSampleButton->setEnabled(false);
-		sampleCountLabel->setText("No samples");
 		return;
 	}
 
-	// Update label
-	sampleCountLabel->setText("Sample " + QString::number(m_currentSampleIndex + 1) +
-		" of " + QString::number(m_currentSamples.size()));
+	// Next matching table row after the current one, in display order
+	auto selectMatch = [this, forward](int fromDisplayRow) {
+		int step = forward ? 1 : -1;
+		for (int displayRow = fromDisplayRow + step; displayRow >= 0 && displayRow < dataTable->rowCount(); displayRow += step)
+		{
+			int row = sampleRowOf(displayRow);
+			if (row >= 0 && row < m_queryMask.size() && m_queryMask[row])
+			{
+				int col = qMax(0, dataTable->currentColumn());
+				dataTable->setCurrentCell(displayRow, col);
+				dataTable->scrollToItem(dataTable->item(displayRow, col), QAbstractItemView::PositionAtCenter);
+				statusBar()->showMessage("Row " + QString::number(row + 1) + " of sample " + QString::number(m_currentSampleIndex + 1) +
+					" matches " + m_rowQuery.text());
+				return true;
+			}
+		}
+		return false;
+	};
 
-	// Enable/disable buttons
-	prevSampleButton->setEnabled(m_currentSampleIndex > 0);
-	nextSampleButton->setEnabled(m_currentSampleIndex < m_currentSamples.size() - 1);
+	if (selectMatch(dataTable->currentRow()))
+	{
+		return;
+	}
 
-	debugPrint("Navigation updated: " + QString::number(m_currentSampleIndex + 1) +
-		"/" + QString::number(m_currentSamples.size()));
+	// Then on to the next sample of the sheet that has matches, around to this one again
+	int samples = m_queryCounts.size();
+	int startSample = m_currentSampleIndex;
+	for (int i = 1; i <= samples; i++)
+	{
+		int index = ((startSample + (forward ? i : -i)) % samples + samples) % samples;
+		if (m_queryCounts[index] == 0)
+		{
+			continue;
+		}
+		if (index != m_currentSampleIndex)
+		{
+			displaySample(index);
+		}
+		if (selectMatch(forward ? -1 : dataTable->rowCount()))
+		{
+			return;
+		}
+	}
+
+	statusBar()->showMessage("No rows where " + m_rowQuery.text());
 }
 
-void MainWindow::updateSampleStatistics(const ExcelReader::SampleData& sample)
+int MainWindow::displayRowOf(int sampleRow) const
 {
-	debugPrint("Updating sample statistics display");
+	if (m_displayRows.isEmpty())
+	{
+		return sampleRow;
+	}
+	return sampleRow >= 0 && sampleRow < m_displayRows.size() ? m_displayRows[sampleRow] : -1;
+}
 
-	// Build statistics HTML
-	QString statsHtml = "<table style='width:100%; font-size:10pt;'>";
+int MainWindow::sampleRowOf(int displayRow) const
+{
+	if (m_displayRows.isEmpty())
+	{
+		return displayRow;
+	}
+	return displayRow >= 0 && displayRow < m_rowOrder.size() ? m_rowOrder[displayRow] : -1;
+}
 
-	// Sample identification
-	statsHtml += "<tr><td style='font-weight:bold; width:40%;'>Sample ID:</td><td>" +
-		sample.metadata.sampleID + "</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Date:</td><td>" +
-		sample.metadata.date + "</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Tester:</td><td>" +
-		sample.metadata.tester + "</td></tr>";
+void MainWindow::discardEdits(const QString& sheetName, const QVector<int>& samples)
+{
+	int discarded = 0;
+	for (auto it = m_sampleEdits.begin(); it != m_sampleEdits.end();)
+	{
+		if (it.key().first == sheetName && (samples.isEmpty() || samples.contains(it.key().second)))
+		{
+			it = m_sampleEdits.erase(it);
+			discarded++;
+		}
+		else
+		{
+			++it;
+		}
+	}
 
-	// Device parameters
-	statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Device Parameters</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Media:</td><td>" +
-		sample.metadata.media + "</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Viscosity:</td><td>" +
-		QString::number(sample.metadata.viscosity, 'f', 0) + " cP</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Resistance:</td><td>" +
-		QString::number(sample.metadata.resistance, 'f', 2) + " Ω</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Voltage:</td><td>" +
-		QString::number(sample.metadata.voltage, 'f', 1) + " V</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Power:</td><td>" +
-		QString::number(sample.metadata.power, 'f', 2) + " W</td></tr>";
+	if (discarded > 0)
+	{
+		debugPrint("Discarded edits of " + QString::number(discarded) + " sample(s) in " + sheetName + ", changed on disk");
+		updateEditActions();
+	}
+}
+
+void MainWindow::updateEditActions()
+{
+	SampleEditHistory* edits = currentEdits();
+	undoAction->setEnabled(edits && edits->canUndo());
+	redoAction->setEnabled(edits && edits->canRedo());
+}
+
+void MainWindow::onToggleLiveMode(bool enabled)
+{
+	debugPrint(QString("Live acquisition ") + (enabled ? "started" : "stopped"));
 
-	if (!sample.metadata.heatingTechnology.isEmpty())
+	if (!enabled)
 	{
-		statsHtml += "<tr><td style='font-weight:bold;'>Heating Tech:</td><td>" +
-			sample.metadata.heatingTechnology + "</td></tr>";
+		liveFlushTimer->stop();
+		m_live->stop();
+		liveFeederAction->setChecked(false);
+		liveFeederAction->setEnabled(false);
+
+		// Rows that arrived since the last flush
+		flushLiveRows();
+		statusBar()->showMessage("Live acquisition stopped after " + QString::number(m_live->rowCount()) + " rows");
+		return;
 	}
 
-	// Test parameters
-	statsHtml += "<tr><td colspan='2' style='padding-top:8px; font-weight:bold; background-color:#e0e0e0;'>Test Parameters</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Puffing Regime:</td><td>" +
-		sample.metadata.puffingRegime + "</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Initial Oil Mass:</td><td>" +
-		QString::number(sample.metadata.initialOilMass, 'f', 2) + " g</td></tr>";
-	statsHtml += "<tr><td style='font-weight:bold;'>Total Puffs:</td><td>" +
-		QString::number(sample.dataRows.size()) + "</td></tr>";
+	completeStartup();
+	if (m_currentSampleIndex < 0 || m_currentSampleIndex >= m_currentSamples.size())
+	{
+		QMessageBox::warning(this, "Live Acquisition", "Open the sample the puffs belong to first.");
+		liveModeAction->setChecked(false);
+		return;
+	}
 
-	statsHtml += "</table>";
+	SheetHandle sheet = m_excelReader->openSheet(currentSheet);
+	if (!m_live->start(sheet, m_currentSampleIndex))
+	{
+		QString error = sheet.isValid() ? m_live->getLastError() : sheet.getLastError();
+		QMessageBox::critical(this, "Live Acquisition", "Cannot start live acquisition:\n" + error);
+		liveModeAction->setChecked(false);
+		return;
+	}
 
-	statsLabel->setText(statsHtml);
-	debugPrint("Statistics updated");
+	// Rows of an earlier session are dropped by start()
+	liveFlushTimer->setInterval(50);
+	displaySample(m_currentSampleIndex);
+	liveFeederAction->setEnabled(true);
+
+	statusBar()->showMessage("Live acquisition: listening on " + m_live->serverName() + ", one puff row per line");
 }
 
-void MainWindow::populateTableWithSample(const ExcelReader::SampleData& sample)
+void MainWindow::onToggleLiveFeeder(bool enabled)
 {
-	debugPrint("Populating table with sample data");
+	debugPrint(QString("Live test feeder ") + (enabled ? "started" : "stopped"));
 
-	// Clear existing data
-	dataTable->clearContents();
+	if (!enabled)
+	{
+		m_live->stopFeeder();
+		statusBar()->showMessage("Live test feeder stopped");
+		return;
+	}
 
-	// set row count based on data
-	int rowCount = sample.dataRows.size();
-	if (rowCount > dataTable->rowCount())
+	bool ok = false;
+	int rate = QInputDialog::getInt(this, "Live Test Feeder",
+		"Puff rows per second to write to the live socket:", 2000, 1, 100000, 500, &ok);
+	if (!ok)
 	{
-		dataTable->setRowCount(rowCount);
-		debugPrint("Expanded Table to " + QString::number(rowCount) + " rows");
+		liveFeederAction->setChecked(false);
+		return;
 	}
 
-	// get column headers
-	QStringList headers = m_excelReader->getColumnHeaders();
-	if (!headers.isEmpty())
+	if (!m_live->startFeeder(rate))
 	{
-		dataTable->setHorizontalHeaderLabels(headers);
-		debugPrint("Set column headers: " + headers.join(", "));
+		QMessageBox::warning(this, "Live Test Feeder", "Cannot start the feeder:\n" + m_live->getLastError());
+		liveFeederAction->setChecked(false);
+		return;
 	}
 
-	// populate rows
-	for (int row = 0; row < rowCount; row++)
+	statusBar()->showMessage("Live test feeder writing " + QString::number(rate) + " rows/s");
+}
+
+void MainWindow::onLiveRowsReceived()
+{
+	// Coalesced: rows arriving before the timer fires go out with the same flush
+	if (!liveFlushTimer->isActive())
 	{
-		const QVector<QVariant>& rowData = sample.dataRows[row];
+		liveFlushTimer->start();
+	}
+}
 
-		for (int col = 0; col < rowData.size() && col < dataTable->columnCount(); col++)
+void MainWindow::flushLiveRows()
+{
+	if (!liveSampleDisplayed() || !m_currentSamples[m_currentSampleIndex].isValid())
+	{
+		// Kept for a sample that is not shown; they appear when it is displayed again
+		if (m_live->isListening())
 		{
-			QVariant value = rowData[col];
+			statusBar()->showMessage("Live acquisition: " + QString::number(m_live->rowCount()) + " rows received for sample " +
+				QString::number(m_live->sampleIndex() + 1) + " of " + m_live->sheetName());
+		}
+		return;
+	}
 
-			QTableWidgetItem* item = new QTableWidgetItem();
+	Metrics::ScopedTimer metric("live.flush");
+	QElapsedTimer timer;
+	timer.start();
 
-			if (value.isNull())
-			{
-				item->setText("");
-			}
-			else if (value.type() == QVariant::Double || value.type() == QVariant::Int)
-			{
-				// format numeric values
-				double numValue = value.toDouble();
-				item->setText(QString::number(numValue, 'f', 4));
-				item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-			}
-			else
+	const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+	int received = m_live->rowCount();
+	int first = m_liveRowsShown;
+
+	if (received > first)
+	{
+		// Follow the newest rows unless the table was scrolled up to older ones
+		QScrollBar* scrollBar = dataTable->verticalScrollBar();
+		bool following = scrollBar->value() >= scrollBar->maximum();
+
+		dataTable->setUpdatesEnabled(false);
+		if (rowOrderActive())
+		{
+			// New rows take their place in the sort and filter; the flush interval
+			// below grows with the cost of redisplaying the whole sample
+			populateTableWithSample(sample);
+		}
+		else
+		{
+			loadDerivedInputs(sample);
+			dataTable->blockSignals(true);
+
+			int tableRows = sample.rowCount() + received;
+			if (tableRows > dataTable->rowCount())
 			{
-				item->setText(value.toString());
+				dataTable->setRowCount(tableRows);
 			}
+			showLiveRows(first, received);
+
+			// Only the new rows; the variation of earlier rows follows the moving mean on the next full display
+			showDerivedColumns(sample.rowCount() + first, tableRows);
+
+			dataTable->blockSignals(false);
+		}
+		dataTable->setUpdatesEnabled(true);
+		m_liveRowsShown = received;
+
+		if (following)
+		{
+			dataTable->scrollToBottom();
+		}
+	}
+
+	updateSampleStatistics(sample);
+	updatePlot();
+
+	statusBar()->showMessage("Live acquisition: " + QString::number(received) + " rows received, " +
+		QString::number(m_live->rowsPerSecond(), 'f', 0) + " rows/s");
+
+	// Slow flushes (long samples, slow machines) are spaced out so the event loop keeps up
+	liveFlushTimer->setInterval(int(qBound<qint64>(50, timer.elapsed() * 4, 1000)));
+}
+
+bool MainWindow::liveSampleDisplayed() const
+{
+	return m_live->sampleIndex() >= 0 && m_live->sampleIndex() == m_currentSampleIndex &&
+		m_currentSampleIndex < m_currentSamples.size() && m_live->sheetName() == currentSheet;
+}
+
+int MainWindow::liveRowCount() const
+{
+	return liveSampleDisplayed() ? m_live->rowCount() : 0;
+}
+
+void MainWindow::showLiveRows(int first, int last)
+{
+	const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+	for (int row = first; row < last; row++)
+	{
+		int tableRow = sample.rowCount() + row;
+		if (displayRowOf(tableRow) < 0)
+		{
+			continue;
+		}
+
+		for (int col = 0; col < LiveAcquisition::COLUMNS && col < dataTable->columnCount(); col++)
+		{
+			showCellValue(tableRow, col, m_live->value(row, col), sample.columnType(col));
+
+			// Received rows are not in the sheet, so there is nothing to edit
+			QTableWidgetItem* item = dataTable->item(displayRowOf(tableRow), col);
+			item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+			item->setToolTip("Received live");
+		}
+	}
+}
 
-			dataTable->setItem(row, col, item);
+void MainWindow::stopLiveAcquisition()
+{
+	liveFlushTimer->stop();
+	m_live->clear();
+	m_liveRowsShown = 0;
+
+	liveModeAction->setChecked(false);
+	liveFeederAction->setChecked(false);
+	liveFeederAction->setEnabled(false);
+}
+
+void MainWindow::updatePlot()
+{
+	if (!liveSampleDisplayed() || m_live->trace().isEmpty())
+	{
+		plotLabel->setText("Plot area - To be implemented");
+		return;
+	}
+
+	// Each bucket is drawn as its min-max range, the trace joins the middles
+	const QVector<LiveAcquisition::TraceBucket>& trace = m_live->trace();
+	double low = qInf();
+	double high = -qInf();
+	for (const LiveAcquisition::TraceBucket& bucket : trace)
+	{
+		if (bucket.min <= bucket.max)
+		{
+			low = qMin(low, bucket.min);
+			high = qMax(high, bucket.max);
+		}
+	}
+
+	QPixmap pixmap(plotLabel->size() - QSize(8, 8));
+	pixmap.fill(Qt::white);
+	QPainter painter(&pixmap);
+	painter.setRenderHint(QPainter::Antialiasing);
+	QRect area = pixmap.rect().adjusted(70, 30, -20, -30);
+
+	QStringList headers = m_excelReader->getColumnHeaders();
+	int column = m_live->traceColumn();
+	QString title = column < headers.size() && !headers[column].isEmpty() ? headers[column] : "Column " + QString::number(column + 1);
+	const ExcelReader::SampleView& sample = m_currentSamples[m_currentSampleIndex];
+	int rows = sample.rowCount() + m_live->rowCount();
+	painter.drawText(QRect(0, 5, pixmap.width(), 20), Qt::AlignCenter,
+		title + " - " + QString::number(rows) + " rows (" + QString::number(m_live->rowCount()) + " live)");
+
+	if (low > high)
+	{
+		painter.drawText(area, Qt::AlignCenter, "No values yet");
+		plotLabel->setPixmap(pixmap);
+		return;
+	}
+	if (high - low < 1e-12)
+	{
+		low -= 0.5;
+		high += 0.5;
+	}
+
+	painter.setPen(QColor("#999999"));
+	painter.drawRect(area);
+	painter.drawText(QRect(0, area.top() - 8, area.left() - 5, 16), Qt::AlignRight | Qt::AlignVCenter, QString::number(high, 'g', 6));
+	painter.drawText(QRect(0, area.bottom() - 8, area.left() - 5, 16), Qt::AlignRight | Qt::AlignVCenter, QString::number(low, 'g', 6));
+
+	double bucketWidth = double(area.width()) / trace.size();
+	auto xOf = [&](double bucket) { return area.left() + bucket * bucketWidth; };
+	auto yOf = [&](double value) { return area.bottom() - (value - low) / (high - low) * area.height(); };
+
+	// Where the received rows start
+	double liveStart = double(sample.rowCount()) / m_live->rowsPerBucket();
+	painter.setPen(QPen(QColor("#cc6600"), 1, Qt::DashLine));
+	painter.drawLine(QPointF(xOf(liveStart), area.top()), QPointF(xOf(liveStart), area.bottom()));
+
+	QPainterPath path;
+	bool started = false;
+	painter.setPen(QPen(QColor("#9ab8e0"), 1));
+	for (int i = 0; i < trace.size(); i++)
+	{
+		const LiveAcquisition::TraceBucket& bucket = trace[i];
+		if (bucket.min > bucket.max)
+		{
+			continue;
 		}
 
-		// Auto resize columns to content
-		dataTable->resizeColumnsToContents();
+		double x = xOf(i + 0.5);
+		painter.drawLine(QPointF(x, yOf(bucket.min)), QPointF(x, yOf(bucket.max)));
 
-		debugPrint("Table populated with " + QString::number(rowCount) + " rows");
+		QPointF middle(x, yOf((bucket.min + bucket.max) / 2.0));
+		if (started)
+		{
+			path.lineTo(middle);
+		}
+		else
+		{
+			path.moveTo(middle);
+			started = true;
+		}
 	}
+	painter.setPen(QPen(QColor("#1f5fa8"), 1.5));
+	painter.drawPath(path);
+	painter.end();
+
+	plotLabel->setPixmap(pixmap);
 }
 
 void MainWindow::debugPrint(const QString& message)
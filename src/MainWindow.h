@@ -5,6 +5,8 @@
 #include <QComboBox>
 #include <QTableWidget>
 #include <QPushButton>
+#include <QLineEdit>
+#include <QListWidget>
 #include <QLabel>
 #include <QVBoxLayout>
 #include <QMenuBar>
@@ -13,8 +15,25 @@
 #include <QStatusBar>
 #include <QString>
 #include <QMap>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QPair>
+#include <QSharedPointer>
+#include <QTimer>
 #include <QDebug>
 #include <ExcelReader.h>
+#include "SampleIndex.h"
+#include "MemoryAccounting.h"
+#include "DerivedColumns.h"
+#include "SampleEditHistory.h"
+#include "LiveAcquisition.h"
+#include "SampleOverview.h"
+#include "RowIndex.h"
+#include "WorkbookDiff.h"
+#include "SheetPrefetcher.h"
+#include "RowQuery.h"
+
+class AggregationDialog;
 
 class MainWindow : public QMainWindow
 {
@@ -29,24 +48,83 @@ private slots:
 	void onNewFile();
 	void onLoadFile();
 	void onSaveFile();
+	void onExportFeather();
 	void onExit();
 
+	// Edit menu
+	void onUndo();
+	void onRedo();
+	void onTableItemChanged(QTableWidgetItem* item);
+
+	// Sorting and filtering the table: header click sorts, the header menu filters
+	void onTableHeaderClicked(int column);
+	void onTableHeaderMenu(const QPoint& position);
+
+	// Row queries: matches are highlighted in the table and visited in turn, across the sheet's samples
+	void onFindRows();
+	void onNextMatch();
+	void onPreviousMatch();
+	void onClearQuery();
+
 	// Data Operations
 	void onFileSelected(int index);
 	void onSheetSelected(int index);
 
+	// File watching
+	void onWatchedFileChanged(const QString& path);
+	void onReloadChangedFile();
+
 	// Sample navigation
 	void onPrevSample();
 	void onNextSample();
+	void onToggleOverview(bool checked);
+	void onOverviewSampleActivated(int sampleIndex);
 
 	// Report generation
 	void onGenerateTestReport();
 	void onGenerateFullReport();
 
+	// Tools menu
+	void onBenchmarkParser();
+	void onShowIngestStats();
+	void onStressTestReads();
+	void onAggregateWorkbooks();
+	void onShowStartupTimeline();
+	void onShowMetrics();
+	void onIndexFolder();
+	void onCompareWorkbook();
+	void onCompareSample();
+	void onClearComparison();
+	void onShowMemoryUsage();
+	void onSetMemoryBudget();
+	void onTogglePrefetch(bool enabled);
+	void onToggleDataServer(bool enabled);
+
+	// Memory accounting, also run periodically
+	void enforceMemoryBudget();
+
+	// Live acquisition: received rows are shown in batches by flushLiveRows()
+	void onToggleLiveMode(bool enabled);
+	void onToggleLiveFeeder(bool enabled);
+	void onLiveRowsReceived();
+	void flushLiveRows();
+
+	// Deferred startup: reader and remaining widgets, built after the first paint
+	void completeStartup();
+
+	// Sample search
+	void onSearchTextChanged(const QString& text);
+	void onSearchReturnPressed();
+	void onSearchResultActivated(QListWidgetItem* item);
+
 	// Help menu
 	void onHelp();
 	void onAbout();
 
+protected:
+	void paintEvent(QPaintEvent* event) override;
+	bool eventFilter(QObject* watched, QEvent* event) override; // User input pauses the sheet prefetch
+
 private:
 	// UI Setup
 	void setupUI();
@@ -54,11 +132,16 @@ private:
 	void createTopFrame();
     void createCenterFrame();
 	void createBottomFrame();
+	void buildCenterPanels();
+	void buildImagePanel();
+	void reportStartup();
+	void ensureSampleIndex();
 
 	// UI components - Top Frame
 	QWidget *topFrame;
 	QComboBox *fileDropdown;
 	QComboBox *sheetDropdown;
+	QLineEdit *searchEdit;
 	QPushButton *loadButton;
 	QPushButton *saveButton;
 
@@ -74,8 +157,12 @@ private:
 	QWidget* sampleNavFrame;
 	QPushButton* prevSampleButton;
 	QPushButton* nextSampleButton;
+	QPushButton* overviewButton;
 	QLabel* sampleCountLabel;
 
+	// Tiles of every sample of the sheet, shown in place of the table
+	SampleOverview* sampleOverview;
+
 	// Plot components
 	QWidget* plotFrame;
     QLabel* plotLabel; // placeholder for plotting
@@ -89,9 +176,32 @@ private:
 	QAction *newAction;
 	QAction *loadAction;
 	QAction *saveAction;
+	QAction *exportFeatherAction;
 	QAction *exitAction;
+	QAction *undoAction;
+	QAction *redoAction;
+	QAction *findRowsAction;
+	QAction *nextMatchAction;
+	QAction *previousMatchAction;
+	QAction *clearQueryAction;
 	QAction *generateTestReportAction;
 	QAction *generateFullReportAction;
+	QAction *benchmarkParserAction;
+	QAction *ingestStatsAction;
+	QAction *stressTestAction;
+	QAction *aggregateAction;
+	QAction *indexFolderAction;
+	QAction *compareWorkbookAction;
+	QAction *compareSampleAction;
+	QAction *clearComparisonAction;
+	QAction *memoryUsageAction;
+	QAction *memoryBudgetAction;
+	QAction *prefetchAction;
+	QAction *dataServerAction;
+	QAction *startupTimelineAction;
+	QAction *metricsAction;
+	QAction *liveModeAction;
+	QAction *liveFeederAction;
 	QAction *helpAction;
 	QAction *aboutAction;
 
@@ -100,22 +210,136 @@ private:
 	QString currentSheet;
 	QMap <QString, QStringList> fileSheets; // Maps filename to list of sheets
 
+	// File watching: change notifications are debounced, writers save in several steps
+	QFileSystemWatcher* fileWatcher;
+	QTimer* reloadTimer;
+	int reloadRetries;
+
+	// Cross-workbook aggregation, kept open so loaded workbooks survive between queries
+	AggregationDialog* aggregationDialog;
+
+	// Sample search over an indexed folder, hits are listed under the search box
+	SampleIndex m_sampleIndex;
+	QListWidget* searchResults;
+	QVector<SampleIndex::Document> m_searchHits;
+
+	// Memory budget (0 = none): above it parsed sheets other than the current one are released
+	qint64 m_memoryBudget;
+	QLabel* memoryLabel;
+	QTimer* memoryTimer; // Only runs while a budget is set
+	int m_tableItems;    // Items in the sample table, counted as they are created
+
+	// Parses the other sheets of the file in the background once the first one is shown
+	SheetPrefetcher m_prefetcher;
+
 	// Excel Data Management
 	ExcelReader* m_excelReader;
-	QVector<ExcelReader::SampleData> m_currentSamples;
+	QVector<ExcelReader::SampleView> m_currentSamples; // Views into the reader's current sheet
 	int m_currentSampleIndex;
 
+	// Template computed columns (TPM, power density, variation, oil consumed) of the displayed sample
+	DerivedColumns m_derivedColumns;
+
+	// Table edits with undo history, per (sheet, sample); created on the first edit of a sample
+	QHash<QPair<QString, int>, QSharedPointer<SampleEditHistory>> m_sampleEdits;
+
+	// Table sort and filter, kept while moving between samples. Rows are not moved:
+	// m_rowOrder lists the sample row shown in each table row (sample rows, then
+	// received live rows), m_displayRows the table row of each sample row (-1 = filtered out).
+	// Both are empty while the table shows every row in sheet order
+	struct ColumnFilter
+	{
+		int column;
+		RowIndex::Comparison comparison;
+		double operand;     // Number, or 1/0 for flag columns
+		QString text;       // Operand as typed, compared as text in text columns
+	};
+	QVector<QPair<int, bool>> m_sortColumns; // Column, descending; first key first
+	QVector<ColumnFilter> m_columnFilters;
+	RowIndex m_rowIndex;
+	QVector<int> m_rowOrder;
+	QVector<int> m_displayRows;
+
+	// Row query, kept while moving between samples and sheets like the sort and filter.
+	// m_queryMask marks the displayed sample's matching rows (sample rows, then received
+	// live rows), m_queryCounts the matches in each sample of the sheet
+	RowQuery m_rowQuery;
+	QVector<quint8> m_queryMask;
+	QVector<int> m_queryCounts;
+	qint64 m_querySheetNs;
+
+	// Last comparison with an earlier version of the file or another sample, shown in the
+	// table and statistics until cleared, another file is opened or the file changes on disk
+	WorkbookDiff m_comparison;
+
+	// Live acquisition into one sample; rows arriving between flushes are shown together,
+	// and the flush interval follows how long the last flush took
+	LiveAcquisition* m_live;
+	QTimer* liveFlushTimer;
+	int m_liveRowsShown; // Received rows already in the table
+
+	// Startup progress
+	bool m_startupComplete;
+	bool m_firstPaintSeen;
+	bool m_interactiveMarked;
+	bool m_sampleIndexChecked;
+
 	// Helper functions
 	void debugPrint(const QString& message);
 	void updateFileDropdown();
 	void updateSheetDropdown();
+	void watchCurrentFile();
+	bool openFile(const QString& filePath);
+	void openSearchHit(const SampleIndex::Document& hit);
+	MemoryAccounting collectMemoryUsage() const;
+	QTableWidgetItem* tableItem(int row, int col); // Creates the item of an empty cell
+	void startPrefetch();
 
 	// Excel Operations
 	void loadExcelData();
 	void displaySample(int sampleIndex);
-	void populateTableWithSample(const ExcelReader::SampleData& sample);
+	void populateTableWithSample(const ExcelReader::SampleView& sample);
+	void loadDerivedInputs(const ExcelReader::SampleView& sample);
+	void showDerivedColumns(int firstRow, int lastRow);
+	void showCellValue(int row, int col, const QVariant& value, XlsxSheet::ColumnType type); // Sample row
+	void showComparison(const ExcelReader::SampleView& sample);
+	void showComparisonResult(const QString& title);
+
+	// Row order of the table
+	bool rowOrderActive() const { return !m_sortColumns.isEmpty() || !m_columnFilters.isEmpty(); }
+	void computeRowOrder(const ExcelReader::SampleView& sample);
+	const double* rowKeyColumn(const ExcelReader::SampleView& sample, int col, QVector<double>* storage,
+		const QString& text = QString(), double* textOperand = nullptr);
+	int displayRowOf(int sampleRow) const; // -1 when filtered out
+	int sampleRowOf(int displayRow) const;
+	bool askColumnFilter(int column);
+	void applyRowOrder(); // Redisplays the current sample after the sort or filter changed
+	QStringList tableHeaders(bool marked = true) const; // Column headers, with sort keys and filters marked
+
+	// Row query
+	void evaluateQuery(const ExcelReader::SampleView& sample); // Displayed sample, edits and live rows included
+	void querySheet();                                        // Match counts of every sample, as in the sheet
+	void showQueryMatches();
+	void showQueryStatus();
+	void goToMatch(bool forward);
+
+	// Table edits
+	SampleEditHistory* currentEdits() const; // nullptr while the displayed sample is unedited
+	void refreshEditedCell(const QPair<int, int>& cell);
+	void discardEdits(const QString& sheetName, const QVector<int>& samples); // Empty = every sample of the sheet
+	void updateEditActions();
+
+	// Live acquisition
+	bool liveSampleDisplayed() const;
+	int liveRowCount() const; // Received rows of the displayed sample, 0 when another one is shown
+	void showLiveRows(int first, int last);
+	void stopLiveAcquisition(); // Also drops the received rows
+	void updatePlot();
 	void updateSampleNavigation();
-	void updateSampleStatistics(const ExcelReader::SampleData& sample);
+	void updateOverview(); // After the sheet's samples were reloaded
+	void updateSampleStatistics(const ExcelReader::SampleView& sample);
+	void refreshChangedSamples(const QVector<int>& changedSamples);
+	void reloadWholeFile();
 };
 
 #endif // MAINWINDOW_H
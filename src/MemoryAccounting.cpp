@@ -0,0 +1,201 @@
+#include "MemoryAccounting.h"
+#include <QFile>
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+// Allocation header of QString/QVector/QByteArray data blocks (QArrayData)
+static const qint64 ARRAY_HEADER_BYTES = 24;
+
+void MemoryAccounting::add(Category category, const QString& name, qint64 bytes)
+{
+	Entry entry;
+	entry.category = category;
+	entry.name = name;
+	entry.bytes = bytes;
+	m_entries.append(entry);
+}
+
+qint64 MemoryAccounting::categoryTotal(Category category) const
+{
+	qint64 total = 0;
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.category == category)
+		{
+			total += entry.bytes;
+		}
+	}
+	return total;
+}
+
+qint64 MemoryAccounting::heapTotal() const
+{
+	return categoryTotal(Workbook) + categoryTotal(Sheet) + categoryTotal(Sample) +
+		categoryTotal(Table) + categoryTotal(Cache);
+}
+
+QString MemoryAccounting::report(int maxEntriesPerCategory) const
+{
+	QString text;
+
+	for (int category = Workbook; category <= Mapped; category++)
+	{
+		QVector<Entry> entries;
+		for (const Entry& entry : m_entries)
+		{
+			if (entry.category == category)
+			{
+				entries.append(entry);
+			}
+		}
+
+		if (entries.isEmpty())
+		{
+			continue;
+		}
+
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.bytes > b.bytes; });
+
+		text += QString("%1: %2\n").arg(categoryName(Category(category)), formatBytes(categoryTotal(Category(category))));
+		for (int i = 0; i < entries.size() && i < maxEntriesPerCategory; i++)
+		{
+			text += QString("    %1  %2\n").arg(formatBytes(entries.at(i).bytes), 10).arg(entries.at(i).name);
+		}
+		if (entries.size() > maxEntriesPerCategory)
+		{
+			text += QString("    ... %1 more\n").arg(entries.size() - maxEntriesPerCategory);
+		}
+	}
+
+	text += "\nTotal (excluding mapped files): " + formatBytes(heapTotal());
+	return text;
+}
+
+QString MemoryAccounting::categoryName(Category category)
+{
+	switch (category)
+	{
+	case Workbook: return "Workbooks";
+	case Sheet: return "Sheets";
+	case Sample: return "Samples";
+	case Table: return "Table";
+	case Cache: return "Caches";
+	case Mapped: return "Mapped files";
+	}
+	return QString();
+}
+
+QString MemoryAccounting::formatBytes(qint64 bytes)
+{
+	if (bytes >= 1024LL * 1024 * 1024)
+	{
+		return QString::number(bytes / (1024.0 * 1024 * 1024), 'f', 2) + " GB";
+	}
+	if (bytes >= 1024 * 1024)
+	{
+		return QString::number(bytes / (1024.0 * 1024), 'f', 1) + " MB";
+	}
+	if (bytes >= 1024)
+	{
+		return QString::number(bytes / 1024.0, 'f', 1) + " KB";
+	}
+	return QString::number(bytes) + " B";
+}
+
+qint64 MemoryAccounting::stringBytes(const QString& text)
+{
+	// Null and empty strings share a static block
+	if (text.isEmpty())
+	{
+		return 0;
+	}
+	return ARRAY_HEADER_BYTES + (qint64(text.capacity()) + 1) * qint64(sizeof(QChar));
+}
+
+qint64 MemoryAccounting::stringListBytes(const QStringList& list)
+{
+	qint64 bytes = ARRAY_HEADER_BYTES + qint64(list.size()) * qint64(sizeof(void*));
+	for (const QString& text : list)
+	{
+		bytes += stringBytes(text);
+	}
+	return bytes;
+}
+
+qint64 MemoryAccounting::variantBytes(const QVariant& value)
+{
+	switch (value.type())
+	{
+	case QVariant::String:
+		return stringBytes(value.toString());
+	case QVariant::ByteArray:
+		return ARRAY_HEADER_BYTES + value.toByteArray().capacity() + 1;
+	case QVariant::Date:
+	case QVariant::DateTime:
+		return 16; // QDateTime keeps its zone data in a private block
+	default:
+		return 0; // Numbers and bools are stored inline
+	}
+}
+
+qint64 MemoryAccounting::rowsBytes(const QVector<QVector<QVariant>>& rows)
+{
+	qint64 bytes = ARRAY_HEADER_BYTES + qint64(rows.capacity()) * qint64(sizeof(QVector<QVariant>));
+	for (const QVector<QVariant>& row : rows)
+	{
+		if (row.capacity() == 0)
+		{
+			continue;
+		}
+
+		bytes += ARRAY_HEADER_BYTES + qint64(row.capacity()) * qint64(sizeof(QVariant));
+		for (const QVariant& value : row)
+		{
+			bytes += variantBytes(value);
+		}
+	}
+	return bytes;
+}
+
+qint64 MemoryAccounting::processResidentBytes()
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return qint64(counters.WorkingSetSize);
+	}
+	return 0;
+#elif defined(Q_OS_MACOS)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+	{
+		return qint64(info.resident_size);
+	}
+	return 0;
+#elif defined(Q_OS_UNIX)
+	// Second field of /proc/self/statm is the resident page count
+	QFile statm("/proc/self/statm");
+	if (!statm.open(QIODevice::ReadOnly))
+	{
+		return 0;
+	}
+	QList<QByteArray> fields = statm.readAll().split(' ');
+	if (fields.size() < 2)
+	{
+		return 0;
+	}
+	return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
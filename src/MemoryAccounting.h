@@ -0,0 +1,59 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+
+// Byte accounting for loaded data. Components add one entry per workbook,
+// sheet, sample or cache they hold; the sizes are estimates of the heap they
+// own (container blocks, string payloads, variant storage). Implicitly shared
+// Qt payloads are counted by every holder, so totals are an upper bound.
+class MemoryAccounting
+{
+public:
+	enum Category
+	{
+		Workbook, // Package index, shared strings and styles
+		Sheet,    // Parsed cell grids
+		Sample,   // Per-sample metadata behind the sample views
+		Table,    // Table widget items
+		Cache,    // Search index, aggregation records
+		Mapped    // File-backed mappings, reclaimable by the OS and not part of the heap total
+	};
+
+	struct Entry
+	{
+		Category category;
+		QString name;
+		qint64 bytes;
+	};
+
+	void clear() { m_entries.clear(); }
+	void add(Category category, const QString& name, qint64 bytes);
+
+	QVector<Entry> entries() const { return m_entries; }
+	qint64 categoryTotal(Category category) const;
+	qint64 heapTotal() const; // Everything except Mapped
+
+	// Plain-text breakdown per category, largest entries first
+	QString report(int maxEntriesPerCategory = 8) const;
+
+	static QString categoryName(Category category);
+	static QString formatBytes(qint64 bytes);
+
+	// Estimators
+	static qint64 stringBytes(const QString& text);
+	static qint64 stringListBytes(const QStringList& list);
+	static qint64 variantBytes(const QVariant& value); // Heap outside the QVariant itself
+	static qint64 rowsBytes(const QVector<QVector<QVariant>>& rows);
+
+	// Resident set size of the process, 0 where it cannot be read
+	static qint64 processResidentBytes();
+
+private:
+	QVector<Entry> m_entries;
+};
+
+#endif // MEMORYACCOUNTING_H
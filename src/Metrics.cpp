@@ -0,0 +1,310 @@
+#include "Metrics.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QtAlgorithms>
+#include <QtMath>
+#include <limits>
+
+namespace
+{
+	struct MetricsState
+	{
+		QMutex mutex;
+		QHash<QString, qint64> counters;
+		QHash<QString, Metrics::Histogram> histograms;
+	};
+
+	MetricsState& state()
+	{
+		static MetricsState metrics;
+		return metrics;
+	}
+
+	QString metricsFolder()
+	{
+		return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/metrics";
+	}
+}
+
+Metrics::Histogram::Histogram()
+	: m_count(0)
+	, m_min(0)
+	, m_max(0)
+	, m_sum(0.0)
+{
+}
+
+int Metrics::Histogram::bucketIndex(qint64 value)
+{
+	const int exact = 1 << SUB_BUCKET_BITS;
+	const int half = exact / 2;
+	if (value < exact)
+	{
+		return value > 0 ? int(value) : 0;
+	}
+
+	// Shifted down until it has SUB_BUCKET_BITS bits, the top one set
+	int highestBit = 63 - qCountLeadingZeroBits(quint64(value));
+	int shift = highestBit - (SUB_BUCKET_BITS - 1);
+	if (shift > MAX_SHIFT)
+	{
+		return BUCKET_COUNT - 1;
+	}
+	int top = int(value >> shift);
+	return exact + (shift - 1) * half + (top - half);
+}
+
+qint64 Metrics::Histogram::bucketLowest(int index)
+{
+	const int exact = 1 << SUB_BUCKET_BITS;
+	const int half = exact / 2;
+	if (index < exact)
+	{
+		return index;
+	}
+
+	int shift = (index - exact) / half + 1;
+	qint64 top = (index - exact) % half + half;
+	return top << shift;
+}
+
+qint64 Metrics::Histogram::bucketHighest(int index)
+{
+	return index + 1 < BUCKET_COUNT ? bucketLowest(index + 1) - 1 : std::numeric_limits<qint64>::max();
+}
+
+void Metrics::Histogram::record(qint64 value)
+{
+	if (m_counts.isEmpty())
+	{
+		m_counts.fill(0, BUCKET_COUNT);
+	}
+
+	value = qMax<qint64>(0, value);
+	m_counts[bucketIndex(value)]++;
+	m_min = m_count ? qMin(m_min, value) : value;
+	m_max = m_count ? qMax(m_max, value) : value;
+	m_sum += value;
+	m_count++;
+}
+
+qint64 Metrics::Histogram::percentile(double percent) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+
+	qint64 rank = qBound<qint64>(1, qint64(qCeil(percent / 100.0 * m_count)), m_count);
+	qint64 seen = 0;
+	for (int index = 0; index < m_counts.size(); index++)
+	{
+		seen += m_counts[index];
+		if (seen >= rank)
+		{
+			return qBound(m_min, bucketHighest(index), m_max);
+		}
+	}
+	return m_max;
+}
+
+QVector<QPair<qint64, qint64>> Metrics::Histogram::buckets() const
+{
+	QVector<QPair<qint64, qint64>> result;
+	for (int index = 0; index < m_counts.size(); index++)
+	{
+		if (m_counts[index])
+		{
+			result.append(qMakePair(bucketLowest(index), m_counts[index]));
+		}
+	}
+	return result;
+}
+
+Metrics::ScopedTimer::ScopedTimer(const char* name)
+	: m_name(name)
+{
+	m_timer.start();
+}
+
+Metrics::ScopedTimer::~ScopedTimer()
+{
+	Metrics::recordNs(QString::fromLatin1(m_name), m_timer.nsecsElapsed());
+}
+
+void Metrics::increment(const QString& name, qint64 by)
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+	metrics.counters[name] += by;
+}
+
+void Metrics::recordNs(const QString& name, qint64 ns)
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+	metrics.histograms[name].record(ns);
+}
+
+QMap<QString, qint64> Metrics::counters()
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+
+	QMap<QString, qint64> result;
+	for (auto it = metrics.counters.constBegin(); it != metrics.counters.constEnd(); ++it)
+	{
+		result.insert(it.key(), it.value());
+	}
+	return result;
+}
+
+QMap<QString, Metrics::Histogram> Metrics::histograms()
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+
+	QMap<QString, Histogram> result;
+	for (auto it = metrics.histograms.constBegin(); it != metrics.histograms.constEnd(); ++it)
+	{
+		result.insert(it.key(), it.value());
+	}
+	return result;
+}
+
+bool Metrics::isEmpty()
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+	return metrics.counters.isEmpty() && metrics.histograms.isEmpty();
+}
+
+void Metrics::reset()
+{
+	MetricsState& metrics = state();
+	QMutexLocker locker(&metrics.mutex);
+	metrics.counters.clear();
+	metrics.histograms.clear();
+}
+
+QString Metrics::report()
+{
+	QMap<QString, Histogram> histogramMap = histograms();
+	QMap<QString, qint64> counterMap = counters();
+	if (histogramMap.isEmpty() && counterMap.isEmpty())
+	{
+		return "Nothing recorded yet";
+	}
+
+	auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 2); };
+
+	QString text = QString("%1 %2 %3 %4 %5 %6\n").arg(QString("operation"), -18).arg(QString("count"), 7)
+		.arg(QString("p50 ms"), 9).arg(QString("p95 ms"), 9).arg(QString("p99 ms"), 9).arg(QString("max ms"), 9);
+	for (auto it = histogramMap.constBegin(); it != histogramMap.constEnd(); ++it)
+	{
+		const Histogram& histogram = it.value();
+		text += QString("%1 %2 %3 %4 %5 %6\n").arg(it.key(), -18).arg(histogram.count(), 7)
+			.arg(ms(histogram.percentile(50)), 9).arg(ms(histogram.percentile(95)), 9)
+			.arg(ms(histogram.percentile(99)), 9).arg(ms(histogram.max()), 9);
+	}
+
+	if (!counterMap.isEmpty())
+	{
+		text += "\n";
+		for (auto it = counterMap.constBegin(); it != counterMap.constEnd(); ++it)
+		{
+			text += QString("%1 %2\n").arg(it.key(), -18).arg(it.value(), 7);
+		}
+	}
+
+	return text;
+}
+
+bool Metrics::writeFile(const QString& filePath, QString* error)
+{
+	QJsonObject counterObject;
+	QMap<QString, qint64> counterMap = counters();
+	for (auto it = counterMap.constBegin(); it != counterMap.constEnd(); ++it)
+	{
+		counterObject.insert(it.key(), double(it.value()));
+	}
+
+	// Buckets are kept so histograms of many sessions can be merged before taking percentiles
+	QJsonObject histogramObject;
+	QMap<QString, Histogram> histogramMap = histograms();
+	for (auto it = histogramMap.constBegin(); it != histogramMap.constEnd(); ++it)
+	{
+		const Histogram& histogram = it.value();
+		QJsonArray buckets;
+		for (const QPair<qint64, qint64>& bucket : histogram.buckets())
+		{
+			buckets.append(QJsonArray({ double(bucket.first), double(bucket.second) }));
+		}
+
+		QJsonObject entry;
+		entry.insert("unit", "ns");
+		entry.insert("count", double(histogram.count()));
+		entry.insert("min", double(histogram.min()));
+		entry.insert("max", double(histogram.max()));
+		entry.insert("mean", histogram.mean());
+		entry.insert("p50", double(histogram.percentile(50)));
+		entry.insert("p95", double(histogram.percentile(95)));
+		entry.insert("p99", double(histogram.percentile(99)));
+		entry.insert("p999", double(histogram.percentile(99.9)));
+		entry.insert("subBucketBits", Histogram::SUB_BUCKET_BITS);
+		entry.insert("buckets", buckets);
+		histogramObject.insert(it.key(), entry);
+	}
+
+	QJsonObject root;
+	root.insert("application", QCoreApplication::applicationName());
+	root.insert("version", QCoreApplication::applicationVersion());
+	root.insert("host", QSysInfo::machineHostName());
+	root.insert("os", QSysInfo::prettyProductName());
+	root.insert("pid", double(QCoreApplication::applicationPid()));
+	root.insert("written", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+	root.insert("counters", counterObject);
+	root.insert("histograms", histogramObject);
+
+	QDir().mkpath(QFileInfo(filePath).absolutePath());
+	QFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		*error = "Cannot write " + filePath + ": " + file.errorString();
+		return false;
+	}
+	file.write(QJsonDocument(root).toJson());
+	file.close();
+
+	qDebug() << "DEBUG [Metrics]:" << "Wrote" << histogramMap.size() << "histograms and" << counterMap.size() << "counters to" << filePath;
+	return true;
+}
+
+QString Metrics::defaultFilePath()
+{
+	return metricsFolder() + "/metrics-" + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss") + "-" +
+		QString::number(QCoreApplication::applicationPid()) + ".json";
+}
+
+void Metrics::pruneFiles(int keep)
+{
+	// The timestamp in the name sorts the files oldest first
+	QDir folder(metricsFolder());
+	QStringList files = folder.entryList(QStringList() << "metrics-*.json", QDir::Files, QDir::Name);
+	for (int i = 0; i < files.size() - keep; i++)
+	{
+		folder.remove(files[i]);
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QVector>
+#include <QMap>
+#include <QPair>
+#include <QElapsedTimer>
+
+// Process-wide counters and latency histograms of user-facing operations:
+// sheet select, sample display, table fill, load phases. Recording is
+// thread-safe and cheap enough for every interaction (one lock, one bucket
+// increment). Histograms keep log-linear buckets in the style of HdrHistogram,
+// so a percentile is within 1/64 of the recorded value at any magnitude, and
+// histograms from several sessions can be added bucket by bucket.
+class Metrics
+{
+public:
+	class Histogram
+	{
+	public:
+		// 2^SUB_BUCKET_BITS exact buckets, then 64 buckets per power of two up to 2^(MAX_SHIFT + 7) ns
+		// (about 36 minutes); longer values are counted in the top bucket
+		static const int SUB_BUCKET_BITS = 7;
+		static const int MAX_SHIFT = 34;
+		static const int BUCKET_COUNT = (1 << SUB_BUCKET_BITS) + MAX_SHIFT * (1 << (SUB_BUCKET_BITS - 1));
+
+		Histogram();
+
+		void record(qint64 value);
+
+		qint64 count() const { return m_count; }
+		qint64 min() const { return m_count ? m_min : 0; }
+		qint64 max() const { return m_count ? m_max : 0; }
+		double mean() const { return m_count ? m_sum / m_count : 0.0; }
+
+		// Highest value of the bucket holding the percentile, clamped to the recorded range
+		qint64 percentile(double percent) const;
+
+		// Non-empty buckets as (lowest value, count)
+		QVector<QPair<qint64, qint64>> buckets() const;
+
+		static int bucketIndex(qint64 value);
+		static qint64 bucketLowest(int index);
+		static qint64 bucketHighest(int index);
+
+	private:
+		QVector<qint64> m_counts; // Allocated on the first value
+		qint64 m_count;
+		qint64 m_min;
+		qint64 m_max;
+		double m_sum;
+	};
+
+	// Records the lifetime of the scope into the named histogram
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(const char* name);
+		~ScopedTimer();
+
+	private:
+		const char* m_name;
+		QElapsedTimer m_timer;
+	};
+
+	static void increment(const QString& name, qint64 by = 1);
+	static void recordNs(const QString& name, qint64 ns);
+
+	static QMap<QString, qint64> counters();
+	static QMap<QString, Histogram> histograms();
+	static bool isEmpty();
+	static void reset();
+
+	// Percentile table in ms, then the counters
+	static QString report();
+
+	// JSON with the host, the counters and per histogram its summary and non-empty buckets
+	static bool writeFile(const QString& filePath, QString* error);
+	static QString defaultFilePath(); // metrics-<time>-<pid>.json under the application data folder
+	static void pruneFiles(int keep); // Deletes all but the newest files of the default folder
+};
+
+#endif // METRICS_H
@@ -0,0 +1,262 @@
+#include "RowIndex.h"
+#include <QDebug>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QtNumeric>
+#include <algorithm>
+
+namespace
+{
+	// Strict weak order over the keys; ties fall through to the next key
+	struct RowLess
+	{
+		const QVector<RowIndex::SortKey>* keys;
+
+		bool operator()(int left, int right) const
+		{
+			for (const RowIndex::SortKey& key : *keys)
+			{
+				double a = key.values[left];
+				double b = key.values[right];
+				bool aBlank = qIsNaN(a);
+				bool bBlank = qIsNaN(b);
+				if (aBlank || bBlank)
+				{
+					if (aBlank && bBlank)
+					{
+						continue;
+					}
+					return bBlank;
+				}
+				if (a < b)
+				{
+					return !key.descending;
+				}
+				if (b < a)
+				{
+					return key.descending;
+				}
+			}
+			return false;
+		}
+	};
+
+	// Runs worker(i) for i in [0, count) on one thread each and waits for all of them
+	template <typename Worker>
+	void runParallel(int count, Worker worker)
+	{
+		if (count == 1)
+		{
+			worker(0);
+			return;
+		}
+
+		QVector<QThread*> threads;
+		for (int i = 0; i < count; i++)
+		{
+			threads.append(QThread::create([worker, i]() { worker(i); }));
+			threads.last()->start();
+		}
+		for (QThread* thread : threads)
+		{
+			thread->wait();
+			delete thread;
+		}
+	}
+}
+
+RowIndex::RowIndex()
+	: m_threadCount(0)
+	, m_parallelThreshold(16384)
+	, m_sortNs(0)
+	, m_filterNs(0)
+	, m_sortThreads(1)
+{
+}
+
+void RowIndex::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [RowIndex]:" << message;
+}
+
+QVector<int> RowIndex::sort(const QVector<SortKey>& keys, int rowCount)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	QVector<int> order(rowCount);
+	for (int row = 0; row < rowCount; row++)
+	{
+		order[row] = row;
+	}
+
+	if (keys.isEmpty() || rowCount < 2)
+	{
+		m_sortNs = timer.nsecsElapsed();
+		m_sortThreads = 1;
+		return order;
+	}
+
+	// A power of two of runs, so every merge round pairs them up
+	int threadCount = m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+	int runs = 1;
+	while (runs * 2 <= threadCount && rowCount / (runs * 2) >= m_parallelThreshold / 2 && rowCount >= m_parallelThreshold)
+	{
+		runs *= 2;
+	}
+	m_sortThreads = runs;
+
+	RowLess less = { &keys };
+	QVector<int> bounds(runs + 1);
+	for (int i = 0; i <= runs; i++)
+	{
+		bounds[i] = int(qint64(rowCount) * i / runs);
+	}
+
+	// Each run sorted on its own thread
+	int* data = order.data();
+	runParallel(runs, [&](int run) {
+		std::stable_sort(data + bounds[run], data + bounds[run + 1], less);
+	});
+
+	// Neighbouring runs merged pairwise, the left run first on ties, which keeps the sort stable
+	QVector<int> buffer(rowCount);
+	int* source = order.data();
+	int* target = buffer.data();
+	for (int width = 1; width < runs; width *= 2)
+	{
+		int merges = runs / (width * 2);
+		runParallel(merges, [&](int merge) {
+			int begin = bounds[merge * width * 2];
+			int middle = bounds[merge * width * 2 + width];
+			int end = bounds[(merge + 1) * width * 2];
+			std::merge(source + begin, source + middle, source + middle, source + end, target + begin, less);
+		});
+		std::swap(source, target);
+	}
+	if (source != order.data())
+	{
+		order.swap(buffer);
+	}
+
+	m_sortNs = timer.nsecsElapsed();
+	debugPrint("Sorted " + QString::number(rowCount) + " rows on " + QString::number(keys.size()) + " keys, " +
+		QString::number(runs) + " threads, in " + QString::number(m_sortNs / 1e6, 'f', 2) + " ms");
+	return order;
+}
+
+void RowIndex::evaluate(const Predicate& predicate, int rowCount, quint8* mask)
+{
+	// One branch-free loop per comparison; NaN compares false, so blanks drop out on their own
+	const double* values = predicate.values;
+	const double operand = predicate.operand;
+	switch (predicate.comparison)
+	{
+	case Less:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] < operand);
+		break;
+	case LessOrEqual:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] <= operand);
+		break;
+	case Greater:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] > operand);
+		break;
+	case GreaterOrEqual:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] >= operand);
+		break;
+	case Equal:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] == operand);
+		break;
+	case NotEqual:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] == values[row] && values[row] != operand);
+		break;
+	case Blank:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] != values[row]);
+		break;
+	case NotBlank:
+		for (int row = 0; row < rowCount; row++) mask[row] &= quint8(values[row] == values[row]);
+		break;
+	}
+}
+
+QVector<int> RowIndex::filter(const QVector<Predicate>& predicates, const QVector<int>& order, int rowCount)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	if (predicates.isEmpty())
+	{
+		m_filterNs = timer.nsecsElapsed();
+		return order;
+	}
+
+	QVector<quint8> mask(rowCount, 1);
+	for (const Predicate& predicate : predicates)
+	{
+		evaluate(predicate, rowCount, mask.data());
+	}
+
+	QVector<int> selected;
+	selected.reserve(order.size());
+	for (int row : order)
+	{
+		if (mask[row])
+		{
+			selected.append(row);
+		}
+	}
+
+	m_filterNs = timer.nsecsElapsed();
+	return selected;
+}
+
+QVector<double> RowIndex::textRanks(const QStringList& values, const QString& operand, double* operandRank)
+{
+	// Distinct values in order, then each value's position among them
+	QMap<QString, int> ranks;
+	for (const QString& value : values)
+	{
+		if (!value.isEmpty())
+		{
+			ranks.insert(value.toCaseFolded(), 0);
+		}
+	}
+	int rank = 0;
+	for (auto it = ranks.begin(); it != ranks.end(); ++it)
+	{
+		it.value() = rank++;
+	}
+
+	QVector<double> result(values.size(), qQNaN());
+	for (int row = 0; row < values.size(); row++)
+	{
+		if (!values[row].isEmpty())
+		{
+			result[row] = ranks.value(values[row].toCaseFolded());
+		}
+	}
+
+	// Text that is not in the column matches no row
+	if (operandRank)
+	{
+		*operandRank = ranks.contains(operand.toCaseFolded()) ? double(ranks.value(operand.toCaseFolded())) : -1.0;
+	}
+	return result;
+}
+
+QString RowIndex::comparisonName(Comparison comparison)
+{
+	switch (comparison)
+	{
+	case Less: return "<";
+	case LessOrEqual: return "<=";
+	case Greater: return ">";
+	case GreaterOrEqual: return ">=";
+	case Equal: return "=";
+	case NotEqual: return "!=";
+	case Blank: return "is blank";
+	case NotBlank: return "is not blank";
+	}
+	return QString();
+}
@@ -0,0 +1,69 @@
+#ifndef ROWINDEX_H
+#define ROWINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Display order of a sample's rows as index vectors over its columns: the
+// columns are read where they are (the sheet's typed storage, the computed
+// columns) and never reordered. sort() builds a permutation, filter() a
+// selection over it; the table then shows row order[i] in place i.
+class RowIndex
+{
+public:
+	struct SortKey
+	{
+		const double* values; // One per row; NaN (blank) sorts last in either direction
+		bool descending;
+	};
+
+	enum Comparison { Less, LessOrEqual, Greater, GreaterOrEqual, Equal, NotEqual, Blank, NotBlank };
+
+	// Blank cells only match Blank
+	struct Predicate
+	{
+		const double* values;
+		Comparison comparison;
+		double operand;
+	};
+
+	RowIndex();
+
+	// Sorts above the threshold are split over threads; 0 threads = QThread::idealThreadCount()
+	void setThreadCount(int threads) { m_threadCount = threads; }
+	void setParallelThreshold(int rows) { m_parallelThreshold = rows; }
+
+	// Stable multi-key sort of rows 0..rowCount-1: the first key decides, later keys break ties,
+	// rows equal on every key keep their sheet order
+	QVector<int> sort(const QVector<SortKey>& keys, int rowCount);
+
+	// Rows of order for which every predicate holds, in the same order.
+	// Each predicate is one pass over its column into a row mask
+	QVector<int> filter(const QVector<Predicate>& predicates, const QVector<int>& order, int rowCount);
+
+	// ANDs one predicate into mask (one byte per row)
+	static void evaluate(const Predicate& predicate, int rowCount, quint8* mask);
+
+	// Sortable stand-in for a text column: each value's rank among the distinct
+	// values, compared without case; empty text is blank (NaN)
+	static QVector<double> textRanks(const QStringList& values, const QString& operand = QString(), double* operandRank = nullptr);
+
+	static QString comparisonName(Comparison comparison);
+
+	// Timing of the last sort and filter
+	qint64 lastSortNs() const { return m_sortNs; }
+	qint64 lastFilterNs() const { return m_filterNs; }
+	int lastSortThreads() const { return m_sortThreads; }
+
+private:
+	int m_threadCount;
+	int m_parallelThreshold;
+	qint64 m_sortNs;
+	qint64 m_filterNs;
+	int m_sortThreads;
+
+	void debugPrint(const QString& message) const;
+};
+
+#endif // ROWINDEX_H
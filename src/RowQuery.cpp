@@ -0,0 +1,630 @@
+#include "RowQuery.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QtNumeric>
+
+namespace
+{
+	const char* const RESERVED[] = { "and", "or", "not", "is", "blank", "outside", "within", "of", "mean", "true", "false" };
+
+	// Lower case letters and digits outside parentheses: "TPM (mg/puff)" -> "tpm"
+	QString columnKey(const QString& name)
+	{
+		QString key;
+		int depth = 0;
+		for (int i = 0; i < name.size(); i++)
+		{
+			QChar c = name[i];
+			if (c == '(')
+			{
+				depth++;
+			}
+			else if (c == ')')
+			{
+				depth = qMax(0, depth - 1);
+			}
+			else if (depth == 0 && c.isLetterOrNumber())
+			{
+				key += c.toLower();
+			}
+		}
+		return key;
+	}
+
+	// Mean of the non-blank values
+	double columnMean(const double* values, int rowCount)
+	{
+		double sum = 0.0;
+		int count = 0;
+		for (int row = 0; row < rowCount; row++)
+		{
+			if (values[row] == values[row])
+			{
+				sum += values[row];
+				count++;
+			}
+		}
+		return count > 0 ? sum / count : qQNaN();
+	}
+}
+
+RowQuery::RowQuery()
+	: m_evaluateNs(0)
+	, m_next(0)
+{
+}
+
+void RowQuery::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [RowQuery]:" << message;
+}
+
+void RowQuery::clear()
+{
+	m_text.clear();
+	m_columnNames.clear();
+	m_steps.clear();
+	m_lastError.clear();
+	m_tokens.clear();
+	m_next = 0;
+}
+
+bool RowQuery::fail(const QString& message)
+{
+	m_lastError = message;
+	return false;
+}
+
+bool RowQuery::isKeyword(const Token& token, const char* keyword)
+{
+	return token.type == Token::Word && token.text.compare(keyword, Qt::CaseInsensitive) == 0;
+}
+
+bool RowQuery::isReserved(const Token& token)
+{
+	for (const char* keyword : RESERVED)
+	{
+		if (isKeyword(token, keyword))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool RowQuery::compile(const QString& query, const QStringList& columnNames)
+{
+	clear();
+	m_columnNames = columnNames;
+
+	bool compiled = tokenize(query);
+	if (compiled && peek().type == Token::End)
+	{
+		compiled = fail("The query is empty");
+	}
+	compiled = compiled && parseOr();
+	if (compiled && peek().type != Token::End)
+	{
+		compiled = fail("Unexpected \"" + peek().text + "\" at position " + QString::number(peek().position + 1));
+	}
+	m_tokens.clear();
+
+	if (!compiled)
+	{
+		m_steps.clear();
+		debugPrint("ERROR: " + m_lastError);
+		return false;
+	}
+
+	// A comparison ANDed to what precedes it is evaluated straight into that mask
+	for (int i = 1; i < m_steps.size(); i++)
+	{
+		if (m_steps[i].kind == Step::And && m_steps[i - 1].kind == Step::Test)
+		{
+			m_steps[i - 1].kind = Step::AndTest;
+			m_steps.remove(i);
+			i--;
+		}
+	}
+
+	m_text = query.trimmed();
+	debugPrint("Compiled \"" + m_text + "\" into " + QString::number(m_steps.size()) + " steps");
+	return true;
+}
+
+bool RowQuery::tokenize(const QString& query)
+{
+	int i = 0;
+	while (i < query.size())
+	{
+		QChar c = query[i];
+		if (c.isSpace())
+		{
+			i++;
+			continue;
+		}
+
+		Token token;
+		token.position = i;
+		if (c == '"' || c == '\'')
+		{
+			int end = query.indexOf(c, i + 1);
+			if (end < 0)
+			{
+				return fail("Unterminated quote at position " + QString::number(i + 1));
+			}
+			token.type = Token::String;
+			token.text = query.mid(i + 1, end - i - 1);
+			i = end + 1;
+		}
+		else if (c.isDigit() || (c == '.' && i + 1 < query.size() && query[i + 1].isDigit()))
+		{
+			int end = i;
+			while (end < query.size() && (query[end].isDigit() || query[end] == '.'))
+			{
+				end++;
+			}
+			if (end + 1 < query.size() && (query[end] == 'e' || query[end] == 'E') &&
+				(query[end + 1].isDigit() || ((query[end + 1] == '-' || query[end + 1] == '+') && end + 2 < query.size() && query[end + 2].isDigit())))
+			{
+				end += 2;
+				while (end < query.size() && query[end].isDigit())
+				{
+					end++;
+				}
+			}
+
+			bool ok = false;
+			token.type = Token::Number;
+			token.text = query.mid(i, end - i);
+			token.number = token.text.toDouble(&ok);
+			if (!ok)
+			{
+				return fail("\"" + token.text + "\" is not a number");
+			}
+			i = end;
+		}
+		else if (c.isLetter() || c == '_' || c == '#')
+		{
+			int end = i + 1;
+			while (end < query.size() && (query[end].isLetterOrNumber() || query[end] == '_'))
+			{
+				end++;
+			}
+			token.type = Token::Word;
+			token.text = query.mid(i, end - i);
+			i = end;
+		}
+		else if (c == '<' || c == '>' || c == '=' || c == '!')
+		{
+			QString two = query.mid(i, 2);
+			token.type = Token::Operator;
+			if (two == "<=" || two == ">=" || two == "!=" || two == "<>" || two == "==")
+			{
+				token.text = two;
+			}
+			else if (c != '!')
+			{
+				token.text = c;
+			}
+			else
+			{
+				return fail("Expected != at position " + QString::number(i + 1));
+			}
+			i += token.text.size();
+		}
+		else
+		{
+			switch (c.toLatin1())
+			{
+			case '(': token.type = Token::Open; break;
+			case ')': token.type = Token::Close; break;
+			case '%': token.type = Token::Percent; break;
+			case '+': token.type = Token::Plus; break;
+			case '-': token.type = Token::Minus; break;
+			default:
+				return fail("Unexpected \"" + QString(c) + "\" at position " + QString::number(i + 1));
+			}
+			token.text = c;
+			i++;
+		}
+		m_tokens.append(token);
+	}
+
+	Token end;
+	end.position = query.size();
+	m_tokens.append(end);
+	return true;
+}
+
+bool RowQuery::parseOr()
+{
+	if (!parseAnd())
+	{
+		return false;
+	}
+	while (isKeyword(peek(), "or"))
+	{
+		m_next++;
+		if (!parseAnd())
+		{
+			return false;
+		}
+		m_steps.append(Step(Step::Or));
+	}
+	return true;
+}
+
+bool RowQuery::parseAnd()
+{
+	if (!parseUnary())
+	{
+		return false;
+	}
+	while (isKeyword(peek(), "and"))
+	{
+		m_next++;
+		if (!parseUnary())
+		{
+			return false;
+		}
+		m_steps.append(Step(Step::And));
+	}
+	return true;
+}
+
+bool RowQuery::parseUnary()
+{
+	if (isKeyword(peek(), "not"))
+	{
+		m_next++;
+		if (!parseUnary())
+		{
+			return false;
+		}
+		m_steps.append(Step(Step::Not));
+		return true;
+	}
+
+	if (peek().type == Token::Open)
+	{
+		int position = peek().position;
+		m_next++;
+		if (!parseOr())
+		{
+			return false;
+		}
+		if (peek().type != Token::Close)
+		{
+			return fail("Missing ) for the ( at position " + QString::number(position + 1));
+		}
+		m_next++;
+		return true;
+	}
+
+	return parseTest();
+}
+
+bool RowQuery::parseTest()
+{
+	int column = -1;
+	if (!parseColumn(&column))
+	{
+		return false;
+	}
+
+	const Token& token = peek();
+	if (token.type == Token::Operator)
+	{
+		Step step;
+		step.column = column;
+		if (token.text == "<") step.comparison = RowIndex::Less;
+		else if (token.text == "<=") step.comparison = RowIndex::LessOrEqual;
+		else if (token.text == ">") step.comparison = RowIndex::Greater;
+		else if (token.text == ">=") step.comparison = RowIndex::GreaterOrEqual;
+		else if (token.text == "=" || token.text == "==") step.comparison = RowIndex::Equal;
+		else step.comparison = RowIndex::NotEqual;
+		m_next++;
+
+		if (!parseOperand(&step))
+		{
+			return false;
+		}
+		if (step.textOperand && step.comparison != RowIndex::Equal && step.comparison != RowIndex::NotEqual)
+		{
+			return fail("Text is compared with = or != only: \"" + step.text + "\"");
+		}
+		m_steps.append(step);
+		return true;
+	}
+
+	if (isKeyword(token, "is"))
+	{
+		m_next++;
+		bool negated = isKeyword(peek(), "not");
+		if (negated)
+		{
+			m_next++;
+		}
+		if (!isKeyword(peek(), "blank"))
+		{
+			return fail("Expected \"blank\" at position " + QString::number(peek().position + 1));
+		}
+		m_next++;
+		addTest(column, negated ? RowIndex::NotBlank : RowIndex::Blank, 0.0, false);
+		return true;
+	}
+
+	if (isKeyword(token, "outside") || isKeyword(token, "within"))
+	{
+		bool outside = isKeyword(token, "outside");
+		m_next++;
+		if (peek().type != Token::Number || m_tokens[m_next + 1].type != Token::Percent)
+		{
+			return fail("Expected a percentage such as 10% at position " + QString::number(peek().position + 1));
+		}
+		double percent = peek().number;
+		m_next += 2;
+		if (isKeyword(peek(), "of"))
+		{
+			m_next++;
+			if (!isKeyword(peek(), "mean"))
+			{
+				return fail("Expected \"mean\" at position " + QString::number(peek().position + 1));
+			}
+			m_next++;
+		}
+
+		// Two passes against the band around the mean
+		if (outside)
+		{
+			addTest(column, RowIndex::Less, -percent, true);
+			addTest(column, RowIndex::Greater, percent, true);
+			m_steps.append(Step(Step::Or));
+		}
+		else
+		{
+			addTest(column, RowIndex::GreaterOrEqual, -percent, true);
+			addTest(column, RowIndex::LessOrEqual, percent, true);
+			m_steps.append(Step(Step::And));
+		}
+		return true;
+	}
+
+	// A column on its own: flag set, number non-zero
+	addTest(column, RowIndex::NotEqual, 0.0, false);
+	return true;
+}
+
+bool RowQuery::parseOperand(Step* step)
+{
+	const Token& token = peek();
+	if (token.type == Token::Number)
+	{
+		step->operand = token.number;
+		m_next++;
+		return true;
+	}
+	if (token.type == Token::Minus && m_tokens[m_next + 1].type == Token::Number)
+	{
+		step->operand = -m_tokens[m_next + 1].number;
+		m_next += 2;
+		return true;
+	}
+	if (isKeyword(token, "true") || isKeyword(token, "false"))
+	{
+		step->operand = isKeyword(token, "true") ? 1.0 : 0.0;
+		m_next++;
+		return true;
+	}
+	if (isKeyword(token, "mean"))
+	{
+		// mean, mean + 5%, mean - 5%
+		step->relativeToMean = true;
+		m_next++;
+		if ((peek().type == Token::Plus || peek().type == Token::Minus) && m_tokens[m_next + 1].type == Token::Number &&
+			m_tokens[m_next + 2].type == Token::Percent)
+		{
+			step->operand = (peek().type == Token::Minus ? -1.0 : 1.0) * m_tokens[m_next + 1].number;
+			m_next += 3;
+		}
+		return true;
+	}
+	if (token.type == Token::String || (token.type == Token::Word && !isReserved(token)))
+	{
+		step->textOperand = true;
+		step->text = token.text;
+		m_next++;
+		return true;
+	}
+	return fail("Expected a value at position " + QString::number(token.position + 1));
+}
+
+bool RowQuery::parseColumn(int* column)
+{
+	const Token& token = peek();
+	QString name;
+	if (token.type == Token::String)
+	{
+		name = token.text;
+		m_next++;
+	}
+	else if (token.type == Token::Word && !isReserved(token))
+	{
+		// Unquoted names run over several words, up to the next operator or keyword
+		QStringList words;
+		while (peek().type == Token::Word && !isReserved(peek()))
+		{
+			words << peek().text;
+			m_next++;
+		}
+		name = words.join(" ");
+	}
+	else
+	{
+		return fail("Expected a column name at position " + QString::number(token.position + 1));
+	}
+
+	// #4 is the fourth column
+	if (name.startsWith('#'))
+	{
+		bool ok = false;
+		int number = name.mid(1).toInt(&ok);
+		if (!ok || number < 1 || number > m_columnNames.size())
+		{
+			return fail("No column " + name + ", there are " + QString::number(m_columnNames.size()));
+		}
+		*column = number - 1;
+		return true;
+	}
+
+	for (int col = 0; col < m_columnNames.size(); col++)
+	{
+		if (m_columnNames[col].compare(name, Qt::CaseInsensitive) == 0)
+		{
+			*column = col;
+			return true;
+		}
+	}
+	QString key = columnKey(name);
+	for (int col = 0; col < m_columnNames.size() && !key.isEmpty(); col++)
+	{
+		if (columnKey(m_columnNames[col]) == key)
+		{
+			*column = col;
+			return true;
+		}
+	}
+	return fail("Unknown column \"" + name + "\"; the columns are " + m_columnNames.join(", "));
+}
+
+void RowQuery::addTest(int column, RowIndex::Comparison comparison, double operand, bool relativeToMean)
+{
+	Step step;
+	step.column = column;
+	step.comparison = comparison;
+	step.operand = operand;
+	step.relativeToMean = relativeToMean;
+	m_steps.append(step);
+}
+
+QVector<int> RowQuery::columns() const
+{
+	QVector<int> columns;
+	for (const Step& step : m_steps)
+	{
+		if ((step.kind == Step::Test || step.kind == Step::AndTest) && !columns.contains(step.column))
+		{
+			columns.append(step.column);
+		}
+	}
+	return columns;
+}
+
+QVector<quint8> RowQuery::evaluate(int rowCount, const ColumnReader& readColumn) const
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	// Each column is read once, a text column once per operand; copies live until the mask is built
+	QVector<QVector<double>> storage(m_steps.size());
+	QHash<QString, const double*> columns;
+	QHash<QString, double> textOperands;
+	QHash<int, double> means;
+	QVector<QVector<quint8>> masks;
+
+	for (int i = 0; i < m_steps.size(); i++)
+	{
+		const Step& step = m_steps[i];
+		switch (step.kind)
+		{
+		case Step::Test:
+		case Step::AndTest:
+		{
+			QString key = QString::number(step.column) + (step.textOperand ? "=" + step.text : QString());
+			if (!columns.contains(key))
+			{
+				double textOperand = qQNaN();
+				const double* values = readColumn(step.column, &storage[i], step.textOperand ? step.text : QString(), &textOperand);
+				if (!values)
+				{
+					storage[i] = QVector<double>(rowCount, qQNaN());
+					values = storage[i].constData();
+				}
+				columns.insert(key, values);
+				textOperands.insert(key, textOperand);
+			}
+
+			RowIndex::Predicate predicate;
+			predicate.values = columns.value(key);
+			predicate.comparison = step.comparison;
+			predicate.operand = step.operand;
+			if (step.textOperand)
+			{
+				predicate.operand = textOperands.value(key);
+			}
+			else if (step.relativeToMean)
+			{
+				if (!means.contains(step.column))
+				{
+					means.insert(step.column, columnMean(predicate.values, rowCount));
+				}
+				double mean = means.value(step.column);
+				predicate.operand = mean + qAbs(mean) * step.operand / 100.0;
+			}
+
+			if (step.kind == Step::Test)
+			{
+				masks.append(QVector<quint8>(rowCount, 1));
+			}
+			RowIndex::evaluate(predicate, rowCount, masks.last().data());
+			break;
+		}
+		case Step::And:
+		case Step::Or:
+		{
+			QVector<quint8> right = masks.takeLast();
+			const quint8* rightMask = right.constData();
+			quint8* leftMask = masks.last().data();
+			if (step.kind == Step::And)
+			{
+				for (int row = 0; row < rowCount; row++) leftMask[row] &= rightMask[row];
+			}
+			else
+			{
+				for (int row = 0; row < rowCount; row++) leftMask[row] |= rightMask[row];
+			}
+			break;
+		}
+		case Step::Not:
+		{
+			quint8* mask = masks.last().data();
+			for (int row = 0; row < rowCount; row++) mask[row] ^= 1;
+			break;
+		}
+		}
+	}
+
+	m_evaluateNs = timer.nsecsElapsed();
+	return masks.isEmpty() ? QVector<quint8>(rowCount, 0) : masks.last();
+}
+
+int RowQuery::matchCount(const QVector<quint8>& mask)
+{
+	int count = 0;
+	for (quint8 match : mask)
+	{
+		count += match;
+	}
+	return count;
+}
+
+QString RowQuery::syntaxHelp()
+{
+	return "Columns by name (\"Draw Pressure\", TPM) or number (#4), joined with and, or, not and ( ):\n"
+		"  Clog                           flag set\n"
+		"  Draw Pressure > 12.5           < <= > >= = !=\n"
+		"  TPM outside 10% of mean        also within 10%, > mean + 5%\n"
+		"  Notes = \"leak\", Notes is blank  text with = and != only";
+}
@@ -0,0 +1,103 @@
+#ifndef ROWQUERY_H
+#define ROWQUERY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "RowIndex.h"
+
+// Row predicates over a sample's columns, typed as a query:
+//
+//   Clog                              flag set (non-zero)
+//   "Draw Pressure" > 12.5            quoted or plain column names, #4 = fourth column
+//   TPM outside 10% of mean           beyond +-10% of the column's mean in the sample
+//   TPM > mean + 5% and not Smell     and, or, not and parentheses
+//   Notes = "leak" or Notes is blank  text compares with = and != only
+//
+// compile() turns the query into postfix steps over RowIndex predicates;
+// evaluate() runs each comparison as one pass over its column into a byte mask
+// (one byte per row, 1 = match) and combines the masks with byte loops, so a
+// query costs a few passes over contiguous doubles whatever the row count.
+// Comparisons ANDed to the left reuse its mask instead of a new one.
+class RowQuery
+{
+public:
+	// Column as doubles for the rows being queried (NaN = blank). A text operand asks for a
+	// text column's ranks (see RowIndex::textRanks) and gets its own rank in *textOperand.
+	// Copies go to storage, which lives until evaluate() returns
+	typedef std::function<const double*(int column, QVector<double>* storage, const QString& text, double* textOperand)> ColumnReader;
+
+	RowQuery();
+
+	// Column names are matched without case, spaces and parenthesised units ("tpm" is "TPM (mg/puff)")
+	bool compile(const QString& query, const QStringList& columnNames);
+	void clear();
+
+	bool isEmpty() const { return m_steps.isEmpty(); }
+	QString text() const { return m_text; }
+	QVector<int> columns() const; // Columns the query reads, in order of appearance
+	QString getLastError() const { return m_lastError; }
+
+	// Selection mask of rows 0..rowCount-1
+	QVector<quint8> evaluate(int rowCount, const ColumnReader& readColumn) const;
+	qint64 lastEvaluateNs() const { return m_evaluateNs; }
+
+	static int matchCount(const QVector<quint8>& mask);
+	static QString syntaxHelp();
+
+private:
+	struct Step
+	{
+		enum Kind { Test, AndTest, And, Or, Not };
+
+		Step(Kind stepKind = Test) : kind(stepKind), column(-1), comparison(RowIndex::Equal), operand(0.0),
+			relativeToMean(false), textOperand(false) {}
+
+		Kind kind;
+		int column;
+		RowIndex::Comparison comparison;
+		double operand;
+		bool relativeToMean; // Operand is a percentage off the column's mean
+		bool textOperand;    // Compared with text, by rank
+		QString text;
+	};
+
+	struct Token
+	{
+		enum Type { Word, Number, String, Operator, Open, Close, Percent, Plus, Minus, End };
+
+		Token() : type(End), number(0.0), position(0) {}
+
+		Type type;
+		QString text;
+		double number;
+		int position;
+	};
+
+	QString m_text;
+	QStringList m_columnNames;
+	QVector<Step> m_steps;
+	QString m_lastError;
+	mutable qint64 m_evaluateNs;
+
+	// Parser state
+	QVector<Token> m_tokens;
+	int m_next;
+
+	bool tokenize(const QString& query);
+	bool parseOr();
+	bool parseAnd();
+	bool parseUnary();
+	bool parseTest();
+	bool parseOperand(Step* step);
+	bool parseColumn(int* column);
+	bool fail(const QString& message);
+	const Token& peek() const { return m_tokens[m_next]; }
+	static bool isKeyword(const Token& token, const char* keyword);
+	static bool isReserved(const Token& token);
+	void addTest(int column, RowIndex::Comparison comparison, double operand, bool relativeToMean);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // ROWQUERY_H
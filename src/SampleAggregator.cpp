@@ -0,0 +1,585 @@
+#include "SampleAggregator.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDate>
+#include <QSet>
+#include <QRegularExpression>
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+SampleAggregator::SampleAggregator()
+{
+}
+
+void SampleAggregator::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [SampleAggregator]:" << message;
+}
+
+void SampleAggregator::clear()
+{
+	m_workbooks.clear();
+	m_columnNames.clear();
+	m_lastError.clear();
+}
+
+int SampleAggregator::sampleCount() const
+{
+	int count = 0;
+	for (const Workbook& workbook : m_workbooks)
+	{
+		count += workbook.samples.size();
+	}
+	return count;
+}
+
+QStringList SampleAggregator::columnNames() const
+{
+	return m_columnNames;
+}
+
+qint64 SampleAggregator::memoryBytes() const
+{
+	qint64 bytes = MemoryAccounting::stringListBytes(m_columnNames);
+	for (const Workbook& workbook : m_workbooks)
+	{
+		bytes += MemoryAccounting::stringBytes(workbook.filePath);
+		for (const SampleRecord& record : workbook.samples)
+		{
+			const ExcelReader::SampleMetadata& metadata = record.metadata;
+			bytes += sizeof(SampleRecord) + MemoryAccounting::stringBytes(record.sheetName) +
+				MemoryAccounting::stringBytes(metadata.testName) + MemoryAccounting::stringBytes(metadata.date) +
+				MemoryAccounting::stringBytes(metadata.sampleID) + MemoryAccounting::stringBytes(metadata.media) +
+				MemoryAccounting::stringBytes(metadata.tester) + MemoryAccounting::stringBytes(metadata.puffingRegime) +
+				MemoryAccounting::stringBytes(metadata.heatingTechnology);
+
+			// Hash node plus the summary per column; the keys are shared with m_columnNames
+			bytes += qint64(record.columns.size()) * (sizeof(ColumnSummary) + 32);
+		}
+	}
+	return bytes;
+}
+
+QStringList SampleAggregator::metadataFields()
+{
+	return QStringList() << "file" << "sheet" << "testName" << "date" << "sampleID" << "media"
+		<< "heatingTechnology" << "puffingRegime" << "tester" << "resistance" << "voltage"
+		<< "power" << "viscosity" << "initialOilMass";
+}
+
+QString SampleAggregator::functionName(Function function)
+{
+	switch (function)
+	{
+	case Count: return "count";
+	case Sum: return "sum";
+	case Mean: return "mean";
+	case Min: return "min";
+	case Max: return "max";
+	}
+	return QString();
+}
+
+bool SampleAggregator::extractWorkbook(const QString& filePath, Workbook* workbook, QString* error)
+{
+	ExcelReader reader;
+	if (!reader.loadFile(filePath))
+	{
+		*error = filePath + ": " + reader.getLastError();
+		return false;
+	}
+
+	workbook->filePath = filePath;
+
+	for (const QString& sheetName : reader.getSheetNames())
+	{
+		if (!reader.selectSheet(sheetName) || reader.isDeprecatedUserTestSimulation())
+		{
+			continue;
+		}
+
+		QStringList headers = reader.getColumnHeaders();
+		QVector<ExcelReader::SampleView> samples = reader.sampleViews();
+
+		for (int sampleIndex = 0; sampleIndex < samples.size(); sampleIndex++)
+		{
+			const ExcelReader::SampleView& sample = samples.at(sampleIndex);
+
+			// Unused 12-column blocks (no ID and no puffs) are not samples
+			if (sample.metadata().sampleID.isEmpty() && sample.rowCount() == 0)
+			{
+				continue;
+			}
+
+			SampleRecord record;
+			record.filePath = filePath;
+			record.sheetName = sheetName;
+			record.sampleIndex = sampleIndex;
+			record.metadata = sample.metadata();
+
+			// Reduce each data column to a summary, queries never need the individual puffs
+			for (int col = 0; col < headers.size(); col++)
+			{
+				QString header = headers.at(col).toLower();
+				if (header.isEmpty())
+				{
+					continue;
+				}
+
+				// Only numeric and flag columns have values to summarise; they are read straight from the column buffer
+				ExcelReader::ColumnSpan span = sample.column(col);
+				if (!span.numbers)
+				{
+					continue;
+				}
+
+				ColumnSummary summary = { 0, 0.0, std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest() };
+				for (int row = 0; row < span.size; row++)
+				{
+					double value = span.numbers[row];
+					if (!qIsNaN(value))
+					{
+						summary.count++;
+						summary.sum += value;
+						summary.min = qMin(summary.min, value);
+						summary.max = qMax(summary.max, value);
+					}
+				}
+
+				if (summary.count > 0)
+				{
+					record.columns.insert(header, summary);
+				}
+			}
+
+			workbook->samples.append(record);
+		}
+	}
+
+	return true;
+}
+
+bool SampleAggregator::loadWorkbooks(const QStringList& filePaths)
+{
+	debugPrint("Loading " + QString::number(filePaths.size()) + " workbooks");
+
+	clear();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QVector<Workbook> workbooks(filePaths.size());
+	QVector<int> loaded(filePaths.size(), 0);
+	QStringList errors;
+	QMutex errorMutex;
+	QAtomicInt nextFile(0);
+
+	// Workers pull files from a shared counter, so a large workbook does not hold up the others
+	auto worker = [&]() {
+		for (int index = nextFile.fetchAndAddRelaxed(1); index < filePaths.size(); index = nextFile.fetchAndAddRelaxed(1))
+		{
+			QString error;
+			loaded[index] = extractWorkbook(filePaths.at(index), &workbooks[index], &error);
+			if (!loaded[index])
+			{
+				QMutexLocker locker(&errorMutex);
+				errors.append(error);
+			}
+		}
+	};
+
+	int threadCount = qBound(1, QThread::idealThreadCount(), filePaths.size());
+	QVector<QThread*> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.append(QThread::create(worker));
+		threads.last()->start();
+	}
+	for (QThread* thread : threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+
+	QSet<QString> seenColumns;
+	for (int i = 0; i < workbooks.size(); i++)
+	{
+		if (!loaded.at(i))
+		{
+			continue;
+		}
+
+		for (const SampleRecord& record : workbooks.at(i).samples)
+		{
+			for (QHash<QString, ColumnSummary>::const_iterator it = record.columns.constBegin(); it != record.columns.constEnd(); ++it)
+			{
+				if (!seenColumns.contains(it.key()))
+				{
+					seenColumns.insert(it.key());
+					m_columnNames.append(it.key());
+				}
+			}
+		}
+		m_workbooks.append(workbooks.at(i));
+	}
+
+	debugPrint("Loaded " + QString::number(sampleCount()) + " samples from " + QString::number(m_workbooks.size()) +
+		" workbooks in " + QString::number(timer.elapsed()) + " ms using " + QString::number(threadCount) + " threads");
+
+	if (!errors.isEmpty())
+	{
+		m_lastError = errors.join("\n");
+		return false;
+	}
+
+	return true;
+}
+
+QString SampleAggregator::fieldText(const SampleRecord& record, const QString& field)
+{
+	const ExcelReader::SampleMetadata& metadata = record.metadata;
+
+	if (field == "file") return QFileInfo(record.filePath).fileName();
+	if (field == "sheet") return record.sheetName;
+	if (field == "testName") return metadata.testName;
+	if (field == "date") return metadata.date;
+	if (field == "sampleID") return metadata.sampleID;
+	if (field == "media") return metadata.media;
+	if (field == "heatingTechnology") return metadata.heatingTechnology;
+	if (field == "puffingRegime") return metadata.puffingRegime;
+	if (field == "tester") return metadata.tester;
+
+	double number = 0.0;
+	if (fieldNumber(record, field, &number))
+	{
+		return QString::number(number);
+	}
+
+	return QString();
+}
+
+bool SampleAggregator::fieldNumber(const SampleRecord& record, const QString& field, double* value)
+{
+	const ExcelReader::SampleMetadata& metadata = record.metadata;
+
+	if (field == "resistance") { *value = metadata.resistance; return true; }
+	if (field == "voltage") { *value = metadata.voltage; return true; }
+	if (field == "power") { *value = metadata.power; return true; }
+	if (field == "viscosity") { *value = metadata.viscosity; return true; }
+	if (field == "initialOilMass") { *value = metadata.initialOilMass; return true; }
+
+	// A data column stands for its per-sample mean
+	QHash<QString, ColumnSummary>::const_iterator it = record.columns.constFind(field.toLower());
+	if (it != record.columns.constEnd())
+	{
+		*value = it.value().sum / it.value().count;
+		return true;
+	}
+
+	return false;
+}
+
+bool SampleAggregator::matches(const SampleRecord& record, const Filter& filter)
+{
+	QString text = fieldText(record, filter.field);
+
+	if (filter.op == Contains)
+	{
+		return text.contains(filter.value, Qt::CaseInsensitive);
+	}
+
+	// Pick the comparison: numbers, then ISO/US dates, then case-insensitive text
+	int comparison = 0;
+	bool leftOk = false;
+	bool rightOk = false;
+	double left = text.toDouble(&leftOk);
+	double right = filter.value.toDouble(&rightOk);
+
+	if (leftOk && rightOk)
+	{
+		comparison = (left < right) ? -1 : (left > right ? 1 : 0);
+	}
+	else
+	{
+		QDate leftDate = QDate::fromString(text, Qt::ISODate);
+		QDate rightDate = QDate::fromString(filter.value, Qt::ISODate);
+		if (!leftDate.isValid())
+		{
+			leftDate = QDate::fromString(text, "M/d/yyyy");
+		}
+		if (!rightDate.isValid())
+		{
+			rightDate = QDate::fromString(filter.value, "M/d/yyyy");
+		}
+
+		if (leftDate.isValid() && rightDate.isValid())
+		{
+			comparison = (leftDate < rightDate) ? -1 : (leftDate > rightDate ? 1 : 0);
+		}
+		else
+		{
+			comparison = QString::compare(text, filter.value, Qt::CaseInsensitive);
+		}
+	}
+
+	switch (filter.op)
+	{
+	case Equals: return comparison == 0;
+	case NotEquals: return comparison != 0;
+	case LessThan: return comparison < 0;
+	case LessOrEqual: return comparison <= 0;
+	case GreaterThan: return comparison > 0;
+	case GreaterOrEqual: return comparison >= 0;
+	case Contains: break;
+	}
+
+	return false;
+}
+
+bool SampleAggregator::parseFilter(const QString& text, Filter* filter)
+{
+	// field, operator, value; longer operators first so ">=" is not read as ">"
+	static const QRegularExpression pattern(QStringLiteral("^\\s*([A-Za-z_][\\w ]*?)\\s*(>=|<=|!=|=|<|>|~)\\s*(.*?)\\s*$"));
+
+	QRegularExpressionMatch match = pattern.match(text);
+	if (!match.hasMatch())
+	{
+		return false;
+	}
+
+	QString op = match.captured(2);
+	filter->field = match.captured(1);
+	filter->value = match.captured(3);
+
+	// Metadata field names are matched case-insensitively ("Media" -> "media")
+	for (const QString& field : metadataFields())
+	{
+		if (field.compare(filter->field, Qt::CaseInsensitive) == 0)
+		{
+			filter->field = field;
+			break;
+		}
+	}
+
+	if (op == "=") filter->op = Equals;
+	else if (op == "!=") filter->op = NotEquals;
+	else if (op == "~") filter->op = Contains;
+	else if (op == "<") filter->op = LessThan;
+	else if (op == "<=") filter->op = LessOrEqual;
+	else if (op == ">") filter->op = GreaterThan;
+	else filter->op = GreaterOrEqual;
+
+	return true;
+}
+
+void SampleAggregator::aggregate(const Workbook& workbook, const Query& query, PartialResult* partial)
+{
+	const ColumnSummary EMPTY = { 0, 0.0, std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest() };
+
+	for (const SampleRecord& record : workbook.samples)
+	{
+		bool accepted = true;
+		for (const Filter& filter : query.filters)
+		{
+			if (!matches(record, filter))
+			{
+				accepted = false;
+				break;
+			}
+		}
+		if (!accepted)
+		{
+			continue;
+		}
+
+		QStringList keys;
+		for (const QString& field : query.groupBy)
+		{
+			keys.append(fieldText(record, field));
+		}
+
+		QString groupKey = keys.join(QChar(0x1f));
+		PartialResult::iterator group = partial->find(groupKey);
+		if (group == partial->end())
+		{
+			Accumulator accumulator;
+			accumulator.keys = keys;
+			accumulator.sampleCount = 0;
+			accumulator.measures.fill(EMPTY, query.measures.size());
+			group = partial->insert(groupKey, accumulator);
+		}
+
+		group->sampleCount++;
+
+		for (int i = 0; i < query.measures.size(); i++)
+		{
+			// Data columns contribute all their puffs, metadata fields one value per sample
+			ColumnSummary contribution = EMPTY;
+			QHash<QString, ColumnSummary>::const_iterator column = record.columns.constFind(query.measures.at(i).field.toLower());
+			double value = 0.0;
+
+			if (column != record.columns.constEnd())
+			{
+				contribution = column.value();
+			}
+			else if (fieldNumber(record, query.measures.at(i).field, &value))
+			{
+				contribution.count = 1;
+				contribution.sum = value;
+				contribution.min = value;
+				contribution.max = value;
+			}
+
+			ColumnSummary& target = group->measures[i];
+			target.count += contribution.count;
+			target.sum += contribution.sum;
+			target.min = qMin(target.min, contribution.min);
+			target.max = qMax(target.max, contribution.max);
+		}
+	}
+}
+
+SampleAggregator::Result SampleAggregator::run(const Query& query) const
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	// Partial aggregation per workbook on worker threads
+	QVector<PartialResult> partials(m_workbooks.size());
+	QAtomicInt nextWorkbook(0);
+
+	auto worker = [&]() {
+		for (int index = nextWorkbook.fetchAndAddRelaxed(1); index < m_workbooks.size(); index = nextWorkbook.fetchAndAddRelaxed(1))
+		{
+			aggregate(m_workbooks.at(index), query, &partials[index]);
+		}
+	};
+
+	// Thread start-up outweighs the work on small data sets
+	const int SAMPLES_PER_THREAD = 2000;
+	int threadCount = qBound(1, qMin(QThread::idealThreadCount(), sampleCount() / SAMPLES_PER_THREAD), qMax(1, m_workbooks.size()));
+
+	if (threadCount == 1)
+	{
+		worker();
+	}
+	else
+	{
+		QVector<QThread*> threads;
+		for (int i = 0; i < threadCount; i++)
+		{
+			threads.append(QThread::create(worker));
+			threads.last()->start();
+		}
+		for (QThread* thread : threads)
+		{
+			thread->wait();
+			delete thread;
+		}
+	}
+
+	// Merge step
+	PartialResult merged;
+	for (const PartialResult& partial : partials)
+	{
+		for (PartialResult::const_iterator it = partial.constBegin(); it != partial.constEnd(); ++it)
+		{
+			PartialResult::iterator target = merged.find(it.key());
+			if (target == merged.end())
+			{
+				merged.insert(it.key(), it.value());
+				continue;
+			}
+
+			target->sampleCount += it.value().sampleCount;
+			for (int i = 0; i < query.measures.size(); i++)
+			{
+				const ColumnSummary& source = it.value().measures.at(i);
+				ColumnSummary& summary = target->measures[i];
+				summary.count += source.count;
+				summary.sum += source.sum;
+				summary.min = qMin(summary.min, source.min);
+				summary.max = qMax(summary.max, source.max);
+			}
+		}
+	}
+
+	Result result;
+	result.columns = query.groupBy;
+	result.columns.append("samples");
+	for (const Measure& measure : query.measures)
+	{
+		result.columns.append(functionName(measure.function) + "(" + measure.field + ")");
+	}
+
+	for (PartialResult::const_iterator it = merged.constBegin(); it != merged.constEnd(); ++it)
+	{
+		ResultRow row;
+		row.keys = it.value().keys;
+		row.sampleCount = it.value().sampleCount;
+
+		for (int i = 0; i < query.measures.size(); i++)
+		{
+			const ColumnSummary& summary = it.value().measures.at(i);
+			double value = std::numeric_limits<double>::quiet_NaN();
+
+			if (query.measures.at(i).function == Count)
+			{
+				value = double(summary.count);
+			}
+			else if (summary.count > 0)
+			{
+				switch (query.measures.at(i).function)
+				{
+				case Sum: value = summary.sum; break;
+				case Mean: value = summary.sum / summary.count; break;
+				case Min: value = summary.min; break;
+				case Max: value = summary.max; break;
+				case Count: break;
+				}
+			}
+			row.values.append(value);
+		}
+
+		result.rows.append(row);
+	}
+
+	// Stable, readable order: by group keys, numeric keys (voltage etc.) by value
+	std::sort(result.rows.begin(), result.rows.end(), [](const ResultRow& a, const ResultRow& b) {
+		for (int i = 0; i < a.keys.size() && i < b.keys.size(); i++)
+		{
+			bool aNumber = false;
+			bool bNumber = false;
+			double aValue = a.keys.at(i).toDouble(&aNumber);
+			double bValue = b.keys.at(i).toDouble(&bNumber);
+			if (aNumber && bNumber)
+			{
+				if (aValue != bValue)
+				{
+					return aValue < bValue;
+				}
+				continue;
+			}
+
+			int comparison = QString::compare(a.keys.at(i), b.keys.at(i), Qt::CaseInsensitive);
+			if (comparison != 0)
+			{
+				return comparison < 0;
+			}
+		}
+		return false;
+	});
+
+	result.elapsedNs = timer.nsecsElapsed();
+	debugPrint("Query over " + QString::number(sampleCount()) + " samples returned " + QString::number(result.rows.size()) +
+		" groups in " + QString::number(result.elapsedNs / 1e6, 'f', 2) + " ms");
+
+	return result;
+}
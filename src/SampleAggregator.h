@@ -0,0 +1,140 @@
+#ifndef SAMPLEAGGREGATOR_H
+#define SAMPLEAGGREGATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include "ExcelReader.h"
+
+// Group-by aggregation over samples extracted from many workbooks, e.g.
+// "mean TPM by heating technology and voltage for all December tests".
+//
+// loadWorkbooks() extracts every sample once (in parallel, one ExcelReader per
+// worker) into compact records: the metadata plus a count/sum/min/max summary
+// of each data column. Queries then only touch those records; they are run as
+// partial aggregates per workbook on worker threads and merged at the end.
+class SampleAggregator
+{
+public:
+	struct ColumnSummary
+	{
+		qint64 count;
+		double sum;
+		double min;
+		double max;
+	};
+
+	struct SampleRecord
+	{
+		QString filePath;
+		QString sheetName;
+		int sampleIndex;
+		ExcelReader::SampleMetadata metadata;
+		QHash<QString, ColumnSummary> columns; // Keyed by lower-case row 4 header
+	};
+
+	enum FilterOp
+	{
+		Equals,
+		NotEquals,
+		Contains,
+		LessThan,
+		LessOrEqual,
+		GreaterThan,
+		GreaterOrEqual
+	};
+
+	// Compares numerically when both sides are numbers, as dates when both are dates, else as text
+	struct Filter
+	{
+		QString field;
+		FilterOp op;
+		QString value;
+	};
+
+	enum Function
+	{
+		Count,
+		Sum,
+		Mean,
+		Min,
+		Max
+	};
+
+	// field is a metadata field (see metadataFields()) or a data column header
+	struct Measure
+	{
+		Function function;
+		QString field;
+	};
+
+	struct Query
+	{
+		QStringList groupBy;
+		QVector<Filter> filters;
+		QVector<Measure> measures;
+	};
+
+	struct ResultRow
+	{
+		QStringList keys;      // One per groupBy field
+		int sampleCount;
+		QVector<double> values; // One per measure, NaN when nothing contributed
+	};
+
+	struct Result
+	{
+		QStringList columns;   // groupBy fields, "samples", then one name per measure
+		QVector<ResultRow> rows;
+		qint64 elapsedNs;
+	};
+
+	SampleAggregator();
+
+	// Replaces the loaded data; returns false if any workbook failed (the rest are kept)
+	bool loadWorkbooks(const QStringList& filePaths);
+	void clear();
+
+	int workbookCount() const { return m_workbooks.size(); }
+	int sampleCount() const;
+	QStringList columnNames() const; // Data column headers seen while loading
+	qint64 memoryBytes() const;      // Estimated heap held by the loaded records
+
+	Result run(const Query& query) const;
+
+	static QStringList metadataFields();
+	static QString functionName(Function function);
+	static bool parseFilter(const QString& text, Filter* filter); // e.g. "voltage >= 3.3", "media = oil A"
+
+	QString getLastError() const { return m_lastError; }
+
+private:
+	struct Workbook
+	{
+		QString filePath;
+		QVector<SampleRecord> samples;
+	};
+
+	// Partial aggregate for one group
+	struct Accumulator
+	{
+		QStringList keys;
+		int sampleCount;
+		QVector<ColumnSummary> measures;
+	};
+	typedef QHash<QString, Accumulator> PartialResult;
+
+	QVector<Workbook> m_workbooks;
+	QStringList m_columnNames;
+	QString m_lastError;
+
+	void debugPrint(const QString& message) const;
+	static bool extractWorkbook(const QString& filePath, Workbook* workbook, QString* error);
+	static void aggregate(const Workbook& workbook, const Query& query, PartialResult* partial);
+	static bool matches(const SampleRecord& record, const Filter& filter);
+	static QString fieldText(const SampleRecord& record, const QString& field);
+	static bool fieldNumber(const SampleRecord& record, const QString& field, double* value);
+};
+
+#endif // SAMPLEAGGREGATOR_H
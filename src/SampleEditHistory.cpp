@@ -0,0 +1,221 @@
+#include "SampleEditHistory.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QSet>
+#include <QtMath>
+
+SampleEditHistory::SampleEditHistory(const SheetHandle& sheet, int sampleIndex)
+	: m_sheet(sheet)
+	, m_sample(sheet.sampleView(sampleIndex))
+	, m_current(0)
+{
+	Version original;
+	original.columns.resize(m_sample.columnCount());
+	original.row = -1;
+	original.column = -1;
+	m_versions.append(original);
+}
+
+void SampleEditHistory::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [SampleEditHistory]:" << message;
+}
+
+const QVariant* SampleEditHistory::editedValue(int row, int col) const
+{
+	if (row < 0 || row >= rowCount() || col < 0 || col >= columnCount())
+	{
+		return nullptr;
+	}
+
+	const ChunkTable& chunks = m_versions.at(m_current).columns.at(col);
+	if (chunks.isEmpty())
+	{
+		return nullptr;
+	}
+
+	const Chunk& chunk = chunks.at(row / CHUNK_ROWS);
+	if (chunk.isEmpty())
+	{
+		return nullptr;
+	}
+
+	const QVariant& value = chunk.at(row % CHUNK_ROWS);
+	return value.isValid() ? &value : nullptr;
+}
+
+QVariant SampleEditHistory::value(int row, int col) const
+{
+	const QVariant* edited = editedValue(row, col);
+	return edited ? *edited : m_sample.value(row, col);
+}
+
+double SampleEditHistory::number(int row, int col) const
+{
+	const QVariant* edited = editedValue(row, col);
+	if (!edited)
+	{
+		return m_sample.number(row, col);
+	}
+
+	bool ok = false;
+	double number = edited->toDouble(&ok);
+	return ok ? number : qQNaN();
+}
+
+bool SampleEditHistory::isEdited(int row, int col) const
+{
+	return editedValue(row, col) != nullptr;
+}
+
+QVector<QPair<int, int>> SampleEditHistory::editedCells() const
+{
+	QVector<QPair<int, int>> cells;
+	const Version& version = m_versions.at(m_current);
+
+	for (int col = 0; col < version.columns.size(); col++)
+	{
+		const ChunkTable& chunks = version.columns.at(col);
+		for (int c = 0; c < chunks.size(); c++)
+		{
+			const Chunk& chunk = chunks.at(c);
+			for (int i = 0; i < chunk.size(); i++)
+			{
+				if (chunk.at(i).isValid())
+				{
+					cells.append(qMakePair(c * CHUNK_ROWS + i, col));
+				}
+			}
+		}
+	}
+
+	return cells;
+}
+
+bool SampleEditHistory::setValue(int row, int col, const QVariant& value)
+{
+	if (row < 0 || row >= rowCount() || col < 0 || col >= columnCount())
+	{
+		m_lastError = "Cell outside the sample: row " + QString::number(row + 1) + ", column " + QString::number(col + 1);
+		return false;
+	}
+
+	if (this->value(row, col) == value)
+	{
+		return false;
+	}
+
+	// Copying the version shares every chunk; writing through the non-const
+	// accessors below detaches only the column's chunk table and one chunk
+	Version next = m_versions.at(m_current);
+	next.row = row;
+	next.column = col;
+
+	ChunkTable& chunks = next.columns[col];
+	if (chunks.isEmpty())
+	{
+		chunks.resize((rowCount() + CHUNK_ROWS - 1) / CHUNK_ROWS);
+	}
+
+	Chunk& chunk = chunks[row / CHUNK_ROWS];
+	if (chunk.isEmpty())
+	{
+		chunk.resize(CHUNK_ROWS);
+	}
+	chunk[row % CHUNK_ROWS] = value;
+
+	// A new edit ends the redo branch
+	m_versions.resize(m_current + 1);
+	m_versions.append(next);
+	m_current++;
+
+	debugPrint("Edit " + QString::number(m_current) + ": row " + QString::number(row + 1) +
+		", column " + QString::number(col + 1));
+	return true;
+}
+
+bool SampleEditHistory::undo()
+{
+	if (!canUndo())
+	{
+		return false;
+	}
+
+	m_current--;
+	return true;
+}
+
+bool SampleEditHistory::redo()
+{
+	if (!canRedo())
+	{
+		return false;
+	}
+
+	m_current++;
+	return true;
+}
+
+QPair<int, int> SampleEditHistory::undoCell() const
+{
+	if (!canUndo())
+	{
+		return qMakePair(-1, -1);
+	}
+
+	const Version& version = m_versions.at(m_current);
+	return qMakePair(version.row, version.column);
+}
+
+QPair<int, int> SampleEditHistory::redoCell() const
+{
+	if (!canRedo())
+	{
+		return qMakePair(-1, -1);
+	}
+
+	const Version& version = m_versions.at(m_current + 1);
+	return qMakePair(version.row, version.column);
+}
+
+qint64 SampleEditHistory::memoryBytes() const
+{
+	// Versions share chunk tables and chunks, count each block once by its address
+	QSet<const void*> seen;
+	qint64 bytes = m_versions.capacity() * qint64(sizeof(Version));
+
+	for (const Version& version : m_versions)
+	{
+		if (!seen.contains(version.columns.constData()))
+		{
+			seen.insert(version.columns.constData());
+			bytes += version.columns.size() * qint64(sizeof(ChunkTable));
+		}
+
+		for (const ChunkTable& chunks : version.columns)
+		{
+			if (chunks.isEmpty() || seen.contains(chunks.constData()))
+			{
+				continue;
+			}
+			seen.insert(chunks.constData());
+			bytes += chunks.size() * qint64(sizeof(Chunk));
+
+			for (const Chunk& chunk : chunks)
+			{
+				if (chunk.isEmpty() || seen.contains(chunk.constData()))
+				{
+					continue;
+				}
+				seen.insert(chunk.constData());
+				bytes += chunk.size() * qint64(sizeof(QVariant));
+				for (const QVariant& value : chunk)
+				{
+					bytes += MemoryAccounting::variantBytes(value);
+				}
+			}
+		}
+	}
+
+	return bytes;
+}
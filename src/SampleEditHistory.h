@@ -0,0 +1,77 @@
+#ifndef SAMPLEEDITHISTORY_H
+#define SAMPLEEDITHISTORY_H
+
+#include <QString>
+#include <QVector>
+#include <QVariant>
+#include <QPair>
+#include "ExcelReader.h"
+
+// Cell edits layered over one read-only sample, with undo and redo.
+// Every column is split into chunks of CHUNK_ROWS cells; a chunk that was
+// never edited stays empty and reads through to the sample. A version is a
+// set of chunk tables shared copy-on-write (Qt implicit sharing) with the
+// version it was made from, so an edit copies one column's chunk table and
+// the one chunk it touches, and the history grows with what was edited, not
+// with the sample size. Undo and redo only move the current version.
+class SampleEditHistory
+{
+public:
+	static const int CHUNK_ROWS = 256;
+
+	// The handle keeps the edited sample readable across reloads of the file
+	SampleEditHistory(const SheetHandle& sheet, int sampleIndex);
+
+	const ExcelReader::SampleView& sample() const { return m_sample; }
+	int rowCount() const { return m_sample.rowCount(); }
+	int columnCount() const { return m_sample.columnCount(); }
+
+	// Edited value where there is one, the sample's value otherwise
+	QVariant value(int row, int col) const;
+	double number(int row, int col) const; // NaN when blank or not a number
+	bool isEdited(int row, int col) const;
+	QVector<QPair<int, int>> editedCells() const; // (row, column) of the current version
+
+	// Records a new version and drops anything that could have been redone;
+	// false when the value is unchanged or the cell lies outside the sample
+	bool setValue(int row, int col, const QVariant& value);
+
+	bool canUndo() const { return m_current > 0; }
+	bool canRedo() const { return m_current < m_versions.size() - 1; }
+	bool undo(); // false when there is nothing to undo
+	bool redo();
+
+	// Cell changed by the edit that undo() would revert, or redo() re-apply
+	QPair<int, int> undoCell() const;
+	QPair<int, int> redoCell() const;
+
+	int versionCount() const { return m_versions.size(); }
+	int currentVersion() const { return m_current; }
+
+	// Chunk storage of all versions, every shared chunk counted once
+	qint64 memoryBytes() const;
+
+	QString getLastError() const { return m_lastError; }
+
+private:
+	typedef QVector<QVariant> Chunk;  // CHUNK_ROWS cells, an invalid variant is not edited
+	typedef QVector<Chunk> ChunkTable; // One chunk per CHUNK_ROWS rows, empty until edited
+
+	struct Version
+	{
+		QVector<ChunkTable> columns; // Empty until a cell of the column is edited
+		int row;                     // Cell this version changed from the previous one
+		int column;
+	};
+
+	SheetHandle m_sheet;
+	ExcelReader::SampleView m_sample;
+	QVector<Version> m_versions; // m_versions[0] is the unedited sample
+	int m_current;
+	QString m_lastError;
+
+	const QVariant* editedValue(int row, int col) const; // nullptr when not edited
+	void debugPrint(const QString& message) const;
+};
+
+#endif // SAMPLEEDITHISTORY_H
@@ -0,0 +1,567 @@
+#include "SampleIndex.h"
+#include "ExcelReader.h"
+#include "MemoryAccounting.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDate>
+#include <QDateTime>
+#include <QSet>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+	const quint32 INDEX_MAGIC = 0x44564958; // "DVIX"
+	const quint32 INDEX_VERSION = 2; // 1 missed the last sample of every sheet
+
+	// Metadata lives in rows 1-3. The header row below them is read too: it spans all
+	// 12 columns of the last sample, which decides how many samples the sheet has
+	const int INDEXED_ROWS = 4;
+
+	QDataStream& operator<<(QDataStream& stream, const SampleIndex::Document& document)
+	{
+		return stream << document.filePath << document.sheetName << qint32(document.sampleIndex)
+			<< document.testName << document.sampleID << document.media << document.tester
+			<< document.heatingTechnology << document.puffingRegime << document.date << document.julianDay;
+	}
+
+	QDataStream& operator>>(QDataStream& stream, SampleIndex::Document& document)
+	{
+		qint32 sampleIndex = 0;
+		stream >> document.filePath >> document.sheetName >> sampleIndex
+			>> document.testName >> document.sampleID >> document.media >> document.tester
+			>> document.heatingTechnology >> document.puffingRegime >> document.date >> document.julianDay;
+		document.sampleIndex = sampleIndex;
+		return stream;
+	}
+}
+
+SampleIndex::SampleIndex()
+{
+}
+
+void SampleIndex::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [SampleIndex]:" << message;
+}
+
+qint64 SampleIndex::memoryBytes() const
+{
+	qint64 bytes = 0;
+
+	for (const Document& document : m_documents)
+	{
+		bytes += sizeof(Document) + MemoryAccounting::stringBytes(document.filePath) +
+			MemoryAccounting::stringBytes(document.sheetName) + MemoryAccounting::stringBytes(document.testName) +
+			MemoryAccounting::stringBytes(document.sampleID) + MemoryAccounting::stringBytes(document.media) +
+			MemoryAccounting::stringBytes(document.tester) + MemoryAccounting::stringBytes(document.heatingTechnology) +
+			MemoryAccounting::stringBytes(document.puffingRegime) + MemoryAccounting::stringBytes(document.date);
+	}
+
+	// Map nodes hold a term and a posting list each
+	for (QMap<QString, QVector<quint32>>::const_iterator it = m_postings.constBegin(); it != m_postings.constEnd(); ++it)
+	{
+		bytes += 48 + MemoryAccounting::stringBytes(it.key()) + 24 + qint64(it.value().capacity()) * sizeof(quint32);
+	}
+
+	bytes += qint64(m_dates.capacity()) * sizeof(QPair<qint64, quint32>);
+	bytes += qint64(m_files.size()) * (sizeof(FileEntry) + 96);
+	return bytes;
+}
+
+QString SampleIndex::indexPathFor(const QString& directory)
+{
+	// One index file per folder, outside the (possibly read-only, shared) data folder
+	QString key = QDir::cleanPath(QDir(directory).absolutePath()).toLower();
+	QString hash = QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+
+	QString folder = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+	return folder + "/sample_index_" + hash + ".dvx";
+}
+
+bool SampleIndex::open(const QString& directory)
+{
+	m_directory = QDir(directory).absolutePath();
+	m_documents.clear();
+	m_files.clear();
+	m_postings.clear();
+	m_dates.clear();
+	m_lastError.clear();
+
+	QFile file(indexPathFor(m_directory));
+	if (!file.exists())
+	{
+		debugPrint("No saved index for " + m_directory);
+		return true;
+	}
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		m_lastError = "Cannot open index file: " + file.errorString();
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QDataStream stream(&file);
+	quint32 magic = 0;
+	quint32 version = 0;
+	stream >> magic >> version;
+
+	if (magic != INDEX_MAGIC || version != INDEX_VERSION)
+	{
+		// Unknown or older format: start over, update() rebuilds it
+		debugPrint("Ignoring index file with unexpected format");
+		return true;
+	}
+
+	QString savedDirectory;
+	qint32 fileCount = 0;
+	stream >> savedDirectory >> fileCount;
+
+	for (qint32 i = 0; i < fileCount && stream.status() == QDataStream::Ok; i++)
+	{
+		QString path;
+		FileEntry entry;
+		stream >> path >> entry.modified >> entry.size;
+		m_files.insert(path, entry);
+	}
+
+	qint32 documentCount = 0;
+	stream >> documentCount;
+	m_documents.resize(qMax(0, documentCount));
+	for (Document& document : m_documents)
+	{
+		stream >> document;
+	}
+
+	qint32 dateCount = 0;
+	stream >> m_postings >> dateCount;
+	m_dates.resize(qMax(0, dateCount));
+	for (QPair<qint64, quint32>& date : m_dates)
+	{
+		stream >> date.first >> date.second;
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		m_lastError = "Index file is truncated or corrupt";
+		m_documents.clear();
+		m_files.clear();
+		m_postings.clear();
+		m_dates.clear();
+		return false;
+	}
+
+	debugPrint("Loaded index of " + QString::number(m_documents.size()) + " samples in " +
+		QString::number(m_files.size()) + " workbooks in " + QString::number(timer.elapsed()) + " ms");
+	return true;
+}
+
+bool SampleIndex::save() const
+{
+	QString path = indexPathFor(m_directory);
+	QDir().mkpath(QFileInfo(path).absolutePath());
+
+	// Write to a temporary file first so an interrupted save keeps the old index
+	QFile file(path + ".tmp");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		debugPrint("ERROR: Cannot write index file: " + file.errorString());
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream << INDEX_MAGIC << INDEX_VERSION << m_directory << qint32(m_files.size());
+
+	for (QHash<QString, FileEntry>::const_iterator it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+	{
+		stream << it.key() << it.value().modified << it.value().size;
+	}
+
+	stream << qint32(m_documents.size());
+	for (const Document& document : m_documents)
+	{
+		stream << document;
+	}
+
+	stream << m_postings << qint32(m_dates.size());
+	for (const QPair<qint64, quint32>& date : m_dates)
+	{
+		stream << date.first << date.second;
+	}
+
+	file.close();
+	QFile::remove(path);
+	return QFile::rename(path + ".tmp", path);
+}
+
+bool SampleIndex::extractFile(const QString& filePath, QVector<Document>* documents, QString* error)
+{
+	ExcelReader reader;
+	reader.setRowLimit(INDEXED_ROWS);
+
+	if (!reader.loadFile(filePath))
+	{
+		*error = filePath + ": " + reader.getLastError();
+		return false;
+	}
+
+	for (const QString& sheetName : reader.getSheetNames())
+	{
+		if (!reader.selectSheet(sheetName))
+		{
+			continue;
+		}
+
+		int sampleCount = reader.getSampleCount();
+		for (int sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++)
+		{
+			ExcelReader::SampleMetadata metadata = reader.getSampleMetadata(sampleIndex);
+			if (metadata.sampleID.isEmpty() && metadata.testName.isEmpty())
+			{
+				continue;
+			}
+
+			Document document;
+			document.filePath = filePath;
+			document.sheetName = sheetName;
+			document.sampleIndex = sampleIndex;
+			document.testName = metadata.testName;
+			document.sampleID = metadata.sampleID;
+			document.media = metadata.media;
+			document.tester = metadata.tester;
+			document.heatingTechnology = metadata.heatingTechnology;
+			document.puffingRegime = metadata.puffingRegime;
+			document.date = metadata.date;
+
+			QDate date = QDate::fromString(metadata.date, Qt::ISODate);
+			if (!date.isValid())
+			{
+				date = QDate::fromString(metadata.date, "M/d/yyyy");
+			}
+			document.julianDay = date.isValid() ? date.toJulianDay() : 0;
+
+			documents->append(document);
+		}
+	}
+
+	return true;
+}
+
+bool SampleIndex::update()
+{
+	if (m_directory.isEmpty())
+	{
+		m_lastError = "No folder selected for indexing";
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Compare the folder against the recorded modification times
+	QHash<QString, FileEntry> current;
+	QStringList changedFiles;
+
+	QDirIterator it(m_directory, QStringList() << "*.xlsx" << "*.xls", QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext())
+	{
+		QString path = it.next();
+		QFileInfo info = it.fileInfo();
+
+		// Excel lock files
+		if (info.fileName().startsWith("~$"))
+		{
+			continue;
+		}
+
+		FileEntry entry;
+		entry.modified = info.lastModified().toMSecsSinceEpoch();
+		entry.size = info.size();
+		current.insert(path, entry);
+
+		QHash<QString, FileEntry>::const_iterator known = m_files.constFind(path);
+		if (known == m_files.constEnd() || known.value().modified != entry.modified || known.value().size != entry.size)
+		{
+			changedFiles.append(path);
+		}
+	}
+
+	int removedFiles = 0;
+	for (QHash<QString, FileEntry>::const_iterator known = m_files.constBegin(); known != m_files.constEnd(); ++known)
+	{
+		if (!current.contains(known.key()))
+		{
+			removedFiles++;
+		}
+	}
+
+	if (changedFiles.isEmpty() && removedFiles == 0)
+	{
+		debugPrint("Index is up to date (" + QString::number(current.size()) + " workbooks)");
+		return true;
+	}
+
+	debugPrint("Indexing " + QString::number(changedFiles.size()) + " new or modified workbooks, " +
+		QString::number(removedFiles) + " removed");
+
+	// Extract the changed workbooks in parallel
+	QVector<QVector<Document>> extracted(changedFiles.size());
+	QVector<int> loaded(changedFiles.size(), 0);
+	QStringList errors;
+	QMutex errorMutex;
+	QAtomicInt nextFile(0);
+
+	auto worker = [&]() {
+		for (int index = nextFile.fetchAndAddRelaxed(1); index < changedFiles.size(); index = nextFile.fetchAndAddRelaxed(1))
+		{
+			QString error;
+			loaded[index] = extractFile(changedFiles.at(index), &extracted[index], &error);
+			if (!loaded[index])
+			{
+				QMutexLocker locker(&errorMutex);
+				errors.append(error);
+			}
+		}
+	};
+
+	int threadCount = qBound(1, QThread::idealThreadCount(), qMax(1, changedFiles.size()));
+	QVector<QThread*> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.append(QThread::create(worker));
+		threads.last()->start();
+	}
+	for (QThread* thread : threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+
+	// Keep documents of unchanged workbooks, replace the rest
+	QSet<QString> replaced;
+	for (const QString& path : changedFiles)
+	{
+		replaced.insert(path);
+	}
+	QVector<Document> documents;
+	documents.reserve(m_documents.size());
+	for (const Document& document : m_documents)
+	{
+		if (current.contains(document.filePath) && !replaced.contains(document.filePath))
+		{
+			documents.append(document);
+		}
+	}
+
+	for (int i = 0; i < changedFiles.size(); i++)
+	{
+		if (loaded.at(i))
+		{
+			documents += extracted.at(i);
+		}
+		else
+		{
+			// Unreadable (e.g. being written): forget it so the next update retries
+			current.remove(changedFiles.at(i));
+		}
+	}
+
+	m_documents = documents;
+	m_files = current;
+	rebuildPostings();
+
+	debugPrint("Indexed " + QString::number(m_documents.size()) + " samples in " + QString::number(m_files.size()) +
+		" workbooks in " + QString::number(timer.elapsed()) + " ms");
+
+	if (!save())
+	{
+		m_lastError = "Index built but could not be saved";
+		return false;
+	}
+
+	if (!errors.isEmpty())
+	{
+		m_lastError = errors.join("\n");
+		return false;
+	}
+
+	return true;
+}
+
+QStringList SampleIndex::documentTerms(const Document& document)
+{
+	static const QRegularExpression separators(QStringLiteral("[^\\w.]+"));
+
+	QStringList values;
+	values << document.sampleID << document.testName << document.media << document.tester
+		<< document.heatingTechnology << document.puffingRegime << document.sheetName
+		<< QFileInfo(document.filePath).completeBaseName() << document.date;
+
+	// Each value as a whole (so "S-12" prefixes "S-123") and word by word
+	QStringList terms;
+	for (const QString& value : values)
+	{
+		QString term = value.trimmed().toLower();
+		if (term.isEmpty())
+		{
+			continue;
+		}
+
+		terms.append(term);
+		for (const QString& word : term.split(separators, QString::SkipEmptyParts))
+		{
+			if (word != term)
+			{
+				terms.append(word);
+			}
+		}
+	}
+
+	terms.removeDuplicates();
+	return terms;
+}
+
+void SampleIndex::rebuildPostings()
+{
+	m_postings.clear();
+	m_dates.clear();
+
+	for (int id = 0; id < m_documents.size(); id++)
+	{
+		// Ids are visited in ascending order, so every posting list stays sorted
+		for (const QString& term : documentTerms(m_documents.at(id)))
+		{
+			m_postings[term].append(quint32(id));
+		}
+
+		if (m_documents.at(id).julianDay != 0)
+		{
+			m_dates.append(qMakePair(m_documents.at(id).julianDay, quint32(id)));
+		}
+	}
+
+	std::sort(m_dates.begin(), m_dates.end());
+}
+
+QVector<quint32> SampleIndex::prefixMatches(const QString& prefix) const
+{
+	// All terms starting with the prefix form one key range of the ordered map
+	QVector<quint32> ids;
+	for (QMap<QString, QVector<quint32>>::const_iterator it = m_postings.lowerBound(prefix);
+		it != m_postings.constEnd() && it.key().startsWith(prefix); ++it)
+	{
+		ids += it.value();
+	}
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	return ids;
+}
+
+QVector<SampleIndex::Document> SampleIndex::search(const QString& text, int maxHits) const
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	QStringList prefixes;
+	QDate from;
+	QDate to;
+
+	for (const QString& token : text.toLower().split(' ', QString::SkipEmptyParts))
+	{
+		if (token.startsWith("from:"))
+		{
+			from = QDate::fromString(token.mid(5), Qt::ISODate);
+		}
+		else if (token.startsWith("to:"))
+		{
+			to = QDate::fromString(token.mid(3), Qt::ISODate);
+		}
+		else
+		{
+			prefixes.append(token);
+		}
+	}
+
+	QVector<quint32> ids;
+	bool first = true;
+
+	for (const QString& prefix : prefixes)
+	{
+		QVector<quint32> matches = prefixMatches(prefix);
+		if (first)
+		{
+			ids = matches;
+			first = false;
+		}
+		else
+		{
+			QVector<quint32> intersection;
+			std::set_intersection(ids.begin(), ids.end(), matches.begin(), matches.end(), std::back_inserter(intersection));
+			ids = intersection;
+		}
+
+		if (ids.isEmpty())
+		{
+			return QVector<Document>();
+		}
+	}
+
+	if (from.isValid() || to.isValid())
+	{
+		qint64 low = from.isValid() ? from.toJulianDay() : 1;
+		qint64 high = to.isValid() ? to.toJulianDay() : std::numeric_limits<qint64>::max();
+
+		// Binary search the sorted dates for [low, high]
+		QVector<QPair<qint64, quint32>>::const_iterator begin = std::lower_bound(m_dates.constBegin(), m_dates.constEnd(),
+			qMakePair(low, quint32(0)));
+		QVector<QPair<qint64, quint32>>::const_iterator end = std::upper_bound(m_dates.constBegin(), m_dates.constEnd(),
+			qMakePair(high, std::numeric_limits<quint32>::max()));
+
+		QVector<quint32> inRange;
+		for (QVector<QPair<qint64, quint32>>::const_iterator it = begin; it < end; ++it)
+		{
+			inRange.append(it->second);
+		}
+		std::sort(inRange.begin(), inRange.end());
+
+		if (first)
+		{
+			ids = inRange;
+			first = false;
+		}
+		else
+		{
+			QVector<quint32> intersection;
+			std::set_intersection(ids.begin(), ids.end(), inRange.begin(), inRange.end(), std::back_inserter(intersection));
+			ids = intersection;
+		}
+	}
+
+	QVector<Document> hits;
+	for (int i = 0; i < ids.size() && hits.size() < maxHits; i++)
+	{
+		hits.append(m_documents.at(int(ids.at(i))));
+	}
+
+	debugPrint("Search \"" + text + "\": " + QString::number(ids.size()) + " hits in " +
+		QString::number(timer.nsecsElapsed() / 1e6, 'f', 2) + " ms");
+
+	return hits;
+}
@@ -0,0 +1,76 @@
+#ifndef SAMPLEINDEX_H
+#define SAMPLEINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+
+// Persistent inverted index over the samples of every workbook in a folder.
+// Only the metadata rows (1-3) of each sheet are read while indexing. Terms
+// are the lower-cased metadata values and their words, kept in an ordered
+// map so a prefix resolves to a contiguous key range; sample dates are kept
+// sorted for range queries. update() only re-reads workbooks whose
+// modification time or size changed since the last run.
+class SampleIndex
+{
+public:
+	struct Document
+	{
+		QString filePath;
+		QString sheetName;
+		int sampleIndex;
+		QString testName;
+		QString sampleID;
+		QString media;
+		QString tester;
+		QString heatingTechnology;
+		QString puffingRegime;
+		QString date;
+		qint64 julianDay; // 0 when the date cell did not hold a date
+	};
+
+	SampleIndex();
+
+	// Loads the persisted index for a folder if there is one
+	bool open(const QString& directory);
+	// Scans the folder and re-indexes new or modified workbooks, then saves
+	bool update();
+	bool save() const;
+
+	// Space separated prefixes, all must match; "from:2025-10-01" and "to:2025-12-31" restrict the date
+	QVector<Document> search(const QString& text, int maxHits = 200) const;
+
+	QString directory() const { return m_directory; }
+	int documentCount() const { return m_documents.size(); }
+	int fileCount() const { return m_files.size(); }
+	qint64 memoryBytes() const; // Estimated heap held by documents and postings
+	bool isOpen() const { return !m_directory.isEmpty(); }
+	QString getLastError() const { return m_lastError; }
+
+	static QString indexPathFor(const QString& directory);
+
+private:
+	struct FileEntry
+	{
+		qint64 modified; // msecs since epoch
+		qint64 size;
+	};
+
+	QString m_directory;
+	QVector<Document> m_documents;
+	QHash<QString, FileEntry> m_files;
+	QMap<QString, QVector<quint32>> m_postings;  // Term -> sorted document ids
+	QVector<QPair<qint64, quint32>> m_dates;     // (julian day, document id), sorted
+	QString m_lastError;
+
+	void debugPrint(const QString& message) const;
+	void rebuildPostings();
+	QVector<quint32> prefixMatches(const QString& prefix) const;
+	static QStringList documentTerms(const Document& document);
+	static bool extractFile(const QString& filePath, QVector<Document>* documents, QString* error);
+};
+
+#endif // SAMPLEINDEX_H
@@ -0,0 +1,455 @@
+#include "SampleOverview.h"
+#include "DerivedColumns.h"
+#include <QDebug>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QScrollBar>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtNumeric>
+#include <algorithm>
+
+SampleOverview::SampleOverview(QWidget* parent)
+	: QAbstractScrollArea(parent)
+	, m_sampleCount(0)
+	, m_currentSample(-1)
+	, m_threadCount(0)
+	, m_generation(0)
+	, m_rendered(0)
+	, m_renderNs(0)
+	, m_queueRatio(1.0)
+	, m_activeWorkers(0)
+{
+	setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+	verticalScrollBar()->setSingleStep(TILE_HEIGHT / 4);
+	viewport()->setCursor(Qt::PointingHandCursor);
+}
+
+SampleOverview::~SampleOverview()
+{
+	stopWorkers();
+}
+
+void SampleOverview::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [SampleOverview]:" << message;
+}
+
+void SampleOverview::setSheet(const SheetHandle& sheet)
+{
+	m_generation++;
+	m_tiles.clear();
+	m_rendered = 0;
+	m_renderNs = 0;
+
+	{
+		QMutexLocker locker(&m_queueMutex);
+		m_queue.clear();
+		m_queueSheet = sheet;
+	}
+
+	m_sheet = sheet;
+	m_sampleCount = sheet.isValid() ? sheet.sampleCount() : 0;
+	updateScrollBars();
+	verticalScrollBar()->setValue(0);
+	viewport()->update();
+
+	if (sheet.isValid())
+	{
+		debugPrint("Overview of " + sheet.sheetName() + ": " + QString::number(m_sampleCount) + " samples");
+	}
+}
+
+void SampleOverview::refreshSamples(const SheetHandle& sheet, const QVector<int>& changedSamples)
+{
+	m_generation++;
+	m_sheet = sheet;
+	m_sampleCount = sheet.isValid() ? sheet.sampleCount() : 0;
+
+	// Tiles of unchanged samples still show the same cells
+	for (auto it = m_tiles.begin(); it != m_tiles.end();)
+	{
+		if (it.key() >= m_sampleCount || changedSamples.contains(it.key()))
+		{
+			it = m_tiles.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	{
+		QMutexLocker locker(&m_queueMutex);
+		m_queue.clear();
+		m_queueSheet = sheet;
+	}
+
+	updateScrollBars();
+	viewport()->update();
+	debugPrint("Refreshed " + QString::number(changedSamples.size()) + " tiles, " + QString::number(m_tiles.size()) + " kept");
+}
+
+void SampleOverview::clear()
+{
+	setSheet(SheetHandle());
+}
+
+void SampleOverview::setCurrentSample(int sampleIndex)
+{
+	if (sampleIndex == m_currentSample)
+	{
+		return;
+	}
+	m_currentSample = sampleIndex;
+	viewport()->update();
+}
+
+int SampleOverview::columnCount() const
+{
+	return qMax(1, (viewport()->width() - SPACING) / (TILE_WIDTH + SPACING));
+}
+
+QRect SampleOverview::tileRect(int sampleIndex) const
+{
+	int columns = columnCount();
+	int x = SPACING + (sampleIndex % columns) * (TILE_WIDTH + SPACING);
+	int y = SPACING + (sampleIndex / columns) * (TILE_HEIGHT + SPACING) - verticalScrollBar()->value();
+	return QRect(x, y, TILE_WIDTH, TILE_HEIGHT);
+}
+
+void SampleOverview::updateScrollBars()
+{
+	int columns = columnCount();
+	int rows = (m_sampleCount + columns - 1) / columns;
+	int contentHeight = SPACING + rows * (TILE_HEIGHT + SPACING);
+	verticalScrollBar()->setRange(0, qMax(0, contentHeight - viewport()->height()));
+	verticalScrollBar()->setPageStep(viewport()->height());
+}
+
+void SampleOverview::resizeEvent(QResizeEvent* event)
+{
+	QAbstractScrollArea::resizeEvent(event);
+	updateScrollBars();
+}
+
+void SampleOverview::paintEvent(QPaintEvent* event)
+{
+	Q_UNUSED(event);
+
+	QPainter painter(viewport());
+	painter.fillRect(viewport()->rect(), palette().color(QPalette::Window));
+
+	if (m_sampleCount == 0)
+	{
+		painter.drawText(viewport()->rect(), Qt::AlignCenter, "No samples");
+		requestTiles(QVector<int>());
+		return;
+	}
+
+	// Rows of tiles that intersect the viewport
+	int columns = columnCount();
+	int rowHeight = TILE_HEIGHT + SPACING;
+	int scroll = verticalScrollBar()->value();
+	int firstRow = qMax(0, (scroll - SPACING) / rowHeight);
+	int lastRow = (scroll + viewport()->height()) / rowHeight;
+
+	QVector<int> missing;
+	for (int index = firstRow * columns; index < m_sampleCount && index < (lastRow + 1) * columns; index++)
+	{
+		QRect rect = tileRect(index);
+		auto tile = m_tiles.constFind(index);
+		if (tile != m_tiles.constEnd())
+		{
+			painter.drawImage(rect.topLeft(), tile.value());
+		}
+		else
+		{
+			painter.fillRect(rect, QColor("#f0f0f0"));
+			painter.setPen(QColor("#999999"));
+			painter.drawText(rect, Qt::AlignCenter, "Sample " + QString::number(index + 1));
+			missing.append(index);
+		}
+
+		if (index == m_currentSample)
+		{
+			painter.setPen(QPen(QColor("#1f5fa8"), 3));
+			painter.drawRect(rect.adjusted(1, 1, -2, -2));
+		}
+	}
+
+	requestTiles(missing);
+}
+
+void SampleOverview::mousePressEvent(QMouseEvent* event)
+{
+	if (event->button() != Qt::LeftButton)
+	{
+		QAbstractScrollArea::mousePressEvent(event);
+		return;
+	}
+
+	int columns = columnCount();
+	int column = (event->pos().x() - SPACING) / (TILE_WIDTH + SPACING);
+	int row = (event->pos().y() + verticalScrollBar()->value() - SPACING) / (TILE_HEIGHT + SPACING);
+	int index = row * columns + column;
+
+	// Clicks on the spacing between tiles select nothing
+	if (column >= 0 && column < columns && row >= 0 && index < m_sampleCount && tileRect(index).contains(event->pos()))
+	{
+		debugPrint("Tile clicked: sample " + QString::number(index + 1));
+		emit sampleActivated(index);
+	}
+}
+
+void SampleOverview::requestTiles(const QVector<int>& sampleIndices)
+{
+	QMutexLocker locker(&m_queueMutex);
+
+	// Tiles that scrolled out of view before a worker took them are not rendered
+	m_queue.clear();
+	for (int index : sampleIndices)
+	{
+		if (!m_inFlight.contains(index))
+		{
+			RenderJob job;
+			job.sampleIndex = index;
+			job.generation = m_generation;
+			m_queue.append(job);
+		}
+	}
+	m_queueRatio = devicePixelRatioF();
+
+	if (!m_queue.isEmpty())
+	{
+		locker.unlock();
+		startWorkers();
+	}
+}
+
+void SampleOverview::startWorkers()
+{
+	QMutexLocker locker(&m_queueMutex);
+
+	// Workers leave when the queue runs dry; delete the ones that have
+	for (int i = m_workers.size() - 1; i >= 0; i--)
+	{
+		if (m_workers[i]->isFinished())
+		{
+			delete m_workers[i];
+			m_workers.remove(i);
+		}
+	}
+
+	int threadCount = m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+	while (m_activeWorkers < threadCount && m_activeWorkers < m_queue.size())
+	{
+		m_activeWorkers++;
+		QThread* thread = QThread::create([this]() {
+			for (;;)
+			{
+				RenderJob job;
+				SheetHandle sheet;
+				qreal ratio;
+				{
+					QMutexLocker locker(&m_queueMutex);
+					if (m_queue.isEmpty())
+					{
+						m_activeWorkers--;
+						return;
+					}
+					job = m_queue.takeFirst();
+					m_inFlight.insert(job.sampleIndex);
+					sheet = m_queueSheet;
+					ratio = m_queueRatio;
+				}
+
+				QElapsedTimer timer;
+				timer.start();
+				QImage image = renderTile(sheet.sampleView(job.sampleIndex), ratio);
+				qint64 renderNs = timer.nsecsElapsed();
+
+				// Delivered on the GUI thread; dropped if the overview is gone by then
+				QMetaObject::invokeMethod(this, [this, job, image, renderNs]() {
+					tileRendered(job.sampleIndex, job.generation, image, renderNs);
+				}, Qt::QueuedConnection);
+			}
+		});
+		m_workers.append(thread);
+		thread->start();
+	}
+}
+
+void SampleOverview::stopWorkers()
+{
+	QVector<QThread*> workers;
+	{
+		QMutexLocker locker(&m_queueMutex);
+		m_queue.clear();
+		workers = m_workers;
+		m_workers.clear();
+	}
+
+	for (QThread* thread : workers)
+	{
+		thread->wait();
+		delete thread;
+	}
+}
+
+void SampleOverview::tileRendered(int sampleIndex, quint64 generation, const QImage& image, qint64 renderNs)
+{
+	{
+		QMutexLocker locker(&m_queueMutex);
+		m_inFlight.remove(sampleIndex);
+	}
+
+	// A tile of a sheet that has since changed is rendered again if still in view
+	if (generation == m_generation && sampleIndex < m_sampleCount)
+	{
+		m_tiles.insert(sampleIndex, image);
+		m_rendered++;
+		m_renderNs += renderNs;
+	}
+	viewport()->update();
+}
+
+QString SampleOverview::renderReport() const
+{
+	int threadCount = m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+	QString report = "Overview: " + QString::number(m_tiles.size()) + " of " + QString::number(m_sampleCount) + " tiles cached";
+	if (m_rendered > 0)
+	{
+		report += ", " + QString::number(m_rendered) + " rendered in " + QString::number(m_renderNs / 1e6, 'f', 1) +
+			" ms (" + QString::number(m_renderNs / 1e6 / m_rendered, 'f', 2) + " ms per tile) on up to " +
+			QString::number(threadCount) + " threads";
+	}
+	return report;
+}
+
+qint64 SampleOverview::memoryBytes() const
+{
+	qint64 bytes = 0;
+	for (const QImage& image : m_tiles)
+	{
+		bytes += image.sizeInBytes();
+	}
+	return bytes;
+}
+
+QImage SampleOverview::renderTile(const ExcelReader::SampleView& sample, qreal devicePixelRatio)
+{
+	QImage image(QSize(TILE_WIDTH, TILE_HEIGHT) * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+	image.setDevicePixelRatio(devicePixelRatio);
+	image.fill(Qt::white);
+
+	QPainter painter(&image);
+	painter.setRenderHint(QPainter::Antialiasing);
+	QRect frame(0, 0, TILE_WIDTH - 1, TILE_HEIGHT - 1);
+	painter.setPen(QColor("#cccccc"));
+	painter.drawRect(frame);
+
+	if (!sample.isValid())
+	{
+		painter.drawText(frame, Qt::AlignCenter, "Not available");
+		return image;
+	}
+
+	const SampleMetadata& metadata = sample.metadata();
+	QFont font = painter.font();
+	font.setBold(true);
+	painter.setFont(font);
+	painter.setPen(Qt::black);
+	QRect titleRect(8, 4, TILE_WIDTH - 16, 18);
+	QString title = "#" + QString::number(sample.sampleIndex() + 1) + "  " + metadata.sampleID;
+	painter.drawText(titleRect, Qt::AlignLeft | Qt::AlignVCenter, painter.fontMetrics().elidedText(title, Qt::ElideRight, titleRect.width()));
+
+	font.setBold(false);
+	painter.setFont(font);
+	painter.setPen(QColor("#555555"));
+	QString details = QString::number(metadata.power, 'f', 1) + " W  " + QString::number(metadata.resistance, 'f', 2) +
+		" Ω  " + QString::number(sample.rowCount()) + " rows";
+	painter.drawText(QRect(8, 22, TILE_WIDTH - 16, 16), Qt::AlignLeft | Qt::AlignVCenter, details);
+
+	// TPM per row, the same computed column the table shows
+	DerivedColumns derived;
+	derived.defineTemplateColumns();
+	static const char* inputs[] = { "puffs", "beforeWeight", "afterWeight" };
+	for (int col = 0; col < 3; col++)
+	{
+		ExcelReader::ColumnSpan span = sample.column(col);
+		QVector<double> values(span.size, qQNaN());
+		if (span.numbers)
+		{
+			std::copy(span.numbers, span.numbers + span.size, values.begin());
+		}
+		derived.setInput(inputs[col], values);
+	}
+	derived.setParameter("power", metadata.power);
+	const QVector<double>& tpm = derived.column("tpm");
+	double mean = derived.scalar("tpmMean");
+
+	double low = qInf();
+	double high = -qInf();
+	for (double value : tpm)
+	{
+		if (!qIsNaN(value))
+		{
+			low = qMin(low, value);
+			high = qMax(high, value);
+		}
+	}
+
+	QRect plot(8, 42, TILE_WIDTH - 16, TILE_HEIGHT - 42 - 22);
+	QRect footer(8, TILE_HEIGHT - 20, TILE_WIDTH - 16, 16);
+	if (low > high)
+	{
+		painter.drawText(plot, Qt::AlignCenter, "No TPM data");
+		return image;
+	}
+	if (high - low < 1e-12)
+	{
+		low -= 0.5;
+		high += 0.5;
+	}
+
+	auto xOf = [&](int row) { return plot.left() + (tpm.size() > 1 ? double(row) / (tpm.size() - 1) : 0.5) * plot.width(); };
+	auto yOf = [&](double value) { return plot.bottom() - (value - low) / (high - low) * plot.height(); };
+
+	painter.setPen(QPen(QColor("#cc6600"), 1, Qt::DashLine));
+	painter.drawLine(QPointF(plot.left(), yOf(mean)), QPointF(plot.right(), yOf(mean)));
+
+	// Blank rows break the line
+	QPainterPath path;
+	bool drawing = false;
+	for (int row = 0; row < tpm.size(); row++)
+	{
+		if (qIsNaN(tpm[row]))
+		{
+			drawing = false;
+			continue;
+		}
+
+		QPointF point(xOf(row), yOf(tpm[row]));
+		if (drawing)
+		{
+			path.lineTo(point);
+		}
+		else
+		{
+			path.moveTo(point);
+			drawing = true;
+		}
+	}
+	painter.setPen(QPen(QColor("#1f5fa8"), 1.2));
+	painter.drawPath(path);
+
+	painter.setPen(QColor("#555555"));
+	painter.drawText(footer, Qt::AlignLeft | Qt::AlignVCenter, "TPM " + QString::number(mean, 'f', 2) + " mg/puff");
+	painter.drawText(footer, Qt::AlignRight | Qt::AlignVCenter, QString::number(low, 'f', 1) + " - " + QString::number(high, 'f', 1));
+
+	return image;
+}
@@ -0,0 +1,97 @@
+#ifndef SAMPLEOVERVIEW_H
+#define SAMPLEOVERVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QImage>
+#include <QMutex>
+#include "ExcelReader.h"
+
+class QThread;
+
+// Every sample of a sheet as a tile: sample ID, power, row count and a TPM
+// sparkline, laid out in a scrolling grid. Only tiles in view are rendered.
+// Tiles are rasterized into QImages on worker threads, each from its own
+// copy of the sheet handle, and cached until the sheet changes, so scrolling
+// back over rendered tiles only draws images. The tiles show the sheet's
+// values; table edits and live rows are not part of them.
+class SampleOverview : public QAbstractScrollArea
+{
+	Q_OBJECT
+
+public:
+	static const int TILE_WIDTH = 240;
+	static const int TILE_HEIGHT = 120;
+	static const int SPACING = 8;
+
+	explicit SampleOverview(QWidget* parent = nullptr);
+	~SampleOverview();
+
+	// Drops every tile; rendering starts once the tiles are in view
+	void setSheet(const SheetHandle& sheet);
+	// Re-reads the sheet after a reload, only the changed samples are rendered again
+	void refreshSamples(const SheetHandle& sheet, const QVector<int>& changedSamples);
+	void clear();
+
+	QString sheetName() const { return m_sheet.sheetName(); }
+	int sampleCount() const { return m_sampleCount; }
+
+	void setCurrentSample(int sampleIndex); // Outlined, not part of the cached tile
+	void setThreadCount(int threads) { m_threadCount = threads; } // 0 = QThread::idealThreadCount()
+
+	// Rendered tiles of the current sheet and the time spent rendering them
+	int renderedCount() const { return m_rendered; }
+	QString renderReport() const;
+	qint64 memoryBytes() const;
+
+	// Image of one tile, as the workers draw it
+	static QImage renderTile(const ExcelReader::SampleView& sample, qreal devicePixelRatio);
+
+signals:
+	void sampleActivated(int sampleIndex);
+
+protected:
+	void paintEvent(QPaintEvent* event) override;
+	void resizeEvent(QResizeEvent* event) override;
+	void mousePressEvent(QMouseEvent* event) override;
+
+private:
+	struct RenderJob
+	{
+		int sampleIndex;
+		quint64 generation;
+	};
+
+	SheetHandle m_sheet;
+	int m_sampleCount;
+	int m_currentSample;
+	int m_threadCount;
+
+	// GUI thread only
+	QHash<int, QImage> m_tiles;
+	quint64 m_generation; // Changes whenever the cached tiles stop matching the sheet
+	int m_rendered;
+	qint64 m_renderNs;
+
+	// Shared with the workers
+	QMutex m_queueMutex;
+	QVector<RenderJob> m_queue; // Tiles in view, top row first; replaced on every paint
+	QSet<int> m_inFlight;       // Taken by a worker, not yet delivered; never queued twice
+	SheetHandle m_queueSheet;
+	qreal m_queueRatio;
+	int m_activeWorkers;
+	QVector<QThread*> m_workers;
+
+	int columnCount() const;
+	QRect tileRect(int sampleIndex) const; // Viewport coordinates
+	void updateScrollBars();
+	void requestTiles(const QVector<int>& sampleIndices);
+	void startWorkers();
+	void stopWorkers();
+	void tileRendered(int sampleIndex, quint64 generation, const QImage& image, qint64 renderNs);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // SAMPLEOVERVIEW_H
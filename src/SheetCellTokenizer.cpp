@@ -0,0 +1,845 @@
+#include "SheetCellTokenizer.h"
+#include <QByteArray>
+#include <QtAlgorithms>
+#include <cstring>
+
+// The library feature macros are only defined once <version> (or the header itself) is in
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+
+#if defined(__cpp_lib_to_chars) || (defined(_MSC_VER) && _MSC_VER >= 1924)
+#include <charconv>
+#define SHEETTOKENIZER_FROM_CHARS
+#endif
+
+// SSE2 is part of every x86-64 CPU. AVX2 is compiled for a target attribute
+// and used when the CPU reports it at startup, so one binary runs everywhere
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__SSE2__) && defined(__i386__))
+#include <immintrin.h>
+#define SHEETTOKENIZER_SSE2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHEETTOKENIZER_AVX2
+#define SHEETTOKENIZER_AVX2_TARGET
+#elif defined(__GNUC__) || defined(__clang__)
+#define SHEETTOKENIZER_AVX2
+#define SHEETTOKENIZER_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+#if defined(SHEETTOKENIZER_AVX2)
+	bool cpuHasAvx2()
+	{
+#if defined(_MSC_VER)
+		// Leaf 7 EBX bit 5, and the OS has to save the YMM registers (OSXSAVE + XCR0 bits 1-2)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	const bool HAS_AVX2 = cpuHasAvx2();
+#endif
+
+	inline const char* findByteScalar(const char* p, const char* end, char c)
+	{
+		const void* hit = memchr(p, c, size_t(end - p));
+		return hit ? static_cast<const char*>(hit) : end;
+	}
+
+	inline const char* findQuoteOrTagEndScalar(const char* p, const char* end)
+	{
+		while (p < end && *p != '"' && *p != '\'' && *p != '>')
+		{
+			p++;
+		}
+		return p;
+	}
+
+#if defined(SHEETTOKENIZER_SSE2)
+	inline const char* findByteSse2(const char* p, const char* end, char c)
+	{
+		const __m128i needle = _mm_set1_epi8(c);
+		while (end - p >= 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			quint32 mask = quint32(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+			if (mask)
+			{
+				return p + qCountTrailingZeroBits(mask);
+			}
+			p += 16;
+		}
+		return findByteScalar(p, end, c);
+	}
+
+	inline const char* findQuoteOrTagEndSse2(const char* p, const char* end)
+	{
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i apostrophe = _mm_set1_epi8('\'');
+		const __m128i close = _mm_set1_epi8('>');
+		while (end - p >= 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote),
+				_mm_cmpeq_epi8(block, apostrophe)), _mm_cmpeq_epi8(block, close));
+			quint32 mask = quint32(_mm_movemask_epi8(hits));
+			if (mask)
+			{
+				return p + qCountTrailingZeroBits(mask);
+			}
+			p += 16;
+		}
+		return findQuoteOrTagEndScalar(p, end);
+	}
+#endif
+
+#if defined(SHEETTOKENIZER_AVX2)
+	SHEETTOKENIZER_AVX2_TARGET const char* findByteAvx2(const char* p, const char* end, char c)
+	{
+		const __m256i needle = _mm256_set1_epi8(c);
+		while (end - p >= 32)
+		{
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			quint32 mask = quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+			if (mask)
+			{
+				return p + qCountTrailingZeroBits(mask);
+			}
+			p += 32;
+		}
+		return findByteScalar(p, end, c);
+	}
+
+	SHEETTOKENIZER_AVX2_TARGET const char* findQuoteOrTagEndAvx2(const char* p, const char* end)
+	{
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i apostrophe = _mm256_set1_epi8('\'');
+		const __m256i close = _mm256_set1_epi8('>');
+		while (end - p >= 32)
+		{
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			__m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote),
+				_mm256_cmpeq_epi8(block, apostrophe)), _mm256_cmpeq_epi8(block, close));
+			quint32 mask = quint32(_mm256_movemask_epi8(hits));
+			if (mask)
+			{
+				return p + qCountTrailingZeroBits(mask);
+			}
+			p += 32;
+		}
+		return findQuoteOrTagEndScalar(p, end);
+	}
+#endif
+
+	// First occurrence of c in [p, end), or end
+	inline const char* findByte(const char* p, const char* end, char c)
+	{
+#if defined(SHEETTOKENIZER_AVX2)
+		if (HAS_AVX2)
+		{
+			return findByteAvx2(p, end, c);
+		}
+#endif
+#if defined(SHEETTOKENIZER_SSE2)
+		return findByteSse2(p, end, c);
+#else
+		return findByteScalar(p, end, c);
+#endif
+	}
+
+	// First quote or tag end in [p, end): the boundaries of an attribute list
+	inline const char* findQuoteOrTagEnd(const char* p, const char* end)
+	{
+#if defined(SHEETTOKENIZER_AVX2)
+		if (HAS_AVX2)
+		{
+			return findQuoteOrTagEndAvx2(p, end);
+		}
+#endif
+#if defined(SHEETTOKENIZER_SSE2)
+		return findQuoteOrTagEndSse2(p, end);
+#else
+		return findQuoteOrTagEndScalar(p, end);
+#endif
+	}
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	inline bool isNameEnd(char c)
+	{
+		return isSpace(c) || c == '>' || c == '/';
+	}
+
+	// Local part of an element name, dropping any namespace prefix (x:c -> c)
+	inline void localName(const char* begin, const char* end, const char** name, int* length)
+	{
+		const char* colon = static_cast<const char*>(memchr(begin, ':', size_t(end - begin)));
+		*name = colon ? colon + 1 : begin;
+		*length = int(end - *name);
+	}
+
+	inline bool nameIs(const char* name, int length, const char* expected)
+	{
+		return int(strlen(expected)) == length && memcmp(name, expected, size_t(length)) == 0;
+	}
+
+	inline int parseInt(const char* p, int length)
+	{
+		int value = 0;
+		for (int i = 0; i < length; i++)
+		{
+			if (p[i] < '0' || p[i] > '9')
+			{
+				break;
+			}
+			value = value * 10 + (p[i] - '0');
+		}
+		return value;
+	}
+
+	// Scans the attributes of a start tag, p points just past the element name.
+	// Returns the position after '>' or nullptr when the tag is incomplete.
+	template <typename Handler>
+	const char* scanAttributes(const char* p, const char* end, bool* selfClosing, Handler handler)
+	{
+		*selfClosing = false;
+
+		while (true)
+		{
+			const char* boundary = findQuoteOrTagEnd(p, end);
+			if (boundary == end)
+			{
+				return nullptr;
+			}
+
+			if (*boundary == '>')
+			{
+				*selfClosing = (boundary > p && boundary[-1] == '/');
+				return boundary + 1;
+			}
+
+			// Attribute name sits between p and '=' before the opening quote
+			const char* nameEnd = boundary - 1;
+			while (nameEnd > p && (isSpace(*nameEnd) || *nameEnd == '='))
+			{
+				nameEnd--;
+			}
+			const char* nameBegin = nameEnd;
+			while (nameBegin > p && !isSpace(nameBegin[-1]))
+			{
+				nameBegin--;
+			}
+
+			const char* valueBegin = boundary + 1;
+			const char* valueEnd = findByte(valueBegin, end, *boundary);
+			if (valueEnd == end)
+			{
+				return nullptr;
+			}
+
+			handler(nameBegin, int(nameEnd - nameBegin + 1), valueBegin, int(valueEnd - valueBegin));
+			p = valueEnd + 1;
+		}
+	}
+
+	// Position of the '<' of the closing tag for a local element name, or nullptr
+	const char* findClosingTag(const char* p, const char* end, const char* name, int nameLength)
+	{
+		while (true)
+		{
+			const char* lt = findByte(p, end, '<');
+			if (end - lt < 2)
+			{
+				return nullptr;
+			}
+
+			if (lt[1] == '/')
+			{
+				const char* gt = findByte(lt, end, '>');
+				if (gt == end)
+				{
+					return nullptr;
+				}
+
+				const char* local = nullptr;
+				int length = 0;
+				const char* tagEnd = gt;
+				while (tagEnd > lt + 2 && isSpace(tagEnd[-1]))
+				{
+					tagEnd--;
+				}
+				localName(lt + 2, tagEnd, &local, &length);
+				if (length == nameLength && memcmp(local, name, size_t(length)) == 0)
+				{
+					return lt;
+				}
+			}
+
+			p = lt + 1;
+		}
+	}
+
+	const char* findSequence(const char* p, const char* end, const char* sequence)
+	{
+		size_t length = strlen(sequence);
+		while (true)
+		{
+			p = findByte(p, end, sequence[0]);
+			if (size_t(end - p) < length)
+			{
+				return nullptr;
+			}
+			if (memcmp(p, sequence, length) == 0)
+			{
+				return p;
+			}
+			p++;
+		}
+	}
+
+	void appendDecoded(QByteArray& out, const char* p, const char* end)
+	{
+		while (p < end)
+		{
+			const char* amp = findByte(p, end, '&');
+			out.append(p, int(amp - p));
+			if (amp == end)
+			{
+				break;
+			}
+
+			const char* semicolon = findByte(amp, end, ';');
+			if (semicolon == end)
+			{
+				out.append(amp, int(end - amp));
+				break;
+			}
+
+			const char* entity = amp + 1;
+			int length = int(semicolon - entity);
+
+			if (nameIs(entity, length, "amp")) out.append('&');
+			else if (nameIs(entity, length, "lt")) out.append('<');
+			else if (nameIs(entity, length, "gt")) out.append('>');
+			else if (nameIs(entity, length, "quot")) out.append('"');
+			else if (nameIs(entity, length, "apos")) out.append('\'');
+			else if (length > 1 && entity[0] == '#')
+			{
+				// Numeric character reference, re-encoded as UTF-8
+				bool ok = false;
+				uint code = (entity[1] == 'x' || entity[1] == 'X')
+					? QByteArray(entity + 2, length - 2).toUInt(&ok, 16)
+					: QByteArray(entity + 1, length - 1).toUInt(&ok, 10);
+				if (ok)
+				{
+					out.append(QString::fromUcs4(&code, 1).toUtf8());
+				}
+			}
+			else
+			{
+				out.append(amp, int(semicolon - amp + 1));
+			}
+
+			p = semicolon + 1;
+		}
+	}
+}
+
+SheetCellTokenizer::SheetCellTokenizer()
+{
+	reset();
+}
+
+void SheetCellTokenizer::reset()
+{
+	m_row = -1;
+	m_col = -1;
+	m_finished = false;
+	m_lastError.clear();
+}
+
+const char* SheetCellTokenizer::simdLevel()
+{
+#if defined(SHEETTOKENIZER_AVX2)
+	if (HAS_AVX2)
+	{
+		return "AVX2";
+	}
+#endif
+#if defined(SHEETTOKENIZER_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+bool SheetCellTokenizer::decodeCellReference(const char* ref, int length, int* row, int* col)
+{
+	int c = 0;
+	int r = 0;
+	int i = 0;
+
+	// Column letters: base-26 with A = 1
+	while (i < length && ref[i] >= 'A' && ref[i] <= 'Z')
+	{
+		c = c * 26 + (ref[i] - 'A' + 1);
+		i++;
+	}
+
+	// Row digits
+	int digitStart = i;
+	while (i < length && ref[i] >= '0' && ref[i] <= '9')
+	{
+		r = r * 10 + (ref[i] - '0');
+		i++;
+	}
+
+	if (c == 0 || i == digitStart || i != length || r == 0)
+	{
+		return false;
+	}
+
+	*row = r - 1;
+	*col = c - 1;
+	return true;
+}
+
+bool SheetCellTokenizer::parseNumber(const char* text, int length, double* value)
+{
+	const char* begin = text;
+	const char* end = text + length;
+	while (begin < end && isSpace(*begin))
+	{
+		begin++;
+	}
+	while (end > begin && isSpace(end[-1]))
+	{
+		end--;
+	}
+
+	if (begin == end)
+	{
+		return false;
+	}
+
+	// from_chars does not accept a leading '+'
+	if (*begin == '+')
+	{
+		begin++;
+	}
+
+#if defined(SHEETTOKENIZER_FROM_CHARS)
+	std::from_chars_result result = std::from_chars(begin, end, *value);
+	return result.ec == std::errc() && result.ptr == end;
+#else
+	// Locale independent fallback for toolchains without floating point from_chars
+	bool ok = false;
+	*value = QByteArray::fromRawData(begin, int(end - begin)).toDouble(&ok);
+	return ok;
+#endif
+}
+
+QString SheetCellTokenizer::decodeText(const char* text, int length)
+{
+	if (!memchr(text, '&', size_t(length)))
+	{
+		return QString::fromUtf8(text, length);
+	}
+
+	QByteArray decoded;
+	decoded.reserve(length);
+	appendDecoded(decoded, text, text + length);
+	return QString::fromUtf8(decoded);
+}
+
+QString SheetCellTokenizer::decodeInlineString(const char* text, int length)
+{
+	// Concatenate every <t> run inside <is>, skipping phonetic (<rPh>) runs
+	QByteArray decoded;
+	const char* p = text;
+	const char* end = text + length;
+
+	while (true)
+	{
+		const char* lt = findByte(p, end, '<');
+		if (end - lt < 2)
+		{
+			break;
+		}
+
+		if (lt[1] == '/' || lt[1] == '?' || lt[1] == '!')
+		{
+			p = lt + 1;
+			continue;
+		}
+
+		const char* nameEnd = lt + 1;
+		while (nameEnd < end && !isNameEnd(*nameEnd))
+		{
+			nameEnd++;
+		}
+
+		const char* name = nullptr;
+		int nameLength = 0;
+		localName(lt + 1, nameEnd, &name, &nameLength);
+
+		bool selfClosing = false;
+		const char* content = scanAttributes(nameEnd, end, &selfClosing, [](const char*, int, const char*, int) {});
+		if (!content)
+		{
+			break;
+		}
+
+		if (nameIs(name, nameLength, "rPh"))
+		{
+			const char* close = selfClosing ? content : findClosingTag(content, end, "rPh", 3);
+			if (!close)
+			{
+				break;
+			}
+			p = selfClosing ? content : close + 1;
+		}
+		else if (nameIs(name, nameLength, "t") && !selfClosing)
+		{
+			const char* close = findClosingTag(content, end, "t", 1);
+			if (!close)
+			{
+				break;
+			}
+			appendDecoded(decoded, content, close);
+			p = close + 1;
+		}
+		else
+		{
+			p = content;
+		}
+	}
+
+	return QString::fromUtf8(decoded);
+}
+
+const char* SheetCellTokenizer::parseRow(const char* p, const char* end)
+{
+	int row = -1;
+	bool selfClosing = false;
+
+	const char* next = scanAttributes(p, end, &selfClosing, [&](const char* name, int nameLength, const char* value, int valueLength) {
+		if (nameLength == 1 && name[0] == 'r')
+		{
+			row = parseInt(value, valueLength) - 1;
+		}
+	});
+
+	if (!next)
+	{
+		return nullptr;
+	}
+
+	// Rows without "r" follow the previous row
+	m_row = row >= 0 ? row : m_row + 1;
+	m_col = -1;
+	return next;
+}
+
+const char* SheetCellTokenizer::parseCell(const char* p, const char* end, QVector<CellToken>& out)
+{
+	CellToken cell;
+	cell.row = m_row;
+	cell.col = m_col + 1; // Cells without "r" follow the previous cell
+	cell.style = 0;
+	cell.type = NumberCell;
+	cell.number = 0.0;
+	cell.text = nullptr;
+	cell.textLength = 0;
+
+	const char* type = nullptr;
+	int typeLength = 0;
+	bool badReference = false;
+	bool selfClosing = false;
+
+	const char* next = scanAttributes(p, end, &selfClosing, [&](const char* name, int nameLength, const char* value, int valueLength) {
+		if (nameLength != 1)
+		{
+			return;
+		}
+
+		if (name[0] == 'r')
+		{
+			badReference = !decodeCellReference(value, valueLength, &cell.row, &cell.col);
+		}
+		else if (name[0] == 't')
+		{
+			type = value;
+			typeLength = valueLength;
+		}
+		else if (name[0] == 's')
+		{
+			cell.style = parseInt(value, valueLength);
+		}
+	});
+
+	if (!next)
+	{
+		return nullptr;
+	}
+
+	if (badReference)
+	{
+		m_lastError = "Invalid cell reference near row " + QString::number(m_row + 1);
+		return nullptr;
+	}
+
+	const char* value = nullptr;
+	int valueLength = 0;
+	bool hasValue = false;
+	bool isInline = false;
+
+	// Children: <f>, <v>, <is>, ... until </c>
+	p = next;
+	while (!selfClosing)
+	{
+		const char* lt = findByte(p, end, '<');
+		if (end - lt < 2)
+		{
+			return nullptr;
+		}
+
+		if (lt[1] == '/')
+		{
+			const char* gt = findByte(lt, end, '>');
+			if (gt == end)
+			{
+				return nullptr;
+			}
+			p = gt + 1;
+			break;
+		}
+
+		const char* nameEnd = lt + 1;
+		while (nameEnd < end && !isNameEnd(*nameEnd))
+		{
+			nameEnd++;
+		}
+		if (nameEnd == end)
+		{
+			return nullptr;
+		}
+
+		const char* name = nullptr;
+		int nameLength = 0;
+		localName(lt + 1, nameEnd, &name, &nameLength);
+
+		bool childSelfClosing = false;
+		const char* content = scanAttributes(nameEnd, end, &childSelfClosing, [](const char*, int, const char*, int) {});
+		if (!content)
+		{
+			return nullptr;
+		}
+
+		if (childSelfClosing)
+		{
+			p = content;
+			continue;
+		}
+
+		// <f> formulas and unknown children (e.g. extLst) are skipped by their local name
+		const char* close = findClosingTag(content, end, name, nameLength);
+		if (!close)
+		{
+			return nullptr;
+		}
+
+		if (nameIs(name, nameLength, "v") || nameIs(name, nameLength, "is"))
+		{
+			value = content;
+			valueLength = int(close - content);
+			hasValue = true;
+			isInline = nameIs(name, nameLength, "is");
+		}
+
+		const char* gt = findByte(close, end, '>');
+		if (gt == end)
+		{
+			return nullptr;
+		}
+		p = gt + 1;
+	}
+
+	m_row = cell.row;
+	m_col = cell.col;
+
+	if (!hasValue)
+	{
+		return p;
+	}
+
+	if (typeLength == 0 || (typeLength == 1 && type[0] == 'n'))
+	{
+		if (valueLength == 0)
+		{
+			// Formula without a cached result
+			return p;
+		}
+
+		if (parseNumber(value, valueLength, &cell.number))
+		{
+			cell.type = NumberCell;
+		}
+		else
+		{
+			cell.type = StringCell;
+			cell.text = value;
+			cell.textLength = valueLength;
+		}
+	}
+	else if (typeLength == 1 && type[0] == 's')
+	{
+		cell.type = SharedStringCell;
+		cell.number = parseInt(value, valueLength);
+	}
+	else if (typeLength == 1 && type[0] == 'b')
+	{
+		cell.type = BooleanCell;
+		cell.number = (valueLength > 0 && value[0] == '1') ? 1.0 : 0.0;
+	}
+	else if (typeLength == 1 && type[0] == 'e')
+	{
+		cell.type = ErrorCell;
+		cell.text = value;
+		cell.textLength = valueLength;
+	}
+	else if (isInline)
+	{
+		cell.type = InlineStringCell;
+		cell.text = value;
+		cell.textLength = valueLength;
+	}
+	else
+	{
+		// t="str" formula strings and t="d" ISO dates are kept as text
+		cell.type = StringCell;
+		cell.text = value;
+		cell.textLength = valueLength;
+	}
+
+	out.append(cell);
+	return p;
+}
+
+int SheetCellTokenizer::tokenize(const char* data, int size, QVector<CellToken>& out)
+{
+	const char* p = data;
+	const char* end = data + size;
+
+	while (!m_finished)
+	{
+		const char* lt = findByte(p, end, '<');
+		if (lt == end)
+		{
+			// Only character data left, nothing to carry over
+			return size;
+		}
+
+		const char* resume = lt;
+		if (end - lt < 2)
+		{
+			return int(resume - data);
+		}
+
+		if (lt[1] == '/')
+		{
+			const char* gt = findByte(lt, end, '>');
+			if (gt == end)
+			{
+				return int(resume - data);
+			}
+
+			const char* name = nullptr;
+			int nameLength = 0;
+			localName(lt + 2, gt, &name, &nameLength);
+			if (nameIs(name, nameLength, "sheetData"))
+			{
+				m_finished = true;
+			}
+
+			p = gt + 1;
+			continue;
+		}
+
+		if (lt[1] == '!' || lt[1] == '?')
+		{
+			const char* close = (end - lt >= 4 && memcmp(lt, "<!--", 4) == 0)
+				? findSequence(lt + 4, end, "-->") : findByte(lt, end, '>');
+			if (!close || close == end)
+			{
+				return int(resume - data);
+			}
+			p = close + 1;
+			continue;
+		}
+
+		const char* nameEnd = lt + 1;
+		while (nameEnd < end && !isNameEnd(*nameEnd))
+		{
+			nameEnd++;
+		}
+		if (nameEnd == end)
+		{
+			return int(resume - data);
+		}
+
+		const char* name = nullptr;
+		int nameLength = 0;
+		localName(lt + 1, nameEnd, &name, &nameLength);
+
+		const char* next = nullptr;
+		if (nameIs(name, nameLength, "c"))
+		{
+			next = parseCell(nameEnd, end, out);
+			if (!next && hasError())
+			{
+				return -1;
+			}
+		}
+		else if (nameIs(name, nameLength, "row"))
+		{
+			next = parseRow(nameEnd, end);
+		}
+		else
+		{
+			bool selfClosing = false;
+			next = scanAttributes(nameEnd, end, &selfClosing, [](const char*, int, const char*, int) {});
+		}
+
+		if (!next)
+		{
+			return int(resume - data);
+		}
+
+		p = next;
+	}
+
+	return size;
+}
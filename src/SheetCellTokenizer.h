@@ -0,0 +1,70 @@
+#ifndef SHEETCELLTOKENIZER_H
+#define SHEETCELLTOKENIZER_H
+
+#include <QString>
+#include <QVector>
+
+// Specialized tokenizer for SpreadsheetML cell streams (<row>/<c>/<v> runs).
+// Tag and quote boundaries are located with SIMD (AVX2 where the CPU has it,
+// else SSE2, scalar off x86), cell references are decoded arithmetically and numeric <v>
+// payloads are parsed with std::from_chars. Everything else in the sheet
+// is skipped without building a DOM.
+//
+// tokenize() can be fed the part in pieces: it returns how many bytes were
+// consumed, and the unconsumed tail (a partial element) must be passed
+// again together with the following data.
+class SheetCellTokenizer
+{
+public:
+	enum CellType
+	{
+		NumberCell,
+		SharedStringCell, // number holds the shared string index
+		InlineStringCell, // text spans the <is> content, see decodeInlineString()
+		StringCell,       // t="str" formula result or unparseable number
+		BooleanCell,      // number is 0 or 1
+		ErrorCell         // text holds the error code, e.g. #DIV/0!
+	};
+
+	struct CellToken
+	{
+		int row;          // 0-based
+		int col;          // 0-based
+		int style;        // index into cellXfs
+		CellType type;
+		double number;
+		const char* text; // raw (entity encoded) bytes inside the input buffer
+		int textLength;
+	};
+
+	SheetCellTokenizer();
+
+	void reset();
+
+	// Returns the number of bytes consumed, or -1 on malformed input
+	int tokenize(const char* data, int size, QVector<CellToken>& out);
+
+	bool isFinished() const { return m_finished; }
+	bool hasError() const { return !m_lastError.isEmpty(); }
+	QString getLastError() const { return m_lastError; }
+
+	// Text helpers for token payloads
+	static QString decodeText(const char* text, int length);
+	static QString decodeInlineString(const char* text, int length);
+	static bool decodeCellReference(const char* ref, int length, int* row, int* col);
+	static bool parseNumber(const char* text, int length, double* value);
+
+	// Instruction set the tokenizer scans with on this CPU
+	static const char* simdLevel();
+
+private:
+	int m_row;
+	int m_col;
+	bool m_finished;
+	QString m_lastError;
+
+	const char* parseRow(const char* p, const char* end);
+	const char* parseCell(const char* p, const char* end, QVector<CellToken>& out);
+};
+
+#endif // SHEETCELLTOKENIZER_H
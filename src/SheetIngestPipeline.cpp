@@ -0,0 +1,223 @@
+#include "SheetIngestPipeline.h"
+#include "SheetCellTokenizer.h"
+#include "BoundedQueue.h"
+#include "XlsxSheet.h"
+#include "ZipArchive.h"
+#include <QThread>
+#include <QElapsedTimer>
+
+namespace
+{
+	// Tokens point into the buffer they were scanned from, so both travel together
+	struct TokenBatch
+	{
+		QByteArray buffer;
+		QVector<SheetCellTokenizer::CellToken> tokens;
+	};
+}
+
+SheetIngestPipeline::SheetIngestPipeline()
+	: m_chunkSize(256 * 1024)
+	, m_queueCapacity(4)
+	, m_rowLimit(0)
+	, m_wallNs(0)
+{
+}
+
+bool SheetIngestPipeline::run(ZipArchive* archive, const QString& partPath, XlsxSheet* sheet,
+	const QStringList& sharedStrings, const QSet<int>& dateStyles, bool date1904)
+{
+	m_lastError.clear();
+	m_stats.clear();
+	m_wallNs = 0;
+
+	ZipArchive::EntryStream stream;
+	if (!archive->openStream(partPath, &stream))
+	{
+		m_lastError = archive->getLastError();
+		return false;
+	}
+
+	QElapsedTimer wallTimer;
+	wallTimer.start();
+
+	BoundedQueue<QByteArray> chunks(m_queueCapacity);
+	BoundedQueue<TokenBatch> batches(m_queueCapacity);
+
+	StageStats inflateStats = { "Inflate", 0, 0, 0, 0, 0 };
+	StageStats tokenizeStats = { "Tokenize", 0, 0, 0, 0, 0 };
+	StageStats convertStats = { "Convert", 0, 0, 0, 0, 0 };
+	QString inflateError;
+	QString tokenizeError;
+	const int rowLimit = m_rowLimit;
+	const int chunkSize = (rowLimit > 0) ? qMin(m_chunkSize, 16 * 1024) : m_chunkSize;
+
+	// Stage 1: inflate the worksheet part in fixed-size chunks
+	QThread* inflateThread = QThread::create([&]() {
+		QElapsedTimer timer;
+		timer.start();
+
+		while (!stream.atEnd())
+		{
+			QByteArray chunk = stream.read(chunkSize);
+			if (stream.hasError())
+			{
+				inflateError = stream.getLastError();
+				chunks.abort();
+				break;
+			}
+
+			inflateStats.items++;
+			inflateStats.bytes += chunk.size();
+
+			if (!chunks.push(chunk))
+			{
+				break; // Downstream finished or failed
+			}
+		}
+		chunks.close();
+
+		inflateStats.outputWaitNs = chunks.pushWaitNs();
+		inflateStats.busyNs = timer.nsecsElapsed() - inflateStats.outputWaitNs;
+	});
+
+	// Stage 2: tokenize chunks; an element split across chunks is carried into the next one
+	QThread* tokenizeThread = QThread::create([&]() {
+		QElapsedTimer timer;
+		timer.start();
+
+		SheetCellTokenizer tokenizer;
+		QByteArray carry;
+		QByteArray chunk;
+		int lastBatchSize = 0;
+		bool limitReached = false;
+
+		while (!tokenizer.isFinished() && !limitReached && chunks.pop(&chunk))
+		{
+			TokenBatch batch;
+			batch.tokens.reserve(lastBatchSize);
+			batch.buffer = carry.isEmpty() ? chunk : carry + chunk;
+			tokenizeStats.bytes += chunk.size();
+
+			int consumed = tokenizer.tokenize(batch.buffer.constData(), batch.buffer.size(), batch.tokens);
+			if (consumed < 0)
+			{
+				tokenizeError = tokenizer.getLastError();
+				break;
+			}
+
+			// Detach the tail from the batch buffer (stored chunks are views into the stream's mapping)
+			carry = QByteArray(batch.buffer.constData() + consumed, batch.buffer.size() - consumed);
+
+			// Rows arrive in order, so everything past the limit sits at the end of the batch
+			if (rowLimit > 0)
+			{
+				while (!batch.tokens.isEmpty() && batch.tokens.last().row >= rowLimit)
+				{
+					batch.tokens.removeLast();
+					limitReached = true;
+				}
+			}
+
+			lastBatchSize = batch.tokens.size();
+			if (!batch.tokens.isEmpty())
+			{
+				tokenizeStats.items++;
+				if (!batches.push(batch))
+				{
+					break;
+				}
+			}
+		}
+
+		if (tokenizeError.isEmpty() && !tokenizer.isFinished() && !limitReached && !carry.isEmpty())
+		{
+			tokenizeError = "Worksheet XML ends inside an element";
+		}
+
+		// Anything left upstream (e.g. parts after </sheetData>) is not needed
+		chunks.abort();
+		if (tokenizeError.isEmpty())
+		{
+			batches.close();
+		}
+		else
+		{
+			batches.abort();
+		}
+
+		tokenizeStats.inputWaitNs = chunks.popWaitNs();
+		tokenizeStats.outputWaitNs = batches.pushWaitNs();
+		tokenizeStats.busyNs = timer.nsecsElapsed() - tokenizeStats.inputWaitNs - tokenizeStats.outputWaitNs;
+	});
+
+	inflateThread->start();
+	tokenizeThread->start();
+
+	// Stage 3: convert token batches into cell values on the calling thread,
+	// the only stage that touches the sheet
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		sheet->clear();
+		TokenBatch batch;
+		while (batches.pop(&batch))
+		{
+			sheet->addTokens(batch.tokens, sharedStrings, dateStyles, date1904);
+			convertStats.items++;
+			convertStats.bytes += batch.buffer.size();
+		}
+
+		convertStats.inputWaitNs = batches.popWaitNs();
+		convertStats.busyNs = timer.nsecsElapsed() - convertStats.inputWaitNs;
+	}
+
+	tokenizeThread->wait();
+	inflateThread->wait();
+	delete tokenizeThread;
+	delete inflateThread;
+
+	m_wallNs = wallTimer.nsecsElapsed();
+	m_stats << inflateStats << tokenizeStats << convertStats;
+
+	if (!inflateError.isEmpty() || !tokenizeError.isEmpty())
+	{
+		m_lastError = inflateError.isEmpty() ? tokenizeError : inflateError;
+		sheet->clear();
+		return false;
+	}
+
+	return true;
+}
+
+QString SheetIngestPipeline::statsReport() const
+{
+	QString report = "Pipeline wall time: " + QString::number(m_wallNs / 1e6, 'f', 2) + " ms";
+
+	for (const StageStats& stage : m_stats)
+	{
+		double utilization = m_wallNs > 0 ? 100.0 * stage.busyNs / m_wallNs : 0.0;
+		report += "\n" + stage.name + ": " + QString::number(utilization, 'f', 0) + "% busy, " +
+			QString::number(stage.busyNs / 1e6, 'f', 2) + " ms work, " +
+			QString::number(stage.inputWaitNs / 1e6, 'f', 2) + " ms starved, " +
+			QString::number(stage.outputWaitNs / 1e6, 'f', 2) + " ms blocked, " +
+			QString::number(stage.items) + " items";
+	}
+
+	// The busiest stage bounds the throughput of the whole pipeline
+	const StageStats* bottleneck = nullptr;
+	for (const StageStats& stage : m_stats)
+	{
+		if (!bottleneck || stage.busyNs > bottleneck->busyNs)
+		{
+			bottleneck = &stage;
+		}
+	}
+	if (bottleneck)
+	{
+		report += "\nBottleneck: " + bottleneck->name;
+	}
+
+	return report;
+}
@@ -0,0 +1,61 @@
+#ifndef SHEETINGESTPIPELINE_H
+#define SHEETINGESTPIPELINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSet>
+
+class ZipArchive;
+class XlsxSheet;
+
+// Worksheet ingest as three overlapping stages connected by bounded queues:
+//
+//   inflate (worker) -> byte chunks -> tokenize (worker) -> token batches -> convert (caller)
+//
+// The queues apply backpressure, so at most a few chunks and batches are in
+// flight regardless of sheet size. Only the convert stage writes to the
+// XlsxSheet the samples are later extracted from.
+class SheetIngestPipeline
+{
+public:
+	struct StageStats
+	{
+		QString name;
+		qint64 busyNs;      // Time spent doing work
+		qint64 inputWaitNs; // Blocked on an empty input queue
+		qint64 outputWaitNs;// Blocked on a full output queue (backpressure)
+		qint64 items;       // Chunks or batches produced/consumed
+		qint64 bytes;       // Bytes produced (inflate) or consumed (tokenize)
+	};
+
+	SheetIngestPipeline();
+
+	// Tuning; the defaults keep roughly 2 MB of sheet data in flight
+	void setChunkSize(int bytes) { m_chunkSize = bytes; }
+	void setQueueCapacity(int items) { m_queueCapacity = items; }
+
+	// Stop after the first rows (0 = whole sheet); inflate then works in small chunks
+	// and stops shortly after the limit instead of decompressing the whole part
+	void setRowLimit(int rows) { m_rowLimit = rows; }
+
+	bool run(ZipArchive* archive, const QString& partPath, XlsxSheet* sheet,
+		const QStringList& sharedStrings, const QSet<int>& dateStyles, bool date1904);
+
+	// Statistics of the last run
+	QVector<StageStats> stageStats() const { return m_stats; }
+	qint64 wallNs() const { return m_wallNs; }
+	QString statsReport() const;
+
+	QString getLastError() const { return m_lastError; }
+
+private:
+	int m_chunkSize;
+	int m_queueCapacity;
+	int m_rowLimit;
+	QVector<StageStats> m_stats;
+	qint64 m_wallNs;
+	QString m_lastError;
+};
+
+#endif // SHEETINGESTPIPELINE_H
@@ -0,0 +1,209 @@
+#include "SheetPrefetcher.h"
+#include "MemoryAccounting.h"
+#include "Metrics.h"
+#include <QDebug>
+#include <QThread>
+#include <QMutexLocker>
+
+SheetPrefetcher::SheetPrefetcher()
+	: m_idleMs(500)
+	, m_memoryLimit(0)
+	, m_lastInteractionMs(0)
+{
+	m_clock.start();
+}
+
+SheetPrefetcher::~SheetPrefetcher()
+{
+	stop();
+	for (QThread* thread : m_threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+}
+
+void SheetPrefetcher::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [SheetPrefetcher]:" << message;
+}
+
+void SheetPrefetcher::start(const QSharedPointer<const Workbook>& workbook, const QStringList& sheetNames)
+{
+	stop();
+	deleteFinishedThreads();
+
+	if (!workbook || sheetNames.isEmpty())
+	{
+		return;
+	}
+
+	QSharedPointer<Run> run(new Run());
+	run->workbook = workbook;
+	run->sheetNames = sheetNames;
+	run->idleMs = m_idleMs;
+	run->memoryLimit = m_memoryLimit;
+	run->parseNs = 0;
+	m_run = run;
+
+	// The idle time counts from now, the first sheet is on screen by then
+	noteInteraction();
+
+	debugPrint("Prefetching " + QString::number(sheetNames.size()) + " sheets of " + workbook->filePath());
+	QThread* thread = QThread::create([this, run]() { execute(run); });
+	m_threads.append(thread);
+	thread->start(QThread::LowestPriority);
+}
+
+void SheetPrefetcher::stop()
+{
+	if (!m_run)
+	{
+		return;
+	}
+
+	// The thread leaves after its current sheet; it holds its own reference to the run
+	m_run->cancelled.storeRelease(1);
+	{
+		QMutexLocker locker(&m_run->mutex);
+		if (m_run->stopReason.isEmpty())
+		{
+			m_run->stopReason = "stopped";
+		}
+		m_run->wake.wakeAll();
+	}
+	m_run.clear();
+}
+
+void SheetPrefetcher::noteInteraction()
+{
+	m_lastInteractionMs.storeRelease(m_clock.elapsed());
+}
+
+bool SheetPrefetcher::isRunning() const
+{
+	if (!m_run)
+	{
+		return false;
+	}
+
+	QMutexLocker locker(&m_run->mutex);
+	return m_run->stopReason.isEmpty();
+}
+
+QString SheetPrefetcher::report() const
+{
+	if (!m_run)
+	{
+		return "Prefetch: idle";
+	}
+
+	QMutexLocker locker(&m_run->mutex);
+	QString report = "Prefetch: " + QString::number(m_run->prefetched.size()) + " of " +
+		QString::number(m_run->sheetNames.size()) + " sheets parsed in the background";
+	if (!m_run->prefetched.isEmpty())
+	{
+		report += " in " + QString::number(m_run->parseNs / 1e6, 'f', 0) + " ms";
+	}
+	report += m_run->stopReason.isEmpty() ? QString(", running") : ", " + m_run->stopReason;
+	if (m_run->memoryLimit > 0)
+	{
+		report += " (limit " + MemoryAccounting::formatBytes(m_run->memoryLimit) + ")";
+	}
+	return report;
+}
+
+bool SheetPrefetcher::waitForIdle(Run* run)
+{
+	QMutexLocker locker(&run->mutex);
+	for (;;)
+	{
+		if (run->cancelled.loadAcquire())
+		{
+			return false;
+		}
+
+		qint64 idle = m_clock.elapsed() - m_lastInteractionMs.loadAcquire();
+		if (idle >= run->idleMs)
+		{
+			return true;
+		}
+		run->wake.wait(&run->mutex, quint64(run->idleMs - idle));
+	}
+}
+
+void SheetPrefetcher::execute(const QSharedPointer<Run>& run)
+{
+	auto parsedBytes = [&run]() {
+		MemoryAccounting accounting;
+		run->workbook->accountMemory(&accounting);
+		return accounting.heapTotal();
+	};
+
+	QString stopReason = "all sheets parsed";
+	for (const QString& sheetName : run->sheetNames)
+	{
+		if (!waitForIdle(run.data()))
+		{
+			return;
+		}
+
+		// Selected by the user in the meantime
+		if (run->workbook->parsedSheet(sheetName))
+		{
+			continue;
+		}
+
+		if (run->memoryLimit > 0 && parsedBytes() >= run->memoryLimit)
+		{
+			stopReason = "memory limit reached";
+			break;
+		}
+
+		QElapsedTimer timer;
+		timer.start();
+		QString error;
+		QSharedPointer<const SheetData> sheet = run->workbook->sheet(sheetName, &error);
+		qint64 parseNs = timer.nsecsElapsed();
+		if (!sheet)
+		{
+			// Reported again when the user selects it
+			debugPrint("WARNING: Could not prefetch " + sheetName + " - " + error);
+			continue;
+		}
+		sheet.clear();
+
+		// Speculative data never pushes the workbook over the limit
+		if (run->memoryLimit > 0 && parsedBytes() > run->memoryLimit)
+		{
+			run->workbook->releaseSheet(sheetName);
+			stopReason = "memory limit reached";
+			break;
+		}
+
+		Metrics::recordNs("prefetch.sheet", parseNs);
+		QMutexLocker locker(&run->mutex);
+		run->prefetched.append(sheetName);
+		run->parseNs += parseNs;
+	}
+
+	QMutexLocker locker(&run->mutex);
+	if (run->stopReason.isEmpty())
+	{
+		run->stopReason = stopReason;
+	}
+	debugPrint("Prefetched " + QString::number(run->prefetched.size()) + " sheets in " +
+		QString::number(run->parseNs / 1e6, 'f', 1) + " ms, " + run->stopReason);
+}
+
+void SheetPrefetcher::deleteFinishedThreads()
+{
+	for (int i = m_threads.size() - 1; i >= 0; i--)
+	{
+		if (m_threads[i]->isFinished())
+		{
+			delete m_threads[i];
+			m_threads.remove(i);
+		}
+	}
+}
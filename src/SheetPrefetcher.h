@@ -0,0 +1,73 @@
+#ifndef SHEETPREFETCHER_H
+#define SHEETPREFETCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include "Workbook.h"
+
+class QThread;
+
+// Parses the sheets the user has not selected yet on one low-priority thread,
+// so switching sheets finds them in the workbook's parse cache. A sheet is only
+// started once the user has been idle for a while; a sheet already being parsed
+// runs to the end. Prefetching stops for good when the workbook's parsed data
+// reaches the memory limit, and a sheet that took it over the limit is dropped
+// again. A stopped run finishes its current sheet in the background and never
+// blocks the caller.
+class SheetPrefetcher
+{
+public:
+	SheetPrefetcher();
+	~SheetPrefetcher(); // Waits for every run to finish its current sheet
+
+	void setIdleMs(int idleMs) { m_idleMs = idleMs; }
+	void setMemoryLimit(qint64 bytes) { m_memoryLimit = bytes; } // 0 = no limit
+
+	// Stops any earlier run and prefetches the given sheets in order
+	void start(const QSharedPointer<const Workbook>& workbook, const QStringList& sheetNames);
+	void stop();
+
+	// Called on every user input; holds back the next sheet for the idle time
+	void noteInteraction();
+
+	bool isRunning() const;
+	QString report() const; // Sheets prefetched, time spent and why the run ended
+
+private:
+	struct Run
+	{
+		QSharedPointer<const Workbook> workbook;
+		QStringList sheetNames;
+		int idleMs;
+		qint64 memoryLimit;
+
+		QAtomicInt cancelled;
+		QMutex mutex;
+		QWaitCondition wake;
+		QStringList prefetched;
+		qint64 parseNs;
+		QString stopReason; // Empty while running
+	};
+
+	QSharedPointer<Run> m_run;
+	QVector<QThread*> m_threads; // Stopped runs may still be finishing a sheet
+	int m_idleMs;
+	qint64 m_memoryLimit;
+
+	// Milliseconds on m_clock of the last user input, read by the worker
+	QElapsedTimer m_clock;
+	QAtomicInteger<qint64> m_lastInteractionMs;
+
+	void execute(const QSharedPointer<Run>& run);
+	bool waitForIdle(Run* run);
+	void deleteFinishedThreads();
+	void debugPrint(const QString& message) const;
+};
+
+#endif // SHEETPREFETCHER_H
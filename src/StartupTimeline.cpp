@@ -0,0 +1,119 @@
+#include "StartupTimeline.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDebug>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+namespace
+{
+	struct TimelineState
+	{
+		QElapsedTimer timer;
+		double offsetMs; // Process start -> first mark
+		QVector<StartupTimeline::Event> events;
+	};
+
+	TimelineState& state()
+	{
+		static TimelineState timeline;
+		return timeline;
+	}
+}
+
+void StartupTimeline::mark(const QString& name)
+{
+	TimelineState& timeline = state();
+	if (!timeline.timer.isValid())
+	{
+		timeline.timer.start();
+		timeline.offsetMs = processStartOffsetMs();
+	}
+
+	Event event;
+	event.name = name;
+	event.ms = timeline.offsetMs + timeline.timer.nsecsElapsed() / 1e6;
+	timeline.events.append(event);
+
+	qDebug() << "DEBUG [StartupTimeline]:" << name << QString::number(event.ms, 'f', 1) + " ms";
+}
+
+double StartupTimeline::elapsedMs()
+{
+	const TimelineState& timeline = state();
+	return timeline.timer.isValid() ? timeline.offsetMs + timeline.timer.nsecsElapsed() / 1e6 : 0;
+}
+
+QVector<StartupTimeline::Event> StartupTimeline::events()
+{
+	return state().events;
+}
+
+QString StartupTimeline::report(double targetMs)
+{
+	const QVector<Event>& events = state().events;
+	QString text = QString("%1 %2 %3\n").arg(QString("milestone"), -24).arg(QString("ms"), 9).arg(QString("+ms"), 9);
+
+	double previous = 0;
+	for (const Event& event : events)
+	{
+		text += QString("%1 %2 %3\n").arg(event.name, -24)
+			.arg(QString::number(event.ms, 'f', 1), 9)
+			.arg(QString::number(event.ms - previous, 'f', 1), 9);
+		previous = event.ms;
+	}
+
+	if (targetMs > 0 && !events.isEmpty())
+	{
+		double total = events.last().ms;
+		text += QString("\nTime to interactive %1 ms, target %2 ms: %3")
+			.arg(QString::number(total, 'f', 1), QString::number(targetMs, 'f', 0), total <= targetMs ? QString("met") : QString("MISSED"));
+	}
+
+	return text;
+}
+
+double StartupTimeline::processStartOffsetMs()
+{
+#if defined(Q_OS_WIN)
+	FILETIME creation, exitTime, kernel, user, now;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user))
+	{
+		return 0;
+	}
+	GetSystemTimeAsFileTime(&now);
+
+	ULARGE_INTEGER created, current;
+	created.LowPart = creation.dwLowDateTime;
+	created.HighPart = creation.dwHighDateTime;
+	current.LowPart = now.dwLowDateTime;
+	current.HighPart = now.dwHighDateTime;
+	return current.QuadPart > created.QuadPart ? (current.QuadPart - created.QuadPart) / 1e4 : 0; // 100 ns units
+#elif defined(Q_OS_LINUX)
+	// Field 22 of /proc/self/stat is the start time in clock ticks since boot
+	QFile stat("/proc/self/stat");
+	QFile uptime("/proc/uptime");
+	if (!stat.open(QIODevice::ReadOnly) || !uptime.open(QIODevice::ReadOnly))
+	{
+		return 0;
+	}
+
+	// The command name (field 2) may contain spaces, count fields after its closing parenthesis
+	QByteArray statLine = stat.readAll();
+	QList<QByteArray> fields = statLine.mid(statLine.lastIndexOf(')') + 2).split(' ');
+	if (fields.size() < 20)
+	{
+		return 0;
+	}
+
+	double startMs = fields.at(19).toDouble() * 1000.0 / sysconf(_SC_CLK_TCK);
+	double uptimeMs = uptime.readAll().split(' ').value(0).toDouble() * 1000.0;
+	return uptimeMs > startMs ? uptimeMs - startMs : 0;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,30 @@
+#ifndef STARTUPTIMELINE_H
+#define STARTUPTIMELINE_H
+
+#include <QString>
+#include <QVector>
+
+// Startup milestones measured from process creation (where the OS reports it,
+// otherwise from the first mark). Marks are recorded on the GUI thread:
+// main -> application -> window constructed -> shown -> first paint -> interactive.
+class StartupTimeline
+{
+public:
+	struct Event
+	{
+		QString name;
+		double ms; // Since process start
+	};
+
+	static void mark(const QString& name);
+	static double elapsedMs();
+	static QVector<Event> events();
+
+	// One line per milestone with its delta; flags the total against targetMs when set
+	static QString report(double targetMs = 0);
+
+private:
+	static double processStartOffsetMs();
+};
+
+#endif // STARTUPTIMELINE_H
@@ -0,0 +1,992 @@
+#include "Workbook.h"
+#include "ZipArchive.h"
+#include "SheetIngestPipeline.h"
+#include "MemoryAccounting.h"
+#include "CsvReader.h"
+#include "BiffWorkbook.h"
+#include "Metrics.h"
+#include "DataServer.h"
+#include "DataServerClient.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QXmlStreamReader>
+#include <QMutexLocker>
+#include <QtMath>
+
+Workbook::Workbook()
+	: m_rowLimit(0)
+	, m_package(nullptr)
+	, m_date1904(false)
+	, m_newTemplate(false)
+	, m_delimited(false)
+	, m_biff(nullptr)
+	, m_fileSize(0)
+	, m_sharedPartsLoaded(0)
+{
+}
+
+Workbook::~Workbook()
+{
+	delete m_package;
+	delete m_biff;
+
+	// Sheets already mapped stay readable, the server only deletes the image files.
+	// The last handle may go on any thread, so the release does not wait for the reply
+	if (!m_servedId.isEmpty())
+	{
+		QJsonObject request;
+		request.insert("op", "release");
+		request.insert("workbook", m_servedId);
+		DataServerClient::post(request);
+	}
+}
+
+void Workbook::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [Workbook]:" << message;
+}
+
+QSharedPointer<Workbook> Workbook::open(const QString& filePath, int rowLimit, QString* error)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	QSharedPointer<Workbook> workbook(new Workbook());
+	workbook->m_rowLimit = rowLimit;
+
+	// Partial ingests are cheap and stay local
+	QString serverError;
+	if (rowLimit == 0 && DataServerClient::isConnected() && workbook->openServed(filePath, &serverError))
+	{
+		workbook->debugPrint("Opened " + filePath + " through the data server, sheets: " + workbook->m_sheetNames.join(","));
+		Metrics::recordNs("load.open", timer.nsecsElapsed());
+		return workbook;
+	}
+	if (!serverError.isEmpty())
+	{
+		workbook->debugPrint("WARNING: Data server could not open " + filePath + ", reading it here - " + serverError);
+	}
+
+	if (isDelimitedText(filePath))
+	{
+		if (!workbook->openDelimited(filePath, error))
+		{
+			return QSharedPointer<Workbook>();
+		}
+	}
+	else if (isLegacyXlsFile(filePath))
+	{
+		if (!workbook->openLegacyXls(filePath, error))
+		{
+			return QSharedPointer<Workbook>();
+		}
+	}
+	else if (!workbook->openPackage(filePath, error) || !workbook->readStructure(error))
+	{
+		return QSharedPointer<Workbook>();
+	}
+
+	workbook->debugPrint("Opened " + filePath + " with sheets: " + workbook->m_sheetNames.join(","));
+	Metrics::recordNs("load.open", timer.nsecsElapsed());
+	return workbook;
+}
+
+bool Workbook::openPackage(const QString& filePath, QString* error)
+{
+	// Index the zip package, sheets are only parsed once they are requested
+	ZipArchive* zip = new ZipArchive();
+	if (!zip->open(filePath))
+	{
+		*error = "Failed to open Excel package: " + zip->getLastError();
+		delete zip;
+		return false;
+	}
+
+	m_package = zip;
+	m_filePath = filePath;
+
+	for (const QString& name : m_package->entryNames())
+	{
+		m_partCrcs.insert(name, m_package->findEntry(name)->crc32);
+	}
+	return true;
+}
+
+bool Workbook::isDelimitedText(const QString& filePath)
+{
+	QString suffix = QFileInfo(filePath).suffix().toLower();
+	return suffix == "csv" || suffix == "tsv" || suffix == "txt";
+}
+
+bool Workbook::openDelimited(const QString& filePath, QString* error)
+{
+	QFileInfo fileInfo(filePath);
+	if (!fileInfo.isReadable())
+	{
+		*error = "Failed to open text file: " + filePath + " is not readable";
+		return false;
+	}
+
+	// One sheet named after the file; the "part" is the file itself
+	m_filePath = filePath;
+	m_delimited = true;
+	m_fileSize = fileInfo.size();
+	m_fileModified = fileInfo.lastModified();
+
+	QString name = fileInfo.completeBaseName();
+	m_sheetNames.append(name);
+	m_sheetParts.insert(name, fileInfo.fileName());
+
+	// Rig exports carry the test name in the file name, e.g. "Rig3 Rapid Puff Lifetime Test.csv"
+	m_newTemplate = isNewTemplateSheet(name, true);
+	return true;
+}
+
+bool Workbook::openServed(const QString& filePath, QString* error)
+{
+	QJsonObject request;
+	request.insert("op", "open");
+	request.insert("path", QFileInfo(filePath).absoluteFilePath());
+	QJsonObject reply = DataServerClient::request(request, error);
+	if (!error->isEmpty())
+	{
+		return false;
+	}
+
+	// Sheets are named after themselves, there are no parts to read
+	m_filePath = filePath;
+	m_servedId = reply.value("workbook").toString();
+	m_newTemplate = reply.value("newTemplate").toBool();
+	for (const QJsonValue& name : reply.value("sheets").toArray())
+	{
+		m_sheetNames.append(name.toString());
+		m_sheetParts.insert(name.toString(), name.toString());
+	}
+	return true;
+}
+
+bool Workbook::isLegacyXlsFile(const QString& filePath)
+{
+	return QFileInfo(filePath).suffix().compare("xls", Qt::CaseInsensitive) == 0;
+}
+
+bool Workbook::openLegacyXls(const QString& filePath, QString* error)
+{
+	BiffWorkbook* biff = new BiffWorkbook();
+	if (!biff->open(filePath))
+	{
+		*error = "Failed to open Excel 97-2003 workbook: " + biff->getLastError();
+		delete biff;
+		return false;
+	}
+
+	QFileInfo fileInfo(filePath);
+	m_biff = biff;
+	m_filePath = filePath;
+	m_fileSize = fileInfo.size();
+	m_fileModified = fileInfo.lastModified();
+	m_date1904 = biff->date1904();
+
+	// Sheets live in the one workbook stream; the "part" names the sheet within it
+	for (const QString& name : biff->sheetNames())
+	{
+		m_sheetNames.append(name);
+		m_sheetParts.insert(name, "Workbook/" + name);
+		m_newTemplate = m_newTemplate || isNewTemplateSheet(name, false);
+	}
+	return true;
+}
+
+bool Workbook::isNewTemplateSheet(const QString& sheetName, bool partialMatch)
+{
+	// The December 2025 template is recognised by its test sheets; otherwise it is
+	// likely the January 2025 one, whose columns 1-9 are identical
+	static const char* newTemplateIndicators[] = {
+		"Long Puff lifetime Test",
+		"Rapid Puff Lifetime Test",
+		"Temperature Cycling Test #1",
+		"Temperature Cycling Teset #2"
+	};
+	for (const char* indicator : newTemplateIndicators)
+	{
+		if (partialMatch ? sheetName.contains(QLatin1String(indicator), Qt::CaseInsensitive)
+			: sheetName.compare(QLatin1String(indicator), Qt::CaseInsensitive) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+QString Workbook::resolvePartPath(const QString& basePart, const QString& target)
+{
+	// Absolute targets are relative to the package root
+	if (target.startsWith('/'))
+	{
+		return target.mid(1);
+	}
+
+	// Relative targets are relative to the folder of the source part
+	QString folder = basePart.section('/', 0, -2);
+	QStringList parts = folder.isEmpty() ? QStringList() : folder.split('/');
+
+	for (const QString& segment : target.split('/'))
+	{
+		if (segment == "..")
+		{
+			if (!parts.isEmpty())
+			{
+				parts.removeLast();
+			}
+		}
+		else if (!segment.isEmpty() && segment != ".")
+		{
+			parts.append(segment);
+		}
+	}
+
+	return parts.join('/');
+}
+
+bool Workbook::readStructure(QString* error)
+{
+	// Locate the workbook part through the package relationships
+	QString workbookPart = "xl/workbook.xml";
+	{
+		QXmlStreamReader reader(readPart("_rels/.rels"));
+		while (!reader.atEnd())
+		{
+			if (reader.readNext() == QXmlStreamReader::StartElement && reader.name() == QLatin1String("Relationship") &&
+				reader.attributes().value(QLatin1String("Type")).endsWith(QLatin1String("/officeDocument")))
+			{
+				workbookPart = resolvePartPath(QString(), reader.attributes().value(QLatin1String("Target")).toString());
+				break;
+			}
+		}
+	}
+
+	QByteArray workbookXml = readPart(workbookPart);
+	if (workbookXml.isEmpty())
+	{
+		*error = "Workbook part not found: " + workbookPart;
+		return false;
+	}
+
+	// Relationship id -> worksheet part, plus the shared strings and styles parts
+	QString relsPart = workbookPart.section('/', 0, -2) + "/_rels/" + workbookPart.section('/', -1) + ".rels";
+	m_structureParts = QStringList() << "_rels/.rels" << workbookPart << relsPart;
+	QHash<QString, QString> relTargets;
+	m_sharedStringsPart = "xl/sharedStrings.xml";
+	m_stylesPart = "xl/styles.xml";
+	{
+		QXmlStreamReader reader(readPart(relsPart));
+		while (!reader.atEnd())
+		{
+			if (reader.readNext() == QXmlStreamReader::StartElement && reader.name() == QLatin1String("Relationship"))
+			{
+				QXmlStreamAttributes attributes = reader.attributes();
+				QString target = resolvePartPath(workbookPart, attributes.value(QLatin1String("Target")).toString());
+				QStringRef type = attributes.value(QLatin1String("Type"));
+
+				if (type.endsWith(QLatin1String("/sharedStrings")))
+				{
+					m_sharedStringsPart = target;
+				}
+				else if (type.endsWith(QLatin1String("/styles")))
+				{
+					m_stylesPart = target;
+				}
+				relTargets.insert(attributes.value(QLatin1String("Id")).toString(), target);
+			}
+		}
+	}
+
+	// Sheet list in workbook order
+	QXmlStreamReader reader(workbookXml);
+	while (!reader.atEnd())
+	{
+		if (reader.readNext() != QXmlStreamReader::StartElement)
+		{
+			continue;
+		}
+
+		if (reader.name() == QLatin1String("workbookPr"))
+		{
+			QStringRef date1904 = reader.attributes().value(QLatin1String("date1904"));
+			m_date1904 = (date1904 == QLatin1String("1") || date1904 == QLatin1String("true"));
+		}
+		else if (reader.name() == QLatin1String("sheet"))
+		{
+			QXmlStreamAttributes attributes = reader.attributes();
+			QString relId;
+			for (const QXmlStreamAttribute& attribute : attributes)
+			{
+				// r:id lives in the officeDocument relationships namespace
+				if (attribute.name() == QLatin1String("id"))
+				{
+					relId = attribute.value().toString();
+				}
+			}
+
+			QString name = attributes.value(QLatin1String("name")).toString();
+			m_sheetNames.append(name);
+			m_sheetParts.insert(name, relTargets.value(relId));
+		}
+	}
+
+	if (reader.hasError())
+	{
+		*error = "Failed to read workbook structure: " + reader.errorString();
+		return false;
+	}
+
+	for (const QString& name : m_sheetNames)
+	{
+		if (isNewTemplateSheet(name, false))
+		{
+			m_newTemplate = true;
+			break;
+		}
+	}
+
+	return true;
+}
+
+Workbook::ReopenResult Workbook::reopen() const
+{
+	if (!m_servedId.isEmpty())
+	{
+		return reopenServed();
+	}
+	if (!m_package)
+	{
+		return reopenWholeFile();
+	}
+
+	ReopenResult result;
+	result.unchanged = false;
+	result.structureChanged = false;
+
+	QSharedPointer<Workbook> workbook(new Workbook());
+	workbook->m_rowLimit = m_rowLimit;
+	if (!workbook->openPackage(m_filePath, &result.error))
+	{
+		// Usually a writer is still in the middle of saving
+		return result;
+	}
+
+	// Compare the new central directory against this one; the CRC covers the uncompressed part
+	QSet<QString> changedParts;
+	for (QHash<QString, quint32>::const_iterator it = workbook->m_partCrcs.constBegin(); it != workbook->m_partCrcs.constEnd(); ++it)
+	{
+		QHash<QString, quint32>::const_iterator old = m_partCrcs.constFind(it.key());
+		if (old == m_partCrcs.constEnd() || old.value() != it.value())
+		{
+			changedParts.insert(it.key());
+		}
+	}
+	for (QHash<QString, quint32>::const_iterator it = m_partCrcs.constBegin(); it != m_partCrcs.constEnd(); ++it)
+	{
+		if (!workbook->m_partCrcs.contains(it.key()))
+		{
+			changedParts.insert(it.key());
+		}
+	}
+
+	if (changedParts.isEmpty())
+	{
+		result.unchanged = true;
+		return result;
+	}
+
+	debugPrint("Changed parts: " + QStringList(changedParts.values()).join(", "));
+
+	for (const QString& part : m_structureParts)
+	{
+		if (changedParts.contains(part))
+		{
+			result.structureChanged = true;
+			return result;
+		}
+	}
+
+	if (!workbook->readStructure(&result.error))
+	{
+		return result;
+	}
+
+	// Shared string indices and style ids may have moved, which affects every parsed sheet
+	bool sharedPartsChanged = changedParts.contains(m_sharedStringsPart) || changedParts.contains(m_stylesPart);
+	if (!sharedPartsChanged && m_sharedPartsLoaded.loadAcquire())
+	{
+		workbook->m_sharedStrings = m_sharedStrings;
+		workbook->m_dateStyles = m_dateStyles;
+		workbook->m_sharedPartsLoaded.storeRelease(1);
+	}
+
+	// Sheets that were never parsed are parsed from the new package on demand
+	QHash<QString, QSharedPointer<const SheetData>> parsed;
+	{
+		QMutexLocker locker(&m_cacheMutex);
+		parsed = m_parsed;
+	}
+
+	for (QHash<QString, QSharedPointer<const SheetData>>::const_iterator it = parsed.constBegin(); it != parsed.constEnd(); ++it)
+	{
+		QString part = workbook->partPath(it.key());
+		if (!sharedPartsChanged && !changedParts.contains(part))
+		{
+			workbook->m_parsed.insert(it.key(), it.value());
+			continue;
+		}
+
+		QString error;
+		QSharedPointer<const SheetData> sheet = workbook->parseSheet(it.key(), &error);
+		if (!sheet)
+		{
+			// Keep the previous cells and retry this part on the next change
+			result.error = error;
+			workbook->m_parsed.insert(it.key(), it.value());
+			workbook->m_partCrcs.remove(part);
+			continue;
+		}
+
+		workbook->m_parsed.insert(it.key(), sheet);
+		result.changedSheets.append(it.key());
+	}
+
+	result.workbook = workbook;
+	return result;
+}
+
+Workbook::ReopenResult Workbook::reopenWholeFile() const
+{
+	ReopenResult result;
+	result.unchanged = false;
+	result.structureChanged = false;
+
+	// Without part checksums, size and modification time tell a change
+	QFileInfo fileInfo(m_filePath);
+	if (fileInfo.size() == m_fileSize && fileInfo.lastModified() == m_fileModified)
+	{
+		result.unchanged = true;
+		return result;
+	}
+
+	QSharedPointer<Workbook> workbook(new Workbook());
+	workbook->m_rowLimit = m_rowLimit;
+	if (!(m_delimited ? workbook->openDelimited(m_filePath, &result.error) : workbook->openLegacyXls(m_filePath, &result.error)))
+	{
+		// Usually a writer is still in the middle of saving
+		return result;
+	}
+
+	if (workbook->m_sheetNames != m_sheetNames)
+	{
+		result.structureChanged = true;
+		return result;
+	}
+
+	// Every parsed sheet may have changed, so all of them are parsed again right away
+	QHash<QString, QSharedPointer<const SheetData>> parsed;
+	{
+		QMutexLocker locker(&m_cacheMutex);
+		parsed = m_parsed;
+	}
+
+	for (QHash<QString, QSharedPointer<const SheetData>>::const_iterator it = parsed.constBegin(); it != parsed.constEnd(); ++it)
+	{
+		QString error;
+		QSharedPointer<const SheetData> sheet = workbook->parseSheet(it.key(), &error);
+		if (!sheet)
+		{
+			// Keep the previous cells and retry on the next change
+			result.error = error;
+			workbook->m_parsed.insert(it.key(), it.value());
+			workbook->m_fileSize = -1;
+			continue;
+		}
+
+		workbook->m_parsed.insert(it.key(), sheet);
+		result.changedSheets.append(it.key());
+	}
+
+	result.workbook = workbook;
+	return result;
+}
+
+Workbook::ReopenResult Workbook::reopenServed() const
+{
+	ReopenResult result;
+	result.unchanged = false;
+	result.structureChanged = false;
+
+	// The server compares the file against the version it serves
+	QSharedPointer<Workbook> workbook(new Workbook());
+	workbook->m_rowLimit = m_rowLimit;
+	if (!workbook->openServed(m_filePath, &result.error))
+	{
+		return result;
+	}
+
+	if (workbook->m_servedId == m_servedId)
+	{
+		// The extra lease is released with the new workbook
+		result.unchanged = true;
+		return result;
+	}
+
+	if (workbook->m_sheetNames != m_sheetNames)
+	{
+		result.structureChanged = true;
+		return result;
+	}
+
+	// Every mapped sheet belongs to the old version, so all of them are fetched again right away
+	QHash<QString, QSharedPointer<const SheetData>> parsed;
+	{
+		QMutexLocker locker(&m_cacheMutex);
+		parsed = m_parsed;
+	}
+
+	for (QHash<QString, QSharedPointer<const SheetData>>::const_iterator it = parsed.constBegin(); it != parsed.constEnd(); ++it)
+	{
+		QString error;
+		QSharedPointer<const SheetData> sheet = workbook->parseSheet(it.key(), &error);
+		if (!sheet)
+		{
+			result.error = error;
+			workbook->m_parsed.insert(it.key(), it.value());
+			continue;
+		}
+
+		workbook->m_parsed.insert(it.key(), sheet);
+		result.changedSheets.append(it.key());
+	}
+
+	result.workbook = workbook;
+	return result;
+}
+
+QStringList Workbook::sheetNames() const
+{
+	return m_sheetNames;
+}
+
+QByteArray Workbook::readPart(const QString& partPath) const
+{
+	// An owning copy: the part is only mapped while it is read
+	return m_package ? m_package->entryData(partPath) : QByteArray();
+}
+
+void Workbook::loadSharedParts() const
+{
+	if (m_sharedPartsLoaded.loadAcquire())
+	{
+		return;
+	}
+
+	QMutexLocker locker(&m_sharedPartsMutex);
+	if (m_sharedPartsLoaded.loadAcquire())
+	{
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	m_sharedStrings = XlsxSheet::parseSharedStrings(readPart(m_sharedStringsPart));
+	m_dateStyles = XlsxSheet::parseDateStyles(readPart(m_stylesPart));
+	m_sharedPartsLoaded.storeRelease(1);
+	Metrics::recordNs("load.sharedParts", timer.nsecsElapsed());
+
+	debugPrint("Loaded " + QString::number(m_sharedStrings.size()) + " shared strings and " +
+		QString::number(m_dateStyles.size()) + " date styles in " + QString::number(timer.elapsed()) + " ms");
+}
+
+const QStringList& Workbook::sharedStrings() const
+{
+	loadSharedParts();
+	return m_sharedStrings;
+}
+
+const QSet<int>& Workbook::dateStyles() const
+{
+	loadSharedParts();
+	return m_dateStyles;
+}
+
+QSharedPointer<const SheetData> Workbook::sheet(const QString& name, QString* error) const
+{
+	QMutexLocker locker(&m_cacheMutex);
+
+	// A sheet is parsed by one thread at a time, the others wait for its result
+	while (!m_parsed.contains(name) && m_parsing.contains(name))
+	{
+		m_parseFinished.wait(&m_cacheMutex);
+	}
+
+	QSharedPointer<const SheetData> sheet = m_parsed.value(name);
+	if (sheet)
+	{
+		return sheet;
+	}
+
+	// Parse outside the lock so other sheets stay available meanwhile
+	m_parsing.insert(name);
+	locker.unlock();
+
+	QString parseError;
+	sheet = parseSheet(name, &parseError);
+
+	locker.relock();
+	m_parsing.remove(name);
+	if (sheet)
+	{
+		m_parsed.insert(name, sheet);
+	}
+	m_parseFinished.wakeAll();
+
+	if (!sheet && error)
+	{
+		*error = parseError;
+	}
+	return sheet;
+}
+
+QSharedPointer<const SheetData> Workbook::parsedSheet(const QString& name) const
+{
+	QMutexLocker locker(&m_cacheMutex);
+	return m_parsed.value(name);
+}
+
+QStringList Workbook::parsedSheetNames() const
+{
+	QMutexLocker locker(&m_cacheMutex);
+	return m_parsed.keys();
+}
+
+qint64 Workbook::releaseSheet(const QString& name) const
+{
+	QSharedPointer<const SheetData> sheet;
+	{
+		QMutexLocker locker(&m_cacheMutex);
+		sheet = m_parsed.take(name);
+	}
+
+	return sheet ? sheet->cells.memoryBytes() : 0;
+}
+
+QSharedPointer<const SheetData> Workbook::parseSheet(const QString& name, QString* error) const
+{
+	if (!m_sheetParts.contains(name))
+	{
+		*error = "Sheet not found: " + name;
+		return QSharedPointer<const SheetData>();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Parsed once by the data server for every viewer; this only maps its image
+	if (!m_servedId.isEmpty())
+	{
+		QJsonObject request;
+		request.insert("op", "sheet");
+		request.insert("workbook", m_servedId);
+		request.insert("name", name);
+		QJsonObject reply = DataServerClient::request(request, error);
+		if (!error->isEmpty())
+		{
+			*error = "Data server could not serve sheet " + name + ": " + *error;
+			return QSharedPointer<const SheetData>();
+		}
+
+		QSharedPointer<const SheetData> sheet = DataServer::mapSheetImage(reply.value("image").toString(), error);
+		Metrics::recordNs("load.served", timer.nsecsElapsed());
+		debugPrint("Mapped sheet " + name + " from the data server (" + MemoryAccounting::formatBytes(qint64(reply.value("bytes").toDouble())) +
+			") in " + QString::number(timer.elapsed()) + " ms");
+		return sheet;
+	}
+
+	QSharedPointer<SheetData> data(new SheetData());
+	data->name = name;
+	QString statsReport;
+
+	if (m_delimited)
+	{
+		// Mapped and parsed in parallel chunks; see CsvReader
+		CsvReader reader;
+		reader.setRowLimit(m_rowLimit);
+		if (!reader.read(m_filePath, &data->cells))
+		{
+			*error = "Failed to read " + name + ": " + reader.getLastError();
+			return QSharedPointer<const SheetData>();
+		}
+		statsReport = reader.statsReport();
+	}
+	else if (m_biff)
+	{
+		// Walks the sheet's records in the workbook stream; see BiffWorkbook
+		BiffWorkbook::ReadStats stats;
+		QString readError;
+		if (!m_biff->readSheet(name, m_rowLimit, &data->cells, &stats, &readError))
+		{
+			*error = "Failed to read sheet " + name + ": " + readError;
+			return QSharedPointer<const SheetData>();
+		}
+		statsReport = "BIFF8 records: " + QString::number(stats.records) + " (" + MemoryAccounting::formatBytes(stats.bytes) +
+			"), " + QString::number(stats.cells) + " cells in " + QString::number(timer.elapsed()) + " ms";
+	}
+	else
+	{
+		loadSharedParts();
+
+		// Inflate, tokenize and convert run overlapped; see SheetIngestPipeline
+		SheetIngestPipeline pipeline;
+		pipeline.setRowLimit(m_rowLimit);
+		if (!pipeline.run(m_package, m_sheetParts.value(name), &data->cells, m_sharedStrings, m_dateStyles, m_date1904))
+		{
+			*error = "Failed to parse sheet " + name + ": " + pipeline.getLastError();
+			return QSharedPointer<const SheetData>();
+		}
+		statsReport = pipeline.statsReport();
+	}
+
+	qint64 parseNs = timer.nsecsElapsed();
+	Metrics::recordNs("load.parse", parseNs);
+
+	// Data rows start below the header row (row 4)
+	data->cells.buildColumns(4);
+	data->ingestReport = "Sheet: " + name + "\n" + statsReport;
+	buildSampleLayout(data.data());
+	Metrics::recordNs("load.columns", timer.nsecsElapsed() - parseNs);
+
+	debugPrint("Parsed sheet " + name + " (" + QString::number(data->cells.rowCount()) + " rows, " +
+		QString::number(data->cells.columnCount()) + " columns) in " + QString::number(timer.elapsed()) + " ms");
+	debugPrint(statsReport);
+
+	return data;
+}
+
+void Workbook::buildSampleLayout(SheetData* data) const
+{
+	// Always 12 columns per sample
+	const int COLUMNS_PER_SAMPLE = 12;
+	int sampleCount = data->cells.columnCount() / COLUMNS_PER_SAMPLE;
+
+	data->metadata.reserve(sampleCount);
+	data->rowCounts.reserve(sampleCount);
+	for (int i = 0; i < sampleCount; i++)
+	{
+		data->metadata.append(extractMetadata(data->cells, i));
+		data->rowCounts.append(countDataRows(data->cells, i * COLUMNS_PER_SAMPLE));
+	}
+
+	debugPrint("Built sample layout for " + data->name + ": " + QString::number(sampleCount) + " samples");
+}
+
+static QString cellString(const XlsxSheet& cells, int row, int col)
+{
+	QVariant value = cells.value(row, col);
+	return value.isNull() ? QString() : value.toString().trimmed();
+}
+
+static double cellDouble(const XlsxSheet& cells, int row, int col)
+{
+	double value = cells.number(row, col);
+	return qIsNaN(value) ? 0.0 : value;
+}
+
+SampleMetadata Workbook::extractMetadata(const XlsxSheet& cells, int sampleIndex) const
+{
+	SampleMetadata metadata;
+
+	// Always use 12 columns per sample
+	const int COLUMNS_PER_SAMPLE = 12;
+	int colOffset = sampleIndex * COLUMNS_PER_SAMPLE;
+
+	debugPrint("Extracting metadata for sample " + QString::number(sampleIndex + 1) +
+		" at column offset " + QString::number(colOffset));
+
+	if (m_newTemplate)
+	{
+		// NEW TEMPLATE (December 2025) structure
+		// Row 1 (index 0): Test name (col A), Date (col C), Sample ID (col E), Heating Technology (col F)
+		metadata.testName = cellString(cells, 0, colOffset + 0);  // Column A + offset
+		metadata.date = cellString(cells, 0, colOffset + 2);      // Column C + offset
+		metadata.sampleID = cellString(cells, 0, colOffset + 4);  // Column E + offset
+		metadata.heatingTechnology = cellString(cells, 0, colOffset + 5); // Column F + offset
+
+		// Row 2 (index 1): Media (col A), Resistance (col C), Power (col E)
+		metadata.media = cellString(cells, 1, colOffset + 0);      // Column A + offset
+		metadata.resistance = cellDouble(cells, 1, colOffset + 2); // Column C + offset
+		// Power will be calculated below or read from E2
+
+		// Row 3 (index 2): Viscosity (col A), Tester (col C), Voltage (col E), Puffing Regime (col G), Initial Oil Mass (col H)
+		metadata.viscosity = cellDouble(cells, 2, colOffset + 0);         // Column A + offset
+		metadata.tester = cellString(cells, 2, colOffset + 2);            // Column C + offset
+		metadata.voltage = cellDouble(cells, 2, colOffset + 4);           // Column E + offset
+		metadata.puffingRegime = cellString(cells, 2, colOffset + 6);     // Column G + offset
+		metadata.initialOilMass = cellDouble(cells, 2, colOffset + 7);    // Column H + offset
+	}
+	else
+	{
+		// OLD TEMPLATE (January 2025) structure
+		// Row 1 (index 0): Test name (col A), Date (col D), Sample ID (col G)
+		metadata.testName = cellString(cells, 0, colOffset + 0);   // Column A + offset
+		metadata.date = cellString(cells, 0, colOffset + 3);       // Column D + offset (Date value)
+		metadata.sampleID = cellString(cells, 0, colOffset + 6);   // Column G + offset (Sample ID value)
+
+		// No heating technology in old template
+		metadata.heatingTechnology = "";
+
+		// Row 2 (index 1): Media value (col B), Resistance value (col D), Puffing Regime value (col I)
+		metadata.media = cellString(cells, 1, colOffset + 1);        // Column B + offset (Media value)
+		metadata.resistance = cellDouble(cells, 1, colOffset + 3);   // Column D + offset (Resistance value)
+		metadata.puffingRegime = cellString(cells, 1, colOffset + 8);// Column I + offset (Puffing Regime value)
+
+		// Row 3 (index 2): Viscosity value (col B), Tester value (col D), Voltage value (col G), Initial Oil Mass (col M or nearby)
+		metadata.viscosity = cellDouble(cells, 2, colOffset + 1);    // Column B + offset (Viscosity value)
+		metadata.tester = cellString(cells, 2, colOffset + 3);       // Column D + offset (Tester value)
+		metadata.voltage = cellDouble(cells, 2, colOffset + 6);      // Column G + offset (Voltage value)
+		metadata.initialOilMass = cellDouble(cells, 2, colOffset + 12); // Column M + offset (Initial Oil Mass value - approximate position)
+	}
+
+	// Calculate power: P = V^2 / (R + Roffset)
+	// For old template, Roffset is always 0 (no heating technology field)
+	double rOffset = 0.0;
+
+	if (!metadata.heatingTechnology.isEmpty())
+	{
+		QString tech = metadata.heatingTechnology.trimmed().toLower();
+		if (tech.contains("t51"))
+		{
+			rOffset = 0.25;
+			debugPrint("Heating technology T51 detected, using Roffset = 0.25");
+		}
+		else if (tech.contains("t58g") || tech.contains("ccell3.0") || tech.contains("ccell 3.0"))
+		{
+			rOffset = 0.78;
+			debugPrint("Heating technology T58G/CCELL3.0 detected, using Roffset = 0.78");
+		}
+	}
+	else
+	{
+		debugPrint("No heating technology (old template), using Roffset = 0.0");
+	}
+
+	// Calculate power only if we have valid voltage and resistance
+	if (metadata.voltage > 0 && metadata.resistance > 0)
+	{
+		double denominator = metadata.resistance + rOffset;
+		if (denominator > 0)
+		{
+			metadata.power = (metadata.voltage * metadata.voltage) / denominator;
+			debugPrint("Calculated power: " + QString::number(metadata.power, 'f', 4) +
+				" W (V=" + QString::number(metadata.voltage) +
+				", R=" + QString::number(metadata.resistance) +
+				", Roffset=" + QString::number(rOffset) + ")");
+		}
+		else
+		{
+			metadata.power = 0.0;
+			debugPrint("Cannot calculate power: denominator is zero");
+		}
+	}
+	else
+	{
+		metadata.power = 0.0;
+		debugPrint("Cannot calculate power: voltage or resistance is zero");
+	}
+
+	debugPrint("Metadata extracted - Sample ID: " + metadata.sampleID +
+		", Tester: " + metadata.tester +
+		", Voltage: " + QString::number(metadata.voltage) +
+		", Power: " + QString::number(metadata.power));
+
+	return metadata;
+}
+
+int Workbook::countDataRows(const XlsxSheet& cells, int startCol)
+{
+	const int COLUMNS_PER_SAMPLE = 12;
+
+	// Data rows from row 5 after the header row, up to the first empty row
+	int rowCount = 0;
+	for (int row = 4; row < cells.rowCount(); row++)
+	{
+		int end = qMin(cells.columnCount(), startCol + COLUMNS_PER_SAMPLE);
+
+		bool isEmpty = true;
+		for (int col = startCol; col < end; col++)
+		{
+			if (!cells.isBlank(row, col))
+			{
+				isEmpty = false;
+				break;
+			}
+		}
+
+		if (isEmpty)
+		{
+			break;
+		}
+		rowCount++;
+	}
+
+	return rowCount;
+}
+
+void Workbook::accountMemory(MemoryAccounting* accounting) const
+{
+	QString fileName = QFileInfo(m_filePath).fileName();
+
+	// Central directory entries and part CRCs, roughly a hash node, an entry and a short name each
+	if (m_package)
+	{
+		qint64 indexBytes = qint64(m_package->entryCount()) * (sizeof(ZipArchive::Entry) + 96) +
+			qint64(m_partCrcs.size()) * 64;
+		accounting->add(MemoryAccounting::Workbook, fileName + " package index", indexBytes);
+	}
+
+	if (m_sharedPartsLoaded.loadAcquire())
+	{
+		accounting->add(MemoryAccounting::Workbook, fileName + " shared strings",
+			MemoryAccounting::stringListBytes(m_sharedStrings) + qint64(m_dateStyles.size()) * 16);
+	}
+
+	QHash<QString, QSharedPointer<const SheetData>> parsed;
+	{
+		QMutexLocker locker(&m_cacheMutex);
+		parsed = m_parsed;
+	}
+
+	for (QHash<QString, QSharedPointer<const SheetData>>::const_iterator it = parsed.constBegin(); it != parsed.constEnd(); ++it)
+	{
+		accounting->add(MemoryAccounting::Sheet, fileName + " / " + it.key(), it.value()->cells.memoryBytes());
+		if (it.value()->cells.mappedBytes() > 0)
+		{
+			accounting->add(MemoryAccounting::Mapped, fileName + " / " + it.key() + " (data server image)", it.value()->cells.mappedBytes());
+		}
+
+		// Sample views share the sheet cells, only the per-sample metadata is extra
+		qint64 bytes = qint64(it.value()->rowCounts.capacity()) * sizeof(int);
+		for (const SampleMetadata& metadata : it.value()->metadata)
+		{
+			bytes += sizeof(SampleMetadata) + MemoryAccounting::stringBytes(metadata.testName) +
+				MemoryAccounting::stringBytes(metadata.date) + MemoryAccounting::stringBytes(metadata.sampleID) +
+				MemoryAccounting::stringBytes(metadata.media) + MemoryAccounting::stringBytes(metadata.tester) +
+				MemoryAccounting::stringBytes(metadata.puffingRegime) + MemoryAccounting::stringBytes(metadata.heatingTechnology);
+		}
+		accounting->add(MemoryAccounting::Sample, fileName + " / " + it.key() + " sample metadata", bytes);
+	}
+
+	// No workbook keeps its file open between reads, a CSV/TSV file is only mapped while it is read
+	if (m_biff)
+	{
+		accounting->add(MemoryAccounting::Workbook, fileName + " shared strings and workbook stream", m_biff->memoryBytes());
+	}
+}
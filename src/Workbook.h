@@ -0,0 +1,168 @@
+#ifndef WORKBOOK_H
+#define WORKBOOK_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QDateTime>
+#include "XlsxSheet.h"
+
+class ZipArchive;
+class BiffWorkbook;
+class MemoryAccounting;
+
+// Metadata rows (1-3) of one 12-column sample block
+struct SampleMetadata
+{
+	QString testName;
+	QString date;
+	QString sampleID;
+	QString media;
+	double resistance;
+	double voltage;
+	double power;
+	double viscosity;
+	QString tester;
+	QString puffingRegime;
+	double initialOilMass;
+	QString heatingTechnology;
+};
+
+// A parsed worksheet together with its sample layout. Built once by Workbook
+// and never modified afterwards, so any number of threads may read it
+struct SheetData
+{
+	QString name;
+	XlsxSheet cells;
+	QVector<SampleMetadata> metadata; // One per 12-column block
+	QVector<int> rowCounts;           // Data rows from row 5 up to the first empty row
+	QString ingestReport;             // Pipeline statistics of the parse
+};
+
+// Shared state of one loaded xlsx package: the entry index, the sheet list,
+// shared strings and styles. None of it changes after open(); worksheets are
+// parsed the first time any thread asks for them and are read-only from then
+// on. Only the parse cache lookup in sheet() takes a lock, readers holding a
+// SheetData never do. A sheet dropped from the cache (releaseSheet, reopen)
+// stays alive for as long as someone still holds it.
+//
+// CSV/TSV exports (.csv, .tsv, .txt) open as a workbook with one sheet named
+// after the file and no package; CsvReader fills the same cell grid. Legacy
+// .xls workbooks are read by BiffWorkbook, also without a package. While the
+// process is connected to a shared data server, whole workbooks are opened
+// through it instead and their sheets are mapped from the server's images.
+class Workbook
+{
+public:
+	// Outcome of re-reading the file after it changed on disk
+	struct ReopenResult
+	{
+		QSharedPointer<Workbook> workbook; // Null when unchanged, restructured or unreadable
+		bool unchanged;                    // No part differs
+		bool structureChanged;             // Sheet list changed, the file has to be loaded again
+		QStringList changedSheets;         // Parsed sheets that were re-parsed
+		QString error;                     // Set on failure, also when a re-parse failed and the old cells were kept
+	};
+
+	~Workbook();
+
+	// Maps the package and reads the sheet list; rowLimit > 0 only ingests the first rows of each sheet
+	static QSharedPointer<Workbook> open(const QString& filePath, int rowLimit, QString* error);
+	static bool isDelimitedText(const QString& filePath);  // Opened with CsvReader, by extension
+	static bool isLegacyXlsFile(const QString& filePath); // Opened with BiffWorkbook, by extension
+
+	// New workbook for the file's current content. Parsed sheets whose parts did not
+	// change are carried over, changed ones are parsed again right away
+	ReopenResult reopen() const;
+
+	QString filePath() const { return m_filePath; }
+	QStringList sheetNames() const;
+	bool hasSheet(const QString& name) const { return m_sheetParts.contains(name); }
+	bool isNewTemplate() const { return m_newTemplate; } // December 2025 template, recognised by its sheet names
+	bool isDelimited() const { return m_delimited; }     // CSV/TSV source without a package
+	bool isLegacyXls() const { return m_biff != nullptr; } // BIFF8 .xls source without a package
+	bool isServed() const { return !m_servedId.isEmpty(); } // Sheets mapped from the data server
+
+	// Thread-safe; parses on first request. Null, with *error set, when the sheet cannot be parsed
+	QSharedPointer<const SheetData> sheet(const QString& name, QString* error = nullptr) const;
+	QSharedPointer<const SheetData> parsedSheet(const QString& name) const; // Null when not parsed
+	QStringList parsedSheetNames() const;
+
+	// Drops a parsed sheet from the cache and returns its estimated size
+	qint64 releaseSheet(const QString& name) const;
+
+	// Package access, used by the parser benchmark; null for CSV/TSV and .xls sources
+	ZipArchive* package() const { return m_package; }
+	QString partPath(const QString& sheetName) const { return m_sheetParts.value(sheetName); }
+	QByteArray readPart(const QString& partPath) const;
+	const QStringList& sharedStrings() const; // Shared strings and styles are loaded on first use
+	const QSet<int>& dateStyles() const;
+	bool date1904() const { return m_date1904; }
+
+	// Package index, shared parts, parsed sheets and their sample metadata
+	void accountMemory(MemoryAccounting* accounting) const;
+
+private:
+	Workbook();
+
+	QString m_filePath;
+	int m_rowLimit;
+	ZipArchive* m_package;
+
+	// Workbook structure, read from workbook.xml and its relationships
+	QStringList m_sheetNames;              // Workbook order
+	QHash<QString, QString> m_sheetParts;  // Sheet name -> part, e.g. xl/worksheets/sheet1.xml
+	QString m_sharedStringsPart;
+	QString m_stylesPart;
+	QStringList m_structureParts;          // Package/workbook parts that define the sheet list
+	bool m_date1904;
+	bool m_newTemplate;
+	QHash<QString, quint32> m_partCrcs;    // Central directory CRC of every part
+
+	// Sources without a package, compared by size and modification time on reopen
+	bool m_delimited;
+	BiffWorkbook* m_biff;
+	qint64 m_fileSize;
+	QDateTime m_fileModified;
+
+	// Version of the file on the data server, released with this workbook
+	QString m_servedId;
+
+	// Loaded once, under m_sharedPartsMutex
+	mutable QMutex m_sharedPartsMutex;
+	mutable QAtomicInt m_sharedPartsLoaded;
+	mutable QStringList m_sharedStrings;
+	mutable QSet<int> m_dateStyles;
+
+	// Parse cache; a sheet being parsed is listed in m_parsing and other threads wait for it
+	mutable QMutex m_cacheMutex;
+	mutable QWaitCondition m_parseFinished;
+	mutable QHash<QString, QSharedPointer<const SheetData>> m_parsed;
+	mutable QSet<QString> m_parsing;
+
+	void debugPrint(const QString& message) const;
+	bool openPackage(const QString& filePath, QString* error);
+	bool readStructure(QString* error);
+	bool openDelimited(const QString& filePath, QString* error);
+	bool openLegacyXls(const QString& filePath, QString* error);
+	bool openServed(const QString& filePath, QString* error);
+	ReopenResult reopenWholeFile() const;
+	ReopenResult reopenServed() const;
+	static bool isNewTemplateSheet(const QString& sheetName, bool partialMatch);
+	void loadSharedParts() const;
+	QSharedPointer<const SheetData> parseSheet(const QString& name, QString* error) const;
+	void buildSampleLayout(SheetData* data) const;
+	SampleMetadata extractMetadata(const XlsxSheet& cells, int sampleIndex) const;
+	static int countDataRows(const XlsxSheet& cells, int startCol);
+	static QString resolvePartPath(const QString& basePart, const QString& target);
+
+	Q_DISABLE_COPY(Workbook)
+};
+
+#endif // WORKBOOK_H
@@ -0,0 +1,599 @@
+#include "WorkbookDiff.h"
+#include "Metrics.h"
+#include <QDebug>
+#include <QThread>
+#include <QAtomicInt>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QtNumeric>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const quint64 BLANK_HASH = 0x6A09E667F3BCC908ULL;
+
+	// Finalizer of MurmurHash3, spreads every input bit over the result
+	inline quint64 mix64(quint64 value)
+	{
+		value ^= value >> 33;
+		value *= 0xFF51AFD7ED558CCDULL;
+		value ^= value >> 33;
+		value *= 0xC4CEB9FE1A85EC53ULL;
+		value ^= value >> 33;
+		return value;
+	}
+
+	inline quint64 numberHash(double number)
+	{
+		// 0.0 and -0.0 show the same
+		if (number == 0.0)
+		{
+			number = 0.0;
+		}
+		quint64 bits;
+		std::memcpy(&bits, &number, sizeof(bits));
+		return mix64(bits);
+	}
+
+	WorkbookDiff::SampleDiff emptySampleDiff(WorkbookDiff::Status status, int beforeSample, int afterSample)
+	{
+		WorkbookDiff::SampleDiff diff;
+		diff.status = status;
+		diff.beforeSample = beforeSample;
+		diff.afterSample = afterSample;
+		diff.addedRows = 0;
+		diff.removedRows = 0;
+		diff.modifiedRows = 0;
+		diff.unchangedRows = 0;
+		return diff;
+	}
+
+	WorkbookDiff::SheetDiff emptySheetDiff(const QString& sheetName, WorkbookDiff::Status status)
+	{
+		WorkbookDiff::SheetDiff diff;
+		diff.sheetName = sheetName;
+		diff.status = status;
+		diff.samplesCompared = 0;
+		diff.rowsCompared = 0;
+		return diff;
+	}
+
+	// Rows with a puff number ordered by it (ties keep their order), and the rows without one
+	void splitByPuff(const ExcelReader::SampleView& sample, QVector<double>* puffs, QVector<int>* numbered, QVector<int>* other)
+	{
+		ExcelReader::ColumnSpan span = sample.column(0);
+		puffs->resize(sample.rowCount());
+		for (int row = 0; row < sample.rowCount(); row++)
+		{
+			double puff = span.numbers && row < span.size ? span.numbers[row] : qQNaN();
+			(*puffs)[row] = puff;
+			if (qIsNaN(puff))
+			{
+				other->append(row);
+			}
+			else
+			{
+				numbered->append(row);
+			}
+		}
+
+		// Puff numbers are mostly ascending already
+		const double* keys = puffs->constData();
+		if (!std::is_sorted(numbered->begin(), numbered->end(), [keys](int a, int b) { return keys[a] < keys[b]; }))
+		{
+			std::stable_sort(numbered->begin(), numbered->end(), [keys](int a, int b) { return keys[a] < keys[b]; });
+		}
+	}
+}
+
+WorkbookDiff::WorkbookDiff()
+	: m_elapsedNs(0)
+	, m_threadCount(0)
+{
+}
+
+void WorkbookDiff::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [WorkbookDiff]:" << message;
+}
+
+void WorkbookDiff::clear()
+{
+	m_sheets.clear();
+	m_beforeLabel.clear();
+	m_afterLabel.clear();
+	m_lastError.clear();
+	m_elapsedNs = 0;
+}
+
+quint64 WorkbookDiff::cellHash(const ExcelReader::SampleView& sample, const ExcelReader::ColumnSpan& span, int row, int col)
+{
+	double number = span.numbers ? span.numbers[row] : qQNaN();
+	if (!qIsNaN(number))
+	{
+		return numberHash(number);
+	}
+	if (span.numbers && !span.hasStrays)
+	{
+		return BLANK_HASH;
+	}
+
+	// Text, mixed columns and stray cells; numbers hash as numbers so a column
+	// whose type differs between the versions does not differ cell by cell
+	QVariant value = sample.value(row, col);
+	switch (value.type())
+	{
+	case QVariant::Double:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Bool:
+		return numberHash(value.toDouble());
+	default:
+		break;
+	}
+
+	QString text = value.toString();
+	if (text.isEmpty())
+	{
+		return BLANK_HASH;
+	}
+	return mix64((quint64(qHash(text, 0x2545F491u)) << 32) | qHash(text, 0x9E3779B9u));
+}
+
+QVector<quint64> WorkbookDiff::rowHashes(const ExcelReader::SampleView& sample)
+{
+	QVector<quint64> hashes(sample.rowCount(), 0xCBF29CE484222325ULL);
+	quint64* data = hashes.data();
+
+	// Column by column, each column salted so swapped values do not cancel out
+	for (int col = 0; col < sample.columnCount(); col++)
+	{
+		ExcelReader::ColumnSpan span = sample.column(col);
+		quint64 salt = 0x9E3779B97F4A7C15ULL * quint64(col + 1);
+		int rows = qMin(sample.rowCount(), span.size);
+		for (int row = 0; row < rows; row++)
+		{
+			data[row] = mix64(data[row] ^ (cellHash(sample, span, row, col) + salt));
+		}
+	}
+	return hashes;
+}
+
+QVector<QPair<QString, QString>> WorkbookDiff::metadataFields(const ExcelReader::SampleMetadata& metadata)
+{
+	auto number = [](double value) { return QString::number(value, 'g', 12); };
+
+	QVector<QPair<QString, QString>> fields;
+	fields.append(qMakePair(QString("testName"), metadata.testName));
+	fields.append(qMakePair(QString("date"), metadata.date));
+	fields.append(qMakePair(QString("sampleID"), metadata.sampleID));
+	fields.append(qMakePair(QString("media"), metadata.media));
+	fields.append(qMakePair(QString("heatingTechnology"), metadata.heatingTechnology));
+	fields.append(qMakePair(QString("puffingRegime"), metadata.puffingRegime));
+	fields.append(qMakePair(QString("tester"), metadata.tester));
+	fields.append(qMakePair(QString("resistance"), number(metadata.resistance)));
+	fields.append(qMakePair(QString("voltage"), number(metadata.voltage)));
+	fields.append(qMakePair(QString("power"), number(metadata.power)));
+	fields.append(qMakePair(QString("viscosity"), number(metadata.viscosity)));
+	fields.append(qMakePair(QString("initialOilMass"), number(metadata.initialOilMass)));
+	return fields;
+}
+
+WorkbookDiff::SampleDiff WorkbookDiff::diffSamples(const ExcelReader::SampleView& before, const ExcelReader::SampleView& after)
+{
+	SampleDiff result = emptySampleDiff(Compared, before.sampleIndex(), after.sampleIndex());
+	result.sampleID = after.metadata().sampleID;
+
+	QVector<QPair<QString, QString>> beforeFields = metadataFields(before.metadata());
+	QVector<QPair<QString, QString>> afterFields = metadataFields(after.metadata());
+	for (int i = 0; i < beforeFields.size(); i++)
+	{
+		if (beforeFields[i].second != afterFields[i].second)
+		{
+			FieldDiff field;
+			field.field = beforeFields[i].first;
+			field.before = beforeFields[i].second;
+			field.after = afterFields[i].second;
+			result.metadata.append(field);
+		}
+	}
+
+	QVector<quint64> beforeHashes = rowHashes(before);
+	QVector<quint64> afterHashes = rowHashes(after);
+
+	QVector<double> beforePuffs;
+	QVector<double> afterPuffs;
+	QVector<int> beforeNumbered;
+	QVector<int> beforeOther;
+	QVector<int> afterNumbered;
+	QVector<int> afterOther;
+	splitByPuff(before, &beforePuffs, &beforeNumbered, &beforeOther);
+	splitByPuff(after, &afterPuffs, &afterNumbered, &afterOther);
+
+	ExcelReader::ColumnSpan beforeSpans[12];
+	ExcelReader::ColumnSpan afterSpans[12];
+	for (int col = 0; col < 12; col++)
+	{
+		beforeSpans[col] = before.column(col);
+		afterSpans[col] = after.column(col);
+	}
+
+	auto removed = [&](int row) {
+		RowDiff diff = { RowRemoved, beforePuffs[row], row, -1, 0, QVector<QVariant>() };
+		result.rows.append(diff);
+		result.removedRows++;
+	};
+	auto added = [&](int row) {
+		RowDiff diff = { RowAdded, afterPuffs[row], -1, row, 0, QVector<QVariant>() };
+		result.rows.append(diff);
+		result.addedRows++;
+	};
+	auto paired = [&](int beforeRow, int afterRow) {
+		if (beforeHashes[beforeRow] == afterHashes[afterRow])
+		{
+			result.unchangedRows++;
+			return;
+		}
+
+		// Only rows whose hashes differ are compared cell by cell
+		RowDiff diff = { RowModified, afterPuffs[afterRow], beforeRow, afterRow, 0, QVector<QVariant>(12) };
+		for (int col = 0; col < 12; col++)
+		{
+			if (cellHash(before, beforeSpans[col], beforeRow, col) != cellHash(after, afterSpans[col], afterRow, col))
+			{
+				diff.changedColumns |= quint16(1 << col);
+				diff.before[col] = before.value(beforeRow, col);
+			}
+		}
+		result.rows.append(diff);
+		result.modifiedRows++;
+	};
+
+	// Merge of the two puff orders; repeated puff numbers pair up in row order
+	int i = 0;
+	int j = 0;
+	while (i < beforeNumbered.size() || j < afterNumbered.size())
+	{
+		if (j >= afterNumbered.size() || (i < beforeNumbered.size() && beforePuffs[beforeNumbered[i]] < afterPuffs[afterNumbered[j]]))
+		{
+			removed(beforeNumbered[i++]);
+		}
+		else if (i >= beforeNumbered.size() || afterPuffs[afterNumbered[j]] < beforePuffs[beforeNumbered[i]])
+		{
+			added(afterNumbered[j++]);
+		}
+		else
+		{
+			paired(beforeNumbered[i++], afterNumbered[j++]);
+		}
+	}
+
+	// Rows without a puff number pair up in order
+	int common = qMin(beforeOther.size(), afterOther.size());
+	for (int k = 0; k < common; k++)
+	{
+		paired(beforeOther[k], afterOther[k]);
+	}
+	for (int k = common; k < beforeOther.size(); k++)
+	{
+		removed(beforeOther[k]);
+	}
+	for (int k = common; k < afterOther.size(); k++)
+	{
+		added(afterOther[k]);
+	}
+
+	return result;
+}
+
+WorkbookDiff::SheetDiff WorkbookDiff::diffSheets(const SheetHandle& before, const SheetHandle& after)
+{
+	SheetDiff sheet = emptySheetDiff(after.sheetName(), Compared);
+	sheet.columnNames = after.columnHeaders();
+
+	int beforeCount = before.sampleCount();
+	int afterCount = after.sampleCount();
+	for (int sample = 0; sample < qMax(beforeCount, afterCount); sample++)
+	{
+		if (sample >= afterCount)
+		{
+			ExcelReader::SampleView view = before.sampleView(sample);
+			SampleDiff diff = emptySampleDiff(Removed, sample, -1);
+			diff.sampleID = view.metadata().sampleID;
+			diff.removedRows = view.rowCount();
+			sheet.samples.append(diff);
+			continue;
+		}
+		if (sample >= beforeCount)
+		{
+			ExcelReader::SampleView view = after.sampleView(sample);
+			SampleDiff diff = emptySampleDiff(Added, -1, sample);
+			diff.sampleID = view.metadata().sampleID;
+			diff.addedRows = view.rowCount();
+			sheet.samples.append(diff);
+			continue;
+		}
+
+		ExcelReader::SampleView beforeView = before.sampleView(sample);
+		ExcelReader::SampleView afterView = after.sampleView(sample);
+		SampleDiff diff = diffSamples(beforeView, afterView);
+		sheet.samplesCompared++;
+		sheet.rowsCompared += qMax(beforeView.rowCount(), afterView.rowCount());
+		if (diff.hasChanges())
+		{
+			sheet.samples.append(diff);
+		}
+	}
+
+	return sheet;
+}
+
+bool WorkbookDiff::compareWorkbooks(const QSharedPointer<const Workbook>& before, const QSharedPointer<const Workbook>& after)
+{
+	m_sheets.clear();
+	m_lastError.clear();
+
+	if (before.isNull() || after.isNull())
+	{
+		m_lastError = "Both workbooks have to be open";
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Sheets of the later version in its order, then the ones it dropped. Sheets pair up
+	// by name; two single-sheet workbooks (CSV exports are named after the file) pair anyway
+	QStringList beforeNames = before->sheetNames();
+	QStringList afterNames = after->sheetNames();
+	QHash<QString, QString> beforeNameOf;
+	if (beforeNames.size() == 1 && afterNames.size() == 1)
+	{
+		beforeNameOf.insert(afterNames.first(), beforeNames.first());
+	}
+	for (const QString& name : afterNames)
+	{
+		if (beforeNames.contains(name))
+		{
+			beforeNameOf.insert(name, name);
+		}
+	}
+
+	QStringList allNames = afterNames;
+	QStringList paired = beforeNameOf.values();
+	for (const QString& name : beforeNames)
+	{
+		if (!paired.contains(name))
+		{
+			allNames.append(name);
+		}
+	}
+
+	// The workers only read these; non-const access would detach the storage shared with afterNames
+	const QStringList names = allNames;
+	const QStringList& afterList = afterNames;
+	const QHash<QString, QString>& pairs = beforeNameOf;
+
+	// Each worker takes the next sheet pair and writes only its own result slot
+	QVector<SheetDiff> results(names.size());
+	SheetDiff* resultSlots = results.data();
+	QAtomicInt next(0);
+	auto worker = [&]() {
+		for (;;)
+		{
+			int index = next.fetchAndAddRelaxed(1);
+			if (index >= names.size())
+			{
+				return;
+			}
+
+			const QString& name = names.at(index);
+			SheetDiff& result = resultSlots[index];
+			if (!afterList.contains(name))
+			{
+				SheetHandle sheet(before, name);
+				result = emptySheetDiff(name, Removed);
+				result.samplesCompared = sheet.sampleCount();
+				continue;
+			}
+			if (!pairs.contains(name))
+			{
+				SheetHandle sheet(after, name);
+				result = emptySheetDiff(name, Added);
+				result.samplesCompared = sheet.sampleCount();
+				continue;
+			}
+
+			SheetHandle beforeSheet(before, pairs.value(name));
+			SheetHandle afterSheet(after, name);
+			if (!beforeSheet.isValid() || !afterSheet.isValid())
+			{
+				result = emptySheetDiff(name, Compared);
+				result.error = !beforeSheet.isValid() ? beforeSheet.getLastError() : afterSheet.getLastError();
+				continue;
+			}
+			result = diffSheets(beforeSheet, afterSheet);
+		}
+	};
+
+	int threadCount = m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+	threadCount = qBound(1, threadCount, qMax(1, names.size()));
+	QVector<QThread*> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.append(QThread::create(worker));
+		threads.last()->start();
+	}
+	for (QThread* thread : threads)
+	{
+		thread->wait();
+		delete thread;
+	}
+
+	m_sheets = results;
+	m_elapsedNs = timer.nsecsElapsed();
+	Metrics::recordNs("compare.workbooks", m_elapsedNs);
+
+	debugPrint("Compared " + QString::number(names.size()) + " sheets on " + QString::number(threadCount) + " threads in " +
+		QString::number(m_elapsedNs / 1e6, 'f', 1) + " ms");
+	return true;
+}
+
+void WorkbookDiff::compareSamples(const ExcelReader::SampleView& before, const ExcelReader::SampleView& after,
+	const QString& sheetName, const QStringList& columnNames)
+{
+	m_sheets.clear();
+	m_lastError.clear();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	SheetDiff sheet = emptySheetDiff(sheetName, Compared);
+	sheet.columnNames = columnNames;
+	SampleDiff diff = diffSamples(before, after);
+	sheet.samplesCompared = 1;
+	sheet.rowsCompared = qMax(before.rowCount(), after.rowCount());
+	if (diff.hasChanges())
+	{
+		sheet.samples.append(diff);
+	}
+	m_sheets.append(sheet);
+
+	m_elapsedNs = timer.nsecsElapsed();
+	debugPrint("Compared sample " + QString::number(before.sampleIndex() + 1) + " with sample " +
+		QString::number(after.sampleIndex() + 1) + " in " + QString::number(m_elapsedNs / 1e6, 'f', 2) + " ms");
+}
+
+const WorkbookDiff::SampleDiff* WorkbookDiff::sampleDiff(const QString& sheetName, int afterSample) const
+{
+	for (const SheetDiff& sheet : m_sheets)
+	{
+		if (sheet.sheetName != sheetName)
+		{
+			continue;
+		}
+		for (const SampleDiff& sample : sheet.samples)
+		{
+			if (sample.afterSample == afterSample)
+			{
+				return &sample;
+			}
+		}
+	}
+	return nullptr;
+}
+
+QString WorkbookDiff::summary() const
+{
+	int samples = 0;
+	int changedSamples = 0;
+	qint64 rows = 0;
+	int added = 0;
+	int removed = 0;
+	int modified = 0;
+	int fields = 0;
+	for (const SheetDiff& sheet : m_sheets)
+	{
+		samples += sheet.samplesCompared;
+		rows += sheet.rowsCompared;
+		changedSamples += sheet.samples.size();
+		for (const SampleDiff& sample : sheet.samples)
+		{
+			added += sample.addedRows;
+			removed += sample.removedRows;
+			modified += sample.modifiedRows;
+			fields += sample.metadata.size();
+		}
+	}
+
+	return QString::number(m_sheets.size()) + " sheets, " + QString::number(samples) + " samples, " + QString::number(rows) +
+		" rows compared in " + QString::number(m_elapsedNs / 1e6, 'f', 1) + " ms\n" +
+		QString::number(changedSamples) + " samples changed: " + QString::number(added) + " rows added, " +
+		QString::number(removed) + " removed, " + QString::number(modified) + " modified, " +
+		QString::number(fields) + " metadata fields changed";
+}
+
+QString WorkbookDiff::report(int rowsPerSample) const
+{
+	QString text;
+	if (!m_beforeLabel.isEmpty() || !m_afterLabel.isEmpty())
+	{
+		text += m_beforeLabel + " -> " + m_afterLabel + "\n";
+	}
+	text += summary() + "\n";
+
+	for (const SheetDiff& sheet : m_sheets)
+	{
+		if (!sheet.error.isEmpty())
+		{
+			text += "\nSheet " + sheet.sheetName + ": not compared, " + sheet.error + "\n";
+			continue;
+		}
+		if (sheet.status != Compared)
+		{
+			text += "\nSheet " + sheet.sheetName + (sheet.status == Added ? ": added, " : ": removed, ") +
+				QString::number(sheet.samplesCompared) + " samples\n";
+			continue;
+		}
+
+		for (const SampleDiff& sample : sheet.samples)
+		{
+			int sampleNumber = (sample.afterSample >= 0 ? sample.afterSample : sample.beforeSample) + 1;
+			text += "\nSheet " + sheet.sheetName + ", sample " + QString::number(sampleNumber) +
+				(sample.sampleID.isEmpty() ? QString() : " (" + sample.sampleID + ")") + ": ";
+			if (sample.status == Added)
+			{
+				text += "added, " + QString::number(sample.addedRows) + " rows\n";
+				continue;
+			}
+			if (sample.status == Removed)
+			{
+				text += "removed, " + QString::number(sample.removedRows) + " rows\n";
+				continue;
+			}
+			text += QString::number(sample.addedRows) + " rows added, " + QString::number(sample.removedRows) + " removed, " +
+				QString::number(sample.modifiedRows) + " modified\n";
+
+			for (const FieldDiff& field : sample.metadata)
+			{
+				text += "  " + field.field + ": " + field.before + " -> " + field.after + "\n";
+			}
+
+			for (int i = 0; i < sample.rows.size() && i < rowsPerSample; i++)
+			{
+				const RowDiff& row = sample.rows[i];
+				QString where = qIsNaN(row.puff) ? "row " + QString::number((row.afterRow >= 0 ? row.afterRow : row.beforeRow) + 1)
+					: "puff " + QString::number(row.puff, 'g', 12);
+				if (row.change == RowAdded)
+				{
+					text += "  " + where + ": added\n";
+				}
+				else if (row.change == RowRemoved)
+				{
+					text += "  " + where + ": removed\n";
+				}
+				else
+				{
+					QStringList columns;
+					for (int col = 0; col < 12; col++)
+					{
+						if (row.changedColumns & (1 << col))
+						{
+							columns << sheet.columnNames.value(col, "column " + QString::number(col + 1));
+						}
+					}
+					text += "  " + where + ": " + columns.join(", ") + "\n";
+				}
+			}
+			if (sample.rows.size() > rowsPerSample)
+			{
+				text += "  ... " + QString::number(sample.rows.size() - rowsPerSample) + " more rows\n";
+			}
+		}
+	}
+
+	return text;
+}
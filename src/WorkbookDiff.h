@@ -0,0 +1,110 @@
+#ifndef WORKBOOKDIFF_H
+#define WORKBOOKDIFF_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+#include <QPair>
+#include <QSharedPointer>
+#include "ExcelReader.h"
+
+// Which puffs and metadata fields changed between two versions of a workbook,
+// or between two samples. Every data row is reduced to a 64-bit hash over its
+// 12 cells, column by column; rows are aligned by puff number (rows without one
+// by their order) and only pairs whose hashes differ are compared cell by cell.
+// Sheets are compared on worker threads, one sheet pair at a time per thread.
+// The comparison reads the sheets as saved; table edits are not part of it.
+class WorkbookDiff
+{
+public:
+	enum RowChange { RowAdded, RowRemoved, RowModified };
+
+	struct RowDiff
+	{
+		RowChange change;
+		double puff;                 // NaN when the row has no puff number
+		int beforeRow;               // -1 for added rows
+		int afterRow;                // -1 for removed rows
+		quint16 changedColumns;      // Bit per column, modified rows only
+		QVector<QVariant> before;    // Earlier values of the changed columns, 12 entries
+	};
+
+	struct FieldDiff
+	{
+		QString field;
+		QString before;
+		QString after;
+	};
+
+	enum Status { Compared, Added, Removed };
+
+	struct SampleDiff
+	{
+		Status status;
+		int beforeSample;            // -1 when added
+		int afterSample;             // -1 when removed
+		QString sampleID;
+		QVector<FieldDiff> metadata;
+		QVector<RowDiff> rows;       // By puff number, rows without one last
+		int addedRows;
+		int removedRows;
+		int modifiedRows;
+		int unchangedRows;
+
+		bool hasChanges() const { return status != Compared || !metadata.isEmpty() || !rows.isEmpty(); }
+	};
+
+	struct SheetDiff
+	{
+		QString sheetName;
+		Status status;
+		QStringList columnNames;
+		QVector<SampleDiff> samples; // Only samples that changed
+		int samplesCompared;
+		qint64 rowsCompared;
+		QString error;
+	};
+
+	WorkbookDiff();
+
+	void setThreadCount(int threads) { m_threadCount = threads; } // 0 = QThread::idealThreadCount()
+	void setLabels(const QString& before, const QString& after) { m_beforeLabel = before; m_afterLabel = after; }
+	QString beforeLabel() const { return m_beforeLabel; }
+	QString afterLabel() const { return m_afterLabel; }
+
+	// Every sheet of both workbooks; samples are paired by their position in the sheet
+	bool compareWorkbooks(const QSharedPointer<const Workbook>& before, const QSharedPointer<const Workbook>& after);
+	// One sample against another, the result is filed under the after sample
+	void compareSamples(const ExcelReader::SampleView& before, const ExcelReader::SampleView& after,
+		const QString& sheetName, const QStringList& columnNames);
+	void clear();
+
+	bool isEmpty() const { return m_sheets.isEmpty(); }
+	const QVector<SheetDiff>& sheets() const { return m_sheets; }
+	const SampleDiff* sampleDiff(const QString& sheetName, int afterSample) const; // nullptr when unchanged
+	qint64 elapsedNs() const { return m_elapsedNs; }
+	QString getLastError() const { return m_lastError; }
+
+	// Summary line per changed sample and up to rowsPerSample rows each
+	QString summary() const;
+	QString report(int rowsPerSample = 20) const;
+
+	static SampleDiff diffSamples(const ExcelReader::SampleView& before, const ExcelReader::SampleView& after);
+	static QVector<quint64> rowHashes(const ExcelReader::SampleView& sample);
+	static QVector<QPair<QString, QString>> metadataFields(const ExcelReader::SampleMetadata& metadata);
+
+private:
+	QVector<SheetDiff> m_sheets;
+	QString m_beforeLabel;
+	QString m_afterLabel;
+	QString m_lastError;
+	qint64 m_elapsedNs;
+	int m_threadCount;
+
+	static SheetDiff diffSheets(const SheetHandle& before, const SheetHandle& after);
+	static quint64 cellHash(const ExcelReader::SampleView& sample, const ExcelReader::ColumnSpan& span, int row, int col);
+	void debugPrint(const QString& message) const;
+};
+
+#endif // WORKBOOKDIFF_H
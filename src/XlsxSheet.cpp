@@ -0,0 +1,1016 @@
+#include "XlsxSheet.h"
+#include "MemoryAccounting.h"
+#include <QXmlStreamReader>
+#include <QDate>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <QDataStream>
+#include <QtMath>
+#include <cstring>
+
+XlsxSheet::XlsxSheet()
+	: m_firstDataRow(-1)
+	, m_dataRowCount(0)
+	, m_columnCount(0)
+	, m_mappedBytes(0)
+{
+}
+
+QStringList XlsxSheet::parseSharedStrings(const QByteArray& xml)
+{
+	QStringList strings;
+	QXmlStreamReader reader(xml);
+
+	// Each <si> is either a plain <t> or a list of rich text runs <r><t>...</t></r>
+	QString current;
+	bool inItem = false;
+
+	while (!reader.atEnd())
+	{
+		QXmlStreamReader::TokenType token = reader.readNext();
+
+		if (token == QXmlStreamReader::StartElement)
+		{
+			if (reader.name() == QLatin1String("si"))
+			{
+				current.clear();
+				inItem = true;
+			}
+			else if (inItem && reader.name() == QLatin1String("t"))
+			{
+				current += reader.readElementText();
+			}
+			else if (inItem && reader.name() == QLatin1String("rPh"))
+			{
+				// Phonetic hints are not part of the displayed text
+				reader.skipCurrentElement();
+			}
+		}
+		else if (token == QXmlStreamReader::EndElement && reader.name() == QLatin1String("si"))
+		{
+			strings.append(current);
+			inItem = false;
+		}
+	}
+
+	return strings;
+}
+
+bool XlsxSheet::isBuiltInDateFormat(int numFmtId)
+{
+	// Built-in date/time formats (ECMA-376 18.8.30)
+	return (numFmtId >= 14 && numFmtId <= 22) || (numFmtId >= 27 && numFmtId <= 36) ||
+		(numFmtId >= 45 && numFmtId <= 47) || (numFmtId >= 50 && numFmtId <= 58);
+}
+
+bool XlsxSheet::isDateFormatCode(const QString& formatCode)
+{
+	// Strips literals ("..."), escapes (\x) and [colour]/[locale] sections before looking for date tokens
+	static const QRegularExpression literals(QStringLiteral("\"[^\"]*\"|\\\\.|\\[[^\\]]*\\]"));
+
+	QString code = formatCode.toLower();
+	code.remove(literals);
+	return code.contains(QLatin1Char('d')) || code.contains(QLatin1Char('m')) ||
+		code.contains(QLatin1Char('y')) || code.contains(QLatin1Char('h')) ||
+		code.contains(QLatin1Char('s'));
+}
+
+QSet<int> XlsxSheet::parseDateStyles(const QByteArray& xml)
+{
+	QSet<int> dateStyles;
+	QSet<int> customDateFormats;
+	QXmlStreamReader reader(xml);
+
+	bool inCellXfs = false;
+	int xfIndex = 0;
+
+	while (!reader.atEnd())
+	{
+		QXmlStreamReader::TokenType token = reader.readNext();
+
+		if (token == QXmlStreamReader::StartElement)
+		{
+			if (reader.name() == QLatin1String("numFmt"))
+			{
+				int id = reader.attributes().value(QLatin1String("numFmtId")).toInt();
+				if (isDateFormatCode(reader.attributes().value(QLatin1String("formatCode")).toString()))
+				{
+					customDateFormats.insert(id);
+				}
+			}
+			else if (reader.name() == QLatin1String("cellXfs"))
+			{
+				inCellXfs = true;
+				xfIndex = 0;
+			}
+			else if (inCellXfs && reader.name() == QLatin1String("xf"))
+			{
+				int id = reader.attributes().value(QLatin1String("numFmtId")).toInt();
+				if (isBuiltInDateFormat(id) || customDateFormats.contains(id))
+				{
+					dateStyles.insert(xfIndex);
+				}
+				xfIndex++;
+			}
+		}
+		else if (token == QXmlStreamReader::EndElement && reader.name() == QLatin1String("cellXfs"))
+		{
+			break;
+		}
+	}
+
+	return dateStyles;
+}
+
+bool XlsxSheet::decodeCellReference(const QStringRef& ref, int* row, int* col)
+{
+	int c = 0;
+	int r = 0;
+	int i = 0;
+
+	// Column letters: base-26 with A = 1
+	while (i < ref.size() && ref.at(i) >= QLatin1Char('A') && ref.at(i) <= QLatin1Char('Z'))
+	{
+		c = c * 26 + (ref.at(i).unicode() - 'A' + 1);
+		i++;
+	}
+
+	// Row digits
+	int digitStart = i;
+	while (i < ref.size() && ref.at(i).isDigit())
+	{
+		r = r * 10 + (ref.at(i).unicode() - '0');
+		i++;
+	}
+
+	if (c == 0 || i == digitStart || i != ref.size() || r == 0)
+	{
+		return false;
+	}
+
+	*row = r - 1;
+	*col = c - 1;
+	return true;
+}
+
+QVariant XlsxSheet::excelDateToVariant(double serial, bool date1904)
+{
+	// Serial 60 is the non-existent 29 Feb 1900 kept for Lotus compatibility,
+	// so serials below it are offset from 31 Dec 1899 instead of 30 Dec 1899
+	QDate epoch;
+	if (date1904)
+	{
+		epoch = QDate(1904, 1, 1);
+	}
+	else
+	{
+		epoch = serial < 60 ? QDate(1899, 12, 31) : QDate(1899, 12, 30);
+	}
+
+	qint64 days = static_cast<qint64>(qFloor(serial));
+	double fraction = serial - days;
+	QDate date = epoch.addDays(days);
+
+	if (fraction <= 0.0)
+	{
+		return QVariant(date);
+	}
+
+	qint64 msecs = qRound64(fraction * 86400000.0);
+	return QVariant(QDateTime(date, QTime(0, 0)).addMSecs(msecs));
+}
+
+bool XlsxSheet::setValue(int row, int col, const QVariant& value)
+{
+	// A missing or malformed cell reference decodes to -1; such a cell is dropped
+	if (row < 0 || col < 0)
+	{
+		m_lastError = "Invalid cell reference (row " + QString::number(row) + ", column " + QString::number(col) + ")";
+		return false;
+	}
+
+	if (row >= m_rows.size())
+	{
+		m_rows.resize(row + 1);
+	}
+
+	QVector<QVariant>& rowData = m_rows[row];
+	if (col >= rowData.size())
+	{
+		rowData.resize(col + 1);
+	}
+
+	rowData[col] = value;
+
+	if (col + 1 > m_columnCount)
+	{
+		m_columnCount = col + 1;
+	}
+	return true;
+}
+
+bool XlsxSheet::parseWithXmlReader(const QByteArray& xml, const QStringList& sharedStrings,
+	const QSet<int>& dateStyles, bool date1904)
+{
+	clear();
+
+	QXmlStreamReader reader(xml);
+
+	int currentRow = -1;
+	int currentCol = -1;
+
+	while (!reader.atEnd())
+	{
+		QXmlStreamReader::TokenType token = reader.readNext();
+		if (token != QXmlStreamReader::StartElement)
+		{
+			continue;
+		}
+
+		if (reader.name() == QLatin1String("row"))
+		{
+			QStringRef rowRef = reader.attributes().value(QLatin1String("r"));
+			currentRow = rowRef.isEmpty() ? currentRow + 1 : rowRef.toInt() - 1;
+			currentCol = -1;
+			continue;
+		}
+
+		if (reader.name() != QLatin1String("c"))
+		{
+			continue;
+		}
+
+		QXmlStreamAttributes attributes = reader.attributes();
+
+		// Cells may omit "r", in which case they follow the previous cell
+		int row = currentRow;
+		int col = currentCol + 1;
+		QStringRef ref = attributes.value(QLatin1String("r"));
+		if (!ref.isEmpty() && !decodeCellReference(ref, &row, &col))
+		{
+			m_lastError = "Invalid cell reference: " + ref.toString();
+			return false;
+		}
+		currentRow = row;
+		currentCol = col;
+
+		QStringRef type = attributes.value(QLatin1String("t"));
+		int style = attributes.value(QLatin1String("s")).toInt();
+
+		// Read the children (<f>, <v>, <is>) of the cell
+		QString rawValue;
+		QString inlineText;
+		bool hasValue = false;
+
+		while (reader.readNextStartElement())
+		{
+			if (reader.name() == QLatin1String("v"))
+			{
+				rawValue = reader.readElementText();
+				hasValue = true;
+			}
+			else if (reader.name() == QLatin1String("is"))
+			{
+				// Inline string: <is><t>..</t></is> or rich text runs
+				while (reader.readNextStartElement())
+				{
+					if (reader.name() == QLatin1String("t"))
+					{
+						inlineText += reader.readElementText();
+					}
+					else if (reader.name() == QLatin1String("r"))
+					{
+						while (reader.readNextStartElement())
+						{
+							if (reader.name() == QLatin1String("t"))
+							{
+								inlineText += reader.readElementText();
+							}
+							else
+							{
+								reader.skipCurrentElement();
+							}
+						}
+					}
+					else
+					{
+						reader.skipCurrentElement();
+					}
+				}
+				hasValue = true;
+			}
+			else
+			{
+				// Formulas: the cached <v> result is what we display
+				reader.skipCurrentElement();
+			}
+		}
+
+		if (!hasValue)
+		{
+			continue;
+		}
+
+		QVariant value;
+		if (type == QLatin1String("s"))
+		{
+			int index = rawValue.toInt();
+			if (index >= 0 && index < sharedStrings.size())
+			{
+				value = sharedStrings.at(index);
+			}
+		}
+		else if (type == QLatin1String("inlineStr"))
+		{
+			value = inlineText;
+		}
+		else if (type == QLatin1String("str") || type == QLatin1String("e"))
+		{
+			value = rawValue;
+		}
+		else if (type == QLatin1String("b"))
+		{
+			value = (rawValue.trimmed() == QLatin1String("1"));
+		}
+		else if (rawValue.isEmpty())
+		{
+			// Formula without a cached result
+			continue;
+		}
+		else
+		{
+			bool ok = false;
+			double number = rawValue.toDouble(&ok);
+			if (!ok)
+			{
+				value = rawValue;
+			}
+			else if (dateStyles.contains(style))
+			{
+				value = excelDateToVariant(number, date1904);
+			}
+			else
+			{
+				value = number;
+			}
+		}
+
+		setValue(row, col, value);
+	}
+
+	if (reader.hasError())
+	{
+		m_lastError = "XML error at line " + QString::number(reader.lineNumber()) +
+			": " + reader.errorString();
+		return false;
+	}
+
+	return true;
+}
+
+QVariant XlsxSheet::tokenValue(const SheetCellTokenizer::CellToken& token, const QStringList& sharedStrings,
+	const QSet<int>& dateStyles, bool date1904)
+{
+	switch (token.type)
+	{
+	case SheetCellTokenizer::NumberCell:
+		if (dateStyles.contains(token.style))
+		{
+			return excelDateToVariant(token.number, date1904);
+		}
+		return token.number;
+
+	case SheetCellTokenizer::SharedStringCell:
+	{
+		int index = int(token.number);
+		return (index >= 0 && index < sharedStrings.size()) ? QVariant(sharedStrings.at(index)) : QVariant();
+	}
+
+	case SheetCellTokenizer::BooleanCell:
+		return token.number != 0.0;
+
+	case SheetCellTokenizer::InlineStringCell:
+		return SheetCellTokenizer::decodeInlineString(token.text, token.textLength);
+
+	case SheetCellTokenizer::StringCell:
+	case SheetCellTokenizer::ErrorCell:
+		return SheetCellTokenizer::decodeText(token.text, token.textLength);
+	}
+
+	return QVariant();
+}
+
+void XlsxSheet::clear()
+{
+	m_rows.clear();
+	m_columns.clear();
+	m_firstDataRow = -1;
+	m_dataRowCount = 0;
+	m_columnCount = 0;
+	m_lastError.clear();
+	m_imageOwner.clear();
+	m_mappedBytes = 0;
+}
+
+void XlsxSheet::addTokens(const QVector<SheetCellTokenizer::CellToken>& tokens, const QStringList& sharedStrings,
+	const QSet<int>& dateStyles, bool date1904)
+{
+	for (const SheetCellTokenizer::CellToken& token : tokens)
+	{
+		setValue(token.row, token.col, tokenValue(token, sharedStrings, dateStyles, date1904));
+	}
+}
+
+void XlsxSheet::appendRows(const QVector<QVector<QVariant>>& rows)
+{
+	m_rows.reserve(m_rows.size() + rows.size());
+	for (const QVector<QVariant>& row : rows)
+	{
+		m_rows.append(row);
+		if (row.size() > m_columnCount)
+		{
+			m_columnCount = row.size();
+		}
+	}
+}
+
+bool XlsxSheet::parse(const QByteArray& xml, const QStringList& sharedStrings,
+	const QSet<int>& dateStyles, bool date1904)
+{
+	clear();
+
+	// Tokenize in windows so the token buffer stays small on large sheets
+	const int WINDOW_SIZE = 1 << 20;
+
+	SheetCellTokenizer tokenizer;
+	QVector<SheetCellTokenizer::CellToken> tokens;
+	int offset = 0;
+	int window = WINDOW_SIZE;
+
+	while (offset < xml.size() && !tokenizer.isFinished())
+	{
+		int length = qMin(window, xml.size() - offset);
+		int consumed = tokenizer.tokenize(xml.constData() + offset, length, tokens);
+		if (consumed < 0)
+		{
+			m_lastError = tokenizer.getLastError();
+			return false;
+		}
+
+		addTokens(tokens, sharedStrings, dateStyles, date1904);
+		tokens.clear();
+
+		if (consumed == 0)
+		{
+			if (offset + length >= xml.size())
+			{
+				m_lastError = "Worksheet XML ends inside an element";
+				return false;
+			}
+			// A single element is larger than the window
+			window *= 2;
+		}
+		offset += consumed;
+	}
+
+	return true;
+}
+
+QString XlsxSheet::columnTypeName(ColumnType type)
+{
+	switch (type)
+	{
+	case EmptyColumn: return "empty";
+	case NumericColumn: return "numeric";
+	case FlagColumn: return "flag";
+	case TextColumn: return "text";
+	case VariantColumn: return "variant";
+	}
+	return QString();
+}
+
+static bool isBlankText(const QVariant& value)
+{
+	return value.type() == QVariant::String && value.toString().trimmed().isEmpty();
+}
+
+static bool isNumberType(const QVariant& value)
+{
+	switch (value.type())
+	{
+	case QVariant::Double:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool XlsxSheet::parseStrayNumber(const QString& text, double* value)
+{
+	// Locale independent; a lone decimal comma (typed on a European keyboard) is accepted too
+	QByteArray latin = text.trimmed().toLatin1();
+	if (latin.isEmpty() || latin.size() > 64)
+	{
+		return false;
+	}
+	if (!latin.contains('.') && latin.count(',') == 1)
+	{
+		latin.replace(',', '.');
+	}
+	return SheetCellTokenizer::parseNumber(latin.constData(), latin.size(), value);
+}
+
+XlsxSheet::ColumnType XlsxSheet::inferColumnType(const QVariant& header, const QVector<QVector<QVariant>>& rows,
+	int firstDataRow, int col, int sampleRows)
+{
+	// Free-text columns stay text even when their first entries happen to be numbers
+	QString headerText = header.toString().toLower();
+	if (headerText.contains("note") || headerText.contains("comment"))
+	{
+		return TextColumn;
+	}
+
+	// The first sampleRows non-blank cells decide, so leading gaps do not make a column "empty"
+	int numbers = 0;
+	int flags = 0;
+	int texts = 0;
+	int others = 0;
+	int sampled = 0;
+	for (int row = firstDataRow; row < rows.size() && sampled < sampleRows; row++)
+	{
+		const QVector<QVariant>& cells = rows.at(row);
+		if (col >= cells.size() || cells.at(col).isNull() || isBlankText(cells.at(col)))
+		{
+			continue;
+		}
+
+		const QVariant& cell = cells.at(col);
+		double number = 0.0;
+		if (isNumberType(cell))
+		{
+			numbers++;
+		}
+		else if (cell.type() == QVariant::Bool)
+		{
+			flags++;
+		}
+		else if (cell.type() == QVariant::String)
+		{
+			if (parseStrayNumber(cell.toString(), &number))
+			{
+				numbers++;
+			}
+			else
+			{
+				texts++;
+			}
+		}
+		else
+		{
+			others++;
+		}
+		sampled++;
+	}
+
+	if (sampled == 0)
+	{
+		return EmptyColumn;
+	}
+	if (others > 0)
+	{
+		return VariantColumn;
+	}
+	if (flags == sampled)
+	{
+		return FlagColumn;
+	}
+
+	// Up to one stray cell in five is tolerated and kept aside
+	if (numbers * 5 >= sampled * 4)
+	{
+		return NumericColumn;
+	}
+	if (texts * 5 >= sampled * 4)
+	{
+		return TextColumn;
+	}
+	return VariantColumn;
+}
+
+// Stores one ingested cell in its typed column; whitespace-only text is stored blank
+static void storeCell(XlsxSheet::Column& column, int dataRow, const QVariant& value)
+{
+	if (value.isNull() || isBlankText(value))
+	{
+		return;
+	}
+
+	switch (column.type)
+	{
+	case XlsxSheet::NumericColumn:
+		if (isNumberType(value))
+		{
+			column.numbers[dataRow] = value.toDouble();
+			return;
+		}
+		break;
+
+	case XlsxSheet::FlagColumn:
+		if (value.type() == QVariant::Bool)
+		{
+			column.numbers[dataRow] = value.toBool() ? 1.0 : 0.0;
+			return;
+		}
+		break;
+
+	case XlsxSheet::TextColumn:
+		if (value.type() == QVariant::String)
+		{
+			column.texts[dataRow] = value.toString();
+			return;
+		}
+		break;
+
+	case XlsxSheet::VariantColumn:
+		column.values[dataRow] = value;
+		return;
+
+	case XlsxSheet::EmptyColumn:
+		break;
+	}
+
+	column.strays.insert(dataRow, value);
+}
+
+void XlsxSheet::buildColumns(int firstDataRow, int sampleRows)
+{
+	m_firstDataRow = firstDataRow;
+	m_dataRowCount = qMax(0, m_rows.size() - firstDataRow);
+	m_columns.clear();
+	m_columns.resize(m_columnCount);
+
+	QVector<QVariant> headers = (firstDataRow > 0 && firstDataRow - 1 < m_rows.size()) ? m_rows.at(firstDataRow - 1) : QVector<QVariant>();
+
+	for (int col = 0; col < m_columnCount; col++)
+	{
+		Column& column = m_columns[col];
+		column.type = inferColumnType(headers.value(col), m_rows, firstDataRow, col, sampleRows);
+
+		switch (column.type)
+		{
+		case NumericColumn:
+		case FlagColumn:
+			column.numbers.fill(qQNaN(), m_dataRowCount);
+			break;
+		case TextColumn:
+			column.texts.resize(m_dataRowCount);
+			break;
+		case VariantColumn:
+			column.values.resize(m_dataRowCount);
+			break;
+		case EmptyColumn:
+			break;
+		}
+	}
+
+	// Convert row by row, releasing each row once its cells are in the columns
+	for (int row = firstDataRow; row < m_rows.size(); row++)
+	{
+		const QVector<QVariant>& cells = m_rows.at(row);
+		for (int col = 0; col < cells.size(); col++)
+		{
+			Column& column = m_columns[col];
+			if (column.type == NumericColumn && cells.at(col).type() == QVariant::String)
+			{
+				// Stray text in a numeric column: keep it as a number when it reads as one
+				double number = 0.0;
+				if (parseStrayNumber(cells.at(col).toString(), &number))
+				{
+					column.numbers[row - firstDataRow] = number;
+					continue;
+				}
+			}
+			storeCell(column, row - firstDataRow, cells.at(col));
+		}
+		m_rows[row] = QVector<QVariant>();
+	}
+
+	if (m_rows.size() > firstDataRow)
+	{
+		m_rows.resize(firstDataRow);
+	}
+	m_rows.squeeze();
+}
+
+const XlsxSheet::Column* XlsxSheet::column(int col) const
+{
+	return (col >= 0 && col < m_columns.size()) ? &m_columns.at(col) : nullptr;
+}
+
+int XlsxSheet::rowCount() const
+{
+	return (hasColumns() && m_dataRowCount > 0) ? m_firstDataRow + m_dataRowCount : m_rows.size();
+}
+
+QVariant XlsxSheet::value(int row, int col) const
+{
+	if (row < 0 || col < 0)
+	{
+		return QVariant();
+	}
+
+	if (hasColumns() && row >= m_firstDataRow)
+	{
+		int dataRow = row - m_firstDataRow;
+		if (col >= m_columns.size() || dataRow >= m_dataRowCount)
+		{
+			return QVariant();
+		}
+
+		const Column& column = m_columns.at(col);
+		if (!column.strays.isEmpty())
+		{
+			QHash<int, QVariant>::const_iterator stray = column.strays.constFind(dataRow);
+			if (stray != column.strays.constEnd())
+			{
+				return stray.value();
+			}
+		}
+
+		switch (column.type)
+		{
+		case NumericColumn:
+		{
+			double number = column.data()[dataRow];
+			return qIsNaN(number) ? QVariant() : QVariant(number);
+		}
+		case FlagColumn:
+		{
+			double flag = column.data()[dataRow];
+			return qIsNaN(flag) ? QVariant() : QVariant(flag != 0.0);
+		}
+		case TextColumn:
+		{
+			const QString& text = column.texts.at(dataRow);
+			return text.isNull() ? QVariant() : QVariant(text);
+		}
+		case VariantColumn:
+			return column.values.at(dataRow);
+		case EmptyColumn:
+			return QVariant();
+		}
+		return QVariant();
+	}
+
+	if (row >= m_rows.size())
+	{
+		return QVariant();
+	}
+
+	const QVector<QVariant>& rowData = m_rows.at(row);
+	if (col < 0 || col >= rowData.size())
+	{
+		return QVariant();
+	}
+
+	return rowData.at(col);
+}
+
+double XlsxSheet::number(int row, int col) const
+{
+	if (hasColumns() && row >= m_firstDataRow && col >= 0 && col < m_columns.size())
+	{
+		int dataRow = row - m_firstDataRow;
+		if (dataRow >= m_dataRowCount)
+		{
+			return qQNaN();
+		}
+
+		const Column& column = m_columns.at(col);
+		switch (column.type)
+		{
+		case NumericColumn:
+		case FlagColumn:
+			return column.data()[dataRow]; // Strays are NaN here
+		case TextColumn:
+		case EmptyColumn:
+			return qQNaN();
+		case VariantColumn:
+			break;
+		}
+	}
+
+	bool ok = false;
+	double number = value(row, col).toDouble(&ok);
+	return ok ? number : qQNaN();
+}
+
+bool XlsxSheet::isBlank(int row, int col) const
+{
+	if (hasColumns() && row >= m_firstDataRow && col >= 0 && col < m_columns.size())
+	{
+		int dataRow = row - m_firstDataRow;
+		if (dataRow >= m_dataRowCount)
+		{
+			return true;
+		}
+
+		const Column& column = m_columns.at(col);
+		if (column.strays.contains(dataRow))
+		{
+			return false;
+		}
+
+		switch (column.type)
+		{
+		case NumericColumn:
+		case FlagColumn:
+			return qIsNaN(column.data()[dataRow]);
+		case TextColumn:
+			return column.texts.at(dataRow).isNull();
+		case VariantColumn:
+			return column.values.at(dataRow).isNull();
+		case EmptyColumn:
+			return true;
+		}
+		return true;
+	}
+
+	QVariant cell = value(row, col);
+	return cell.isNull() || isBlankText(cell);
+}
+
+qint64 XlsxSheet::memoryBytes() const
+{
+	qint64 bytes = sizeof(XlsxSheet) + MemoryAccounting::rowsBytes(m_rows);
+
+	for (const Column& column : m_columns)
+	{
+		bytes += qint64(column.numbers.capacity()) * qint64(sizeof(double));
+		bytes += qint64(column.texts.capacity()) * qint64(sizeof(QString));
+		for (const QString& text : column.texts)
+		{
+			bytes += MemoryAccounting::stringBytes(text);
+		}
+		bytes += qint64(column.values.capacity()) * qint64(sizeof(QVariant));
+		for (const QVariant& value : column.values)
+		{
+			bytes += MemoryAccounting::variantBytes(value);
+		}
+		for (const QVariant& value : column.strays)
+		{
+			bytes += 32 + qint64(sizeof(QVariant)) + MemoryAccounting::variantBytes(value); // Hash node
+		}
+	}
+
+	return bytes;
+}
+
+namespace
+{
+	const quint32 IMAGE_MAGIC = 0x53585644; // "DVXS"
+	const quint32 IMAGE_VERSION = 1;
+
+	// Fixed part of an image; followed by one number column offset per column (-1 for none),
+	// the number columns themselves and the stream with everything else
+	struct ImageHeader
+	{
+		quint32 magic;
+		quint32 version;
+		qint32 firstDataRow;
+		qint32 dataRowCount;
+		qint32 columnCount;
+		qint32 reserved;
+		qint64 streamOffset;
+		qint64 streamSize;
+	};
+}
+
+QByteArray XlsxSheet::toImage() const
+{
+	if (!hasColumns())
+	{
+		return QByteArray();
+	}
+
+	// Header rows and whatever is not a number column
+	QByteArray streamed;
+	{
+		QDataStream stream(&streamed, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_6);
+		stream << m_rows;
+		for (const Column& column : m_columns)
+		{
+			stream << qint32(column.type) << column.texts << column.values << column.strays;
+		}
+	}
+
+	// Offsets stay multiples of 8, so the doubles can be read in place from a mapped image
+	qint64 offset = sizeof(ImageHeader) + qint64(m_columns.size()) * sizeof(qint64);
+	QVector<qint64> numberOffsets(m_columns.size(), -1);
+	for (int col = 0; col < m_columns.size(); col++)
+	{
+		if (m_columns[col].type == NumericColumn || m_columns[col].type == FlagColumn)
+		{
+			numberOffsets[col] = offset;
+			offset += qint64(m_dataRowCount) * sizeof(double);
+		}
+	}
+
+	ImageHeader header;
+	header.magic = IMAGE_MAGIC;
+	header.version = IMAGE_VERSION;
+	header.firstDataRow = m_firstDataRow;
+	header.dataRowCount = m_dataRowCount;
+	header.columnCount = m_columns.size();
+	header.reserved = 0;
+	header.streamOffset = offset;
+	header.streamSize = streamed.size();
+
+	QByteArray image(int(offset + streamed.size()), Qt::Uninitialized);
+	char* data = image.data();
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), numberOffsets.constData(), size_t(numberOffsets.size()) * sizeof(qint64));
+	for (int col = 0; col < m_columns.size(); col++)
+	{
+		if (numberOffsets[col] >= 0)
+		{
+			memcpy(data + numberOffsets[col], m_columns[col].data(), size_t(m_dataRowCount) * sizeof(double));
+		}
+	}
+	memcpy(data + offset, streamed.constData(), size_t(streamed.size()));
+	return image;
+}
+
+bool XlsxSheet::attachImage(const uchar* image, qint64 size, const QSharedPointer<QObject>& owner)
+{
+	clear();
+
+	ImageHeader header;
+	if (size < qint64(sizeof(header)) || quintptr(image) % sizeof(double) != 0)
+	{
+		m_lastError = "Sheet image is truncated or misaligned";
+		return false;
+	}
+	memcpy(&header, image, sizeof(header));
+
+	qint64 tableEnd = sizeof(header) + qint64(qMax(0, header.columnCount)) * sizeof(qint64);
+	if (header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION || header.columnCount < 0 || header.dataRowCount < 0 ||
+		header.firstDataRow < 0 || tableEnd > size || header.streamOffset < tableEnd || header.streamSize < 0 ||
+		header.streamOffset + header.streamSize > size)
+	{
+		m_lastError = "Not a sheet image, or one of another version";
+		return false;
+	}
+
+	QVector<qint64> numberOffsets(header.columnCount);
+	memcpy(numberOffsets.data(), image + sizeof(header), size_t(header.columnCount) * sizeof(qint64));
+
+	QByteArray streamed = QByteArray::fromRawData(reinterpret_cast<const char*>(image) + header.streamOffset, int(header.streamSize));
+	QDataStream stream(streamed);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream >> m_rows;
+
+	m_columns.resize(header.columnCount);
+	qint64 numberBytes = qint64(header.dataRowCount) * sizeof(double);
+	for (int col = 0; col < header.columnCount; col++)
+	{
+		Column& column = m_columns[col];
+		qint32 type = 0;
+		stream >> type >> column.texts >> column.values >> column.strays;
+		column.type = ColumnType(type);
+
+		if (numberOffsets[col] >= 0)
+		{
+			if (numberOffsets[col] % sizeof(double) != 0 || numberOffsets[col] + numberBytes > header.streamOffset)
+			{
+				clear();
+				m_lastError = "Sheet image has a bad column offset";
+				return false;
+			}
+			column.mapped = reinterpret_cast<const double*>(image + numberOffsets[col]);
+		}
+		else if (column.type == NumericColumn || column.type == FlagColumn)
+		{
+			column.numbers.fill(qQNaN(), header.dataRowCount);
+		}
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		clear();
+		m_lastError = "Sheet image is corrupt";
+		return false;
+	}
+
+	m_firstDataRow = header.firstDataRow;
+	m_dataRowCount = header.dataRowCount;
+	m_columnCount = header.columnCount;
+	m_imageOwner = owner;
+	m_mappedBytes = size;
+	return true;
+}
@@ -0,0 +1,120 @@
+#ifndef XLSXSHEET_H
+#define XLSXSHEET_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVariant>
+#include <QSet>
+#include <QHash>
+#include <QSharedPointer>
+#include "SheetCellTokenizer.h"
+
+class QObject;
+
+// Cell grid of a single worksheet part (e.g. xl/worksheets/sheet1.xml).
+// Sheets are parsed on demand by ExcelReader, so a workbook only pays for
+// the sheets that are actually selected.
+class XlsxSheet
+{
+public:
+	// Storage type of a data column, inferred by buildColumns()
+	enum ColumnType
+	{
+		EmptyColumn,
+		NumericColumn, // doubles, NaN where blank
+		FlagColumn,    // booleans stored as 0/1, NaN where blank
+		TextColumn,
+		VariantColumn  // dates or no dominant type
+	};
+
+	struct Column
+	{
+		Column() : type(EmptyColumn), mapped(nullptr) {}
+
+		ColumnType type;
+		QVector<double> numbers;     // Numeric and flag columns, one per data row
+		QVector<QString> texts;      // Text columns
+		QVector<QVariant> values;    // Variant columns
+		QHash<int, QVariant> strays; // Cells that do not fit the column type, by data row
+		const double* mapped;        // Numbers read in place from an attached image instead of numbers
+
+		const double* data() const { return mapped ? mapped : numbers.constData(); }
+	};
+
+	XlsxSheet();
+
+	// Workbook-level parts a worksheet depends on
+	static QStringList parseSharedStrings(const QByteArray& xml);
+	static QSet<int> parseDateStyles(const QByteArray& xml);
+	static bool isBuiltInDateFormat(int numFmtId);
+	static bool isDateFormatCode(const QString& formatCode); // Custom number format that shows a date or time
+
+	// Cell ingest through SheetCellTokenizer
+	bool parse(const QByteArray& xml, const QStringList& sharedStrings,
+		const QSet<int>& dateStyles, bool date1904 = false);
+
+	// Incremental ingest, used by SheetIngestPipeline: clear() then feed token batches
+	void clear();
+	void addTokens(const QVector<SheetCellTokenizer::CellToken>& tokens, const QStringList& sharedStrings,
+		const QSet<int>& dateStyles, bool date1904);
+
+	// Whole rows below the existing ones, used by CsvReader; the row vectors are shared, not copied
+	void appendRows(const QVector<QVector<QVariant>>& rows);
+
+	// Generic QXmlStreamReader ingest, kept as the reference for benchmarking
+	bool parseWithXmlReader(const QByteArray& xml, const QStringList& sharedStrings,
+		const QSet<int>& dateStyles, bool date1904 = false);
+
+	// Converts the rows from firstDataRow on into typed columns. Each column's type is
+	// inferred from its header (the row above) and the first sampleRows data cells
+	void buildColumns(int firstDataRow, int sampleRows = 64);
+	bool hasColumns() const { return m_firstDataRow >= 0; }
+	int firstDataRow() const { return m_firstDataRow; }
+	const Column* column(int col) const; // nullptr before buildColumns() or outside the used range
+
+	// 0-based access, returns a null QVariant outside the used range
+	QVariant value(int row, int col) const;
+	double number(int row, int col) const; // NaN when blank or not a number
+	bool isBlank(int row, int col) const;  // Null or whitespace only
+
+	int rowCount() const;
+	int columnCount() const { return m_columnCount; }
+	qint64 memoryBytes() const; // Estimated heap held by the cell grid
+	qint64 mappedBytes() const { return m_mappedBytes; } // Image the number columns are read from, not heap
+
+	// Image of the built columns for sharing between processes (see DataServer). Number and
+	// flag columns are raw doubles that attachImage() reads in place, so a mapped image costs
+	// no heap for them; the header rows, text and variant columns and strays are streamed.
+	// The owner keeps the image's memory alive for as long as this grid or a copy exists
+	QByteArray toImage() const;
+	bool attachImage(const uchar* image, qint64 size, const QSharedPointer<QObject>& owner);
+	QString getLastError() const { return m_lastError; }
+
+	// Cell helpers: references ("AB12" -> row 11, col 27), date serials and tokenizer output
+	static bool decodeCellReference(const QStringRef& ref, int* row, int* col);
+	static QVariant excelDateToVariant(double serial, bool date1904);
+	static QVariant tokenValue(const SheetCellTokenizer::CellToken& token, const QStringList& sharedStrings,
+		const QSet<int>& dateStyles, bool date1904);
+	static QString columnTypeName(ColumnType type);
+
+private:
+	QVector<QVector<QVariant>> m_rows; // Row x Column; only the rows above the data once columns are built
+	QVector<Column> m_columns;
+	int m_firstDataRow;                // -1 until buildColumns()
+	int m_dataRowCount;
+	int m_columnCount;
+	QString m_lastError;
+
+	// Attached image behind the mapped number columns
+	QSharedPointer<QObject> m_imageOwner;
+	qint64 m_mappedBytes;
+
+	bool setValue(int row, int col, const QVariant& value); // False for a negative row or column
+	static ColumnType inferColumnType(const QVariant& header, const QVector<QVector<QVariant>>& rows,
+		int firstDataRow, int col, int sampleRows);
+	static bool parseStrayNumber(const QString& text, double* value);
+};
+
+#endif // XLSXSHEET_H
@@ -0,0 +1,547 @@
+#include "ZipArchive.h"
+#include <QDebug>
+#include <QtEndian>
+#include <QMutexLocker>
+#include <zlib.h>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	const quint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+	const quint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+	const quint32 END_OF_CENTRAL_DIR_SIGNATURE = 0x06054b50;
+	const quint32 ZIP64_END_OF_CENTRAL_DIR_SIGNATURE = 0x06064b50;
+	const quint32 ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+	const int LOCAL_HEADER_SIZE = 30;
+	const int CENTRAL_HEADER_SIZE = 46;
+	const int END_OF_CENTRAL_DIR_SIZE = 22;
+	const int ZIP64_LOCATOR_SIZE = 20;
+	const int ZIP64_END_OF_CENTRAL_DIR_SIZE = 56;
+
+	quint16 read16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+	quint32 read32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+	quint64 read64(const uchar* p) { return qFromLittleEndian<quint64>(p); }
+
+	// Local header plus the largest name and extra field it can carry
+	const qint64 LOCAL_HEADER_MAX_SIZE = LOCAL_HEADER_SIZE + 2 * 0xFFFF;
+
+	// Compressed input is handed to zlib in slices that fit its 32-bit counters
+	const qint64 INFLATE_SLICE = 1 << 30;
+
+	// Exactly length bytes at offset, false if the file ends before that
+	bool readAt(QFile* file, qint64 offset, qint64 length, QByteArray* data)
+	{
+		data->resize(int(length));
+		return file->seek(offset) && file->read(data->data(), length) == length;
+	}
+
+	const uchar* bytes(const QByteArray& data) { return reinterpret_cast<const uchar*>(data.constData()); }
+}
+
+ZipArchive::ZipArchive()
+	: m_size(0)
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+	close();
+}
+
+void ZipArchive::debugPrint(const QString& message) const
+{
+	qDebug() << "DEBUG [ZipArchive]:" << message;
+}
+
+void ZipArchive::setError(const QString& message)
+{
+	QMutexLocker locker(&m_errorMutex);
+	m_lastError = message;
+}
+
+QString ZipArchive::getLastError() const
+{
+	QMutexLocker locker(&m_errorMutex);
+	return m_lastError;
+}
+
+bool ZipArchive::open(const QString& filePath)
+{
+	close();
+
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		setError("Cannot open file: " + file.errorString());
+		return false;
+	}
+
+	m_size = file.size();
+	if (m_size < END_OF_CENTRAL_DIR_SIZE)
+	{
+		setError("File is too small to be a zip archive");
+		close();
+		return false;
+	}
+
+	if (!readCentralDirectory(&file))
+	{
+		close();
+		return false;
+	}
+
+	m_filePath = filePath;
+	debugPrint("Read " + QString::number(m_entries.size()) + " entries of " +
+		QString::number(m_size) + " bytes");
+	return true;
+}
+
+void ZipArchive::close()
+{
+	m_filePath.clear();
+	m_size = 0;
+	m_entries.clear();
+	m_entryOrder.clear();
+}
+
+bool ZipArchive::readCentralDirectory(QFile* file)
+{
+	// The end of central directory record sits within the last 64 KiB + 22 bytes (comment length is 16 bit)
+	qint64 tailStart = qMax<qint64>(0, m_size - END_OF_CENTRAL_DIR_SIZE - 0xFFFF);
+	QByteArray tail;
+	if (!readAt(file, tailStart, m_size - tailStart, &tail))
+	{
+		setError("Cannot read the end of the file: " + file->errorString());
+		return false;
+	}
+
+	qint64 eocd = -1;
+	for (qint64 pos = tail.size() - END_OF_CENTRAL_DIR_SIZE; pos >= 0; pos--)
+	{
+		if (read32(bytes(tail) + pos) == END_OF_CENTRAL_DIR_SIGNATURE)
+		{
+			eocd = pos;
+			break;
+		}
+	}
+
+	if (eocd < 0)
+	{
+		setError("End of central directory not found");
+		return false;
+	}
+
+	const uchar* record = bytes(tail) + eocd;
+	quint64 entryCount = read16(record + 10);
+	quint64 directorySize = read32(record + 12);
+	quint64 directoryOffset = read32(record + 16);
+
+	// ZIP64: the real values live in the zip64 end of central directory record
+	if (entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF)
+	{
+		QByteArray locator;
+		qint64 locatorOffset = tailStart + eocd - ZIP64_LOCATOR_SIZE;
+		if (locatorOffset < 0 || !readAt(file, locatorOffset, ZIP64_LOCATOR_SIZE, &locator) ||
+			read32(bytes(locator)) != ZIP64_LOCATOR_SIGNATURE)
+		{
+			setError("ZIP64 locator not found");
+			return false;
+		}
+
+		QByteArray zip64Record;
+		quint64 recordOffset = read64(bytes(locator) + 8);
+		if (recordOffset + ZIP64_END_OF_CENTRAL_DIR_SIZE > quint64(m_size) ||
+			!readAt(file, qint64(recordOffset), ZIP64_END_OF_CENTRAL_DIR_SIZE, &zip64Record) ||
+			read32(bytes(zip64Record)) != ZIP64_END_OF_CENTRAL_DIR_SIGNATURE)
+		{
+			setError("ZIP64 end of central directory is invalid");
+			return false;
+		}
+
+		entryCount = read64(bytes(zip64Record) + 32);
+		directorySize = read64(bytes(zip64Record) + 40);
+		directoryOffset = read64(bytes(zip64Record) + 48);
+	}
+
+	if (directoryOffset + directorySize > quint64(m_size))
+	{
+		setError("Central directory lies outside the file");
+		return false;
+	}
+
+	QByteArray directory;
+	if (!readAt(file, qint64(directoryOffset), qint64(directorySize), &directory))
+	{
+		setError("Cannot read the central directory: " + file->errorString());
+		return false;
+	}
+
+	m_entries.reserve(int(entryCount));
+
+	const uchar* p = bytes(directory);
+	const uchar* end = p + directory.size();
+
+	for (quint64 i = 0; i < entryCount; i++)
+	{
+		if (p + CENTRAL_HEADER_SIZE > end || read32(p) != CENTRAL_HEADER_SIGNATURE)
+		{
+			setError("Corrupt central directory at entry " + QString::number(i));
+			return false;
+		}
+
+		quint16 nameLength = read16(p + 28);
+		quint16 extraLength = read16(p + 30);
+		quint16 commentLength = read16(p + 32);
+
+		if (p + CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength > end)
+		{
+			setError("Corrupt central directory at entry " + QString::number(i));
+			return false;
+		}
+
+		Entry entry;
+		entry.method = read16(p + 10);
+		entry.crc32 = read32(p + 16);
+		entry.compressedSize = read32(p + 20);
+		entry.uncompressedSize = read32(p + 24);
+		entry.localHeaderOffset = read32(p + 42);
+		entry.name = QString::fromUtf8(reinterpret_cast<const char*>(p + CENTRAL_HEADER_SIZE), nameLength);
+
+		// ZIP64 extended information replaces the saturated 32-bit fields, in this order
+		const uchar* extra = p + CENTRAL_HEADER_SIZE + nameLength;
+		const uchar* extraEnd = extra + extraLength;
+		while (extra + 4 <= extraEnd)
+		{
+			quint16 id = read16(extra);
+			quint16 size = read16(extra + 2);
+			const uchar* field = extra + 4;
+			const uchar* fieldEnd = qMin(field + size, extraEnd);
+
+			if (id == 0x0001)
+			{
+				if (entry.uncompressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd)
+				{
+					entry.uncompressedSize = qint64(read64(field));
+					field += 8;
+				}
+				if (entry.compressedSize == 0xFFFFFFFF && field + 8 <= fieldEnd)
+				{
+					entry.compressedSize = qint64(read64(field));
+					field += 8;
+				}
+				if (entry.localHeaderOffset == 0xFFFFFFFF && field + 8 <= fieldEnd)
+				{
+					entry.localHeaderOffset = qint64(read64(field));
+				}
+			}
+
+			extra += 4 + size;
+		}
+
+		m_entries.insert(entry.name, entry);
+		m_entryOrder.append(entry.name);
+
+		p += CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+	}
+
+	return true;
+}
+
+const ZipArchive::Entry* ZipArchive::findEntry(const QString& name) const
+{
+	QHash<QString, Entry>::const_iterator it = m_entries.constFind(name);
+	if (it == m_entries.constEnd())
+	{
+		return nullptr;
+	}
+
+	return &it.value();
+}
+
+const uchar* ZipArchive::mapPayload(const Entry& entry, QFile* file, uchar** map)
+{
+	*map = nullptr;
+	file->setFileName(m_filePath);
+	if (!file->open(QIODevice::ReadOnly))
+	{
+		setError("Cannot open file: " + file->errorString());
+		return nullptr;
+	}
+
+	// Offsets from the central directory only hold for the file it was read from
+	if (file->size() != m_size)
+	{
+		setError("File changed since it was opened: " + entry.name);
+		file->close();
+		return nullptr;
+	}
+
+	qint64 header = entry.localHeaderOffset;
+	if (header < 0 || entry.compressedSize < 0 || header + LOCAL_HEADER_SIZE > m_size)
+	{
+		setError("Corrupt local header for " + entry.name);
+		file->close();
+		return nullptr;
+	}
+
+	// Map the local header and the entry data behind it, nothing else of the file
+	*map = file->map(header, qMin(m_size - header, LOCAL_HEADER_MAX_SIZE + entry.compressedSize));
+	if (!*map)
+	{
+		setError("Cannot memory-map " + entry.name + ": " + file->errorString());
+		file->close();
+		return nullptr;
+	}
+
+	// The local header repeats name/extra with possibly different lengths, so it has to be read
+	qint64 payload = -1;
+	if (read32(*map) == LOCAL_HEADER_SIGNATURE)
+	{
+		payload = LOCAL_HEADER_SIZE + read16(*map + 26) + read16(*map + 28);
+	}
+
+	if (payload < 0 || header + payload + entry.compressedSize > m_size)
+	{
+		setError(payload < 0 ? "Corrupt local header for " + entry.name : "Entry data lies outside the file: " + entry.name);
+		file->unmap(*map);
+		*map = nullptr;
+		file->close();
+		return nullptr;
+	}
+
+	return *map + payload;
+}
+
+QByteArray ZipArchive::entryData(const QString& name)
+{
+	const Entry* entry = findEntry(name);
+	if (!entry)
+	{
+		setError("Entry not found: " + name);
+		return QByteArray();
+	}
+
+	if (entry->method != 0 && entry->method != 8)
+	{
+		setError("Unsupported compression method " + QString::number(entry->method) + " for " + name);
+		return QByteArray();
+	}
+
+	// A QByteArray holds at most 2 GB; larger parts can only be read through openStream()
+	const qint64 maxBytes = std::numeric_limits<int>::max();
+	if (entry->compressedSize > maxBytes || entry->uncompressedSize > maxBytes)
+	{
+		setError("Entry is larger than 2 GB: " + name);
+		return QByteArray();
+	}
+
+	QFile file;
+	uchar* map = nullptr;
+	const uchar* payload = mapPayload(*entry, &file, &map);
+	if (!payload)
+	{
+		return QByteArray();
+	}
+
+	QByteArray data;
+	if (entry->method == 0)
+	{
+		// Stored: one copy out of the mapping, which ends with this read
+		data = QByteArray(reinterpret_cast<const char*>(payload), int(entry->compressedSize));
+	}
+	else if (entry->uncompressedSize > 0)
+	{
+		// Deflate: inflate from the mapped pages into a buffer of the final size
+		data.resize(int(entry->uncompressedSize));
+
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		int result = inflateInit2(&stream, -MAX_WBITS);
+		if (result == Z_OK)
+		{
+			stream.next_in = const_cast<Bytef*>(payload);
+			stream.avail_in = uInt(entry->compressedSize);
+			stream.next_out = reinterpret_cast<Bytef*>(data.data());
+			stream.avail_out = uInt(data.size());
+
+			result = inflate(&stream, Z_FINISH);
+			inflateEnd(&stream);
+		}
+
+		if (result != Z_STREAM_END || stream.total_out != uLong(entry->uncompressedSize))
+		{
+			setError("Failed to inflate " + name + " (zlib error " + QString::number(result) + ")");
+			data.clear();
+		}
+	}
+
+	file.unmap(map);
+	file.close();
+	return data;
+}
+
+bool ZipArchive::openStream(const QString& name, EntryStream* stream)
+{
+	stream->release();
+	stream->m_lastError.clear();
+
+	const Entry* entry = findEntry(name);
+	if (!entry)
+	{
+		setError("Entry not found: " + name);
+		return false;
+	}
+
+	if (entry->method != 0 && entry->method != 8)
+	{
+		setError("Unsupported compression method " + QString::number(entry->method) + " for " + name);
+		return false;
+	}
+
+	const uchar* payload = mapPayload(*entry, &stream->m_file, &stream->m_map);
+	if (!payload)
+	{
+		return false;
+	}
+
+	stream->m_name = name;
+	stream->m_payload = payload;
+	stream->m_compressedSize = entry->compressedSize;
+	stream->m_uncompressedSize = entry->uncompressedSize;
+	stream->m_method = entry->method;
+	stream->m_atEnd = (entry->uncompressedSize == 0);
+
+	if (entry->method == 8 && !stream->m_atEnd)
+	{
+		z_stream* inflater = new z_stream;
+		memset(inflater, 0, sizeof(z_stream));
+		if (inflateInit2(inflater, -MAX_WBITS) != Z_OK)
+		{
+			delete inflater;
+			stream->release();
+			setError("inflateInit failed for " + name);
+			return false;
+		}
+		stream->m_inflater = inflater;
+	}
+
+	return true;
+}
+
+ZipArchive::EntryStream::EntryStream()
+	: m_map(nullptr)
+	, m_payload(nullptr)
+	, m_compressedSize(0)
+	, m_uncompressedSize(0)
+	, m_consumed(0)
+	, m_produced(0)
+	, m_method(0)
+	, m_inflater(nullptr)
+	, m_atEnd(true)
+{
+}
+
+ZipArchive::EntryStream::~EntryStream()
+{
+	release();
+}
+
+void ZipArchive::EntryStream::release()
+{
+	if (m_inflater)
+	{
+		z_stream* inflater = static_cast<z_stream*>(m_inflater);
+		inflateEnd(inflater);
+		delete inflater;
+		m_inflater = nullptr;
+	}
+
+	if (m_map)
+	{
+		m_file.unmap(m_map);
+		m_map = nullptr;
+	}
+	if (m_file.isOpen())
+	{
+		m_file.close();
+	}
+	m_payload = nullptr;
+	m_consumed = 0;
+	m_produced = 0;
+	m_atEnd = true;
+}
+
+QByteArray ZipArchive::EntryStream::read(int maxSize)
+{
+	if (m_atEnd || maxSize <= 0)
+	{
+		return QByteArray();
+	}
+
+	if (m_method == 0)
+	{
+		// Stored: a view into the mapping, no copy
+		int length = int(qMin<qint64>(maxSize, m_compressedSize - m_consumed));
+		QByteArray chunk = QByteArray::fromRawData(reinterpret_cast<const char*>(m_payload + m_consumed), length);
+		m_consumed += length;
+		m_produced += length;
+		m_atEnd = (m_consumed >= m_compressedSize);
+		return chunk;
+	}
+
+	QByteArray chunk;
+	chunk.resize(int(qMin<qint64>(maxSize, m_uncompressedSize - m_produced)));
+
+	z_stream* inflater = static_cast<z_stream*>(m_inflater);
+	inflater->next_out = reinterpret_cast<Bytef*>(chunk.data());
+	inflater->avail_out = uInt(chunk.size());
+
+	// Feed the compressed input straight from the mapped pages
+	int result = Z_OK;
+	while (inflater->avail_out > 0 && result != Z_STREAM_END)
+	{
+		if (inflater->avail_in == 0)
+		{
+			uInt slice = uInt(qMin<qint64>(m_compressedSize - m_consumed, INFLATE_SLICE));
+			if (slice == 0)
+			{
+				break;
+			}
+			inflater->next_in = const_cast<Bytef*>(m_payload + m_consumed);
+			inflater->avail_in = slice;
+			m_consumed += slice;
+		}
+
+		result = inflate(inflater, Z_NO_FLUSH);
+		if (result != Z_OK && result != Z_STREAM_END)
+		{
+			m_lastError = "Failed to inflate " + m_name + " (zlib error " + QString::number(result) + ")";
+			release();
+			return QByteArray();
+		}
+	}
+
+	chunk.resize(chunk.size() - int(inflater->avail_out));
+	m_produced += chunk.size();
+
+	if (result == Z_STREAM_END || m_produced >= m_uncompressedSize)
+	{
+		if (m_produced != m_uncompressedSize)
+		{
+			m_lastError = "Size mismatch while inflating " + m_name;
+			release();
+			return QByteArray();
+		}
+		m_atEnd = true;
+	}
+	else if (chunk.isEmpty())
+	{
+		m_lastError = "Truncated deflate data in " + m_name;
+		release();
+		return QByteArray();
+	}
+
+	return chunk;
+}
@@ -0,0 +1,105 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+
+// Read-only zip container. open() copies the central directory and closes the
+// file again; every entry read maps just that entry for as long as it runs and
+// inflates straight from the mapped pages. Nothing stays open or mapped between
+// reads, so the workbook can be rewritten while it is being viewed: a read
+// started after the file changed size fails with an error instead of reading
+// stale offsets. Once open() returned, entries may be read from several threads
+// at the same time.
+class ZipArchive
+{
+public:
+	struct Entry
+	{
+		QString name;
+		quint16 method;          // 0 = stored, 8 = deflate
+		quint32 crc32;
+		qint64 compressedSize;
+		qint64 uncompressedSize;
+		qint64 localHeaderOffset;
+	};
+
+	// Incremental reader over one entry, for consumers that process a part in chunks.
+	// The stream keeps its own mapping of the entry and inflate state, so it may be
+	// drained on another thread; the mapping is dropped when the stream is released.
+	class EntryStream
+	{
+	public:
+		EntryStream();
+		~EntryStream();
+
+		// Up to maxSize bytes; empty at the end of the entry or on error. Stored
+		// entries come back as views into the mapping, valid until the stream is released
+		QByteArray read(int maxSize);
+
+		bool atEnd() const { return m_atEnd; }
+		bool hasError() const { return !m_lastError.isEmpty(); }
+		QString getLastError() const { return m_lastError; }
+		qint64 size() const { return m_uncompressedSize; }
+
+	private:
+		friend class ZipArchive;
+
+		QString m_name;
+		QFile m_file;
+		uchar* m_map;            // Mapping of the entry, held until release()
+		const uchar* m_payload;  // Entry data inside m_map
+		qint64 m_compressedSize;
+		qint64 m_uncompressedSize;
+		qint64 m_consumed;       // Compressed bytes handed to zlib (or returned for stored entries)
+		qint64 m_produced;       // Uncompressed bytes returned
+		quint16 m_method;
+		void* m_inflater;        // z_stream, kept opaque so zlib stays out of this header
+		bool m_atEnd;
+		QString m_lastError;
+
+		void release();
+
+		Q_DISABLE_COPY(EntryStream)
+	};
+
+	ZipArchive();
+	~ZipArchive();
+
+	bool open(const QString& filePath);
+	void close();
+	bool isOpen() const { return !m_filePath.isEmpty(); }
+	qint64 fileSize() const { return m_size; }
+	int entryCount() const { return m_entryOrder.size(); }
+
+	QStringList entryNames() const { return m_entryOrder; }
+	const Entry* findEntry(const QString& name) const;
+
+	// Whole entry, read and inflated in one go. The mapping ends with the read, so
+	// stored entries are copied out; entries over 2 GB are rejected
+	QByteArray entryData(const QString& name);
+
+	// Chunked access to one entry
+	bool openStream(const QString& name, EntryStream* stream);
+
+	QString getLastError() const;
+
+private:
+	QString m_filePath;
+	qint64 m_size;           // At open(); a different size means the file was replaced
+	QHash<QString, Entry> m_entries;
+	QStringList m_entryOrder;
+	QString m_lastError;
+	mutable QMutex m_errorMutex; // Readers on several threads may fail at the same time
+
+	void debugPrint(const QString& message) const;
+	void setError(const QString& message);
+	bool readCentralDirectory(QFile* file);
+	const uchar* mapPayload(const Entry& entry, QFile* file, uchar** map);
+};
+
+#endif // ZIPARCHIVE_H
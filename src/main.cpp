@@ -1,19 +1,60 @@
 #include "MainWindow.h"
+#include "StartupTimeline.h"
+#include "Metrics.h"
+#include "DataServer.h"
+#include "DataServerClient.h"
 #include <QApplication>
 #include <QDebug>
+#include <QSettings>
 
 int main(int argc, char* argv[])
 {
+	StartupTimeline::mark("main");
+
+	// Headless shared data server, started by the first viewer that uses it
+	if (argc > 1 && QString(argv[1]) == "--data-server")
+	{
+		QCoreApplication app(argc, argv);
+		app.setApplicationName("DataViewer Enterprise");
+		app.setOrganizationName("SDR");
+
+		QString error;
+		DataServer server;
+		if (!server.listen(argc > 2 ? QString(argv[2]) : DataServerClient::defaultServerName(), &error))
+		{
+			qDebug() << "DEBUG: Data server not started:" << error;
+			return 1;
+		}
+		return app.exec();
+	}
+
 	qDebug() << "DEBUG: Application starting..";
 
 	QApplication app(argc, argv);
 	app.setApplicationName("DataViewer Enterprise");
 	app.setOrganizationName("SDR");
+	StartupTimeline::mark("application created");
 
 	qDebug() << "DEBUG: Creating MainWindow...";
 	MainWindow window;
+	StartupTimeline::mark("window constructed");
 	window.show();
+	StartupTimeline::mark("window shown");
 
 	qDebug() << "DEBUG: Entering main event loop...";
-	return app.exec();
+	int result = app.exec();
+
+	// Latencies of the session, one file per run for collecting across installations that opt in
+	QSettings settings;
+	if (settings.value("metrics/writeOnExit", false).toBool() && !Metrics::isEmpty())
+	{
+		QString error;
+		if (!Metrics::writeFile(Metrics::defaultFilePath(), &error))
+		{
+			qDebug() << "DEBUG: Metrics not written:" << error;
+		}
+		Metrics::pruneFiles(50);
+	}
+
+	return result;
 }
\ No newline at end of file